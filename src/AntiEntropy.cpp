@@ -0,0 +1,89 @@
+#include "AntiEntropy.hpp"
+
+const unsigned g18::AntiEntropy::defaultGraceMs;
+
+g18::AntiEntropy::AntiEntropy(const unsigned graceMs)
+: graceMs(graceMs)
+{
+}
+
+bool g18::AntiEntropy::observe(const persistent_node_id_t peer,
+                               const membership_digest_t theirs,
+                               const membership_digest_t ours, const uint64_t nowMs)
+{
+  if (theirs == ours) {
+    divergedSinceMs.erase(peer);
+    return false;
+  }
+  auto it = divergedSinceMs.find(peer);
+  if (it == divergedSinceMs.end()) {
+    divergedSinceMs[peer] = nowMs;
+    return false;
+  }
+  if (nowMs - it->second < graceMs) {
+    return false;
+  }
+  // Give the sync time to land before asking again
+  it->second = nowMs;
+  return true;
+}
+
+void g18::AntiEntropy::forget(const persistent_node_id_t peer)
+{
+  divergedSinceMs.erase(peer);
+}
+
+size_t g18::AntiEntropy::size() const
+{
+  return divergedSinceMs.size();
+}
+
+uint64_t g18::AntiEntropy::differingBuckets(const MembershipSnapshot &ours,
+                                            const std::vector<membership_digest_t> &theirs)
+{
+  if (theirs.size() != MembershipSnapshot::digestBuckets) {
+    // Bucketed some other way, so compare everything
+    return ~static_cast<uint64_t>(0);
+  }
+  uint64_t mask = 0;
+  for (size_t b = 0; b < theirs.size(); b++) {
+    if (ours.bucketDigest(b) != theirs[b]) {
+      mask |= static_cast<uint64_t>(1) << b;
+    }
+  }
+  return mask;
+}
+
+void g18::AntiEntropy::reconcile(const MembershipSnapshot &ours,
+                                 const std::vector<membership_entry_t> &theirs,
+                                 changelist_t &repairs)
+{
+  for (auto it = theirs.begin(); it != theirs.end(); ++it) {
+    membership_entry_t mine;
+    if (!ours.latestEntryFor(it->id.ip, mine)) {
+      // A tombstone we never had, or have forgotten, is nothing to us
+      if (it->state == NODE_STATE_ONLINE) {
+        repairs.joined.push_back(it->id);
+      }
+      continue;
+    }
+    if (mine.id.timestamp > it->id.timestamp ||
+        (mine.id.timestamp == it->id.timestamp && mine.state == it->state)) {
+      continue; // We're at least as up to date
+    }
+    if (mine.id.timestamp == it->id.timestamp) {
+      // Same incarnation; it's gone for them but not yet for us
+      if (mine.state == NODE_STATE_ONLINE) {
+        (it->state == NODE_STATE_DEPARTED ? repairs.left : repairs.failed).push_back(mine.id);
+      }
+      continue;
+    }
+    // They've seen a newer incarnation, so ours is gone
+    if (mine.state == NODE_STATE_ONLINE) {
+      repairs.failed.push_back(mine.id);
+    }
+    if (it->state == NODE_STATE_ONLINE) {
+      repairs.joined.push_back(it->id);
+    }
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "MembershipSnapshot.hpp"
+#include "net_types.hpp"
+
+namespace g18 {
+  /// Catches membership lists that have drifted apart, as when a changelist
+  /// is lost for good, and repairs them. Neighbors compare list digests on
+  /// every heartbeat, which costs a few bytes. Only when one stays different
+  /// for a while do they swap bucket digests, and then the entries in the
+  /// buckets that differ, so repairing a missed change costs about one
+  /// bucket's worth of entries however big the group is. Holds no sockets;
+  /// the Daemon sends what it's given. Not thread-safe.
+  ///
+  /// A list that missed a death by longer than tombstones are kept would
+  /// bring the dead node back, until its monitors declare it dead again.
+  class AntiEntropy {
+    public:
+      /// How long a neighbor's digest may differ from ours before we sync.
+      /// Changes in flight make lists differ for a moment all the time.
+      static const unsigned defaultGraceMs = 2000;
+
+      AntiEntropy(const unsigned graceMs = defaultGraceMs);
+
+      /// Compare a neighbor's digest, from a heartbeat at nowMs, with ours.
+      /// Returns true if they've differed for graceMs, in which case we
+      /// should ask it to sync; it won't return true again for the same
+      /// neighbor for another graceMs.
+      bool observe(const persistent_node_id_t peer, const membership_digest_t theirs,
+                   const membership_digest_t ours, const uint64_t nowMs);
+
+      /// Drop everything we know about this neighbor, once we no longer
+      /// monitor it.
+      void forget(const persistent_node_id_t peer);
+
+      /// Number of neighbors whose digests differ from ours.
+      size_t size() const;
+
+      /// A mask of the buckets whose digests in ours and theirs differ.
+      static uint64_t differingBuckets(const MembershipSnapshot &ours,
+                                       const std::vector<membership_digest_t> &theirs);
+
+      /// Given another node's latest entries for some buckets, find the
+      /// changes we missed: nodes it has that we don't, and deaths and
+      /// departures it knows of and we don't. A newer incarnation of a node
+      /// means ours has failed. Nothing it has missed is included; it hears
+      /// about those from our entries.
+      static void reconcile(const MembershipSnapshot &ours,
+                            const std::vector<membership_entry_t> &theirs,
+                            changelist_t &repairs);
+
+    private:
+      const unsigned graceMs;
+
+      /// When each neighbor whose digest differs started to, or when we
+      /// last asked it to sync, by IP.
+      std::unordered_map<persistent_node_id_t, uint64_t> divergedSinceMs;
+
+      AntiEntropy(const AntiEntropy &) = delete;
+      AntiEntropy & operator=(const AntiEntropy &) = delete;
+  };
+}
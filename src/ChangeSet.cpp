@@ -0,0 +1,210 @@
+#include "ChangeSet.hpp"
+
+/// Tables start, and shrink back down to, this many slots.
+#define CHANGESET_MIN_CAPACITY 16
+
+g18::ChangeSet::ChangeSet()
+: slots(CHANGESET_MIN_CAPACITY), count(0)
+{
+}
+
+bool g18::ChangeSet::insert(const node_id_t &node, const node_state_e state)
+{
+  const change_t change = {node, state};
+  return insert(change);
+}
+
+bool g18::ChangeSet::insert(const change_t &change)
+{
+  if ((count + 1) * 4 > slots.size() * 3) {
+    rehash(slots.size() * 2);
+  }
+  slot_t &slot = slots[find(change)];
+  if (slot.used) {
+    return false;
+  }
+  slot.change = change;
+  slot.used = true;
+  count++;
+  return true;
+}
+
+void g18::ChangeSet::insert(const changelist_t &msg)
+{
+  const std::list<node_id_t> *lists[3] = {&msg.joined, &msg.left, &msg.failed};
+  const node_state_e states[3] = {
+    NODE_STATE_ONLINE, NODE_STATE_DEPARTED, NODE_STATE_DIED
+  };
+  for (int l = 0; l < 3; l++) {
+    for (auto it = lists[l]->begin(); it != lists[l]->end(); ++it) {
+      insert(*it, states[l]);
+    }
+  }
+}
+
+bool g18::ChangeSet::contains(const change_t &change) const
+{
+  return slots[find(change)].used;
+}
+
+bool g18::ChangeSet::erase(const change_t &change)
+{
+  const size_t mask = slots.size() - 1;
+  size_t hole = find(change);
+  if (!slots[hole].used) {
+    return false;
+  }
+  // Shift back any later entry in the run that would no longer be reachable
+  // from its home slot, so we never need tombstones
+  for (size_t next = (hole + 1) & mask; slots[next].used; next = (next + 1) & mask) {
+    const size_t home = hash(slots[next].change) & mask;
+    const bool reachable = (hole <= next) ? (hole < home && home <= next)
+                                          : (hole < home || home <= next);
+    if (!reachable) {
+      slots[hole] = slots[next];
+      hole = next;
+    }
+  }
+  slots[hole].used = false;
+  count--;
+  return true;
+}
+
+void g18::ChangeSet::subtract(const ChangeSet &other)
+{
+  if (other.empty()) {
+    return;
+  }
+  eraseIf([&other](const change_t &change) {
+    return other.contains(change);
+  });
+}
+
+void g18::ChangeSet::merge(const ChangeSet &other)
+{
+  for (auto it = other.slots.begin(); it != other.slots.end(); ++it) {
+    if (it->used) {
+      insert(it->change);
+    }
+  }
+}
+
+size_t g18::ChangeSet::cancelCommon(ChangeSet &other)
+{
+  if (empty() || other.empty()) {
+    return 0;
+  }
+  return eraseIf([&other](const change_t &change) {
+    return other.erase(change);
+  });
+}
+
+size_t g18::ChangeSet::size() const
+{
+  return count;
+}
+
+bool g18::ChangeSet::empty() const
+{
+  return count == 0;
+}
+
+void g18::ChangeSet::clear()
+{
+  if (count == 0) {
+    return;
+  }
+  // Don't hang on to the memory from a burst
+  slots.assign(CHANGESET_MIN_CAPACITY, slot_t());
+  count = 0;
+}
+
+void g18::ChangeSet::appendTo(changelist_t &out) const
+{
+  for (auto it = slots.begin(); it != slots.end(); ++it) {
+    if (!it->used) {
+      continue;
+    }
+    switch (it->change.state) {
+    case NODE_STATE_ONLINE:
+      out.joined.push_back(it->change.id);
+      break;
+    case NODE_STATE_DEPARTED:
+      out.left.push_back(it->change.id);
+      break;
+    case NODE_STATE_DIED:
+      out.failed.push_back(it->change.id);
+      break;
+    }
+  }
+}
+
+uint64_t g18::ChangeSet::hash(const change_t &change)
+{
+  // Mix with the splitmix64 finalizer so nearby IDs land far apart
+  uint64_t h = (static_cast<uint64_t>(change.id.ip) << 32) ^
+               (static_cast<uint64_t>(change.id.timestamp) << 2) ^
+               static_cast<uint64_t>(change.state);
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+bool g18::ChangeSet::sameChange(const change_t &a, const change_t &b)
+{
+  return a.state == b.state && g18::isEqual(a.id, b.id);
+}
+
+size_t g18::ChangeSet::find(const change_t &change) const
+{
+  const size_t mask = slots.size() - 1;
+  size_t i = hash(change) & mask;
+  while (slots[i].used && !sameChange(slots[i].change, change)) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void g18::ChangeSet::rehash(const size_t newCapacity)
+{
+  std::vector<slot_t> old(newCapacity);
+  old.swap(slots);
+  count = 0;
+  for (auto it = old.begin(); it != old.end(); ++it) {
+    if (it->used) {
+      slots[find(it->change)] = *it;
+      count++;
+    }
+  }
+}
+
+template <typename Predicate>
+size_t g18::ChangeSet::eraseIf(Predicate pred)
+{
+  std::vector<change_t> kept;
+  kept.reserve(count);
+  for (auto it = slots.begin(); it != slots.end(); ++it) {
+    if (it->used && !pred(it->change)) {
+      kept.push_back(it->change);
+    }
+  }
+  const size_t erased = count - kept.size();
+  if (erased == 0) {
+    return 0;
+  }
+  // Rebuild at a size that suits what's left
+  size_t capacity = CHANGESET_MIN_CAPACITY;
+  while (kept.size() * 4 > capacity * 3) {
+    capacity *= 2;
+  }
+  slots.assign(capacity, slot_t());
+  count = 0;
+  for (auto it = kept.begin(); it != kept.end(); ++it) {
+    slots[find(*it)] = (slot_t){*it, true};
+    count++;
+  }
+  return erased;
+}
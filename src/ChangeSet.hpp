@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+#include "net_types.hpp"
+
+/// One membership change: a node and the state it moved to.
+typedef struct {
+  node_id_t id;
+  node_state_e state;
+} change_t;
+
+namespace g18 {
+  /// A set of membership changes, keyed by (ip, timestamp, state), in an
+  /// open-addressing hash table with linear probing. Insertion is idempotent,
+  /// and merging or subtracting whole sets takes time linear in their sizes.
+  class ChangeSet {
+    public:
+      ChangeSet();
+
+      /// Add a change. Returns whether it wasn't already present.
+      bool insert(const node_id_t &node, const node_state_e state);
+      bool insert(const change_t &change);
+
+      /// Add every change in the changelist.
+      void insert(const changelist_t &msg);
+
+      /// Whether this change is present.
+      bool contains(const change_t &change) const;
+
+      /// Remove a change. Returns whether it was present.
+      bool erase(const change_t &change);
+
+      /// Remove every change that's also in other.
+      void subtract(const ChangeSet &other);
+
+      /// Add every change in other.
+      void merge(const ChangeSet &other);
+
+      /// Remove the changes the two sets have in common from both of them.
+      /// Returns how many there were.
+      size_t cancelCommon(ChangeSet &other);
+
+      size_t size() const;
+      bool empty() const;
+      void clear();
+
+      /// Append every change to the matching list in out.
+      void appendTo(changelist_t &out) const;
+
+    private:
+      typedef struct {
+        change_t change;
+        bool used;
+      } slot_t;
+
+      /// Always a power of two, and never more than 3/4 full.
+      std::vector<slot_t> slots;
+      size_t count;
+
+      static uint64_t hash(const change_t &change);
+      static bool sameChange(const change_t &a, const change_t &b);
+
+      /// The slot holding this change, or the empty slot where it would go.
+      size_t find(const change_t &change) const;
+
+      /// Move everything into a table of newCapacity slots.
+      void rehash(const size_t newCapacity);
+
+      /// Drop every change for which the predicate holds, in one pass.
+      template <typename Predicate>
+      size_t eraseIf(Predicate pred);
+  };
+}
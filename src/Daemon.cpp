@@ -1,222 +1,699 @@
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
 #include <cstring>
+#include <memory>
 #include <sstream>
 #include <pthread.h>
+#include <unistd.h>
 #include "Daemon.hpp"
+#include "codec.hpp"
 #include "net_types.hpp"
 #include "socket.hpp"
 #include "utils.hpp"
 
-static void * send_heartbeats_forever(void *void_daemon);
-static void * receive_heartbeats_forever(void *void_daemon);
-static void * receive_bp_messages_forever(void *void_daemon);
+const persistent_node_id_t g18::Daemon::recruiterID;
 
-g18::Daemon::Daemon(const persistent_node_id_t persistentID)
+static_assert(g18::Daemon::maxTombstones <= WIRE_MAX_SNAPSHOT_TOMBSTONES,
+              "joiners would refuse our snapshots");
+static_assert(g18::Daemon::maxBackpropagationDatagramSize >= WIRE_MIN_SNAPSHOT_DATAGRAM_SIZE,
+              "our snapshots could take more datagrams than joiners accept");
+
+daemon_config_t g18::Daemon::defaultConfig()
+{
+  return (daemon_config_t){
+    .heartbeatPeriodMs = 250,
+    .monitoringDegree = 1,
+    .heartbeatPriority = 0,
+    .heartbeatCpu = -1,
+    .journalDir = "journal",
+    .statsSocket = "mp2-stats.sock",
+    .dissemination = DISSEMINATION_RING,
+    .probeHelpers = IndirectProber::defaultHelpers,
+    .phiThreshold = defaultPhiThreshold,
+    .joinWindowMs = JoinAdmissionQueue::defaultWindowMs,
+    .seeds = NULL,
+    .numSeeds = 0
+  };
+}
+
+int g18::Daemon::closerReporter(const std::vector<monitored_state_e> &closer)
+{
+  for (size_t i = 0; i < closer.size(); i++) {
+    if (closer[i] != MONITORED_SILENT) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+g18::Daemon::Daemon(const persistent_node_id_t persistentID,
+                    const daemon_config_t &config)
 : isHeartbeating(false), isExpectingHeartbeats(false),
-ourPersistentID(persistentID), curTime(1), deltaLock(PTHREAD_MUTEX_INITIALIZER)
+ourPersistentID(persistentID), config(config),
+deltaLock(PTHREAD_MUTEX_INITIALIZER),
+gossip(config.dissemination == DISSEMINATION_GOSSIP ?
+         GossipDisseminator::defaultFanout : 0,
+       persistentID ^ static_cast<unsigned>(monotonic_time_ns())),
+heartbeatSockfd(-1), bpSockfd(-1),
+receiveBuffer(MAX_DATAGRAM_SIZE), bpBatch(bpBatchCapacity, MAX_DATAGRAM_SIZE),
+heartbeatScheduler(config.heartbeatPeriodMs, onHeartbeatTick, this),
+heartbeatDeadlines(deadlineTickMs, 512, onHeartbeatDeadline, this),
+phiDetector(config.phiThreshold, phiMinStdDevMs, config.heartbeatPeriodMs),
+prober(config.probeHelpers, persistentID ^ static_cast<unsigned>(monotonic_time_ns())),
+probeDeadlines(deadlineTickMs, 64, onProbeDeadline, this),
+joinQueue(config.joinWindowMs),
+joinBackoff(otherSeeds(persistentID, config),
+            persistentID ^ static_cast<unsigned>(monotonic_time_ns())),
+joinStartedNs(0),
+deadlineTimerfd(-1), tombstoneTimerfd(-1), gossipTimerfd(-1), joinTimerfd(-1),
+joinRetryTimerfd(-1), statsListenfd(-1), lastAskedSeed(0),
+snapshotVersion(0), snapshotOrigin(0), snapshotChunksReceived(0)
 {
   memset(&ourID, 0, sizeof(ourID));
+  memset(&joiningAs, 0, sizeof(joiningAs));
   ourIDIsValid = PTHREAD_MUTEX_INITIALIZER;
   pthread_mutex_lock(&ourIDIsValid);
-  delta = (changelist_t){
-    .joined = std::list<node_id_t>(),
-    .left = std::list<node_id_t>(),
-    .failed = std::list<node_id_t>(),
-    .timestamp = curTime
-  };
+  if (config.journalDir != NULL && journal.open(config.journalDir) != 0) {
+    // The journal is only for debugging, so carry on without it
+    MPLOG_WARNING("not journaling events");
+  }
+  registerGauges();
+  if (config.statsSocket != NULL) {
+    statsListenfd = Metrics::openEndpoint(config.statsSocket);
+    if (statsListenfd < 0 ||
+        eventLoop.addReader(statsListenfd, onStatsConnection, this) != 0) {
+      // Stats are still available from the REPL
+      MPLOG_WARNING("not serving stats");
+    }
+  }
   beginExpectingBackpropagatedMessages();
+  tombstoneTimerfd = EventLoop::createTimer();
+  if (tombstoneTimerfd < 0 ||
+      EventLoop::armTimer(tombstoneTimerfd, tombstoneSweepMs, tombstoneSweepMs) != 0 ||
+      eventLoop.addReader(tombstoneTimerfd, onTombstoneTimer, this) != 0) {
+    MPLOG_ERROR("scheduling tombstone collection");
+    exit(1);
+  }
+  if (config.dissemination == DISSEMINATION_GOSSIP) {
+    const unsigned periodMs = config.heartbeatPeriodMs;
+    gossipTimerfd = EventLoop::createTimer();
+    if (gossipTimerfd < 0 ||
+        EventLoop::armTimer(gossipTimerfd, periodMs, periodMs) != 0 ||
+        eventLoop.addReader(gossipTimerfd, onGossipTimer, this) != 0) {
+      MPLOG_ERROR("scheduling gossip rounds");
+      exit(1);
+    }
+  }
+  if (config.joinWindowMs > 0) {
+    // Armed when a request opens a window
+    joinTimerfd = EventLoop::createTimer();
+    if (joinTimerfd < 0 || eventLoop.addReader(joinTimerfd, onJoinTimer, this) != 0) {
+      MPLOG_ERROR("scheduling join admission");
+      exit(1);
+    }
+  }
   MPLOG("Created daemon with ID %u", persistentID);
+  // Found the group, or send our first request, while nothing else can
+  // touch what that sets up; from here on it's the loop thread's
   joinGroup();
+  if (eventLoop.start() != 0) {
+    exit(1);
+  }
 }
 
 persistent_node_id_t g18::Daemon::getBackpropagationTarget()
 {
   waitForValidID();
   // Might be all zeroes
-  node_id_t predecessorMaybe = membershipList.predecessorOf(ourID);
+  node_id_t predecessorMaybe = membershipList.snapshot()->predecessorOf(ourID);
   return predecessorMaybe.ip;
 }
 
-void g18::Daemon::handleReceivedHeartbeat(const std::string &hb)
+void g18::Daemon::handleReceivedHeartbeat(const char *hb, const size_t len)
 {
+  // Heartbeats look like <ip>:<timestamp>:<membership digest>, though the
+  // digest is optional
   node_id_t senderID;
-  const char *hbstr = hb.c_str();
-  senderID.ip = atol(hbstr);
-  while (*hbstr++ != ':') {
-    // Keep going
+  const char *p = hb, *end = hb + len;
+  uint64_t ip, timestamp, digest = 0;
+  bool malformed = parseNumber(p, end, ip) != 0 || p == end || *p++ != ':' ||
+    parseNumber(p, end, timestamp) != 0;
+  const bool hasDigest = !malformed && p != end && *p == ':';
+  if (hasDigest) {
+    malformed = parseNumber(++p, end, digest) != 0 || digest > UINT32_MAX;
+  }
+  if (malformed) {
+    MPLOG_WARNING("dropping malformed heartbeat of %zu bytes", len);
+    Metrics::instance().increment(METRIC_HEARTBEATS_MALFORMED);
+    return;
+  }
+  Metrics::instance().increment(METRIC_HEARTBEATS_RECEIVED);
+  senderID.ip = static_cast<persistent_node_id_t>(ip);
+  senderID.timestamp = static_cast<lamp_time_t>(timestamp);
+  journalEvent(JOURNAL_EVENT_HEARTBEAT, senderID);
+  const uint64_t nowNs = monotonic_time_ns();
+  const bool wasSuspected = prober.end(senderID);
+  if (wasSuspected || heartbeatDeadlines.isScheduled(senderID)) {
+    // A late heartbeat still counts, so a link that's often slow earns
+    // itself more slack
+    phiDetector.heartbeat(senderID, nowNs);
+  }
+  if (wasSuspected) {
+    // A heartbeat is as good as an ack
+    MPLOG("Node %u sent a heartbeat while we were probing it", senderID.ip);
+    refuteSuspicion(senderID);
+  }
+  // Push back this neighbor's deadline, but only if we're monitoring it
+  if (heartbeatDeadlines.isScheduled(senderID)) {
+    const uint64_t timeoutMs = heartbeatTimeoutFor(senderID, nowNs);
+    Metrics::instance().record(METRIC_HEARTBEAT_TIMEOUT_MS, timeoutMs);
+    heartbeatDeadlines.schedule(senderID, timeoutMs, nowNs / 1000000);
+  }
+  if (hasDigest && hasValidID()) {
+    const membership_digest_t ours = membershipList.snapshot()->digest();
+    if (digest != ours) {
+      Metrics::instance().increment(METRIC_DIGEST_MISMATCHES);
+    }
+    // Only neighbors we monitor are tracked, so that they're forgotten
+    // when we stop
+    const bool monitored =
+      std::any_of(monitoredNeighbors.begin(), monitoredNeighbors.end(),
+                  [&senderID](const node_id_t &n) { return isEqual(n, senderID); });
+    if (monitored &&
+        antiEntropy.observe(senderID.ip, static_cast<membership_digest_t>(digest),
+                            ours, nowNs / 1000000)) {
+      sendSyncRequest(senderID.ip);
+    }
+  }
+  // Anything after that is a slice of the sender's membership changes
+  if (p != end && config.dissemination == DISSEMINATION_PIGGYBACK) {
+    handlePiggybackedChanges(p, end - p);
   }
-  senderID.timestamp = atol(hbstr);
-  // TODO(jloew2): Switch to a timer-based system instead of using socket timeouts
-  // Until then, nothing to do here
-  (void)senderID;
 }
 
-void g18::Daemon::handleMissedHeartbeat()
+void g18::Daemon::handlePiggybackedChanges(const char *buf, const size_t len)
 {
+  Metrics &metrics = Metrics::instance();
+  changelist_t msg;
+  if (convertNetworkFormatToChangelist(buf, len, msg) != 0) {
+    // The heartbeat itself still counts
+    MPLOG_WARNING("dropping %zu bytes of malformed piggybacked changes", len);
+    metrics.increment(METRIC_HEARTBEATS_MALFORMED);
+    return;
+  }
+  metrics.increment(METRIC_PIGGYBACKED_CHANGES_RECEIVED,
+                    msg.joined.size() + msg.left.size() + msg.failed.size());
+  updateTimestamp(msg.timestamp);
+  const changelist_t news = updateMembershipList(msg);
+  // Only pass on what was news to us, so every change dies out
+  if (!changelistIsEmpty(news)) {
+    lockDelta();
+    gossip.enqueue(news);
+    unlockDelta();
+  }
+}
+
+void g18::Daemon::handleMissedHeartbeat(const node_id_t &sender)
+{
+  const uint64_t startNs = monotonic_time_ns();
+  Metrics &metrics = Metrics::instance();
+  metrics.increment(METRIC_MISSED_HEARTBEATS);
   updateTimestamp(0);
-  // Figure out who should've been sending us a heartbeat
+  // Make sure the sender is still someone who should be sending us heartbeats
   waitForValidID();
-  if (!membershipList.hasPredecessor(ourID)) {
-    MPLOG("Error: timed out on a heartbeat, but nobody should be sending us heartbeats");
+  std::shared_ptr<const MembershipSnapshot> members = membershipList.snapshot();
+  const std::vector<node_id_t> monitored =
+    members->predecessorsOf(ourID, config.monitoringDegree);
+  size_t distance = 0;
+  while (distance < monitored.size() && !isEqual(monitored[distance], sender)) {
+    distance++;
+  }
+  if (distance == monitored.size()) {
+    MPLOG_DEBUG("Node %u missed a heartbeat, but we no longer expect any from it",
+          sender.ip);
+    refreshMonitoredNeighbors();
     return;
   }
-  node_id_t sender = membershipList.predecessorOf(ourID);
-  // Mark the sender as dead
-  // membershipList.nodeDidDie(sender);
-  // MPLOG("Node %d timed out; marking as dead", sender.ip);
-  pthread_mutex_lock(&deltaLock);
-  //delta.failed.push_back(sender);
-  pthread_mutex_unlock(&deltaLock);
-  // Tell everyone that the sender has died
-  sendBackpropagatedMessage();
+  // If anyone between us and the sender may still be alive, it's their job;
+  // check again next tick in case they turn out to be dead too
+  std::vector<monitored_state_e> closer(distance);
+  for (size_t i = 0; i < distance; i++) {
+    closer[i] = heartbeatDeadlines.isScheduled(monitored[i]) ? MONITORED_HEARTBEATING :
+      prober.isProbing(monitored[i]) ? MONITORED_PROBING : MONITORED_SILENT;
+  }
+  const int reporter = closerReporter(closer);
+  if (reporter >= 0) {
+    MPLOG_DEBUG("Node %u timed out; leaving it to node %u to report",
+          sender.ip, monitored[reporter].ip);
+    metrics.increment(METRIC_FAILURE_REPORTS_DEFERRED);
+    heartbeatDeadlines.schedule(sender, deadlineTickMs, monotonic_time_ns() / 1000000);
+    return;
+  }
+  journalEvent(JOURNAL_EVENT_MISSED_HEARTBEAT, sender);
+  if (config.phiThreshold > 0) {
+    MPLOG_DEBUG("Node %u reached phi %.1f", sender.ip, phiDetector.phi(sender, startNs));
+  }
+  if (config.probeHelpers > 0) {
+    // Make sure it isn't just our own link to it before declaring it dead
+    beginProbe(sender);
+  } else {
+    declareDead(sender);
+  }
+  metrics.record(METRIC_MISSED_HEARTBEAT_NS, monotonic_time_ns() - startNs);
+}
+
+uint64_t g18::Daemon::heartbeatTimeoutFor(const node_id_t &node, const uint64_t nowNs) const
+{
+  uint64_t timeoutMs;
+  if (config.phiThreshold <= 0 || !phiDetector.timeUntilSuspicionMs(node, nowNs, timeoutMs)) {
+    return fixedHeartbeatTimeoutMs();
+  }
+  // The wheel can't tell apart deadlines closer than a tick
+  return std::max(timeoutMs, static_cast<uint64_t>(deadlineTickMs));
+}
+
+uint64_t g18::Daemon::fixedHeartbeatTimeoutMs() const
+{
+  return std::max(static_cast<uint64_t>(heartbeatTimeoutMs),
+                  static_cast<uint64_t>(heartbeatTimeoutPeriods) * config.heartbeatPeriodMs);
+}
+
+void g18::Daemon::declareDead(const node_id_t &node)
+{
+  MPLOG("Node %u timed out; marking as dead", node.ip);
+  if (membershipList.nodeDidDie(node, logicalClock.now()) == 0) {
+    Metrics::instance().increment(METRIC_NODES_DECLARED_DEAD);
+    journalEvent(JOURNAL_EVENT_DIED, node);
+    transport.invalidate(node.ip);
+    addToDelta(node, NODE_STATE_DIED);
+  }
+  // Start watching whoever's now among our predecessors
+  refreshMonitoredNeighbors();
+  // Tell everyone that it has died
+  spreadChanges();
+}
+
+void g18::Daemon::beginProbe(const node_id_t &node)
+{
+  const uint64_t nowNs = monotonic_time_ns();
+  std::vector<probe_t> probes;
+  std::vector<persistent_node_id_t> recipients;
+  prober.begin(node, ourID, *membershipList.snapshot(), nowNs, probes, recipients);
+  probeDeadlines.schedule(node, probeTimeoutMs, nowNs / 1000000);
+  Metrics::instance().increment(METRIC_PROBES_STARTED);
+  MPLOG("Node %u timed out; probing it through %zu other members", node.ip,
+        probes.size() - 1);
+  std::string packet;
+  for (size_t i = 0; i < probes.size(); i++) {
+    encodeProbe(probes[i], packet);
+    transport.sendTo(recipients[i], BACK_PROP_PORT_STR, packet);
+  }
+}
+
+void g18::Daemon::refuteSuspicion(const node_id_t &node)
+{
+  probeDeadlines.cancel(node.ip);
+  Metrics::instance().increment(METRIC_PROBES_REFUTED);
+  // Give it a fresh timeout, if we're still monitoring it
+  refreshMonitoredNeighbors();
 }
 
-void g18::Daemon::handleReceivedBackpropagationMessage(const std::string &bp)
+void g18::Daemon::handleProbe(const probe_t &probe)
 {
-  // Check if it's a new node trying to join at the recruiter or a regular BP
-  // message
-  if (bp.length() > 0 && bp[0] == '+') {
-    handleNodeJoinRequest(bp);
+  if (!hasValidID()) {
+    return; // No one can be probing us yet
+  }
+  if (probe.type == WIRE_MSG_ACK && probe.origin == ourID.ip) {
+    uint64_t rttNs;
+    if (prober.acknowledge(probe, monotonic_time_ns(), rttNs) == 0) {
+      MPLOG("Node %u answered a probe in %" PRIu64 " us; not declaring it dead",
+            probe.target.ip, rttNs / 1000);
+      Metrics::instance().record(METRIC_PROBE_RTT_NS, rttNs);
+      refuteSuspicion(probe.target);
+    }
     return;
   }
+  probe_t reply;
+  persistent_node_id_t to;
+  if (IndirectProber::respond(probe, ourID, reply, to) != 0) {
+    return;
+  }
+  Metrics::instance().increment(METRIC_PROBE_MESSAGES_SENT);
+  std::string packet;
+  encodeProbe(reply, packet);
+  transport.sendTo(to, BACK_PROP_PORT_STR, packet);
+}
+
+void g18::Daemon::handleReceivedBackpropagationMessage(const char *bp, const size_t len)
+{
+  if (processBackpropagationMessage(bp, len)) {
+    // Pass it on
+    spreadChanges();
+  }
+}
+
+void g18::Daemon::handleNodeJoinRequest(const char *bp, const size_t len)
+{
+  if (admitJoinRequest(bp, len)) {
+    // Send out our changelist
+    spreadChanges();
+  }
+}
+
+bool g18::Daemon::processBackpropagationMessage(const char *bp, const size_t len)
+{
+  // Check if it's a new node trying to join or a regular BP message
+  if (len > 0 && bp[0] == '+') {
+    return admitJoinRequest(bp, len);
+  }
+  probe_t probe;
+  if (decodeProbe(bp, len, probe) == 0) {
+    handleProbe(probe);
+    return false;
+  }
+  snapshot_chunk_t chunk;
+  if (decodeSnapshot(bp, len, chunk) == 0) {
+    handleSnapshot(chunk);
+    return false;
+  }
+  if (!hasValidID()) {
+    // Anything we applied before our snapshot would be out of ring order
+    MPLOG_DEBUG("Ignoring a %zu byte BP message until we've joined", len);
+    return false;
+  }
+  sync_request_t syncRequest;
+  if (decodeSyncRequest(bp, len, syncRequest) == 0) {
+    handleSyncRequest(syncRequest);
+    return false;
+  }
+  sync_entries_t syncEntries;
+  if (decodeSyncEntries(bp, len, syncEntries) == 0) {
+    handleSyncEntries(syncEntries);
+    return false;
+  }
   // Regular BP message
-  changelist_t msg = convertNetworkFormatToChangelist(bp);
+  const uint64_t startNs = monotonic_time_ns();
+  Metrics &metrics = Metrics::instance();
+  metrics.increment(METRIC_BP_MESSAGES_RECEIVED);
+  metrics.record(METRIC_BP_MESSAGE_BYTES, len);
+  changelist_t msg;
+  if (convertNetworkFormatToChangelist(bp, len, msg) != 0) {
+    MPLOG_WARNING("dropping malformed BP message of %zu bytes", len);
+    metrics.increment(METRIC_BP_MESSAGES_MALFORMED);
+    return false;
+  }
+  metrics.record(METRIC_BP_CHANGES,
+                 msg.joined.size() + msg.left.size() + msg.failed.size());
   updateTimestamp(msg.timestamp);
 
-  MPLOG("Debug: About to update membership list");
-  updateMembershipList(msg);
+  MPLOG_DEBUG("About to update membership list");
+  const changelist_t news = updateMembershipList(msg);
   MPLOG("Finished updating membership list");
 
-  pthread_mutex_lock(&deltaLock);
-  removeSentMessages(msg);
-  augmentWithDelta(msg);
-  pthread_mutex_unlock(&deltaLock);
+  if (config.dissemination != DISSEMINATION_RING) {
+    // Only gossip or piggyback what was news to us, so every change dies out
+    metrics.record(METRIC_BP_HANDLER_NS, monotonic_time_ns() - startNs);
+    if (changelistIsEmpty(news)) {
+      return false;
+    }
+    lockDelta();
+    gossip.enqueue(news);
+    unlockDelta();
+    return true;
+  }
 
-  // Pass it on
-  sendBackpropagatedMessage();
+  ChangeSet incoming;
+  incoming.insert(msg);
+  lockDelta();
+  // Anything we sent that made it all the way around the ring is confirmed
+  incoming.cancelCommon(delta);
+  // Pass on everything else, but only once, so that updates from a node that
+  // has since died can't circulate forever
+  incoming.subtract(recentlyForwarded);
+  recentlyForwarded.merge(incoming);
+  toForward.merge(incoming);
+  unlockDelta();
+  metrics.record(METRIC_BP_HANDLER_NS, monotonic_time_ns() - startNs);
+  return true;
 }
 
-void g18::Daemon::handleNodeJoinRequest(const std::string &bp)
+bool g18::Daemon::admitJoinRequest(const char *bp, const size_t len)
 {
-  MPLOG("Debug: Got node join request: %s", bp.c_str());
-  // Make sure we're actually the recruiter
-  if (!isRecruiter()) {
-    MPLOG("Warning: we're not the recruiter, but a node is asking us to join");
-    return;
+  MPLOG_DEBUG("Got node join request: %.*s", (int)len, bp);
+  // Any member can let a node in, but we have to be one
+  if (!hasValidID()) {
+    MPLOG_WARNING("a node is asking us to join, but we haven't joined ourselves");
+    return false;
   }
-  // Parse out the new node's ID
-  const persistent_node_id_t newNodeID = atol(bp.c_str());
-  // Update our timestamp
-  updateTimestamp(0);
-  // Add the new node to our changelist
-  pthread_mutex_lock(&deltaLock);
-  const node_id_t newNode = (node_id_t){
-    .ip = newNodeID,
-    .timestamp = curTime
+  // Parse out the new node's ID, which comes after the '+'. Nodes that
+  // don't say which incarnation they are get a timestamp from us.
+  const char *p = bp + 1, *end = bp + len;
+  uint64_t parsedID, timestamp = 0;
+  if (parseNumber(p, end, parsedID) != 0 ||
+      (p != end && (*p++ != ':' || parseNumber(p, end, timestamp) != 0)) || p != end) {
+    MPLOG_WARNING("dropping malformed join request of %zu bytes", len);
+    return false;
+  }
+  const node_id_t requested = (node_id_t){
+    .ip = static_cast<persistent_node_id_t>(parsedID),
+    .timestamp = static_cast<lamp_time_t>(timestamp)
   };
-  delta.joined.push_back(newNode);
-  pthread_mutex_unlock(&deltaLock);
-  membershipList.nodeDidJoin(newNode);
-  // Add ourself to our changelist
-  waitForValidID();
-  addToDelta(ourID, NODE_STATE_ONLINE);
-  // Send out our changelist
-  sendBackpropagatedMessage();
+  if (joinTimerfd < 0) {
+    admitJoins(std::vector<node_id_t>(1, requested));
+    return true;
+  }
+  if (joinQueue.add(requested) &&
+      EventLoop::armTimer(joinTimerfd, joinQueue.getWindowMs(), 0) != 0) {
+    MPLOG_ERROR("scheduling join admission; admitting node %u now", requested.ip);
+    return admitQueuedJoins();
+  }
+  MPLOG_DEBUG("Queued node %u's join request, one of %zu", requested.ip, joinQueue.size());
+  // A full batch goes now; the timer finds nothing left when it fires
+  return joinQueue.isFull() && admitQueuedJoins();
+}
+
+bool g18::Daemon::admitQueuedJoins()
+{
+  std::vector<node_id_t> batch;
+  if (joinQueue.take(batch) == 0) {
+    return false;
+  }
+  admitJoins(batch);
+  return true;
+}
+
+void g18::Daemon::admitJoins(const std::vector<node_id_t> &nodes)
+{
+  // Readers, and the snapshots we send, see the whole batch at once. The
+  // queue only holds one request per IP, so the batch can all be judged
+  // against the list as it was before.
+  std::shared_ptr<const MembershipSnapshot> before = membershipList.snapshot();
+  std::vector<node_id_t> joined, died;
+  std::vector<persistent_node_id_t> admitted;
+  membershipList.beginUpdate();
+  for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+    const node_id_t newNode = admissionIDFor(*it, *before);
+    updateTimestamp(newNode.timestamp);
+    membership_entry_t existing;
+    if (before->latestEntryFor(newNode.ip, existing) &&
+        existing.state == NODE_STATE_ONLINE &&
+        existing.id.timestamp < newNode.timestamp) {
+      // It's restarted before anyone noticed, so its old incarnation is gone
+      MPLOG("Node %u is rejoining; its old incarnation has died", newNode.ip);
+      if (membershipList.nodeDidDie(existing.id, logicalClock.now()) == 0) {
+        journalEvent(JOURNAL_EVENT_DIED, existing.id);
+        transport.invalidate(existing.id.ip);
+        died.push_back(existing.id);
+      }
+    }
+    // A node that's already in, because another seed or an earlier attempt
+    // let it in, just needs our list again
+    const int ret = membershipList.nodeDidJoin(newNode);
+    if (ret < 0) {
+      continue;
+    }
+    if (ret > 0) {
+      journalEvent(JOURNAL_EVENT_JOINED, newNode);
+      joined.push_back(newNode);
+    }
+    admitted.push_back(newNode.ip);
+  }
+  membershipList.endUpdate();
+  for (auto it = died.begin(); it != died.end(); ++it) {
+    addToDelta(*it, NODE_STATE_DIED);
+  }
+  for (auto it = joined.begin(); it != joined.end(); ++it) {
+    addToDelta(*it, NODE_STATE_ONLINE);
+  }
+  // The group only has to hear about the new nodes; they hear about the
+  // group from us, all at once
+  for (auto it = admitted.begin(); it != admitted.end(); ++it) {
+    sendSnapshot(*it);
+  }
+  refreshMonitoredNeighbors();
+  MPLOG("Admitted %zu nodes, %zu of them new", admitted.size(), joined.size());
+  Metrics &metrics = Metrics::instance();
+  metrics.increment(METRIC_JOIN_REQUESTS_ADMITTED, admitted.size());
+  metrics.increment(METRIC_JOIN_BATCHES);
+  metrics.record(METRIC_JOIN_BATCH_SIZE, nodes.size());
 }
 
-std::string g18::Daemon::generateMessageForHeartbeat() const
+node_id_t g18::Daemon::admissionIDFor(const node_id_t &requested,
+                                      const MembershipSnapshot &members)
+{
+  membership_entry_t existing;
+  if (!members.latestEntryFor(requested.ip, existing)) {
+    if (requested.timestamp != 0) {
+      return requested;
+    }
+    updateTimestamp(0);
+    return (node_id_t){
+      .ip = requested.ip,
+      .timestamp = logicalClock.now()
+    };
+  }
+  if (existing.id.timestamp < requested.timestamp) {
+    return requested;
+  }
+  if (existing.state == NODE_STATE_ONLINE) {
+    // Already in, maybe as a timestamp we gave it
+    return existing.id;
+  }
+  // nodeDidJoin() would refuse anything not newer than its tombstone. Every
+  // member with the same tombstone picks the same successor to it, so that
+  // seeds asked one after another don't admit conflicting incarnations.
+  return (node_id_t){
+    .ip = requested.ip,
+    .timestamp = existing.id.timestamp + 1
+  };
+}
+
+std::string g18::Daemon::generateMessageForHeartbeat()
 {
   waitForValidID();
   std::stringstream ourIDStr;
-  ourIDStr << ourID.ip << ":" << ourID.timestamp;
-  return ourIDStr.str();
+  ourIDStr << ourID.ip << ":" << ourID.timestamp << ":"
+           << membershipList.snapshot()->digest();
+  std::string hb = ourIDStr.str();
+  if (config.dissemination != DISSEMINATION_PIGGYBACK) {
+    return hb;
+  }
+  // The binary changelist starts with WIRE_MAGIC, which can't be mistaken
+  // for more of the digest
+  changelist_t changes;
+  changes.timestamp = logicalClock.now();
+  lockDelta();
+  const size_t pruned = gossip.prune(maxPiggybackBacklog);
+  const size_t count = gossip.empty() ? 0 :
+    gossip.nextRound(membershipList.liveCount(), changes, maxPiggybackChanges);
+  unlockDelta();
+  if (pruned > 0) {
+    Metrics::instance().increment(METRIC_PIGGYBACKED_CHANGES_PRUNED, pruned);
+  }
+  if (count > 0) {
+    std::string slice;
+    encodeChangelist(changes, slice);
+    hb += slice;
+    Metrics::instance().increment(METRIC_PIGGYBACKED_CHANGES_SENT, count);
+  }
+  return hb;
 }
 
-std::string g18::Daemon::generateMessageForBackpropagation()
+std::vector<std::string> g18::Daemon::generateMessageForBackpropagation()
 {
-  // Update the timestamp and return our delta list.
-  pthread_mutex_lock(&deltaLock);
-  delta.timestamp = curTime;
-  std::string msg = convertChangelistToNetworkFormat(delta);
-  pthread_mutex_unlock(&deltaLock);
+  // Send our own delta along with everything we're passing on. Our delta
+  // goes out every time until it's confirmed; the rest goes out once.
+  changelist_t changes;
+  changes.timestamp = logicalClock.now();
+  lockDelta();
+  toForward.subtract(delta);
+  delta.appendTo(changes);
+  toForward.appendTo(changes);
+  toForward.clear();
+  unlockDelta();
+  std::vector<std::string> msg;
+  encodeChangelistDatagrams(changes, maxBackpropagationDatagramSize, msg);
   return msg;
 }
 
 void g18::Daemon::addToDelta(const node_id_t &node, const node_state_e state)
 {
-  // Choose the right list
-  std::list<node_id_t> *list = NULL;
-  switch (state) {
-  case NODE_STATE_ONLINE:
-    list = &delta.joined;
-    break;
-  case NODE_STATE_DEPARTED:
-    list = &delta.left;
-    break;
-  case NODE_STATE_DIED:
-    list = &delta.failed;
-    break;
+  lockDelta();
+  if (config.dissemination != DISSEMINATION_RING) {
+    gossip.enqueue(node, state);
+  } else {
+    delta.insert(node, state);
   }
-
-  pthread_mutex_lock(&deltaLock);
-  // Check if this node is already in the list
-  for (auto it = list->begin(); it != list->end(); ++it) {
-    if (isEqual(*it, node)) {
-      // Already present, ignore this duplicate entry
-      pthread_mutex_unlock(&deltaLock);
-      return;
-    }
-  }
-  // Not found; add it
-  list->push_back(node);
-  pthread_mutex_unlock(&deltaLock);
+  unlockDelta();
 }
 
 void g18::Daemon::joinGroup()
 {
-  if (isRecruiter()) {
+  // Every attempt asks to join as the same incarnation
+  updateTimestamp(0);
+  joiningAs = (node_id_t){
+    .ip = ourPersistentID,
+    .timestamp = logicalClock.now()
+  };
+  joinStartedNs = monotonic_time_ns();
+  if (isFounder() && otherSeeds(ourPersistentID, config).empty()) {
     // I AM the group
-    // We have not yet set our ID. Let's set it right meow.
-    ourID = (node_id_t){
-      .ip = ourPersistentID,
-      .timestamp = curTime
-    };
-    membershipList.nodeDidJoin(ourID);
-    pthread_mutex_unlock(&ourIDIsValid);
-    beginExpectingHeartbeats();
-    beginHeartbeating();
-    MPLOG("Debug: Self-joined because we're the recruiter");
+    foundGroup();
     return;
   }
-  // Generate a message with just our persistent ID
-  std::stringstream sstr;
-  sstr << '+' << ourPersistentID;
-  std::string joinMsg = sstr.str();
-  // Send it to the recruiter
-  char *recruiter = generateServerHostname(recruiterID);
-  int err = Write(recruiter, BACK_PROP_PORT_STR, joinMsg);
-  if (err == 0) {
-    MPLOG("Error sending join message. Exiting");
+  joinRetryTimerfd = EventLoop::createTimer();
+  if (joinRetryTimerfd < 0 ||
+      eventLoop.addReader(joinRetryTimerfd, onJoinRetryTimer, this) != 0) {
+    MPLOG_ERROR("scheduling join retries. Exiting");
     exit(1);
   }
-  MPLOG("Debug: Sending join request");
+  requestToJoin();
   // And now we wait
 }
 
+void g18::Daemon::requestToJoin()
+{
+  uint64_t waitMs;
+  const persistent_node_id_t seed = joinBackoff.next(waitMs);
+  lastAskedSeed = seed;
+  std::stringstream sstr;
+  sstr << '+' << joiningAs.ip << ':' << joiningAs.timestamp;
+  // A seed we can't reach is no worse than one that doesn't answer
+  if (transport.sendTo(seed, BACK_PROP_PORT_STR, sstr.str()) < 0) {
+    MPLOG_WARNING("couldn't ask node %u to let us join", seed);
+  } else {
+    MPLOG("Asked node %u to let us join; asking again in %" PRIu64 " ms", seed, waitMs);
+    Metrics::instance().increment(METRIC_JOIN_REQUESTS_SENT);
+  }
+  if (EventLoop::armTimer(joinRetryTimerfd, waitMs, 0) != 0) {
+    MPLOG_ERROR("scheduling our next join request");
+  }
+}
+
+void g18::Daemon::foundGroup()
+{
+  ourID = joiningAs;
+  membershipList.nodeDidJoin(ourID);
+  journalEvent(JOURNAL_EVENT_JOINED, ourID);
+  pthread_mutex_unlock(&ourIDIsValid);
+  beginExpectingHeartbeats();
+  beginHeartbeating();
+  MPLOG("Founded the group as %02u:%" PRIu64, ourID.ip, ourID.timestamp);
+}
+
 void g18::Daemon::leaveGroup()
 {
   // Wait until we have a persistent ID before we can leave
   waitForValidID();
-
-  addToDelta(ourID, NODE_STATE_DEPARTED);
-
-  // Send a message that we're leaving and kill ourself
-  int err = sendBackpropagatedMessage();
-  if (err != 0) {
-    MPLOG("Error sending leave message");
+  if (eventLoop.post(onLeave, this) != 0) {
+    MPLOG_ERROR("sending leave message");
     exit(1);
   }
-  MPLOG("Sent leave message; goodbye");
-  exit(0);
+  // The loop thread exits once it's sent
+  while (true) {
+    pause();
+  }
 }
 
 void g18::Daemon::killSelf() const
@@ -225,106 +702,365 @@ void g18::Daemon::killSelf() const
   exit(0);
 }
 
-void g18::Daemon::beginHeartbeating() const
+void g18::Daemon::beginHeartbeating()
 {
   if (isHeartbeating) {
-    MPLOG("Debug: Will NOT begin heartbeating");
+    MPLOG_DEBUG("Will NOT begin heartbeating");
     return; // Nothing to do
   }
-  pthread_t tid;
-  int err = pthread_create(&tid, NULL, send_heartbeats_forever, (void *)this);
+  int err;
+  if (config.heartbeatPriority > 0 || config.heartbeatCpu >= 0) {
+    // Keep heartbeats off the event loop so slow handlers can't delay them
+    err = heartbeatScheduler.startDedicated(config.heartbeatPriority,
+                                            config.heartbeatCpu);
+  } else {
+    err = heartbeatScheduler.start(eventLoop);
+  }
   if (err != 0) {
-    MPLOG("Error starting a new thread to send heartbeats: %s", strerror(errno));
+    MPLOG_ERROR("starting the heartbeat scheduler");
+    return;
   }
-  MPLOG("Debug: Will begin heartbeating");
+  isHeartbeating = true;
+  MPLOG_DEBUG("Will begin heartbeating");
 }
 
-void g18::Daemon::beginExpectingHeartbeats() const
+void g18::Daemon::beginExpectingHeartbeats()
 {
   if (isExpectingHeartbeats) {
-    MPLOG("Debug: Will NOT begin expecting heartbeats");
+    MPLOG_DEBUG("Will NOT begin expecting heartbeats");
     return; // Nothing to do
   }
-  // Start listening for heartbeats on a new thread
-  pthread_t tid;
-  int err = pthread_create(&tid, NULL, receive_heartbeats_forever, (void *)this);
-  if (err != 0) {
-    MPLOG("Error starting a new thread to receive heartbeats: %s", strerror(errno));
+  // Open a socket to receive heartbeats
+  heartbeatSockfd = openReadSocket(FORWARD_PROP_PORT_STR);
+  if (heartbeatSockfd < 0) {
+    MPLOG_ERROR("opening heartbeat receive socket");
+    exit(1);
+  }
+  // Start watching our neighbors before the deadline timer can fire
+  isExpectingHeartbeats = true;
+  refreshMonitoredNeighbors();
+  deadlineTimerfd = EventLoop::createTimer();
+  if (deadlineTimerfd < 0 ||
+      EventLoop::armTimer(deadlineTimerfd, deadlineTickMs, deadlineTickMs) != 0 ||
+      eventLoop.addReader(deadlineTimerfd, onDeadlineTimer, this) != 0 ||
+      eventLoop.addReader(heartbeatSockfd, onHeartbeatReadable, this) != 0) {
+    MPLOG_ERROR("registering to receive heartbeats");
+    exit(1);
   }
-  MPLOG("Debug: Will begin expecting heartbeats");
+  MPLOG_DEBUG("Will begin expecting heartbeats");
 }
 
-void g18::Daemon::beginExpectingBackpropagatedMessages() const
+void g18::Daemon::beginExpectingBackpropagatedMessages()
 {
-  // Start listening for backpropagated messages on a new thread
-  pthread_t tid;
-  int err = pthread_create(&tid, NULL, receive_bp_messages_forever, (void *)this);
-  if (err != 0) {
-    MPLOG("Error starting a new thread to receive BP messages: %s", strerror(errno));
+  // Open a socket to receive BP messages
+  bpSockfd = openReadSocket(BACK_PROP_PORT_STR);
+  if (bpSockfd < 0) {
+    MPLOG_ERROR("opening BP message receive socket");
+    exit(1);
+  }
+  DatagramBatch::enableDropCounting(bpSockfd);
+  if (eventLoop.addReader(bpSockfd, onBackpropagationReadable, this) != 0) {
+    MPLOG_ERROR("registering to receive BP messages");
+    exit(1);
   }
-  MPLOG("Debug: Will begin expecting BP messages");
+  MPLOG_DEBUG("Will begin expecting BP messages");
 }
 
 int g18::Daemon::sendHeartbeat()
 {
   // Figure out who to send the heartbeat to
   waitForValidID();
-  if (!membershipList.hasSuccessor(ourID)) {
+  std::shared_ptr<const MembershipSnapshot> members = membershipList.snapshot();
+  const std::vector<node_id_t> successors =
+    members->successorsOf(ourID, config.monitoringDegree);
+  if (successors.empty()) {
     // No node to which we can send a heartbeat
     return -1;
   }
-  node_id_t successor = membershipList.successorOf(ourID);
+  const uint64_t startNs = monotonic_time_ns();
+  Metrics &metrics = Metrics::instance();
+  std::vector<persistent_node_id_t> recipients;
+  for (auto it = successors.begin(); it != successors.end(); ++it) {
+    recipients.push_back(it->ip);
+  }
   // Generate the heartbeat message
-  std::string hb = generateMessageForHeartbeat();
+  std::vector<std::string> hb;
+  hb.push_back(generateMessageForHeartbeat());
   // Send the heartbeat
-  char *recipientHostname = generateServerHostname(successor.ip);
-  int err = Write(recipientHostname, FORWARD_PROP_PORT_STR, hb);
-  free(recipientHostname);
-  if (err == 0) {
-    MPLOG("Error sending heartbeat");
+  int err = transport.sendBatch(recipients, FORWARD_PROP_PORT_STR, hb);
+  if (err < 0) {
+    MPLOG_ERROR("sending heartbeat");
+    metrics.increment(METRIC_HEARTBEAT_SEND_ERRORS);
     return -1;
   }
-  MPLOG("Debug: Sent heartbeat");
+  metrics.increment(METRIC_HEARTBEATS_SENT);
+  metrics.record(METRIC_HEARTBEAT_SEND_NS, monotonic_time_ns() - startNs);
+  MPLOG_DEBUG("Sent heartbeat");
   return 0;
 }
 
 int g18::Daemon::sendBackpropagatedMessage()
 {
   // Make sure we actually have something to send
-  pthread_mutex_lock(&deltaLock);
-  if ((delta.joined.size() == 0) && (delta.left.size() == 0) &&
-      (delta.failed.size() == 0)) {
+  lockDelta();
+  if (delta.empty() && toForward.empty()) {
     // Nothing to send
-    MPLOG("Debug: Not sending BP message: nothing to send");
-    pthread_mutex_unlock(&deltaLock);
+    MPLOG_DEBUG("Not sending BP message: nothing to send");
+    unlockDelta();
     return 0;
   }
-  pthread_mutex_unlock(&deltaLock);
+  unlockDelta();
   // Figure out who to send the backpropagated message to.
   waitForValidID();
-  if (!membershipList.hasPredecessor(ourID)) {
+  std::shared_ptr<const MembershipSnapshot> members = membershipList.snapshot();
+  if (!members->hasPredecessor(ourID)) {
     // No node to which we can send a backpropagated message
-    MPLOG("Debug: No predecessor");
+    MPLOG_DEBUG("No predecessor");
     return -1;
   }
-  node_id_t recipient = membershipList.predecessorOf(ourID);
+  std::vector<persistent_node_id_t> recipients;
+  recipients.push_back(members->predecessorOf(ourID).ip);
   // Generate the BP message
-  std::string msg = generateMessageForBackpropagation();
+  std::vector<std::string> msg = generateMessageForBackpropagation();
   // Send the BP message
-  char *recipientHostname = generateServerHostname(recipient.ip);
-  MPLOG("Debug: Sending BP message %s to %s", msg.c_str(), recipientHostname);
-  int err = Write(recipientHostname, BACK_PROP_PORT_STR, msg);
-  free(recipientHostname);
-  if (err == 0) {
-    MPLOG("Error sending backpropagated message");
+  MPLOG_DEBUG("Sending BP message in %zu datagrams to node %u", msg.size(),
+        recipients[0]);
+  int err = transport.sendBatch(recipients, BACK_PROP_PORT_STR, msg);
+  if (err < 0) {
+    MPLOG_ERROR("sending backpropagated message");
+    Metrics::instance().increment(METRIC_BP_SEND_ERRORS);
+    return -1;
+  }
+  Metrics::instance().increment(METRIC_BP_MESSAGES_SENT);
+  Metrics::instance().increment(METRIC_BP_DATAGRAMS_SENT, msg.size());
+  return 0;
+}
+
+int g18::Daemon::sendGossip()
+{
+  // Before we've joined there's no one to gossip to, and waiting for our ID
+  // here would block the event loop that's going to deliver it
+  lockDelta();
+  const bool idle = gossip.empty();
+  unlockDelta();
+  if (idle || !hasValidID()) {
+    return 0;
+  }
+  std::shared_ptr<const MembershipSnapshot> members = membershipList.snapshot();
+  std::vector<persistent_node_id_t> recipients;
+  changelist_t changes;
+  changes.timestamp = logicalClock.now();
+  lockDelta();
+  gossip.chooseTargets(*members, ourID, recipients);
+  if (!recipients.empty()) {
+    gossip.nextRound(members->liveCount(), changes);
+  }
+  unlockDelta();
+  if (recipients.empty()) {
+    MPLOG_DEBUG("No one to gossip to");
+    return -1;
+  }
+  std::vector<std::string> msg;
+  encodeChangelistDatagrams(changes, maxBackpropagationDatagramSize, msg);
+  MPLOG_DEBUG("Gossiping %zu datagrams to %zu members", msg.size(), recipients.size());
+  Metrics &metrics = Metrics::instance();
+  if (transport.sendBatch(recipients, BACK_PROP_PORT_STR, msg) < 0) {
+    MPLOG_ERROR("sending gossip");
+    metrics.increment(METRIC_GOSSIP_SEND_ERRORS);
+    return -1;
+  }
+  metrics.increment(METRIC_GOSSIP_ROUNDS);
+  metrics.increment(METRIC_GOSSIP_DATAGRAMS_SENT, msg.size() * recipients.size());
+  return 0;
+}
+
+int g18::Daemon::sendSnapshot(const persistent_node_id_t to)
+{
+  std::shared_ptr<const MembershipSnapshot> members = membershipList.snapshot();
+  std::vector<std::string> msg;
+  encodeSnapshotDatagrams(members->entries(), logicalClock.now(), ourPersistentID,
+                          maxBackpropagationDatagramSize, msg);
+  Metrics &metrics = Metrics::instance();
+  if (transport.sendBatch(std::vector<persistent_node_id_t>(1, to),
+                          BACK_PROP_PORT_STR, msg) < 0) {
+    MPLOG_ERROR("sending our membership list to node %u", to);
+    metrics.increment(METRIC_BP_SEND_ERRORS);
+    return -1;
+  }
+  MPLOG("Sent node %u our membership list of %zu entries in %zu datagrams", to,
+        members->size(), msg.size());
+  metrics.increment(METRIC_SNAPSHOTS_SENT);
+  metrics.increment(METRIC_BP_DATAGRAMS_SENT, msg.size());
+  return 0;
+}
+
+void g18::Daemon::handleSnapshot(const snapshot_chunk_t &chunk)
+{
+  if (hasValidID()) {
+    // An answer to a join request we sent earlier, most likely
+    MPLOG_DEBUG("Ignoring a membership snapshot; we've already joined");
+    return;
+  }
+  if (chunk.version != snapshotVersion || chunk.origin != snapshotOrigin ||
+      chunk.count != snapshotChunks.size()) {
+    // Once we've started on a snapshot, only a newer one from the seed we
+    // last asked replaces it
+    if (snapshotChunksReceived > 0 &&
+        (chunk.origin != lastAskedSeed ||
+         (chunk.origin == snapshotOrigin && chunk.version <= snapshotVersion))) {
+      MPLOG_DEBUG("Ignoring node %u's snapshot while we collect node %u's",
+                  chunk.origin, snapshotOrigin);
+      return;
+    }
+    snapshotVersion = chunk.version;
+    snapshotOrigin = chunk.origin;
+    snapshotChunks.assign(chunk.count, snapshot_chunk_t());
+    snapshotChunksReceived = 0;
+  }
+  // Every chunk we decode has a count, so an empty slot's is zero
+  snapshot_chunk_t &slot = snapshotChunks[chunk.index];
+  if (slot.count == 0) {
+    slot = chunk;
+    snapshotChunksReceived++;
+  }
+  if (snapshotChunksReceived == snapshotChunks.size()) {
+    applySnapshot();
+  }
+}
+
+void g18::Daemon::applySnapshot()
+{
+  updateTimestamp(snapshotVersion);
+  node_id_t self;
+  bool found = false;
+  size_t count = 0;
+  membershipList.beginUpdate();
+  for (auto c = snapshotChunks.begin(); c != snapshotChunks.end(); ++c) {
+    for (auto it = c->entries.begin(); it != c->entries.end(); ++it) {
+      // Entries come in ring order, so replaying them as joins, and then
+      // deaths for the tombstones, rebuilds the sender's ring exactly
+      membershipList.nodeDidJoin(it->id);
+      if (it->state == NODE_STATE_DEPARTED) {
+        membershipList.nodeDidLeave(it->id, logicalClock.now());
+      } else if (it->state == NODE_STATE_DIED) {
+        membershipList.nodeDidDie(it->id, logicalClock.now());
+      } else {
+        journalEvent(JOURNAL_EVENT_JOINED, it->id);
+      }
+      if (it->id.ip == ourPersistentID && it->state == NODE_STATE_ONLINE) {
+        self = it->id;
+        found = true;
+      }
+      count++;
+    }
+  }
+  membershipList.endUpdate();
+  snapshotChunks.clear();
+  snapshotChunksReceived = 0;
+  if (!found) {
+    MPLOG_WARNING("membership snapshot %" PRIu64 " doesn't include us", snapshotVersion);
+    return;
+  }
+  Metrics &metrics = Metrics::instance();
+  metrics.increment(METRIC_SNAPSHOTS_APPLIED);
+  metrics.record(METRIC_JOIN_LATENCY_MS, (monotonic_time_ns() - joinStartedNs) / 1000000);
+  ourID = self;
+  MPLOG("Joined from a membership list of %zu entries; our ID is %02u:%" PRIu64,
+        count, ourID.ip, ourID.timestamp);
+  pthread_mutex_unlock(&ourIDIsValid);
+  beginExpectingHeartbeats();
+  beginHeartbeating();
+}
+
+int g18::Daemon::sendSyncRequest(const persistent_node_id_t to)
+{
+  std::shared_ptr<const MembershipSnapshot> members = membershipList.snapshot();
+  sync_request_t req;
+  req.origin = ourID.ip;
+  for (size_t b = 0; b < MembershipSnapshot::digestBuckets; b++) {
+    req.buckets.push_back(members->bucketDigest(b));
+  }
+  std::string packet;
+  encodeSyncRequest(req, packet);
+  MPLOG("Node %u's membership digest differs from ours; asking it to sync", to);
+  if (transport.sendTo(to, BACK_PROP_PORT_STR, packet) < 0) {
+    MPLOG_ERROR("sending sync request to node %u", to);
+    Metrics::instance().increment(METRIC_BP_SEND_ERRORS);
     return -1;
   }
+  Metrics::instance().increment(METRIC_SYNC_REQUESTS_SENT);
   return 0;
 }
 
-bool g18::Daemon::isRecruiter() const
+int g18::Daemon::sendSyncEntries(const persistent_node_id_t to, const uint64_t mask,
+                                 const bool wantsReply)
+{
+  sync_entries_t msg;
+  msg.origin = ourID.ip;
+  msg.buckets = mask;
+  msg.wantsReply = wantsReply;
+  membershipList.snapshot()->entriesInBuckets(mask, msg.entries);
+  std::vector<std::string> datagrams;
+  encodeSyncEntriesDatagrams(msg, maxBackpropagationDatagramSize, datagrams);
+  Metrics &metrics = Metrics::instance();
+  if (transport.sendBatch(std::vector<persistent_node_id_t>(1, to),
+                          BACK_PROP_PORT_STR, datagrams) < 0) {
+    MPLOG_ERROR("sending sync entries to node %u", to);
+    metrics.increment(METRIC_BP_SEND_ERRORS);
+    return -1;
+  }
+  MPLOG_DEBUG("Sent node %u our %zu entries in %zu datagrams to sync", to,
+              msg.entries.size(), datagrams.size());
+  metrics.increment(METRIC_SYNC_DATAGRAMS_SENT, datagrams.size());
+  return 0;
+}
+
+void g18::Daemon::handleSyncRequest(const sync_request_t &req)
+{
+  const uint64_t mask =
+    AntiEntropy::differingBuckets(*membershipList.snapshot(), req.buckets);
+  if (mask == 0) {
+    return; // We've caught up since it asked
+  }
+  sendSyncEntries(req.origin, mask, true);
+}
+
+void g18::Daemon::handleSyncEntries(const sync_entries_t &msg)
+{
+  changelist_t repairs;
+  repairs.timestamp = logicalClock.now();
+  AntiEntropy::reconcile(*membershipList.snapshot(), msg.entries, repairs);
+  if (!changelistIsEmpty(repairs)) {
+    // Neither of us is the only one likely to have missed these, but our
+    // other neighbors will find out from their own digests
+    const changelist_t news = updateMembershipList(repairs);
+    const size_t count = news.joined.size() + news.left.size() + news.failed.size();
+    MPLOG("Syncing with node %u repaired %zu entries", msg.origin, count);
+    Metrics::instance().increment(METRIC_SYNC_REPAIRS, count);
+  }
+  if (msg.wantsReply) {
+    sendSyncEntries(msg.origin, msg.buckets, false);
+  }
+}
+
+bool g18::Daemon::isFounder() const
+{
+  const persistent_node_id_t founder =
+    config.numSeeds > 0 ? config.seeds[0] : recruiterID;
+  return getPersistentID() == founder;
+}
+
+std::vector<persistent_node_id_t> g18::Daemon::otherSeeds(const persistent_node_id_t self,
+                                                         const daemon_config_t &config)
 {
-  return getPersistentID() == recruiterID;
+  std::vector<persistent_node_id_t> seeds;
+  if (config.numSeeds == 0) {
+    seeds.push_back(recruiterID);
+  } else {
+    seeds.assign(config.seeds, config.seeds + config.numSeeds);
+  }
+  seeds.erase(std::remove(seeds.begin(), seeds.end(), self), seeds.end());
+  return seeds;
 }
 
 persistent_node_id_t g18::Daemon::getPersistentID() const
@@ -332,328 +1068,367 @@ persistent_node_id_t g18::Daemon::getPersistentID() const
   return ourPersistentID;
 }
 
+const g18::HeartbeatScheduler & g18::Daemon::getHeartbeatScheduler() const
+{
+  return heartbeatScheduler;
+}
+
+const g18::MembershipList & g18::Daemon::getMembershipList() const
+{
+  return membershipList;
+}
+
 void g18::Daemon::waitForValidID() const
 {
   pthread_mutex_lock(&ourIDIsValid);
   pthread_mutex_unlock(&ourIDIsValid);
 }
 
-void g18::Daemon::updateTimestamp(const lamp_time_t newTime)
+bool g18::Daemon::hasValidID() const
 {
-  curTime = MAX(curTime, newTime) + 1;
+  if (pthread_mutex_trylock(&ourIDIsValid) != 0) {
+    return false;
+  }
+  pthread_mutex_unlock(&ourIDIsValid);
+  return true;
 }
 
-void g18::Daemon::updateMembershipList(const changelist_t &updates)
+int g18::Daemon::spreadChanges()
 {
-  for (auto leftIter = updates.left.begin(); leftIter != updates.left.end(); ++leftIter) {
-    membershipList.nodeDidLeave(*leftIter);
+  assert(eventLoop.isLoopThread() || !eventLoop.hasStarted());
+  switch (config.dissemination) {
+  case DISSEMINATION_GOSSIP:
+    // Don't wait for the next period; the rounds after it retransmit
+    return sendGossip();
+  case DISSEMINATION_PIGGYBACK:
+    // They go out with our next heartbeat
+    return 0;
+  default:
+    return sendBackpropagatedMessage();
   }
+}
 
-  for (auto diedIter = updates.failed.begin(); diedIter != updates.failed.end(); ++diedIter) {
-    membershipList.nodeDidDie(*diedIter);
+void g18::Daemon::updateTimestamp(const lamp_time_t newTime)
+{
+  if (logicalClock.update(newTime) < newTime) {
+    MPLOG_WARNING("ignoring time %" PRIu64 ", too far ahead of our clock", newTime);
+    Metrics::instance().increment(METRIC_CLOCK_SKEW_REJECTED);
   }
+}
 
-  for (auto joinIter = updates.joined.begin(); joinIter != updates.joined.end(); ++joinIter) {
-    // MPLOG("Debug: Processing joined node");
-    int nodeAddStatus = membershipList.nodeDidJoin(*joinIter);
-    // Check if we've just been added, in which case we need to set our ID with
-    // the timestamp.
-    if (joinIter->ip == ourPersistentID) {
-      if (pthread_mutex_trylock(&ourIDIsValid) != 0) {
-        // We have not yet set our ID. Let's set it right meow.
-        ourID = (node_id_t){
-          .ip = ourPersistentID,
-          .timestamp = curTime
-        };
-        MPLOG("Setting our ID to %02u%d", ourID.ip, ourID.timestamp);
-        pthread_mutex_unlock(&ourIDIsValid);
-        beginExpectingHeartbeats();
-        beginHeartbeating();
-      }
-    } else if (nodeAddStatus > 0) {
-      // A new node has joined; add ourself to the delta list as having joined
-      waitForValidID();
-      addToDelta(ourID, NODE_STATE_ONLINE);
-    }
-  }
+void g18::Daemon::lockDelta()
+{
+  pthread_mutex_lock(&deltaLock);
+  deltaLockedAtNs = monotonic_time_ns();
 }
 
-void g18::Daemon::removeSentMessages(changelist_t &msg)
+void g18::Daemon::unlockDelta()
 {
-  removeSentMessages_helper(msg.joined, delta.joined);
-  removeSentMessages_helper(msg.left, delta.left);
-  removeSentMessages_helper(msg.failed, delta.failed);
+  const uint64_t heldNs = monotonic_time_ns() - deltaLockedAtNs;
+  pthread_mutex_unlock(&deltaLock);
+  Metrics::instance().record(METRIC_DELTA_LOCK_HOLD_NS, heldNs);
 }
 
-void g18::Daemon::removeSentMessages_helper(std::list<node_id_t> &msgList,
-                                            std::list<node_id_t> &deltaList)
+void g18::Daemon::registerGauges()
 {
-  for (auto deltaIter = deltaList.begin(); deltaIter != deltaList.end(); ++deltaIter) {
-    for (auto msgIter = msgList.begin(); msgIter != msgList.end(); ++msgIter) {
-      if (isEqual(*deltaIter, *msgIter)) {
-        // We're the original sender of this update. Remove it from both lists.
-        deltaList.erase(deltaIter);
-        msgList.erase(msgIter);
-        break;
-      }
-    }
-  }
+  // Capture-less lambdas convert to plain gauge functions
+  Metrics &metrics = Metrics::instance();
+  metrics.addGauge("membership_live", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->membershipList.liveCount();
+  }, this);
+  metrics.addGauge("membership_tombstones", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->membershipList.tombstoneCount();
+  }, this);
+  metrics.addGauge("membership_bytes", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->membershipList.memoryUsage();
+  }, this);
+  metrics.addGauge("heartbeats_late", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->heartbeatScheduler.getLateCount();
+  }, this);
+  metrics.addGauge("heartbeats_skipped", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->heartbeatScheduler.getSkippedCount();
+  }, this);
+  metrics.addGauge("transport_resolutions", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->transport.getResolutionCount();
+  }, this);
+  metrics.addGauge("transport_sends", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->transport.getSendCount();
+  }, this);
+  metrics.addGauge("transport_send_errors", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->transport.getSendErrorCount();
+  }, this);
+  metrics.addGauge("bp_kernel_drops", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->bpBatch.getKernelDropCount();
+  }, this);
+  metrics.addGauge("bp_truncated", [](const void *context) -> uint64_t {
+    return static_cast<const Daemon *>(context)->bpBatch.getTruncatedCount();
+  }, this);
+  metrics.addGauge("probe_false_positive_ppm", [](const void *) -> uint64_t {
+    // Of the suspicions probes have settled, how many were wrong
+    const Metrics &m = Metrics::instance();
+    const uint64_t refuted = m.value(METRIC_PROBES_REFUTED);
+    const uint64_t settled = refuted + m.value(METRIC_PROBES_FAILED);
+    return settled == 0 ? 0 : refuted * 1000000 / settled;
+  }, NULL);
+  metrics.addGauge("log_records_written", [](const void *) -> uint64_t {
+    return Logger::instance().getWrittenCount();
+  }, NULL);
+  metrics.addGauge("log_records_dropped", [](const void *) -> uint64_t {
+    return Logger::instance().getDroppedCount();
+  }, NULL);
 }
 
-void g18::Daemon::augmentWithDelta(changelist_t &msg)
+void g18::Daemon::journalEvent(const journal_event_e type, const node_id_t &node)
 {
-  augmentWithDelta_helper(msg.joined, delta.joined);
-  augmentWithDelta_helper(msg.left, delta.left);
-  augmentWithDelta_helper(msg.failed, delta.failed);
+  if (journal.append(type, node, logicalClock.now()) != 0) {
+    MPLOG_WARNING("unable to journal %s event for node %u",
+                  EventJournal::eventName(type), node.ip);
+  }
 }
 
-void g18::Daemon::augmentWithDelta_helper(std::list<node_id_t> &msgList,
-                                          std::list<node_id_t> &deltaList)
+changelist_t g18::Daemon::updateMembershipList(const changelist_t &updates)
 {
-  for (auto deltaIter = deltaList.begin(); deltaIter != deltaList.end(); ++deltaIter) {
-    bool found = false;
-    for (auto msgIter = msgList.begin(); msgIter != msgList.end(); ++msgIter) {
-      if (isEqual(*deltaIter, *msgIter)) {
-        found = true;
-        break;
-      }
+  changelist_t news;
+  news.timestamp = updates.timestamp;
+  // Readers see the whole changelist applied at once
+  membershipList.beginUpdate();
+  for (auto leftIter = updates.left.begin(); leftIter != updates.left.end(); ++leftIter) {
+    if (membershipList.nodeDidLeave(*leftIter, logicalClock.now()) == 0) {
+      news.left.push_back(*leftIter);
+      journalEvent(JOURNAL_EVENT_LEFT, *leftIter);
+      transport.invalidate(leftIter->ip);
+    }
+  }
+
+  for (auto diedIter = updates.failed.begin(); diedIter != updates.failed.end(); ++diedIter) {
+    if (membershipList.nodeDidDie(*diedIter, logicalClock.now()) == 0) {
+      news.failed.push_back(*diedIter);
+      journalEvent(JOURNAL_EVENT_DIED, *diedIter);
+      transport.invalidate(diedIter->ip);
     }
-    if (!found) {
-      msgList.push_back(*deltaIter);
+  }
+
+  for (auto joinIter = updates.joined.begin(); joinIter != updates.joined.end(); ++joinIter) {
+    // MPLOG_DEBUG("Processing joined node");
+    // Our own join comes in a snapshot instead, and new nodes learn about
+    // us from theirs
+    if (membershipList.nodeDidJoin(*joinIter) > 0) {
+      news.joined.push_back(*joinIter);
+      journalEvent(JOURNAL_EVENT_JOINED, *joinIter);
+      // It may have come back somewhere else
+      transport.invalidate(joinIter->ip);
     }
   }
+  membershipList.endUpdate();
+
+  // Our neighbors may have changed
+  refreshMonitoredNeighbors();
+  return news;
 }
 
-std::string g18::Daemon::convertChangelistToNetworkFormat(changelist_t theChanges) const
+void g18::Daemon::refreshMonitoredNeighbors()
 {
-  std::string packet;
-  std::stringstream theStream;
-  theStream << theChanges.timestamp;
-  int j, l, f;
-  j = theChanges.joined.size();
-  l = theChanges.left.size();
-  f = theChanges.failed.size();
-  node_id_t val;
-  theStream << "j";
-  for(int j1 = 0; j1 < j; j1++)
-  {
-    val = theChanges.joined.front();
-    if(val.ip == 10)
-    {
-      theStream << 10;
-    }
-    else
-    {
-      theStream << 0;
-      theStream << val.ip;
+  assert(eventLoop.isLoopThread() || !eventLoop.hasStarted());
+  if (!isExpectingHeartbeats) {
+    return;
+  }
+  std::shared_ptr<const MembershipSnapshot> members = membershipList.snapshot();
+  const std::vector<node_id_t> expected =
+    members->predecessorsOf(ourID, config.monitoringDegree);
+  // Stop watching anyone who shouldn't be sending us heartbeats any more
+  for (auto it = monitoredNeighbors.begin(); it != monitoredNeighbors.end(); ++it) {
+    bool stillExpected = false;
+    for (auto exp = expected.begin(); exp != expected.end(); ++exp) {
+      stillExpected = stillExpected || isEqual(*it, *exp);
     }
-    theStream << val.timestamp;
-    theStream << "m";
-    theChanges.joined.pop_front();
-  }
-  theStream << "l";
-  for(int l1 = 0; l1 < l; l1++)
-  {
-    val = theChanges.left.front();
-    if(val.ip == 10)
-    {
-      theStream << 10;
+    if (!stillExpected && heartbeatDeadlines.isScheduled(*it)) {
+      heartbeatDeadlines.cancel(it->ip);
     }
-    else
-    {
-      theStream << 0;
-      theStream << val.ip;
+    if (!stillExpected && prober.end(*it)) {
+      probeDeadlines.cancel(it->ip);
     }
-    theStream << val.timestamp;
-    theStream << "m";
-    theChanges.left.pop_front();
-  }
-  theStream << "f";
-  for(int f1 = 0; f1 < f; f1++)
-  {
-    val = theChanges.failed.front();
-    if(val.ip == 10)
-    {
-      theStream << 10;
+    if (!stillExpected) {
+      phiDetector.forget(it->ip);
+      antiEntropy.forget(it->ip);
     }
-    else
-    {
-      theStream << 0;
-      theStream << val.ip;
+  }
+  // Give any new neighbor a full timeout to get its first heartbeat to us
+  const uint64_t nowMs = monotonic_time_ns() / 1000000;
+  for (auto exp = expected.begin(); exp != expected.end(); ++exp) {
+    if (!heartbeatDeadlines.isScheduled(*exp) && !prober.isProbing(*exp)) {
+      heartbeatDeadlines.schedule(*exp, fixedHeartbeatTimeoutMs(), nowMs);
     }
-    theStream << val.timestamp;
-    theStream << "m";
-    theChanges.failed.pop_front();
   }
-  packet = theStream.str();
+  monitoredNeighbors = expected;
+}
+
+std::string g18::Daemon::convertChangelistToNetworkFormat(const changelist_t &theChanges) const
+{
+  std::string packet;
+  encodeChangelist(theChanges, packet);
   return packet;
 }
 
-changelist_t g18::Daemon::convertNetworkFormatToChangelist(const std::string &CLPacket) const
-{
-  std::string temp;
-  changelist_t ret;
-  node_id_t hold;
-  int j = 0;
-  int k;
-  int val;
-  int val2;
-  for(int i = 0; CLPacket[i] != 'j'; i++)
-  {
-    temp += CLPacket[i];
-    j = i;
-  }
-  std::istringstream iss (temp);
-  iss >> val;
-  ret.timestamp = val;
-  j = j+2;
-
-  while(CLPacket[j] != 'l')
-  {
-    temp = "";
-    k = 0;
-    for(int i = j; CLPacket[i] != 'm'; i++)
-    {
-      temp += CLPacket[i];
-      j = i;
-      k++;
-      if(k ==2)
-      {
-        temp += " ";
-      }
-    }
-    std::istringstream iss (temp);
-    iss >> val;
-    iss >> val2;
-    hold.ip = val;
-    hold.timestamp = val2;
-    ret.joined.push_back(hold);
-
-    j = j+2;
-  }
-
-  j++;
-
-  while(CLPacket[j] != 'f')
-  {
-    temp = "";
-    k = 0;
-    for(int i = j; CLPacket[i] != 'm'; i++)
-    {
-      temp += CLPacket[i];
-      j = i;
-      k++;
-      if(k ==2)
-      {
-        temp += " ";
-      }
-    }
-    std::istringstream iss (temp);
-    iss >> val;
-    iss >> val2;
-    hold.ip = val;
-    hold.timestamp = val2;
-    ret.left.push_back(hold);
-
-    j = j+2;
-  }
-
-  j++;
-
-  while(j < static_cast<signed>(CLPacket.size()))
-  {
-    temp = "";
-    k = 0;
-    for(int i = j; CLPacket[i] != 'm'; i++)
-    {
-      temp += CLPacket[i];
-      j = i;
-      k++;
-      if(k ==2)
-      {
-        temp += " ";
-      }
-    }
-    std::istringstream iss (temp);
-    iss >> val;
-    iss >> val2;
-    hold.ip = val;
-    hold.timestamp = val2;
-    ret.failed.push_back(hold);
+int g18::Daemon::convertNetworkFormatToChangelist(const char *CLPacket,
+                                                  const size_t len,
+                                                  changelist_t &out) const
+{
+  return decodeChangelist(CLPacket, len, out);
+}
 
-    j = j+2;
+int g18::Daemon::parseNumber(const char *&p, const char *end, uint64_t &value)
+{
+  const char *start = p;
+  value = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p++ - '0');
   }
+  return p == start ? -1 : 0;
+}
+
+void g18::Daemon::onHeartbeatTick(void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  // Having nobody to send to is fine; a successor may join later
+  daemon->sendHeartbeat();
+}
 
-  return ret;
+void g18::Daemon::onDeadlineTimer(int fd, void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  if (EventLoop::drainTimer(fd) == 0) {
+    return; // Spurious wakeup
+  }
+  const uint64_t nowMs = monotonic_time_ns() / 1000000;
+  daemon->heartbeatDeadlines.advance(nowMs);
+  daemon->probeDeadlines.advance(nowMs);
 }
 
-static void * send_heartbeats_forever(void *void_daemon)
+void g18::Daemon::onTombstoneTimer(int fd, void *context)
 {
-  g18::Daemon *daemon = static_cast<g18::Daemon *>(void_daemon);
-  if (daemon == NULL) {
-    MPLOG("Got a NULL daemon");
-    return NULL;
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  if (EventLoop::drainTimer(fd) == 0) {
+    return; // Spurious wakeup
   }
-  daemon->isHeartbeating = true;
-  // Send heartbeats until the end of time.
-  int err;
-  do {
-    err = daemon->sendHeartbeat();
-  } while (err == 0);
-  // Error
-  daemon->isHeartbeating = false;
-  return NULL;
+  const tombstone_policy_t policy = {
+    .maxAgeMs = tombstoneMaxAgeMs,
+    .maxAgeTicks = tombstoneMaxAgeTicks,
+    .maxTombstones = maxTombstones
+  };
+  MembershipList &list = daemon->membershipList;
+  const size_t collected = list.collectTombstones(monotonic_time_ns() / 1000000,
+                                                  daemon->logicalClock.now(), policy);
+  if (collected > 0) {
+    MPLOG_DEBUG("Collected %zu tombstones; %zu live, %zu tombstones, %zu bytes",
+          collected, list.liveCount(), list.tombstoneCount(), list.memoryUsage());
+  }
+  // Anything we forwarded a sweep ago has long since made it around the ring
+  daemon->lockDelta();
+  daemon->recentlyForwarded.clear();
+  daemon->unlockDelta();
 }
 
-static void * receive_heartbeats_forever(void *void_daemon)
+void g18::Daemon::onGossipTimer(int fd, void *context)
 {
-  g18::Daemon *daemon = static_cast<g18::Daemon *>(void_daemon);
-  if (daemon == NULL) {
-    MPLOG("Got a NULL daemon");
-    return NULL;
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  if (EventLoop::drainTimer(fd) == 0) {
+    return; // Spurious wakeup
   }
-  daemon->isExpectingHeartbeats = true;
-  // Open a socket to receive heartbeats
-  int sockfd = openReadSocket(FORWARD_PROP_PORT_STR);
-  if (sockfd < 0) {
-    MPLOG("Error opening heartbeat receive socket");
-    exit(1);
+  daemon->sendGossip();
+}
+
+void g18::Daemon::onJoinTimer(int fd, void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  if (EventLoop::drainTimer(fd) == 0) {
+    return; // Spurious wakeup
   }
-  // Receive heartbeats until the end of time.
-  while (true) {
-    std::string hb = receiveData(sockfd);
-    if (hb.length() == 0) {
-      // Socket timed out, somebody missed a heartbeat
-      daemon->handleMissedHeartbeat();
-    } else {
-      // Got a heartbeat
-      MPLOG("Got heartbeat: %s", hb.c_str());
-      daemon->handleReceivedHeartbeat(hb);
-    }
+  if (daemon->admitQueuedJoins()) {
+    daemon->spreadChanges();
   }
-  daemon->isExpectingHeartbeats = false;
 }
 
-static void * receive_bp_messages_forever(void *void_daemon)
+void g18::Daemon::onJoinRetryTimer(int fd, void *context)
 {
-  g18::Daemon *daemon = static_cast<g18::Daemon *>(void_daemon);
-  if (daemon == NULL) {
-    MPLOG("Got a NULL daemon");
-    return NULL;
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  if (EventLoop::drainTimer(fd) == 0 || daemon->hasValidID()) {
+    return; // Spurious wakeup, or someone let us in
   }
-  // Open a socket to receive BP messages
-  int sockfd = openReadSocket(BACK_PROP_PORT_STR);
-  if (sockfd < 0) {
-    MPLOG("Error opening BP message receive socket");
+  if (daemon->isFounder() && daemon->joinBackoff.hasAskedEverySeed()) {
+    // No other seed answered, so there's no group yet
+    daemon->foundGroup();
+    return;
+  }
+  daemon->requestToJoin();
+}
+
+void g18::Daemon::onLeave(void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  daemon->addToDelta(daemon->ourID, NODE_STATE_DEPARTED);
+  // Send a message that we're leaving and kill ourself. A piggybacked
+  // departure would otherwise wait for a heartbeat we'll never send.
+  const int err = daemon->config.dissemination == DISSEMINATION_PIGGYBACK ?
+    daemon->sendHeartbeat() : daemon->spreadChanges();
+  if (err != 0) {
+    MPLOG_ERROR("sending leave message");
     exit(1);
   }
-  // Receive BP messages until the end of time.
-  while (true) {
-    std::string bp = receiveData(sockfd);
-    if (bp.length() == 0) {
-      continue; // FISI
+  MPLOG("Sent leave message; goodbye");
+  exit(0);
+}
+
+void g18::Daemon::onHeartbeatDeadline(const node_id_t &node, void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  daemon->handleMissedHeartbeat(node);
+}
+
+void g18::Daemon::onProbeDeadline(const node_id_t &node, void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  if (!daemon->prober.end(node)) {
+    return; // It answered after all
+  }
+  MPLOG("Node %u didn't answer any probe", node.ip);
+  Metrics::instance().increment(METRIC_PROBES_FAILED);
+  daemon->declareDead(node);
+}
+
+void g18::Daemon::onStatsConnection(int fd, void *)
+{
+  Metrics::instance().serveEndpoint(fd);
+}
+
+void g18::Daemon::onHeartbeatReadable(int fd, void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  char *buf = &daemon->receiveBuffer[0];
+  // Drain everything that's waiting
+  ssize_t len;
+  while ((len = receiveDatagram(fd, buf, daemon->receiveBuffer.size())) >= 0) {
+    // Log just the ID, not any binary changes piggybacked after it
+    const char *idEnd = static_cast<const char *>(memchr(buf, WIRE_MAGIC, len));
+    MPLOG("Got heartbeat: %.*s", (int)(idEnd == NULL ? len : idEnd - buf), buf);
+    daemon->handleReceivedHeartbeat(buf, len);
+  }
+}
+
+void g18::Daemon::onBackpropagationReadable(int fd, void *context)
+{
+  g18::Daemon *daemon = static_cast<g18::Daemon *>(context);
+  DatagramBatch &batch = daemon->bpBatch;
+  // Drain everything that's waiting a batch at a time, then pass on all of
+  // the changes at once
+  bool shouldForward = false;
+  while (batch.receive(fd) > 0) {
+    for (unsigned i = 0; i < batch.size(); i++) {
+      MPLOG("Got %zu byte BP message", batch.length(i));
+      shouldForward |= daemon->processBackpropagationMessage(batch.data(i),
+                                                             batch.length(i));
     }
-    MPLOG("Got BP message: %s", bp.c_str());
-    daemon->handleReceivedBackpropagationMessage(bp);
+  }
+  if (shouldForward) {
+    daemon->spreadChanges();
   }
 }
@@ -2,62 +2,210 @@
 #include <pthread.h>
 #include <string>
 #include <vector>
+#include "AntiEntropy.hpp"
+#include "ChangeSet.hpp"
+#include "DatagramBatch.hpp"
+#include "EventJournal.hpp"
+#include "EventLoop.hpp"
+#include "GossipDisseminator.hpp"
+#include "HeartbeatScheduler.hpp"
+#include "HybridClock.hpp"
+#include "IndirectProber.hpp"
+#include "JoinAdmissionQueue.hpp"
+#include "JoinBackoff.hpp"
 #include "MembershipList.hpp"
+#include "Metrics.hpp"
+#include "PhiAccrualDetector.hpp"
+#include "TimerWheel.hpp"
+#include "Transport.hpp"
+#include "codec.hpp"
 #include "net_types.hpp"
 
+/// How membership changes are spread through the group.
+typedef enum {
+  /// Hop by hop backwards around the ring, each change until it comes back.
+  DISSEMINATION_RING,
+  /// To a few random members every protocol period, each change log(n) times.
+  DISSEMINATION_GOSSIP,
+  /// On our heartbeats, a bounded slice at a time, each change log(n) times.
+  /// No separate datagrams, but changes only advance a hop per heartbeat.
+  DISSEMINATION_PIGGYBACK
+} dissemination_mode_e;
+
+/// What a monitor knows of a predecessor it watches.
+typedef enum {
+  /// We're still waiting on its next heartbeat, which isn't overdue yet.
+  MONITORED_HEARTBEATING,
+  /// It missed its heartbeats and we're having others probe it.
+  MONITORED_PROBING,
+  /// It missed its heartbeats and we haven't acted on it yet.
+  MONITORED_SILENT
+} monitored_state_e;
+
+/// Tunables for a Daemon, normally set from the command line.
+typedef struct {
+  /// How often we send a heartbeat to our successor.
+  unsigned heartbeatPeriodMs;
+  /// How many successors we heartbeat, and so how many predecessors we
+  /// monitor. More catch adjacent failures sooner, at the cost of more
+  /// heartbeats. At most Daemon::maxMonitoringDegree.
+  unsigned monitoringDegree;
+  /// SCHED_FIFO priority for a dedicated heartbeat thread, or 0 to send
+  /// heartbeats from the event loop at normal priority.
+  int heartbeatPriority;
+  /// CPU to pin a dedicated heartbeat thread to, or -1 for no pinning.
+  int heartbeatCpu;
+  /// Directory to journal membership events to, or NULL for none.
+  const char *journalDir;
+  /// Unix socket path to serve our metrics on, or NULL for none.
+  const char *statsSocket;
+  /// How we spread membership changes. In gossip mode the heartbeat period
+  /// is also the protocol period.
+  dissemination_mode_e dissemination;
+  /// Members asked to probe a predecessor that's missed its heartbeats
+  /// before we declare it dead, or 0 to declare it dead straight away.
+  unsigned probeHelpers;
+  /// Suspicion level at which a neighbor we monitor has missed its
+  /// heartbeats, or 0 to always wait a fixed timeout of at least
+  /// Daemon::heartbeatTimeoutMs.
+  double phiThreshold;
+  /// How long a member collects join requests to admit them as one batch,
+  /// or 0 to admit each one as it comes.
+  unsigned joinWindowMs;
+  /// Members we ask to let us join, or NULL for just Daemon::recruiterID.
+  /// The first founds the group, once it has asked every other one in turn
+  /// and none answered.
+  const persistent_node_id_t *seeds;
+  size_t numSeeds;
+} daemon_config_t;
+
 namespace g18 {
   class Daemon {
     public:
-      /// The persistent identifier of the recruiter.
+      /// The seed when none are configured, which founds the group.
       static const persistent_node_id_t recruiterID = 1;
 
+      /// The most successors we'll heartbeat.
+      static const unsigned maxMonitoringDegree = 8;
+
+      /// How long we wait for a heartbeat before declaring one missed, until
+      /// we've seen enough of a neighbor's heartbeats to judge it by phi.
+      /// Slow heartbeat periods stretch it; see fixedHeartbeatTimeoutMs().
+      static const unsigned heartbeatTimeoutMs = 1000;
+
+      /// How many heartbeat periods the fixed timeout spans at least, so a
+      /// long period doesn't have every neighbor miss between heartbeats.
+      static const unsigned heartbeatTimeoutPeriods = 4;
+
+      /// The default phi threshold: about one false suspicion in 10^8
+      /// heartbeats, if arrivals really were normally distributed.
+      static const unsigned defaultPhiThreshold = 8;
+
+      /// The least heartbeat jitter we assume a neighbor has.
+      static const unsigned phiMinStdDevMs = 25;
+
+      /// How long we wait for an ack once we've started probing a node.
+      static const unsigned probeTimeoutMs = 500;
+
+      /// Resolution of heartbeat deadlines.
+      static const unsigned deadlineTickMs = 50;
+
+      /// How often we forget the tombstones of departed and dead nodes.
+      static const unsigned tombstoneSweepMs = 5000;
+
+      /// Tombstones are kept until they're this old in either wall or Lamport
+      /// time, long enough that no late message can still mention them. The
+      /// Lamport age is a minute's worth of HybridClock time, which the
+      /// group's clocks can push forward faster than our own wall clock.
+      static const uint64_t tombstoneMaxAgeMs = 60000;
+      static const lamp_time_t tombstoneMaxAgeTicks =
+        static_cast<lamp_time_t>(60000) << HybridClock::logicalBits;
+
+      /// Beyond this many, the oldest tombstones are forgotten early.
+      static const size_t maxTombstones = 4096;
+
+      /// How many BP datagrams we read per syscall.
+      static const unsigned bpBatchCapacity = 16;
+
+      /// BP messages are split so no datagram exceeds this, which keeps them
+      /// from being fragmented on a standard Ethernet MTU.
+      static const size_t maxBackpropagationDatagramSize = 1400;
+
+      /// The most changes a heartbeat carries in piggyback mode, which keeps
+      /// every heartbeat well under maxBackpropagationDatagramSize.
+      static const unsigned maxPiggybackChanges = 16;
+
+      /// Beyond this many pending changes in piggyback mode, those already
+      /// sent the most are dropped, so churn faster than our heartbeats can
+      /// carry it doesn't grow the queue without bound.
+      static const unsigned maxPiggybackBacklog = 4 * maxPiggybackChanges;
+
+      /// The configuration used when none is given.
+      static daemon_config_t defaultConfig();
+
+      /// Only the nearest monitor still alive reports a failure, so that k
+      /// monitors don't send k reports. Given what we know of each
+      /// predecessor between us and one that timed out, nearest to us first,
+      /// return the index of the one whose job reporting it is, or -1 if it's
+      /// ours. One still heartbeating or being probed may yet be alive.
+      static int closerReporter(const std::vector<monitored_state_e> &closer);
+
       /// Create a new Daemon with the given persistent identifier.
-      Daemon(const persistent_node_id_t persistentID);
+      Daemon(const persistent_node_id_t persistentID,
+             const daemon_config_t &config = defaultConfig());
 
       /// Get the persistent ID of the node to which we should send our next backpropagation message.
       persistent_node_id_t getBackpropagationTarget();
 
       /// Update our internal state based on the contents of a received heartbeat.
-      void handleReceivedHeartbeat(const std::string &hb);
+      void handleReceivedHeartbeat(const char *hb, const size_t len);
 
-      /// Do something if a neighbor skips a heartbeat.
-      void handleMissedHeartbeat();
+      /// Do something if the given neighbor skips a heartbeat. Of the nodes
+      /// monitoring it, only the nearest one still alive declares it dead.
+      void handleMissedHeartbeat(const node_id_t &sender);
 
       /// Update our internal state based on the contents of a received message.
-      void handleReceivedBackpropagationMessage(const std::string &bp);
+      void handleReceivedBackpropagationMessage(const char *bp, const size_t len);
 
-      /// Take appropriate action to allow a new node to join the group.
-      /// Only valid when this Daemon is the recruiter for the group.
-      void handleNodeJoinRequest(const std::string &bp);
+      /// Take appropriate action to allow a new node to join the group. Any
+      /// member can; until we've joined ourselves, requests are dropped and
+      /// the node asks someone else.
+      void handleNodeJoinRequest(const char *bp, const size_t len);
 
-      /// Generate a message to be sent as a heartbeat.
-      std::string generateMessageForHeartbeat() const;
+      /// Generate a message to be sent as a heartbeat. In piggyback mode it
+      /// carries the next slice of our pending changes.
+      std::string generateMessageForHeartbeat();
 
-      /// Generate a message to be sent containing all of our internal updates.
-      std::string generateMessageForBackpropagation();
+      /// Generate a message to be sent containing all of our internal updates,
+      /// split into as many datagrams as it takes.
+      std::vector<std::string> generateMessageForBackpropagation();
 
       /// Add the node to the delta with the specified action, but only if not
       /// already present.
       void addToDelta(const node_id_t &node, const node_state_e state);
 
-      /// Attempt to join the group.
+      /// Attempt to join the group, asking our seeds in turn until one of
+      /// them lets us in. The founding seed starts the group instead once it
+      /// has asked every other seed, waiting out each backoff, and none
+      /// answered: a group with any of them up would have let it back in.
       void joinGroup();
 
-      /// Notify the group that we're leaving, then leave the group.
-      void leaveGroup();
+      /// Notify the group that we're leaving, then leave the group. The
+      /// notice goes out from the loop thread, which exits the process.
+      void leaveGroup() __attribute__((noreturn));
 
       /// Call this when we want to kill ourself without notifying the group.
       void killSelf() const __attribute__((noreturn));
 
-      /// Asynchronously start sending periodic heartbeats to whomever's our
-      /// next neighbor over in the group.
-      void beginHeartbeating() const;
+      /// Asynchronously start sending periodic heartbeats to our next
+      /// config.monitoringDegree neighbors over in the group.
+      void beginHeartbeating();
 
       /// Asynchronously start listening for periodic heartbeats.
-      void beginExpectingHeartbeats() const;
+      void beginExpectingHeartbeats();
 
       /// Asynchronously start listening for spurious backpropagated messages.
-      void beginExpectingBackpropagatedMessages() const;
+      void beginExpectingBackpropagatedMessages();
 
       /// Send a single heartbeat. Returns 0 on success, -1 on error.
       int sendHeartbeat();
@@ -65,59 +213,289 @@ namespace g18 {
       /// Send a single backpropagated message.
       int sendBackpropagatedMessage();
 
-      /// Determine if this node is the recruiter.
-      bool isRecruiter() const;
+      /// Send one round of gossip, if there's anything to send. Returns 0 on
+      /// success, -1 on error.
+      int sendGossip();
+
+      /// Determine if this node is the first seed, which founds the group.
+      bool isFounder() const;
 
       /// Return a copy of our persistent identifier.
       persistent_node_id_t getPersistentID() const;
 
+      /// Our heartbeat schedule, including how late our sends have been.
+      const HeartbeatScheduler & getHeartbeatScheduler() const;
+
+      /// Our membership list, for reporting its size.
+      const MembershipList & getMembershipList() const;
+
       /// Whether we're currently sending heartbeats.
       bool isHeartbeating;
 
-      /// Whether the heartbeat-sending thread is currently active.
+      /// Whether we're currently listening for heartbeats.
       bool isExpectingHeartbeats;
 
     private:
       /// Our persistent identifier.
       persistent_node_id_t ourPersistentID;
 
+      /// Our tunables.
+      const daemon_config_t config;
+
       node_id_t ourID;
       mutable pthread_mutex_t ourIDIsValid;
 
-      /// The current Lamport time.
-      // TODO(jloew2): Do we need a lock for this?
-      lamp_time_t curTime;
+      /// Our Lamport time.
+      HybridClock logicalClock;
 
       /// Our local copy of the membership list.
       MembershipList membershipList;
 
+      /// Sends our heartbeats and BP messages with cached peer addresses.
+      Transport transport;
+
       /// Everything we've sent out (or figured out on our own) but haven't yet
       /// received a confirmation on. We keep track so we can resend it in the
       /// event of a dropped node or packet.
-      changelist_t delta;
+      ChangeSet delta;
       mutable pthread_mutex_t deltaLock;
 
+      /// When deltaLock was last taken, for timing how long it's held.
+      uint64_t deltaLockedAtNs;
+
+      /// Other nodes' changes waiting to be passed on with our next BP
+      /// message. Guarded by deltaLock.
+      ChangeSet toForward;
+
+      /// Other nodes' changes we've already passed on, which we won't pass on
+      /// again. Cleared every tombstoneSweepMs. Guarded by deltaLock.
+      ChangeSet recentlyForwarded;
+
+      /// Changes waiting to be gossiped, or piggybacked on our heartbeats, in
+      /// those modes. Guarded by deltaLock.
+      GossipDisseminator gossip;
+
+      /// Binary record of every membership change and heartbeat.
+      EventJournal journal;
+
+      /// Runs every socket and timer handler on a single thread.
+      EventLoop eventLoop;
+
+      /// Sockets on which we receive heartbeats and BP messages.
+      int heartbeatSockfd;
+      int bpSockfd;
+
+      /// Every heartbeat we receive lands here, one at a time. Handlers get a
+      /// view into it that's only valid until they return.
+      std::vector<char> receiveBuffer;
+
+      /// BP messages are read a burst at a time into here.
+      DatagramBatch bpBatch;
+
+      /// Sends a heartbeat every config.heartbeatPeriodMs.
+      HeartbeatScheduler heartbeatScheduler;
+
+      /// When we next expect a heartbeat from each neighbor we monitor.
+      TimerWheel heartbeatDeadlines;
+
+      /// How regularly each neighbor we monitor heartbeats, which sets its
+      /// deadlines when config.phiThreshold is set. A lost heartbeat is
+      /// allowed for, and otherwise left to the prober.
+      PhiAccrualDetector phiDetector;
+
+      /// Probes the neighbors who've missed their heartbeats.
+      IndirectProber prober;
+
+      /// When we give up on each probe and declare its target dead.
+      TimerWheel probeDeadlines;
+
+      /// Compares our membership digest with our neighbors' and decides when
+      /// to sync with them.
+      AntiEntropy antiEntropy;
+
+      /// Join requests waiting to be admitted.
+      JoinAdmissionQueue joinQueue;
+
+      /// Which seed we ask to let us join next, and when. Only used until
+      /// we've joined.
+      JoinBackoff joinBackoff;
+
+      /// The ID we ask to join as. Every attempt asks for the same one, so
+      /// that however many seeds admit us, they all admit the same node.
+      node_id_t joiningAs;
+      uint64_t joinStartedNs;
+
+      /// The neighbors heartbeatDeadlines is tracking for us.
+      std::vector<node_id_t> monitoredNeighbors;
+
+      /// Advances heartbeatDeadlines and probeDeadlines every deadlineTickMs.
+      int deadlineTimerfd;
+
+      /// Collects tombstones, and forgets what we've forwarded, every
+      /// tombstoneSweepMs.
+      int tombstoneTimerfd;
+
+      /// Runs a round of gossip every protocol period, in gossip mode.
+      int gossipTimerfd;
+
+      /// Admits the queued join requests when their window closes, when
+      /// config.joinWindowMs is set.
+      int joinTimerfd;
+
+      /// Sends our next join request if no one's let us in by then.
+      int joinRetryTimerfd;
+
+      /// Listening socket that serves our metrics, or -1.
+      int statsListenfd;
+
+      /// The seed we last asked to let us join. Only it can make us drop a
+      /// snapshot we've started to collect for another.
+      persistent_node_id_t lastAskedSeed;
+
+      /// The pieces we have of the snapshot we're collecting, by index, while
+      /// we wait for the rest. Only used until we've joined.
+      lamp_time_t snapshotVersion;
+      persistent_node_id_t snapshotOrigin;
+      std::vector<snapshot_chunk_t> snapshotChunks;
+      size_t snapshotChunksReceived;
+
+      /// Event loop handlers. The context is the Daemon.
+      static void onHeartbeatReadable(int fd, void *context);
+      static void onBackpropagationReadable(int fd, void *context);
+      static void onHeartbeatTick(void *context);
+      static void onDeadlineTimer(int fd, void *context);
+      static void onTombstoneTimer(int fd, void *context);
+      static void onGossipTimer(int fd, void *context);
+      static void onJoinTimer(int fd, void *context);
+      static void onJoinRetryTimer(int fd, void *context);
+      static void onLeave(void *context);
+      static void onHeartbeatDeadline(const node_id_t &node, void *context);
+      static void onProbeDeadline(const node_id_t &node, void *context);
+      static void onStatsConnection(int fd, void *context);
+
+      /// Take and release deltaLock, recording how long it was held.
+      void lockDelta();
+      void unlockDelta();
+
+      /// Report our components' own counters along with our metrics.
+      void registerGauges();
+
+      /// Make sure we're expecting heartbeats from exactly the neighbors who
+      /// should be sending them. Call after every membership change.
+      void refreshMonitoredNeighbors();
+
+      /// How long from nowNs until node's next heartbeat deadline.
+      uint64_t heartbeatTimeoutFor(const node_id_t &node, const uint64_t nowNs) const;
+
+      /// The timeout we use without phi: heartbeatTimeoutMs, or
+      /// heartbeatTimeoutPeriods heartbeat periods if that's longer.
+      uint64_t fixedHeartbeatTimeoutMs() const;
+
+      /// Mark a node we were monitoring as dead, and tell everyone.
+      void declareDead(const node_id_t &node);
+
+      /// Ping a node that's missed its heartbeats, directly and through
+      /// config.probeHelpers other members.
+      void beginProbe(const node_id_t &node);
+
+      /// A node we were probing has turned out to be alive.
+      void refuteSuspicion(const node_id_t &node);
+
+      /// Answer, relay or collect a ping, ping request or ack.
+      void handleProbe(const probe_t &probe);
+
+      /// Apply the changes that came along with a heartbeat, and queue what
+      /// was news to us to go out on our own.
+      void handlePiggybackedChanges(const char *buf, const size_t len);
+
+      /// Send a node we've just admitted our whole membership list, including
+      /// its own new ID, so nobody has to announce themselves to it.
+      int sendSnapshot(const persistent_node_id_t to);
+
+      /// Collect a piece of the snapshot we're joining from, and join once
+      /// we have all of it.
+      void handleSnapshot(const snapshot_chunk_t &chunk);
+
+      /// Fill our membership list from a complete snapshot and take our ID
+      /// from it.
+      void applySnapshot();
+
+      /// Ask a neighbor whose digest differs from ours which buckets do.
+      int sendSyncRequest(const persistent_node_id_t to);
+
+      /// Send our latest entries for the buckets in mask.
+      int sendSyncEntries(const persistent_node_id_t to, const uint64_t mask,
+                          const bool wantsReply);
+
+      /// Answer a sync request with our entries in the buckets that differ.
+      void handleSyncRequest(const sync_request_t &req);
+
+      /// Apply whatever a neighbor's entries show we've missed, and send ours
+      /// back if it wants them.
+      void handleSyncEntries(const sync_entries_t &msg);
+
+      /// Apply a BP message or join request without passing anything on.
+      /// Returns whether we have changes that should be sent.
+      bool processBackpropagationMessage(const char *bp, const size_t len);
+      bool admitJoinRequest(const char *bp, const size_t len);
+
+      /// Admit every queued join request as one batch. Returns whether there
+      /// were any, and so changes that should be sent.
+      bool admitQueuedJoins();
+
+      /// Add these nodes to the group in one update, and send each of them
+      /// our membership list.
+      void admitJoins(const std::vector<node_id_t> &nodes);
+
+      /// The ID to admit a node asking to join as requested. Normally it's
+      /// what the node asked for, but an incarnation of it we already have
+      /// that's as new takes precedence. Nodes that don't say which
+      /// incarnation they are get a timestamp from our clock.
+      node_id_t admissionIDFor(const node_id_t &requested,
+                               const MembershipSnapshot &members);
+
+      /// Ask the next seed to let us join, and arrange to ask again if it
+      /// doesn't.
+      void requestToJoin();
+
+      /// Start the group with just us in it.
+      void foundGroup();
+
+      /// Our seeds, leaving us out.
+      static std::vector<persistent_node_id_t> otherSeeds(const persistent_node_id_t self,
+                                                          const daemon_config_t &config);
+
       /// Blocks until we have a valid ID.
       void waitForValidID() const;
 
-      /// Update our internal clock. Pass zero to simply increment the clock.
+      /// Whether we have a valid ID yet, without blocking.
+      bool hasValidID() const;
+
+      /// Pass on the changes we're holding, by backpropagation or gossip.
+      int spreadChanges();
+
+      /// Update our internal clock past a received time. Pass zero to simply
+      /// increment the clock.
       void updateTimestamp(const lamp_time_t newTime);
 
+      /// Record an event about node in the journal at the current time.
+      void journalEvent(const journal_event_e type, const node_id_t &node);
+
       /// Update our local membership list to reflect any new changes.
-      void updateMembershipList(const changelist_t &updates);
+      /// Returns the updates that were news to us.
+      changelist_t updateMembershipList(const changelist_t &updates);
 
-      /// Remove any messages that we originally sent (in-place).
-      void removeSentMessages(changelist_t &msg);
-      void removeSentMessages_helper(std::list<node_id_t> &msgList,
-                                     std::list<node_id_t> &deltaList);
+      /// Conversions to/from network format.
+      std::string convertChangelistToNetworkFormat(const changelist_t &msg) const;
+      /// Returns 0 on success, -1 if the message is malformed.
+      int convertNetworkFormatToChangelist(const char *msg, const size_t len,
+                                           changelist_t &out) const;
 
-      /// Add anything in our local delta to the changelist.
-      void augmentWithDelta(changelist_t &msg);
-      void augmentWithDelta_helper(std::list<node_id_t> &msgList,
-                                   std::list<node_id_t> &deltaList);
+      /// Parse an unsigned decimal number from [p, end), advancing p past it.
+      /// Returns -1 if there are no digits.
+      static int parseNumber(const char *&p, const char *end, uint64_t &value);
 
-      /// Conversions to/from network format.
-      std::string convertChangelistToNetworkFormat(changelist_t msg) const;
-      changelist_t convertNetworkFormatToChangelist(const std::string &msg) const;
+      Daemon(const Daemon &) = delete;
+      Daemon & operator=(const Daemon &) = delete;
   };
 }
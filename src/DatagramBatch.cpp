@@ -0,0 +1,110 @@
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include "DatagramBatch.hpp"
+#include "utils.hpp"
+
+#define CONTROL_BUFFER_SIZE CMSG_SPACE(sizeof(uint32_t))
+
+g18::DatagramBatch::DatagramBatch(const unsigned capacity, const size_t datagramSize)
+: datagramSize(datagramSize), buffers(capacity * datagramSize),
+controlBuffers(capacity * CONTROL_BUFFER_SIZE), headers(capacity),
+iovecs(capacity), kernelDropCount(0), truncatedCount(0)
+{
+  valid.reserve(capacity);
+  for (unsigned i = 0; i < capacity; i++) {
+    iovecs[i].iov_base = &buffers[i * datagramSize];
+    iovecs[i].iov_len = datagramSize;
+  }
+}
+
+int g18::DatagramBatch::enableDropCounting(const int sockfd)
+{
+  int on = 1;
+  if (setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) != 0) {
+    MPLOG_WARNING("unable to count kernel drops: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+int g18::DatagramBatch::receive(const int sockfd)
+{
+  // recvmmsg overwrites the lengths, so reset them every time
+  const unsigned capacity = headers.size();
+  memset(&headers[0], 0, capacity * sizeof(headers[0]));
+  for (unsigned i = 0; i < capacity; i++) {
+    headers[i].msg_hdr.msg_iov = &iovecs[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+    headers[i].msg_hdr.msg_control = &controlBuffers[i * CONTROL_BUFFER_SIZE];
+    headers[i].msg_hdr.msg_controllen = CONTROL_BUFFER_SIZE;
+  }
+  valid.clear();
+
+  int received = recvmmsg(sockfd, &headers[0], capacity, MSG_DONTWAIT, NULL);
+  if (received < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+    MPLOG_ERROR("in recvmmsg: %s", strerror(errno));
+    return -1;
+  }
+  if (received == 0) {
+    return 0;
+  }
+  batchSizes.record(received);
+
+  for (int i = 0; i < received; i++) {
+    struct msghdr *hdr = &headers[i].msg_hdr;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        uint32_t drops;
+        memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+        if (drops != kernelDropCount.load(std::memory_order_relaxed)) {
+          MPLOG_WARNING("the kernel has dropped %u datagrams on this socket",
+                drops);
+          kernelDropCount.store(drops, std::memory_order_relaxed);
+        }
+      }
+    }
+    if ((hdr->msg_flags & MSG_TRUNC) != 0) {
+      MPLOG_WARNING("Dropping datagram that doesn't fit in our %zu byte buffer",
+            datagramSize);
+      truncatedCount.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    valid.push_back(i);
+  }
+  return received;
+}
+
+unsigned g18::DatagramBatch::size() const
+{
+  return valid.size();
+}
+
+const char * g18::DatagramBatch::data(const unsigned i) const
+{
+  return &buffers[valid[i] * datagramSize];
+}
+
+size_t g18::DatagramBatch::length(const unsigned i) const
+{
+  return headers[valid[i]].msg_len;
+}
+
+const g18::Histogram & g18::DatagramBatch::getBatchSizes() const
+{
+  return batchSizes;
+}
+
+uint32_t g18::DatagramBatch::getKernelDropCount() const
+{
+  return kernelDropCount.load(std::memory_order_relaxed);
+}
+
+uint64_t g18::DatagramBatch::getTruncatedCount() const
+{
+  return truncatedCount.load(std::memory_order_relaxed);
+}
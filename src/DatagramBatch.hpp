@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "Histogram.hpp"
+
+namespace g18 {
+  /// A ring of receive buffers filled by a single recvmmsg() call, so a burst
+  /// of datagrams costs one syscall instead of one each. Also tracks how many
+  /// datagrams the kernel dropped because the socket's buffer was full.
+  class DatagramBatch {
+    public:
+      /// capacity datagrams of up to datagramSize bytes each.
+      DatagramBatch(const unsigned capacity, const size_t datagramSize);
+
+      /// Ask the kernel to report drops on this socket. Returns 0 on success.
+      static int enableDropCounting(const int sockfd);
+
+      /// Read as many waiting datagrams as fit without blocking. Returns how
+      /// many were read (zero if none were waiting), or -1 on error.
+      int receive(const int sockfd);
+
+      /// Number of datagrams from the last receive().
+      unsigned size() const;
+
+      /// The i-th datagram from the last receive(). Valid until the next one.
+      const char * data(const unsigned i) const;
+      size_t length(const unsigned i) const;
+
+      /// How many datagrams each non-empty receive() returned.
+      const Histogram & getBatchSizes() const;
+
+      /// Total datagrams the kernel has dropped on the socket, as of the
+      /// last receive().
+      uint32_t getKernelDropCount() const;
+
+      /// Datagrams we discarded because they didn't fit in a buffer.
+      uint64_t getTruncatedCount() const;
+
+    private:
+      const size_t datagramSize;
+      std::vector<char> buffers;
+      std::vector<char> controlBuffers;
+      std::vector<struct mmsghdr> headers;
+      std::vector<struct iovec> iovecs;
+
+      /// Indices into headers of the usable datagrams from the last receive().
+      std::vector<unsigned> valid;
+
+      Histogram batchSizes;
+      /// Atomic so they can be reported from other threads.
+      std::atomic<uint32_t> kernelDropCount;
+      std::atomic<uint64_t> truncatedCount;
+
+      DatagramBatch(const DatagramBatch &) = delete;
+      DatagramBatch & operator=(const DatagramBatch &) = delete;
+  };
+}
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "EventJournal.hpp"
+#include "utils.hpp"
+
+#define JOURNAL_MAGIC 0x4a523138 // "JR18"
+#define JOURNAL_VERSION 1
+#define JOURNAL_SEGMENT_SUFFIX ".seg"
+
+const uint32_t g18::EventJournal::recordsPerSegment;
+const unsigned g18::EventJournal::maxSegments;
+const size_t g18::EventJournal::headerSize;
+const unsigned g18::EventJournal::nodeBitmapBits;
+
+static_assert(sizeof(journal_record_t) == 32, "journal records must stay 32 bytes");
+
+static const char *eventNames[JOURNAL_EVENT_COUNT] = {
+  "joined", "left", "died", "heartbeat", "missed-heartbeat"
+};
+
+static uint64_t wallTimeNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+g18::EventJournal::EventJournal()
+: segmentNumber(0), fd(-1), header(NULL), records(NULL),
+lock(PTHREAD_MUTEX_INITIALIZER)
+{
+}
+
+g18::EventJournal::~EventJournal()
+{
+  closeSegment();
+}
+
+int g18::EventJournal::open(const char *dir)
+{
+  pthread_mutex_lock(&lock);
+  closeSegment();
+  this->dir = dir;
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    MPLOG_ERROR("creating journal directory %s: %s", dir, strerror(errno));
+    pthread_mutex_unlock(&lock);
+    return -1;
+  }
+  // Carry on from the newest segment, unless it's full or unreadable
+  std::vector<unsigned> numbers;
+  int status = listSegments(this->dir, numbers);
+  if (status == 0) {
+    if (!numbers.empty() && openSegment(numbers.back(), false) == 0) {
+      if (header->count >= header->capacity) {
+        status = rotate();
+      }
+    } else {
+      status = openSegment(numbers.empty() ? 0 : numbers.back() + 1, true);
+    }
+  }
+  if (status == 0) {
+    MPLOG("Journaling events to %s, segment %u", dir, segmentNumber);
+  }
+  pthread_mutex_unlock(&lock);
+  return status;
+}
+
+bool g18::EventJournal::isOpen() const
+{
+  return header != NULL;
+}
+
+int g18::EventJournal::append(const journal_event_e type, const node_id_t &node,
+                              const lamp_time_t time)
+{
+  pthread_mutex_lock(&lock);
+  if (header == NULL) {
+    pthread_mutex_unlock(&lock);
+    return 0;
+  }
+  if (header->count >= header->capacity && rotate() != 0) {
+    pthread_mutex_unlock(&lock);
+    return -1;
+  }
+  journal_record_t &record = records[header->count];
+  memset(&record, 0, sizeof(record));
+  record.type = type;
+  record.node = node;
+  record.time = time;
+  record.wallNs = wallTimeNs();
+  // Index it before it's published
+  if (header->count > 0 && time < header->maxTime) {
+    header->sorted = 0;
+  }
+  header->minTime = std::min(header->minTime, time);
+  header->maxTime = MAX(header->maxTime, time);
+  header->minWallNs = std::min(header->minWallNs, record.wallNs);
+  header->maxWallNs = MAX(header->maxWallNs, record.wallNs);
+  const unsigned bit = node.ip % nodeBitmapBits;
+  header->nodeBitmap[bit / 64] |= 1ULL << (bit % 64);
+  __atomic_store_n(&header->count, header->count + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&lock);
+  return 0;
+}
+
+int g18::EventJournal::query(const char *dir, const journal_query_t &query,
+                             std::vector<journal_record_t> &out,
+                             journal_query_stats_t *stats)
+{
+  journal_query_stats_t ignored;
+  if (stats == NULL) {
+    stats = &ignored;
+  }
+  memset(stats, 0, sizeof(*stats));
+  std::vector<unsigned> numbers;
+  if (listSegments(dir, numbers) != 0) {
+    return -1;
+  }
+  stats->segments = numbers.size();
+  for (auto it = numbers.begin(); it != numbers.end(); ++it) {
+    const std::string path = segmentPath(dir, *it);
+    const int segfd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (segfd < 0) {
+      continue; // Deleted out from under us
+    }
+    if (fstat(segfd, &st) != 0 || static_cast<size_t>(st.st_size) != segmentSize()) {
+      MPLOG_WARNING("skipping truncated journal segment %s", path.c_str());
+      close(segfd);
+      continue;
+    }
+    void *base = mmap(NULL, segmentSize(), PROT_READ, MAP_SHARED, segfd, 0);
+    close(segfd);
+    if (base == MAP_FAILED) {
+      MPLOG_WARNING("mapping journal segment %s: %s", path.c_str(), strerror(errno));
+      continue;
+    }
+    const segment_header_t *header = static_cast<const segment_header_t *>(base);
+    const journal_record_t *records = reinterpret_cast<const journal_record_t *>(
+      static_cast<const char *>(base) + headerSize);
+    if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION ||
+        header->capacity != recordsPerSegment) {
+      MPLOG_WARNING("skipping unrecognized journal segment %s", path.c_str());
+    } else if (mightMatch(header, query)) {
+      stats->segmentsSearched++;
+      const uint32_t count = std::min(__atomic_load_n(&header->count, __ATOMIC_ACQUIRE),
+                                      header->capacity);
+      const journal_record_t *begin = records, *end = records + count;
+      if (header->sorted) {
+        // Only look at the part of the segment inside the window
+        begin = std::lower_bound(begin, end, query.from,
+          [](const journal_record_t &r, const lamp_time_t t) { return r.time < t; });
+        end = std::upper_bound(begin, end, query.to,
+          [](const lamp_time_t t, const journal_record_t &r) { return t < r.time; });
+      }
+      for (const journal_record_t *r = begin; r != end; r++) {
+        if (matches(*r, query)) {
+          out.push_back(*r);
+        }
+      }
+      stats->recordsExamined += end - begin;
+    }
+    munmap(base, segmentSize());
+  }
+  return 0;
+}
+
+const char * g18::EventJournal::eventName(const uint8_t type)
+{
+  return type < JOURNAL_EVENT_COUNT ? eventNames[type] : "unknown";
+}
+
+int g18::EventJournal::openSegment(const unsigned number, const bool create)
+{
+  static_assert(sizeof(segment_header_t) <= headerSize, "segment header must fit its page");
+  const std::string path = segmentPath(dir, number);
+  fd = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+  if (fd < 0) {
+    MPLOG_ERROR("opening journal segment %s: %s", path.c_str(), strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if ((create && ftruncate(fd, segmentSize()) != 0) || fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) != segmentSize()) {
+    MPLOG_ERROR("sizing journal segment %s", path.c_str());
+    closeSegment();
+    return -1;
+  }
+  void *base = mmap(NULL, segmentSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    MPLOG_ERROR("mapping journal segment %s: %s", path.c_str(), strerror(errno));
+    closeSegment();
+    return -1;
+  }
+  header = static_cast<segment_header_t *>(base);
+  records = reinterpret_cast<journal_record_t *>(static_cast<char *>(base) + headerSize);
+  segmentNumber = number;
+  if (create) {
+    // The file starts out zeroed
+    header->version = JOURNAL_VERSION;
+    header->sorted = 1;
+    header->capacity = recordsPerSegment;
+    header->minTime = UINT64_MAX;
+    header->minWallNs = UINT64_MAX;
+    header->magic = JOURNAL_MAGIC;
+  } else if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION ||
+             header->capacity != recordsPerSegment) {
+    MPLOG_WARNING("not appending to unrecognized journal segment %s", path.c_str());
+    closeSegment();
+    return -1;
+  }
+  return 0;
+}
+
+void g18::EventJournal::closeSegment()
+{
+  if (header != NULL) {
+    munmap(header, segmentSize());
+    header = NULL;
+    records = NULL;
+  }
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+int g18::EventJournal::rotate()
+{
+  const unsigned next = segmentNumber + 1;
+  closeSegment();
+  if (openSegment(next, true) != 0) {
+    return -1;
+  }
+  if (next >= maxSegments) {
+    // Segments are numbered consecutively, so only one can have aged out,
+    // unless maxSegments shrank since the journal was written
+    std::vector<unsigned> numbers;
+    listSegments(dir, numbers);
+    for (auto it = numbers.begin(); it != numbers.end() && *it <= next - maxSegments; ++it) {
+      unlink(segmentPath(dir, *it).c_str());
+    }
+  }
+  return 0;
+}
+
+size_t g18::EventJournal::segmentSize()
+{
+  return headerSize + recordsPerSegment * sizeof(journal_record_t);
+}
+
+std::string g18::EventJournal::segmentPath(const std::string &dir, const unsigned number)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/%08u" JOURNAL_SEGMENT_SUFFIX, number);
+  return dir + name;
+}
+
+int g18::EventJournal::listSegments(const std::string &dir, std::vector<unsigned> &numbers)
+{
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) {
+    MPLOG_ERROR("opening journal directory %s: %s", dir.c_str(), strerror(errno));
+    return -1;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    unsigned number;
+    char suffix[8];
+    if (sscanf(entry->d_name, "%8u%7s", &number, suffix) == 2 &&
+        strcmp(suffix, JOURNAL_SEGMENT_SUFFIX) == 0) {
+      numbers.push_back(number);
+    }
+  }
+  closedir(d);
+  std::sort(numbers.begin(), numbers.end());
+  return 0;
+}
+
+bool g18::EventJournal::mightMatch(const segment_header_t *header,
+                                   const journal_query_t &query)
+{
+  if (header->count == 0 || header->maxTime < query.from || header->minTime > query.to) {
+    return false;
+  }
+  const unsigned bit = query.ip % nodeBitmapBits;
+  return query.anyNode || (header->nodeBitmap[bit / 64] & (1ULL << (bit % 64))) != 0;
+}
+
+bool g18::EventJournal::matches(const journal_record_t &record,
+                                const journal_query_t &query)
+{
+  return record.time >= query.from && record.time <= query.to &&
+         (query.anyNode || record.node.ip == query.ip) &&
+         (query.typeMask & (1U << record.type)) != 0;
+}
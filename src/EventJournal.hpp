@@ -0,0 +1,130 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+#include "net_types.hpp"
+
+typedef enum {
+  JOURNAL_EVENT_JOINED,
+  JOURNAL_EVENT_LEFT,
+  JOURNAL_EVENT_DIED,
+  JOURNAL_EVENT_HEARTBEAT,
+  JOURNAL_EVENT_MISSED_HEARTBEAT,
+  JOURNAL_EVENT_COUNT
+} journal_event_e;
+
+/// One event as it's stored on disk.
+typedef struct __attribute__((packed)) {
+  uint8_t type; // A journal_event_e
+  uint8_t reserved[3];
+  node_id_t node;
+  lamp_time_t time;
+  /// CLOCK_REALTIME nanoseconds.
+  uint64_t wallNs;
+} journal_record_t;
+
+/// What to look for in a journal. Every field must match.
+typedef struct {
+  /// Only this node's events, unless anyNode is set.
+  bool anyNode;
+  persistent_node_id_t ip;
+  /// Inclusive window of Lamport time.
+  lamp_time_t from, to;
+  /// Bit (1 << type) is set for each journal_event_e wanted.
+  uint32_t typeMask;
+} journal_query_t;
+
+/// How much of the journal a query had to look at.
+typedef struct {
+  size_t segments;
+  size_t segmentsSearched;
+  size_t recordsExamined;
+} journal_query_stats_t;
+
+namespace g18 {
+  /// An append-only binary journal of membership events, split across
+  /// fixed-size memory-mapped segment files in one directory. Each segment's
+  /// header indexes it by the range of Lamport times it covers and a bitmap
+  /// of the nodes it mentions, so a query skips most segments after reading
+  /// one page, and binary searches the rest by time. Only the newest
+  /// maxSegments segments are kept.
+  class EventJournal {
+    public:
+      /// Records in each segment file.
+      static const uint32_t recordsPerSegment = 65536;
+
+      /// Older segments are deleted as new ones are started.
+      static const unsigned maxSegments = 64;
+
+      EventJournal();
+      ~EventJournal();
+
+      /// Start appending to the journal in dir, creating it if need be and
+      /// carrying on from its newest segment. Returns 0 on success.
+      int open(const char *dir);
+
+      bool isOpen() const;
+
+      /// Record an event. Does nothing if the journal isn't open. Returns 0
+      /// on success, -1 on error.
+      int append(const journal_event_e type, const node_id_t &node,
+                 const lamp_time_t time);
+
+      /// Append every record in the journal in dir matching the query to out,
+      /// oldest segment first. stats may be NULL. Returns 0 on success.
+      static int query(const char *dir, const journal_query_t &query,
+                       std::vector<journal_record_t> &out,
+                       journal_query_stats_t *stats = NULL);
+
+      static const char * eventName(const uint8_t type);
+
+    private:
+      /// The first page of every segment. The records follow it.
+      typedef struct {
+        uint32_t magic;
+        uint16_t version;
+        /// Whether the records are in order of time, so we can binary search.
+        uint8_t sorted;
+        uint8_t reserved;
+        uint32_t capacity;
+        /// Published after the record it counts has been written.
+        uint32_t count;
+        lamp_time_t minTime, maxTime;
+        uint64_t minWallNs, maxWallNs;
+        /// Bit (ip % nodeBitmapBits) is set if any record mentions ip.
+        uint64_t nodeBitmap[64];
+      } segment_header_t;
+
+      static const size_t headerSize = 4096;
+      static const unsigned nodeBitmapBits = 64 * 64;
+
+      std::string dir;
+      unsigned segmentNumber;
+      int fd;
+      segment_header_t *header;
+      journal_record_t *records;
+      pthread_mutex_t lock;
+
+      /// Map segment number, creating it if asked to. Returns 0 on success.
+      int openSegment(const unsigned number, const bool create);
+      void closeSegment();
+
+      /// Move on to a fresh segment and delete any that are now too old.
+      int rotate();
+
+      static size_t segmentSize();
+      static std::string segmentPath(const std::string &dir, const unsigned number);
+
+      /// The numbers of the segments in dir, in ascending order.
+      static int listSegments(const std::string &dir, std::vector<unsigned> &numbers);
+
+      /// Whether a segment's index says it might hold matching records.
+      static bool mightMatch(const segment_header_t *header, const journal_query_t &query);
+      static bool matches(const journal_record_t &record, const journal_query_t &query);
+
+      EventJournal(const EventJournal &) = delete;
+      EventJournal & operator=(const EventJournal &) = delete;
+  };
+}
@@ -0,0 +1,217 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "EventLoop.hpp"
+#include "utils.hpp"
+
+#define MAX_EVENTS_PER_WAIT 64
+
+static void * run_loop_forever(void *void_loop);
+
+g18::EventLoop::EventLoop()
+: isRunning(false), isStarted(false), postedLock(PTHREAD_MUTEX_INITIALIZER),
+registrationsLock(PTHREAD_MUTEX_INITIALIZER)
+{
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    MPLOG_ERROR("creating epoll instance: %s", strerror(errno));
+    exit(1);
+  }
+  postfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (postfd < 0 || addReader(postfd, onPosted, this) != 0) {
+    MPLOG_ERROR("creating the event loop's task queue: %s", strerror(errno));
+    exit(1);
+  }
+}
+
+g18::EventLoop::~EventLoop()
+{
+  close(postfd);
+  close(epfd);
+  for (auto it = registrations.begin(); it != registrations.end(); ++it) {
+    delete it->second;
+  }
+  for (auto it = retired.begin(); it != retired.end(); ++it) {
+    delete *it;
+  }
+}
+
+int g18::EventLoop::addReader(const int fd, event_handler_t handler, void *context)
+{
+  registration_t *reg = new registration_t;
+  reg->fd = fd;
+  reg->handler = handler;
+  reg->context = context;
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = reg;
+
+  pthread_mutex_lock(&registrationsLock);
+  if (registrations.count(fd) != 0) {
+    pthread_mutex_unlock(&registrationsLock);
+    MPLOG_ERROR("fd %d is already registered with the event loop", fd);
+    delete reg;
+    return -1;
+  }
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    pthread_mutex_unlock(&registrationsLock);
+    MPLOG_ERROR("adding fd %d to the event loop: %s", fd, strerror(errno));
+    delete reg;
+    return -1;
+  }
+  registrations[fd] = reg;
+  pthread_mutex_unlock(&registrationsLock);
+  return 0;
+}
+
+int g18::EventLoop::removeReader(const int fd)
+{
+  pthread_mutex_lock(&registrationsLock);
+  auto it = registrations.find(fd);
+  if (it == registrations.end()) {
+    pthread_mutex_unlock(&registrationsLock);
+    return -1;
+  }
+  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+  // The loop may still hold this registration from its current epoll_wait
+  // batch, so neuter it now and free it before the next wait.
+  it->second->handler = NULL;
+  retired.push_back(it->second);
+  registrations.erase(it);
+  pthread_mutex_unlock(&registrationsLock);
+  return 0;
+}
+
+void g18::EventLoop::run()
+{
+  isStarted = true;
+  loopThread = pthread_self();
+  isRunning = true;
+  struct epoll_event events[MAX_EVENTS_PER_WAIT];
+  while (true) {
+    pthread_mutex_lock(&registrationsLock);
+    for (auto it = retired.begin(); it != retired.end(); ++it) {
+      delete *it;
+    }
+    retired.clear();
+    pthread_mutex_unlock(&registrationsLock);
+
+    int numEvents = epoll_wait(epfd, events, MAX_EVENTS_PER_WAIT, -1);
+    if (numEvents < 0) {
+      if (errno != EINTR) {
+        MPLOG_ERROR("in epoll_wait: %s", strerror(errno));
+      }
+      continue;
+    }
+    for (int i = 0; i < numEvents; i++) {
+      registration_t *reg = static_cast<registration_t *>(events[i].data.ptr);
+      pthread_mutex_lock(&registrationsLock);
+      const event_handler_t handler = reg->handler;
+      pthread_mutex_unlock(&registrationsLock);
+      if (handler != NULL) {
+        handler(reg->fd, reg->context);
+      }
+    }
+  }
+}
+
+int g18::EventLoop::start()
+{
+  isStarted = true;
+  pthread_t tid;
+  int err = pthread_create(&tid, NULL, run_loop_forever, (void *)this);
+  if (err != 0) {
+    MPLOG_ERROR("starting the event loop thread: %s", strerror(err));
+    return -1;
+  }
+  return 0;
+}
+
+bool g18::EventLoop::isLoopThread() const
+{
+  return isRunning && pthread_equal(loopThread, pthread_self());
+}
+
+bool g18::EventLoop::hasStarted() const
+{
+  return isStarted;
+}
+
+int g18::EventLoop::post(task_t task, void *context)
+{
+  pthread_mutex_lock(&postedLock);
+  posted.push_back(std::make_pair(task, context));
+  pthread_mutex_unlock(&postedLock);
+  const uint64_t one = 1;
+  if (write(postfd, &one, sizeof(one)) != sizeof(one)) {
+    MPLOG_ERROR("waking the event loop: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+void g18::EventLoop::onPosted(int fd, void *context)
+{
+  EventLoop *loop = static_cast<EventLoop *>(context);
+  uint64_t count;
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+    return;
+  }
+  std::vector<std::pair<task_t, void *> > tasks;
+  pthread_mutex_lock(&loop->postedLock);
+  tasks.swap(loop->posted);
+  pthread_mutex_unlock(&loop->postedLock);
+  for (auto it = tasks.begin(); it != tasks.end(); ++it) {
+    it->first(it->second);
+  }
+}
+
+int g18::EventLoop::createTimer()
+{
+  int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerfd < 0) {
+    MPLOG_ERROR("creating timer: %s", strerror(errno));
+  }
+  return timerfd;
+}
+
+int g18::EventLoop::armTimer(const int timerfd, const uint64_t initialMs,
+                             const uint64_t intervalMs)
+{
+  struct itimerspec spec;
+  spec.it_value.tv_sec = initialMs / 1000;
+  spec.it_value.tv_nsec = (initialMs % 1000) * 1000000;
+  spec.it_interval.tv_sec = intervalMs / 1000;
+  spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000;
+  if (timerfd_settime(timerfd, 0, &spec, NULL) != 0) {
+    MPLOG_ERROR("arming timer: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+uint64_t g18::EventLoop::drainTimer(const int timerfd)
+{
+  uint64_t expirations = 0;
+  if (read(timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    // EAGAIN: the timer was re-armed after epoll reported it
+    return 0;
+  }
+  return expirations;
+}
+
+static void * run_loop_forever(void *void_loop)
+{
+  g18::EventLoop *loop = static_cast<g18::EventLoop *>(void_loop);
+  if (loop == NULL) {
+    MPLOG_ERROR("Got a NULL event loop");
+    return NULL;
+  }
+  loop->run();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+namespace g18 {
+  /// A single-threaded epoll reactor. File descriptors (sockets and timerfds)
+  /// are registered with a handler that runs on the loop thread whenever the
+  /// descriptor becomes readable. Other threads hand it work with post().
+  class EventLoop {
+    public:
+      /// Called on the loop thread when fd is readable.
+      typedef void (*event_handler_t)(int fd, void *context);
+
+      /// Called on the loop thread for work posted from another.
+      typedef void (*task_t)(void *context);
+
+      EventLoop();
+      ~EventLoop();
+
+      /// Start watching fd for readability. Returns 0 on success, -1 on error.
+      int addReader(const int fd, event_handler_t handler, void *context);
+
+      /// Stop watching fd. The caller still owns (and must close) it.
+      int removeReader(const int fd);
+
+      /// Run the loop on the calling thread. Never returns.
+      void run() __attribute__((noreturn));
+
+      /// Run the loop on a new thread. Returns 0 on success, -1 on error.
+      int start();
+
+      /// Whether the calling thread is the one running the loop.
+      bool isLoopThread() const;
+
+      /// Whether start() or run() has been called. Until then, whoever set
+      /// the loop up owns everything its handlers touch.
+      bool hasStarted() const;
+
+      /// Run task(context) on the loop thread, after the handlers it's in the
+      /// middle of. Safe from any thread. Returns 0 on success, -1 on error.
+      int post(task_t task, void *context);
+
+      /// Create a CLOCK_MONOTONIC timerfd. Returns -1 on error.
+      static int createTimer();
+
+      /// Arm a timer to fire once after initialMs, then every intervalMs (or
+      /// never again if intervalMs is zero). Returns 0 on success, -1 on error.
+      static int armTimer(const int timerfd, const uint64_t initialMs,
+                          const uint64_t intervalMs);
+
+      /// Consume a timer's expirations. Returns how many have occurred since
+      /// the last call (possibly zero).
+      static uint64_t drainTimer(const int timerfd);
+
+    private:
+      typedef struct {
+        int fd;
+        event_handler_t handler;
+        void *context;
+      } registration_t;
+
+      int epfd;
+      pthread_t loopThread;
+      /// Set once loopThread is.
+      std::atomic<bool> isRunning;
+      std::atomic<bool> isStarted;
+
+      /// Readable while there are posted tasks to run.
+      int postfd;
+      std::vector<std::pair<task_t, void *> > posted;
+      pthread_mutex_t postedLock;
+
+      static void onPosted(int fd, void *context);
+
+      /// Registrations by fd. Guarded so handlers can be added from any thread.
+      std::map<int, registration_t *> registrations;
+      pthread_mutex_t registrationsLock;
+
+      /// Removed registrations awaiting the end of the current dispatch round.
+      std::vector<registration_t *> retired;
+
+      EventLoop(const EventLoop &) = delete;
+      EventLoop & operator=(const EventLoop &) = delete;
+  };
+}
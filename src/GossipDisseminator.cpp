@@ -0,0 +1,143 @@
+#include <algorithm>
+#include "GossipDisseminator.hpp"
+
+const unsigned g18::GossipDisseminator::defaultFanout;
+const unsigned g18::GossipDisseminator::retransmitMultiplier;
+
+g18::GossipDisseminator::GossipDisseminator(const unsigned fanout, const unsigned seed)
+: fanout(fanout), seed(seed)
+{
+}
+
+void g18::GossipDisseminator::enqueue(const node_id_t &node, const node_state_e state)
+{
+  for (auto it = pending.begin(); it != pending.end(); ++it) {
+    if (it->change.state == state && isEqual(it->change.id, node)) {
+      it->transmissions = 0;
+      return;
+    }
+  }
+  const pending_change_t entry = {{node, state}, 0};
+  pending.push_back(entry);
+}
+
+void g18::GossipDisseminator::enqueue(const changelist_t &msg)
+{
+  for (auto it = msg.joined.begin(); it != msg.joined.end(); ++it) {
+    enqueue(*it, NODE_STATE_ONLINE);
+  }
+  for (auto it = msg.left.begin(); it != msg.left.end(); ++it) {
+    enqueue(*it, NODE_STATE_DEPARTED);
+  }
+  for (auto it = msg.failed.begin(); it != msg.failed.end(); ++it) {
+    enqueue(*it, NODE_STATE_DIED);
+  }
+}
+
+void g18::GossipDisseminator::chooseTargets(const MembershipSnapshot &members,
+                                            const node_id_t &self,
+                                            std::vector<persistent_node_id_t> &out)
+{
+  out.clear();
+  std::vector<node_id_t> random;
+  members.sampleLive(fanout, std::vector<node_id_t>(1, self), &seed, random);
+  for (auto it = random.begin(); it != random.end(); ++it) {
+    out.push_back(it->ip);
+  }
+}
+
+size_t g18::GossipDisseminator::nextRound(const size_t clusterSize, changelist_t &out,
+                                          const size_t maxChanges)
+{
+  const unsigned limit = retransmitLimit(clusterSize);
+  std::vector<bool> chosen(pending.size(), true);
+  if (maxChanges < pending.size()) {
+    // A stable sort keeps the oldest first among those sent equally often
+    std::vector<size_t> order(pending.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      return pending[a].transmissions < pending[b].transmissions;
+    });
+    for (size_t i = maxChanges; i < order.size(); i++) {
+      chosen[order[i]] = false;
+    }
+  }
+  size_t count = 0, kept = 0;
+  for (size_t i = 0; i < pending.size(); i++) {
+    pending_change_t &p = pending[i];
+    if (!chosen[i]) {
+      pending[kept++] = p;
+      continue;
+    }
+    switch (p.change.state) {
+    case NODE_STATE_ONLINE:
+      out.joined.push_back(p.change.id);
+      break;
+    case NODE_STATE_DEPARTED:
+      out.left.push_back(p.change.id);
+      break;
+    case NODE_STATE_DIED:
+      out.failed.push_back(p.change.id);
+      break;
+    }
+    count++;
+    if (++p.transmissions < limit) {
+      pending[kept++] = p;
+    }
+  }
+  pending.resize(kept);
+  return count;
+}
+
+size_t g18::GossipDisseminator::prune(const size_t maxPending)
+{
+  if (pending.size() <= maxPending) {
+    return 0;
+  }
+  std::vector<size_t> order(pending.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return pending[a].transmissions > pending[b].transmissions;
+  });
+  std::vector<bool> dropped(pending.size(), false);
+  const size_t excess = pending.size() - maxPending;
+  size_t count = 0;
+  for (size_t i = 0; i < order.size() && count < excess; i++) {
+    if (pending[order[i]].transmissions == 0) {
+      break;
+    }
+    dropped[order[i]] = true;
+    count++;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < pending.size(); i++) {
+    if (!dropped[i]) {
+      pending[kept++] = pending[i];
+    }
+  }
+  pending.resize(kept);
+  return count;
+}
+
+size_t g18::GossipDisseminator::size() const
+{
+  return pending.size();
+}
+
+bool g18::GossipDisseminator::empty() const
+{
+  return pending.empty();
+}
+
+unsigned g18::GossipDisseminator::retransmitLimit(const size_t n)
+{
+  unsigned rounds = 0;
+  while ((static_cast<size_t>(1) << rounds) < n + 1) {
+    rounds++;
+  }
+  return retransmitMultiplier * std::max(rounds, 1u);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+#include "ChangeSet.hpp"
+#include "MembershipSnapshot.hpp"
+#include "net_types.hpp"
+
+namespace g18 {
+  /// Spreads membership changes SWIM-style: every round, all the changes
+  /// still pending go to a few members picked at random, and each change is
+  /// retired after it's been sent about log(n) times. Changes reach everyone
+  /// in O(log n) rounds with high probability, however slow any one member
+  /// is. Rounds can also be capped and ride along on heartbeats instead.
+  /// Not thread-safe; the Daemon guards it with deltaLock.
+  class GossipDisseminator {
+    public:
+      /// Members each round is sent to.
+      static const unsigned defaultFanout = 3;
+
+      /// Each change is sent in this many times log2(n + 1) rounds.
+      static const unsigned retransmitMultiplier = 3;
+
+      GossipDisseminator(const unsigned fanout = defaultFanout,
+                         const unsigned seed = 1);
+
+      /// Queue a change to go out from the next round on. A change that's
+      /// already queued starts its retransmissions over.
+      void enqueue(const node_id_t &node, const node_state_e state);
+
+      /// Queue every change in the changelist.
+      void enqueue(const changelist_t &msg);
+
+      /// Pick the next round's recipients: up to fanout online members other
+      /// than self, uniformly at random.
+      void chooseTargets(const MembershipSnapshot &members, const node_id_t &self,
+                         std::vector<persistent_node_id_t> &out);
+
+      /// Append up to maxChanges pending changes to out and count each as sent
+      /// once more, retiring those that have now been sent
+      /// retransmitLimit(clusterSize) times. If they don't all fit, the ones
+      /// sent the fewest times go first, and the oldest of those. Returns how
+      /// many changes were appended.
+      size_t nextRound(const size_t clusterSize, changelist_t &out,
+                       const size_t maxChanges = SIZE_MAX);
+
+      /// Drop the changes sent the most times, the oldest first among equals,
+      /// until no more than maxPending are left. Changes that haven't been sent
+      /// yet are always kept. Returns how many were dropped.
+      size_t prune(const size_t maxPending);
+
+      /// Number of changes still to be sent.
+      size_t size() const;
+      bool empty() const;
+
+      /// How many rounds a change is sent in, in a cluster of n members.
+      static unsigned retransmitLimit(const size_t n);
+
+    private:
+      typedef struct {
+        change_t change;
+        unsigned transmissions;
+      } pending_change_t;
+
+      const unsigned fanout;
+      unsigned seed;
+
+      /// Oldest first. Short-lived, since changes retire after a few rounds.
+      std::vector<pending_change_t> pending;
+
+      GossipDisseminator(const GossipDisseminator &) = delete;
+      GossipDisseminator & operator=(const GossipDisseminator &) = delete;
+  };
+}
@@ -0,0 +1,167 @@
+#include <cerrno>
+#include <cstring>
+#include <sched.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "HeartbeatScheduler.hpp"
+#include "utils.hpp"
+
+#define NS_PER_MS 1000000ULL
+#define NS_PER_US 1000ULL
+
+g18::HeartbeatScheduler::HeartbeatScheduler(const unsigned periodMs,
+                                            tick_handler_t handler,
+                                            void *context)
+: periodNs(periodMs * NS_PER_MS), handler(handler), context(context),
+timerfd(-1), priority(0), cpu(-1), nextDeadlineNs(0), lastTickNs(0),
+lateCount(0), skippedCount(0)
+{
+}
+
+g18::HeartbeatScheduler::~HeartbeatScheduler()
+{
+  if (timerfd >= 0) {
+    close(timerfd);
+  }
+}
+
+int g18::HeartbeatScheduler::start(EventLoop &loop)
+{
+  if (prepare(true) != 0) {
+    return -1;
+  }
+  return loop.addReader(timerfd, onTimer, this);
+}
+
+int g18::HeartbeatScheduler::startDedicated(const int priority, const int cpu)
+{
+  this->priority = priority;
+  this->cpu = cpu;
+  if (prepare(false) != 0) {
+    return -1;
+  }
+  pthread_t tid;
+  int err = pthread_create(&tid, NULL, runDedicated, (void *)this);
+  if (err != 0) {
+    MPLOG_ERROR("starting the heartbeat thread: %s", strerror(err));
+    return -1;
+  }
+  return 0;
+}
+
+unsigned g18::HeartbeatScheduler::getPeriodMs() const
+{
+  return static_cast<unsigned>(periodNs / NS_PER_MS);
+}
+
+const g18::Histogram & g18::HeartbeatScheduler::getIntervalHistogram() const
+{
+  return intervalHistogram;
+}
+
+uint64_t g18::HeartbeatScheduler::getLateCount() const
+{
+  return lateCount.load();
+}
+
+uint64_t g18::HeartbeatScheduler::getSkippedCount() const
+{
+  return skippedCount.load();
+}
+
+int g18::HeartbeatScheduler::prepare(const bool nonBlocking)
+{
+  timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | (nonBlocking ? TFD_NONBLOCK : 0));
+  if (timerfd < 0) {
+    MPLOG_ERROR("creating heartbeat timer: %s", strerror(errno));
+    return -1;
+  }
+  nextDeadlineNs = monotonic_time_ns() + periodNs;
+  return armNextDeadline();
+}
+
+void g18::HeartbeatScheduler::tick()
+{
+  const uint64_t now = monotonic_time_ns();
+  if (lastTickNs != 0) {
+    const uint64_t interval = now - lastTickNs;
+    intervalHistogram.record(interval / NS_PER_US);
+    if (interval > periodNs + periodNs / 2) {
+      lateCount++;
+      MPLOG_WARNING("heartbeat is %llu us late",
+            (unsigned long long)((interval - periodNs) / NS_PER_US));
+    }
+  }
+  lastTickNs = now;
+
+  handler(context);
+
+  // Stay on the original schedule. If we've fallen a whole period or more
+  // behind, drop the ticks we missed instead of sending a burst.
+  nextDeadlineNs += periodNs;
+  const uint64_t after = monotonic_time_ns();
+  if (nextDeadlineNs <= after) {
+    const uint64_t missed = (after - nextDeadlineNs) / periodNs + 1;
+    skippedCount += missed;
+    nextDeadlineNs += missed * periodNs;
+  }
+  armNextDeadline();
+}
+
+int g18::HeartbeatScheduler::armNextDeadline()
+{
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = nextDeadlineNs / 1000000000ULL;
+  spec.it_value.tv_nsec = nextDeadlineNs % 1000000000ULL;
+  if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+    MPLOG_ERROR("arming heartbeat timer: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+void g18::HeartbeatScheduler::onTimer(int fd, void *context)
+{
+  g18::HeartbeatScheduler *scheduler = static_cast<g18::HeartbeatScheduler *>(context);
+  if (EventLoop::drainTimer(fd) == 0) {
+    return; // Spurious wakeup
+  }
+  scheduler->tick();
+}
+
+void * g18::HeartbeatScheduler::runDedicated(void *void_scheduler)
+{
+  g18::HeartbeatScheduler *scheduler = static_cast<g18::HeartbeatScheduler *>(void_scheduler);
+  if (scheduler->cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(scheduler->cpu, &cpus);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0) {
+      MPLOG_WARNING("unable to pin heartbeats to CPU %d: %s",
+            scheduler->cpu, strerror(err));
+    }
+  }
+  if (scheduler->priority > 0) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = scheduler->priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+      MPLOG_WARNING("unable to raise heartbeat priority to %d: %s",
+            scheduler->priority, strerror(err));
+    }
+  }
+  while (true) {
+    uint64_t expirations;
+    if (read(scheduler->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+      if (errno != EINTR) {
+        MPLOG_ERROR("waiting on heartbeat timer: %s", strerror(errno));
+      }
+      continue;
+    }
+    scheduler->tick();
+  }
+  return NULL;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <pthread.h>
+#include <stdint.h>
+#include "EventLoop.hpp"
+#include "Histogram.hpp"
+
+namespace g18 {
+  /// Calls a handler at a fixed period off a CLOCK_MONOTONIC timerfd. Each
+  /// deadline is computed from the schedule's start rather than from the
+  /// previous tick, so a late tick doesn't push back every tick after it.
+  /// Records the actual interval between ticks so late sends are visible.
+  class HeartbeatScheduler {
+    public:
+      typedef void (*tick_handler_t)(void *context);
+
+      HeartbeatScheduler(const unsigned periodMs, tick_handler_t handler,
+                         void *context);
+      ~HeartbeatScheduler();
+
+      /// Tick on the given event loop. Returns 0 on success, -1 on error.
+      int start(EventLoop &loop);
+
+      /// Tick on a dedicated thread, optionally at SCHED_FIFO priority
+      /// (0 to leave it alone) and pinned to a CPU (-1 to leave it alone).
+      /// Returns 0 on success, -1 on error.
+      int startDedicated(const int priority, const int cpu);
+
+      unsigned getPeriodMs() const;
+
+      /// Actual intervals between ticks, in microseconds.
+      const Histogram & getIntervalHistogram() const;
+
+      /// Ticks that came more than half a period late.
+      uint64_t getLateCount() const;
+
+      /// Ticks that were dropped entirely because we fell a full period behind.
+      uint64_t getSkippedCount() const;
+
+    private:
+      const uint64_t periodNs;
+      tick_handler_t handler;
+      void *context;
+
+      int timerfd;
+      int priority;
+      int cpu;
+
+      /// Absolute CLOCK_MONOTONIC deadline of the next tick, in nanoseconds.
+      uint64_t nextDeadlineNs;
+      /// When the last tick actually ran, in nanoseconds. Zero before the first.
+      uint64_t lastTickNs;
+
+      Histogram intervalHistogram;
+      std::atomic<uint64_t> lateCount;
+      std::atomic<uint64_t> skippedCount;
+
+      /// Open the timer and arm the first deadline.
+      int prepare(const bool nonBlocking);
+
+      /// Handle an expiration: run the handler and arm the next deadline.
+      void tick();
+
+      /// Arm the timer for nextDeadlineNs.
+      int armNextDeadline();
+
+      static void onTimer(int fd, void *context);
+      static void * runDedicated(void *void_scheduler);
+
+      HeartbeatScheduler(const HeartbeatScheduler &) = delete;
+      HeartbeatScheduler & operator=(const HeartbeatScheduler &) = delete;
+  };
+}
@@ -0,0 +1,116 @@
+#include <cstdio>
+#include "Histogram.hpp"
+
+g18::Histogram::Histogram()
+{
+  reset();
+}
+
+void g18::Histogram::record(const uint64_t value)
+{
+  buckets[indexFor(value)].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(value, std::memory_order_relaxed);
+  uint64_t seen = minValue.load(std::memory_order_relaxed);
+  while (value < seen &&
+         !minValue.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    // Lost a race; seen has been refreshed
+  }
+  seen = maxValue.load(std::memory_order_relaxed);
+  while (value > seen &&
+         !maxValue.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    // Lost a race; seen has been refreshed
+  }
+}
+
+void g18::Histogram::reset()
+{
+  for (unsigned i = 0; i < numBuckets; i++) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+  total.store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+  minValue.store(UINT64_MAX, std::memory_order_relaxed);
+  maxValue.store(0, std::memory_order_relaxed);
+}
+
+uint64_t g18::Histogram::count() const
+{
+  return total.load(std::memory_order_relaxed);
+}
+
+uint64_t g18::Histogram::min() const
+{
+  return count() == 0 ? 0 : minValue.load(std::memory_order_relaxed);
+}
+
+uint64_t g18::Histogram::max() const
+{
+  return maxValue.load(std::memory_order_relaxed);
+}
+
+double g18::Histogram::mean() const
+{
+  const uint64_t n = count();
+  if (n == 0) {
+    return 0.0;
+  }
+  return static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+}
+
+uint64_t g18::Histogram::percentile(const double p) const
+{
+  const uint64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  uint64_t target = static_cast<uint64_t>(p * n + 0.5);
+  if (target == 0) {
+    target = 1;
+  }
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < numBuckets; i++) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= target) {
+      // Never report past what we've actually seen
+      const uint64_t value = highestValueIn(i);
+      return value < max() ? value : max();
+    }
+  }
+  return max();
+}
+
+std::string g18::Histogram::summary() const
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "n=%llu min=%llu p50=%llu p90=%llu p99=%llu p999=%llu max=%llu mean=%.1f",
+           (unsigned long long)count(), (unsigned long long)min(),
+           (unsigned long long)percentile(0.5), (unsigned long long)percentile(0.9),
+           (unsigned long long)percentile(0.99), (unsigned long long)percentile(0.999),
+           (unsigned long long)max(), mean());
+  return std::string(buf);
+}
+
+unsigned g18::Histogram::indexFor(const uint64_t value)
+{
+  if (value < subBuckets) {
+    return static_cast<unsigned>(value);
+  }
+  // Values in [2^m, 2^(m+1)) share subBuckets linear sub-buckets
+  const unsigned m = 63 - __builtin_clzll(value);
+  const unsigned shift = m - subBucketBits;
+  return (m - subBucketBits + 1) * subBuckets +
+         static_cast<unsigned>((value >> shift) - subBuckets);
+}
+
+uint64_t g18::Histogram::highestValueIn(const unsigned index)
+{
+  if (index < subBuckets) {
+    return index;
+  }
+  const unsigned m = index / subBuckets + subBucketBits - 1;
+  const unsigned shift = m - subBucketBits;
+  const uint64_t low = static_cast<uint64_t>(index % subBuckets + subBuckets) << shift;
+  return low + ((static_cast<uint64_t>(1) << shift) - 1);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+namespace g18 {
+  /// A log-linear histogram of non-negative integer samples in the style of
+  /// HdrHistogram. Values are bucketed by power of two, and each power of two
+  /// is split into subBuckets linear sub-buckets, which bounds the relative
+  /// error of any reported value to 1/subBuckets. Recording is lock-free and
+  /// may happen from any thread.
+  class Histogram {
+    public:
+      Histogram();
+
+      /// Add a sample.
+      void record(const uint64_t value);
+
+      /// Forget every sample.
+      void reset();
+
+      /// Number of samples recorded.
+      uint64_t count() const;
+
+      uint64_t min() const;
+      uint64_t max() const;
+      double mean() const;
+
+      /// The smallest value such that at least fraction p (0 to 1) of the
+      /// samples are at or below it. Returns 0 if there are no samples.
+      uint64_t percentile(const double p) const;
+
+      /// Summarize as "n=.. min=.. p50=.. p90=.. p99=.. p999=.. max=.. mean=..".
+      std::string summary() const;
+
+    private:
+      static const unsigned subBucketBits = 5;
+      static const unsigned subBuckets = 1 << subBucketBits;
+      static const unsigned numBuckets = (64 - subBucketBits + 1) * subBuckets;
+
+      std::atomic<uint64_t> buckets[numBuckets];
+      std::atomic<uint64_t> total;
+      std::atomic<uint64_t> sum;
+      std::atomic<uint64_t> minValue;
+      std::atomic<uint64_t> maxValue;
+
+      static unsigned indexFor(const uint64_t value);
+      static uint64_t highestValueIn(const unsigned index);
+
+      Histogram(const Histogram &) = delete;
+      Histogram & operator=(const Histogram &) = delete;
+  };
+}
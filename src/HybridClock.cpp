@@ -0,0 +1,54 @@
+#include <time.h>
+#include "HybridClock.hpp"
+
+const uint64_t g18::HybridClock::defaultMaxSkewMs;
+
+g18::HybridClock::HybridClock(const uint64_t maxSkewMs)
+: last(physicalNow()), maxSkew(static_cast<lamp_time_t>(maxSkewMs) << logicalBits)
+{
+}
+
+lamp_time_t g18::HybridClock::now() const
+{
+  return last.load();
+}
+
+lamp_time_t g18::HybridClock::tick()
+{
+  return update(0);
+}
+
+lamp_time_t g18::HybridClock::update(const lamp_time_t remote)
+{
+  // The next value is past everything we've seen: our last value, the
+  // remote's, and the wall clock. Falling behind the wall clock resets the
+  // logical counter; if the counter ever overflows, it carries into the
+  // physical part. A remote too far ahead is ignored rather than followed,
+  // which also keeps every value far enough from overflowing.
+  const lamp_time_t physical = physicalNow();
+  const lamp_time_t seen = (remote > physical + maxSkew) ? 0 : remote;
+  lamp_time_t prev = last.load(std::memory_order_relaxed);
+  lamp_time_t next;
+  do {
+    next = MAX(MAX(prev, seen) + 1, physical);
+  } while (!last.compare_exchange_weak(prev, next));
+  return next;
+}
+
+uint64_t g18::HybridClock::physicalPart(const lamp_time_t time)
+{
+  return time >> logicalBits;
+}
+
+uint64_t g18::HybridClock::logicalPart(const lamp_time_t time)
+{
+  return time & ((static_cast<lamp_time_t>(1) << logicalBits) - 1);
+}
+
+lamp_time_t g18::HybridClock::physicalNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  const uint64_t ms = static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+  return static_cast<lamp_time_t>(ms) << logicalBits;
+}
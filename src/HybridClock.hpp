@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include "net_types.hpp"
+
+namespace g18 {
+  /// A hybrid logical clock. Each value is a wall-clock millisecond in the
+  /// upper 48 bits and a logical counter in the lower 16, so values track
+  /// real time closely but still order causally related events the way a
+  /// Lamport clock would. Updates are a lock-free compare-and-swap and may
+  /// come from any thread. A value from another node whose wall-clock part
+  /// is more than maxSkewMs ahead of ours is ignored, so that one node's bad
+  /// clock, or a corrupt timestamp, can't drag everyone's forward for good.
+  class HybridClock {
+    public:
+      static const unsigned logicalBits = 16;
+
+      /// How far ahead of our wall clock a remote value may be.
+      static const uint64_t defaultMaxSkewMs = 10000;
+
+      HybridClock(const uint64_t maxSkewMs = defaultMaxSkewMs);
+
+      /// The most recent value handed out.
+      lamp_time_t now() const;
+
+      /// Advance the clock for a local event and return the new value.
+      lamp_time_t tick();
+
+      /// Advance the clock past a value received from another node and
+      /// return the new value. That's only not past remote if remote was too
+      /// far ahead, and ignored.
+      lamp_time_t update(const lamp_time_t remote);
+
+      /// The wall-clock milliseconds and logical counter of a value.
+      static uint64_t physicalPart(const lamp_time_t time);
+      static uint64_t logicalPart(const lamp_time_t time);
+
+    private:
+      std::atomic<lamp_time_t> last;
+      const lamp_time_t maxSkew;
+
+      /// Wall-clock time, in the same units as the clock.
+      static lamp_time_t physicalNow();
+
+      HybridClock(const HybridClock &) = delete;
+      HybridClock & operator=(const HybridClock &) = delete;
+  };
+}
@@ -0,0 +1,101 @@
+#include "IndirectProber.hpp"
+
+const unsigned g18::IndirectProber::defaultHelpers;
+
+g18::IndirectProber::IndirectProber(const unsigned numHelpers, const unsigned seed)
+: numHelpers(numHelpers), seed(seed), nextSeq(1)
+{
+}
+
+void g18::IndirectProber::begin(const node_id_t &target, const node_id_t &self,
+                                const MembershipSnapshot &members,
+                                const uint64_t nowNs,
+                                std::vector<probe_t> &probes,
+                                std::vector<persistent_node_id_t> &recipients)
+{
+  const outstanding_t probe = {target, nextSeq++, nowNs};
+  probing[target.ip] = probe;
+
+  probes.clear();
+  recipients.clear();
+  const probe_t ping = {WIRE_MSG_PING, probe.seq, self.ip, 0, target};
+  probes.push_back(ping);
+  recipients.push_back(target.ip);
+
+  std::vector<node_id_t> exclude, helpers;
+  exclude.push_back(self);
+  exclude.push_back(target);
+  members.sampleLive(numHelpers, exclude, &seed, helpers);
+  for (auto it = helpers.begin(); it != helpers.end(); ++it) {
+    const probe_t request = {WIRE_MSG_PING_REQ, probe.seq, self.ip, it->ip, target};
+    probes.push_back(request);
+    recipients.push_back(it->ip);
+  }
+}
+
+bool g18::IndirectProber::isProbing(const node_id_t &target) const
+{
+  auto it = probing.find(target.ip);
+  return it != probing.end() && isEqual(it->second.target, target);
+}
+
+int g18::IndirectProber::acknowledge(const probe_t &ack, const uint64_t nowNs,
+                                     uint64_t &rttNs)
+{
+  auto it = probing.find(ack.target.ip);
+  if (ack.type != WIRE_MSG_ACK || it == probing.end() ||
+      it->second.seq != ack.seq || !isEqual(it->second.target, ack.target)) {
+    return -1;
+  }
+  rttNs = nowNs - it->second.startedNs;
+  probing.erase(it);
+  return 0;
+}
+
+bool g18::IndirectProber::end(const node_id_t &target)
+{
+  if (!isProbing(target)) {
+    return false;
+  }
+  probing.erase(target.ip);
+  return true;
+}
+
+size_t g18::IndirectProber::size() const
+{
+  return probing.size();
+}
+
+int g18::IndirectProber::respond(const probe_t &in, const node_id_t &self,
+                                 probe_t &reply, persistent_node_id_t &to)
+{
+  reply = in;
+  switch (in.type) {
+  case WIRE_MSG_PING_REQ:
+    // Ping the target for the origin, and have the ack come back through us
+    if (in.relay != self.ip) {
+      return -1;
+    }
+    reply.type = WIRE_MSG_PING;
+    to = in.target.ip;
+    return 0;
+  case WIRE_MSG_PING:
+    // A ping for an earlier incarnation of us should go unanswered, so that
+    // the group finishes declaring it dead
+    if (!isEqual(in.target, self)) {
+      return -1;
+    }
+    reply.type = WIRE_MSG_ACK;
+    to = in.relay != 0 ? in.relay : in.origin;
+    return 0;
+  case WIRE_MSG_ACK:
+    // Pass an ack for someone else's ping request back to them
+    if (in.relay != self.ip || in.origin == self.ip) {
+      return -1;
+    }
+    to = in.origin;
+    return 0;
+  default:
+    return -1;
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "MembershipSnapshot.hpp"
+#include "codec.hpp"
+#include "net_types.hpp"
+
+namespace g18 {
+  /// Probes nodes we suspect before we declare them dead, SWIM-style. A
+  /// missed heartbeat may only mean a dropped packet or a congested link, so
+  /// we ping the suspect directly and ask a few other members to ping it for
+  /// us, over paths that don't share ours. Any ack clears it. Holds no
+  /// sockets; the Daemon sends what it's given. Not thread-safe.
+  class IndirectProber {
+    public:
+      /// Members asked to ping a suspect on our behalf.
+      static const unsigned defaultHelpers = 3;
+
+      IndirectProber(const unsigned numHelpers = defaultHelpers,
+                     const unsigned seed = 1);
+
+      /// Start probing target at nowNs. Fills in the probes to send and who
+      /// to send each one to: a ping to the target, then a ping request to
+      /// each helper picked from members.
+      void begin(const node_id_t &target, const node_id_t &self,
+                 const MembershipSnapshot &members, const uint64_t nowNs,
+                 std::vector<probe_t> &probes,
+                 std::vector<persistent_node_id_t> &recipients);
+
+      /// Whether we're currently probing this exact node.
+      bool isProbing(const node_id_t &target) const;
+
+      /// Match an ack addressed to us to the probe it answers, and end that
+      /// probe. Returns 0 with the time since it began, or -1 if it's for no
+      /// probe in progress, such as a second ack for the same one.
+      int acknowledge(const probe_t &ack, const uint64_t nowNs, uint64_t &rttNs);
+
+      /// Stop probing target. Returns whether we were.
+      bool end(const node_id_t &target);
+
+      /// Number of probes in progress.
+      size_t size() const;
+
+      /// What a node with ID self should send on receiving a probe message
+      /// that isn't an ack to its own probe: a ping on the origin's behalf, an
+      /// ack, or an ack passed back to its origin. Returns 0 with the reply and
+      /// its recipient, or -1 if there's nothing to send, as for a ping to an
+      /// older incarnation of self.
+      static int respond(const probe_t &in, const node_id_t &self,
+                         probe_t &reply, persistent_node_id_t &to);
+
+    private:
+      typedef struct {
+        node_id_t target;
+        uint32_t seq;
+        uint64_t startedNs;
+      } outstanding_t;
+
+      const unsigned numHelpers;
+      unsigned seed;
+      uint32_t nextSeq;
+
+      /// Probes in progress, by the target's IP.
+      std::unordered_map<persistent_node_id_t, outstanding_t> probing;
+
+      IndirectProber(const IndirectProber &) = delete;
+      IndirectProber & operator=(const IndirectProber &) = delete;
+  };
+}
@@ -0,0 +1,41 @@
+#include "JoinAdmissionQueue.hpp"
+
+const unsigned g18::JoinAdmissionQueue::defaultWindowMs;
+const size_t g18::JoinAdmissionQueue::maxBatch;
+
+g18::JoinAdmissionQueue::JoinAdmissionQueue(const unsigned windowMs)
+: windowMs(windowMs)
+{
+}
+
+bool g18::JoinAdmissionQueue::add(const node_id_t &node)
+{
+  if (!queued.insert(node.ip).second) {
+    return false; // A retry while it waits
+  }
+  pending.push_back(node);
+  return pending.size() == 1;
+}
+
+bool g18::JoinAdmissionQueue::isFull() const
+{
+  return pending.size() >= maxBatch;
+}
+
+size_t g18::JoinAdmissionQueue::take(std::vector<node_id_t> &out)
+{
+  out.swap(pending);
+  pending.clear();
+  queued.clear();
+  return out.size();
+}
+
+size_t g18::JoinAdmissionQueue::size() const
+{
+  return pending.size();
+}
+
+unsigned g18::JoinAdmissionQueue::getWindowMs() const
+{
+  return windowMs;
+}
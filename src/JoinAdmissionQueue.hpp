@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+#include "net_types.hpp"
+
+namespace g18 {
+  /// Holds join requests at a member for a short window and hands them
+  /// over as one batch, so that a deploy of hundreds of nodes costs the group
+  /// a membership update and a dissemination round per batch rather than per
+  /// node. A node asking again while it waits is only queued once, as it
+  /// first asked. Not thread-safe.
+  class JoinAdmissionQueue {
+    public:
+      /// How long the first request of a batch waits for others.
+      static const unsigned defaultWindowMs = 100;
+
+      /// A batch this big is admitted without waiting out its window, which
+      /// bounds how long one admission holds up the event loop.
+      static const size_t maxBatch = 256;
+
+      JoinAdmissionQueue(const unsigned windowMs = defaultWindowMs);
+
+      /// Queue a join request from a node. Returns true if it opened a new
+      /// window, in which case the batch is due windowMs from now.
+      bool add(const node_id_t &node);
+
+      /// Whether the batch should be admitted now, without waiting out its
+      /// window.
+      bool isFull() const;
+
+      /// Move everything queued to out, in the order it was asked for, and
+      /// close the window. Returns how many there were.
+      size_t take(std::vector<node_id_t> &out);
+
+      /// Number of requests waiting.
+      size_t size() const;
+
+      unsigned getWindowMs() const;
+
+    private:
+      const unsigned windowMs;
+      std::vector<node_id_t> pending;
+
+      /// The IPs in pending.
+      std::unordered_set<persistent_node_id_t> queued;
+
+      JoinAdmissionQueue(const JoinAdmissionQueue &) = delete;
+      JoinAdmissionQueue & operator=(const JoinAdmissionQueue &) = delete;
+  };
+}
@@ -0,0 +1,47 @@
+#include <algorithm>
+#include <cstdlib>
+#include "JoinBackoff.hpp"
+
+const unsigned g18::JoinBackoff::defaultBaseMs;
+const unsigned g18::JoinBackoff::defaultMaxMs;
+
+g18::JoinBackoff::JoinBackoff(const std::vector<persistent_node_id_t> &seeds,
+                              const unsigned seed, const unsigned baseMs,
+                              const unsigned maxMs)
+: seeds(seeds), baseMs(baseMs), maxMs(maxMs), seed(seed), nextSeed(0), attempts(0)
+{
+  if (!seeds.empty()) {
+    nextSeed = rand_r(&this->seed) % seeds.size();
+  }
+}
+
+persistent_node_id_t g18::JoinBackoff::next(uint64_t &waitMs)
+{
+  const persistent_node_id_t to = seeds[nextSeed];
+  nextSeed = (nextSeed + 1) % seeds.size();
+  waitMs = delayMs(attempts++, baseMs, maxMs, &seed);
+  return to;
+}
+
+unsigned g18::JoinBackoff::getAttempts() const
+{
+  return attempts;
+}
+
+bool g18::JoinBackoff::hasAskedEverySeed() const
+{
+  return attempts >= seeds.size();
+}
+
+uint64_t g18::JoinBackoff::delayMs(const unsigned attempt, const unsigned baseMs,
+                                   const unsigned maxMs, unsigned *seed)
+{
+  // Past the cap there's no point shifting any further
+  uint64_t ceilingMs = baseMs;
+  for (unsigned i = 0; i < attempt && ceilingMs < maxMs; i++) {
+    ceilingMs *= 2;
+  }
+  ceilingMs = std::min(ceilingMs, static_cast<uint64_t>(maxMs));
+  const uint64_t half = ceilingMs / 2;
+  return ceilingMs - half + rand_r(seed) % (half + 1);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+#include "net_types.hpp"
+
+namespace g18 {
+  /// Paces a joining node's requests. Any member can admit us, so each
+  /// attempt asks the next of a list of seeds, starting from a random one so
+  /// that a deploy's worth of joiners spread out over them. Between attempts
+  /// we wait exponentially longer, with jitter so that nodes whose requests
+  /// were lost together don't all retry together. Not thread-safe.
+  class JoinBackoff {
+    public:
+      /// The first wait for an answer, before jitter.
+      static const unsigned defaultBaseMs = 500;
+
+      /// The longest wait, before jitter.
+      static const unsigned defaultMaxMs = 8000;
+
+      /// next() must only be called with seeds. seed is for rand_r().
+      JoinBackoff(const std::vector<persistent_node_id_t> &seeds,
+                  const unsigned seed = 1, const unsigned baseMs = defaultBaseMs,
+                  const unsigned maxMs = defaultMaxMs);
+
+      /// Pick who to ask for the next attempt, and how long to wait for an
+      /// answer before the one after.
+      persistent_node_id_t next(uint64_t &waitMs);
+
+      /// Number of attempts so far.
+      unsigned getAttempts() const;
+
+      /// Whether every seed has been asked at least once, so that once the
+      /// wait after the last attempt is up, none of them has answered.
+      bool hasAskedEverySeed() const;
+
+      /// The wait after attempt number attempt, counting from 0: uniformly
+      /// random between half and all of baseMs * 2^attempt, capped at maxMs.
+      static uint64_t delayMs(const unsigned attempt, const unsigned baseMs,
+                              const unsigned maxMs, unsigned *seed);
+
+    private:
+      const std::vector<persistent_node_id_t> seeds;
+      const unsigned baseMs;
+      const unsigned maxMs;
+      unsigned seed;
+      size_t nextSeed;
+      unsigned attempts;
+
+      JoinBackoff(const JoinBackoff &) = delete;
+      JoinBackoff & operator=(const JoinBackoff &) = delete;
+  };
+}
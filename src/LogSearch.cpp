@@ -0,0 +1,660 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <regex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "LogSearch.hpp"
+#include "utils.hpp"
+
+const size_t g18::LogSearch::defaultChunkSize;
+const int g18::LogSearch::maxIovecs;
+
+/// How many chunks the workers may get ahead of what's been written out.
+#define LOG_SEARCH_WINDOW_PER_THREAD 4
+
+static const char newline = '\n';
+
+/////////////////////////////////////////
+// Literal prefilter
+/////////////////////////////////////////
+
+/// A string to look for, ASCII case-insensitively if folded is set, in
+/// which case text holds it in lower case.
+typedef struct {
+  std::string text;
+  bool folded;
+} literal_t;
+
+static inline bool sameByte(const char a, const char b, const bool folded)
+{
+  return folded ? tolower(static_cast<unsigned char>(a)) == b : a == b;
+}
+
+static bool literalAt(const char *p, const literal_t &lit)
+{
+  for (size_t i = 0; i < lit.text.size(); i++) {
+    if (!sameByte(p[i], lit.text[i], lit.folded)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Look for text, ASCII case-insensitively if folded.
+static literal_t literalFor(const std::string &text, const bool folded)
+{
+  literal_t lit = {text, folded};
+  if (folded) {
+    for (size_t i = 0; i < lit.text.size(); i++) {
+      lit.text[i] = tolower(static_cast<unsigned char>(lit.text[i]));
+    }
+  }
+  return lit;
+}
+
+/// The first occurrence of lit in [p, p + len), or NULL.
+static const char *findLiteral(const char *p, const size_t len, const literal_t &lit)
+{
+  const size_t n = lit.text.size();
+  if (n == 0 || n > len) {
+    return n == 0 ? p : NULL;
+  }
+  size_t i = 0;
+#ifdef __SSE2__
+  // Compare 16 candidate positions at a time against the literal's first and
+  // last bytes, and only check the rest at positions where both match
+  const char first = lit.text[0], last = lit.text[n - 1];
+  const __m128i firstLo = _mm_set1_epi8(first), lastLo = _mm_set1_epi8(last);
+  const __m128i firstUp = _mm_set1_epi8(lit.folded ? toupper(first) : first);
+  const __m128i lastUp = _mm_set1_epi8(lit.folded ? toupper(last) : last);
+  for (; i + n - 1 + 16 <= len; i += 16) {
+    const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + n - 1));
+    const __m128i both = _mm_and_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(head, firstLo), _mm_cmpeq_epi8(head, firstUp)),
+      _mm_or_si128(_mm_cmpeq_epi8(tail, lastLo), _mm_cmpeq_epi8(tail, lastUp)));
+    unsigned mask = _mm_movemask_epi8(both);
+    while (mask != 0) {
+      const unsigned bit = __builtin_ctz(mask);
+      if (literalAt(p + i + bit, lit)) {
+        return p + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i + n <= len; i++) {
+    if (literalAt(p + i, lit)) {
+      return p + i;
+    }
+  }
+  return NULL;
+}
+
+/////////////////////////////////////////
+// Searching
+/////////////////////////////////////////
+
+typedef struct {
+  /// Index into the files being searched.
+  size_t file;
+  size_t start, end;
+  /// Whether this is the file's last chunk.
+  bool lastOfFile;
+} search_task_t;
+
+typedef struct {
+  std::vector<struct iovec> iov;
+  size_t matches;
+  bool done;
+} chunk_result_t;
+
+struct g18::LogSearch::search_job {
+  const search_query_t *query;
+  std::vector<mapped_file_t> files;
+  /// "name:" for each file.
+  std::vector<std::string> prefixes;
+  literal_t literal;
+  /// The patterns themselves, with -F.
+  std::vector<literal_t> fixed;
+  /// Each pattern compiled once per worker, since glibc serializes regexec()
+  /// on a shared regex_t: worker w's are from w * patterns.size().
+  std::vector<regex_t> regexes;
+  std::vector<search_task_t> tasks;
+  std::vector<chunk_result_t> results;
+
+  std::atomic<size_t> nextTask;
+  std::atomic<bool> aborted;
+  size_t written;
+  size_t window;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+};
+
+g18::LogSearch::LogSearch(const std::vector<std::string> &files,
+                          const unsigned numThreads, const size_t chunkSize)
+: files(files), numThreads(std::max(numThreads, 1U)),
+chunkSize(std::max(chunkSize, static_cast<size_t>(4096)))
+{
+}
+
+int g18::LogSearch::parseCommand(const std::string &command, search_query_t &query,
+                                 std::string &error)
+{
+  // Split into words, honoring quotes and backslashes like a shell
+  std::vector<std::string> words;
+  std::string word;
+  bool inWord = false;
+  char quote = '\0';
+  for (size_t i = 0; i < command.size(); i++) {
+    const char c = command[i];
+    if (quote != '\0') {
+      if (c == quote) {
+        quote = '\0';
+      } else if (c == '\\' && quote == '"' && i + 1 < command.size() &&
+                 strchr("\"\\$`", command[i + 1]) != NULL) {
+        word += command[++i];
+      } else {
+        word += c;
+      }
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      inWord = true;
+    } else if (c == '\\' && i + 1 < command.size()) {
+      word += command[++i];
+      inWord = true;
+    } else if (isspace(static_cast<unsigned char>(c))) {
+      if (inWord) {
+        words.push_back(word);
+      }
+      word.clear();
+      inWord = false;
+    } else {
+      word += c;
+      inWord = true;
+    }
+  }
+  if (quote != '\0') {
+    error = "unterminated quote";
+    return -1;
+  }
+  if (inWord) {
+    words.push_back(word);
+  }
+
+  query = (search_query_t){std::vector<std::string>(), false, false, false, false, false};
+  // Like grep, take options anywhere up to a "--"; once there's been an -e,
+  // every other word would be a file
+  std::vector<std::string> operands;
+  bool optionsDone = false;
+  for (size_t w = 0; w < words.size(); w++) {
+    const std::string &arg = words[w];
+    if (!optionsDone && arg == "--") {
+      optionsDone = true;
+    } else if (!optionsDone && arg.size() > 1 && arg[0] == '-') {
+      for (size_t f = 1; f < arg.size(); f++) {
+        switch (arg[f]) {
+        case 'i': query.ignoreCase = true; break;
+        case 'E': query.extended = true; break;
+        case 'G': query.extended = false; break;
+        case 'F': query.fixed = true; break;
+        case 'v': query.invert = true; break;
+        case 'c': query.countOnly = true; break;
+        case 'H': break; // We always print the file name
+        case 'e':
+          // The rest of the word, or the next word, is the pattern
+          if (f + 1 < arg.size()) {
+            query.patterns.push_back(arg.substr(f + 1));
+          } else if (w + 1 < words.size()) {
+            query.patterns.push_back(words[++w]);
+          } else {
+            error = "option requires an argument -- 'e'";
+            return -1;
+          }
+          f = arg.size();
+          break;
+        default:
+          error = std::string("unsupported option -- '") + arg[f] + "'";
+          return -1;
+        }
+      }
+    } else {
+      operands.push_back(arg);
+    }
+  }
+  if (query.patterns.empty() && !operands.empty()) {
+    query.patterns.push_back(operands.front());
+    operands.erase(operands.begin());
+  }
+  if (query.patterns.empty()) {
+    error = "no pattern given";
+    return -1;
+  }
+  if (!operands.empty()) {
+    error = "file arguments aren't supported; the server picks the files";
+    return -1;
+  }
+  return 0;
+}
+
+std::string g18::LogSearch::requiredLiteral(const search_query_t &query)
+{
+  // A line need only match one of several patterns, so none is required
+  if (query.patterns.size() != 1) {
+    return "";
+  }
+  if (query.fixed) {
+    return query.patterns[0];
+  }
+  // Walk the pattern collecting runs of plain characters that must all
+  // appear, one after the other, in anything it matches. Anything we're
+  // unsure of just ends the run, which only makes the prefilter weaker.
+  const std::string &p = query.patterns[0];
+  const bool ere = query.extended;
+  std::string best, run;
+  int depth = 0;
+  size_t i = 0;
+  while (i < p.size()) {
+    bool literal = false;
+    char c = p[i];
+    size_t next = i + 1;
+    if (c == '\\' && i + 1 < p.size()) {
+      const char e = p[i + 1];
+      next = i + 2;
+      if (!ere && e == '|') {
+        return ""; // Alternation: nothing is required
+      } else if (!ere && e == '(') {
+        depth++;
+      } else if (!ere && e == ')') {
+        depth--;
+      } else if (!ere && e == '{') {
+        // An interval on a group; skip it
+        const size_t close = p.find("\\}", next);
+        next = (close == std::string::npos) ? p.size() : close + 2;
+      } else if (!isalnum(static_cast<unsigned char>(e)) && e != '<' && e != '>' &&
+                 e != '`' && e != '\'') {
+        literal = true;
+        c = e;
+      }
+    } else if (c == '[') {
+      // Skip the bracket expression; a ']' first is part of it, as is any
+      // in a class, equivalence class or collating symbol like [:digit:]
+      size_t close = next;
+      if (close < p.size() && p[close] == '^') {
+        close++;
+      }
+      if (close < p.size() && p[close] == ']') {
+        close++;
+      }
+      while (close < p.size() && p[close] != ']') {
+        if (p[close] == '[' && close + 1 < p.size() && strchr(":=.", p[close + 1]) != NULL) {
+          const char terminator[] = {p[close + 1], ']', '\0'};
+          const size_t end = p.find(terminator, close + 2);
+          close = (end == std::string::npos) ? p.size() : end + 2;
+        } else {
+          close++;
+        }
+      }
+      next = (close >= p.size()) ? p.size() : close + 1;
+    } else if (ere && c == '|') {
+      return "";
+    } else if (ere && c == '(') {
+      depth++;
+    } else if (ere && c == ')') {
+      depth--;
+    } else if (ere && c == '{') {
+      const size_t close = p.find('}', next);
+      next = (close == std::string::npos) ? p.size() : close + 1;
+    } else if (c != '.' && c != '^' && c != '$' && c != '*' &&
+               !(ere && (c == '+' || c == '?'))) {
+      literal = true;
+    }
+    // A quantifier afterward means this character may not appear at all
+    bool quantified = false;
+    if (next < p.size()) {
+      const char q = p[next];
+      quantified = q == '*' || (ere && (q == '+' || q == '?' || q == '{')) ||
+                   (!ere && q == '\\' && next + 1 < p.size() &&
+                    strchr("?+{", p[next + 1]) != NULL);
+    }
+    if (literal && depth == 0 && !quantified) {
+      run += c;
+    } else {
+      if (run.size() > best.size()) {
+        best = run;
+      }
+      run.clear();
+    }
+    i = next;
+  }
+  return run.size() > best.size() ? run : best;
+}
+
+ssize_t g18::LogSearch::search(const search_query_t &query, const int fd,
+                               std::string &error) const
+{
+  search_job_t job;
+  job.query = &query;
+  job.literal = literalFor(requiredLiteral(query), query.ignoreCase);
+  const size_t numPatterns = query.patterns.size();
+  if (query.fixed) {
+    for (size_t p = 0; p < numPatterns; p++) {
+      job.fixed.push_back(literalFor(query.patterns[p], query.ignoreCase));
+    }
+  } else {
+    const int flags = REG_NOSUB | (query.extended ? REG_EXTENDED : 0) |
+                      (query.ignoreCase ? REG_ICASE : 0);
+    job.regexes.resize(numThreads * numPatterns);
+    for (size_t i = 0; i < job.regexes.size(); i++) {
+      const int err = regcomp(&job.regexes[i], query.patterns[i % numPatterns].c_str(), flags);
+      if (err != 0) {
+        char msg[256];
+        regerror(err, &job.regexes[i], msg, sizeof(msg));
+        error = msg;
+        for (size_t j = 0; j < i; j++) {
+          regfree(&job.regexes[j]);
+        }
+        return -1;
+      }
+    }
+  }
+
+  // Map everything and carve it into chunks
+  job.files.reserve(files.size());
+  job.prefixes.reserve(files.size());
+  for (auto it = files.begin(); it != files.end(); ++it) {
+    mapped_file_t file;
+    if (mapFile(*it, file) != 0) {
+      continue;
+    }
+    const size_t f = job.files.size();
+    job.files.push_back(file);
+    job.prefixes.push_back(*it + ":");
+    for (size_t c = 0; c < file.chunkStarts.size(); c++) {
+      const bool last = (c + 1 == file.chunkStarts.size());
+      const search_task_t task = {
+        f, file.chunkStarts[c], last ? file.size : file.chunkStarts[c + 1], last
+      };
+      job.tasks.push_back(task);
+    }
+  }
+  job.results.resize(job.tasks.size());
+  job.nextTask = 0;
+  job.aborted = false;
+  job.written = 0;
+  job.window = numThreads * LOG_SEARCH_WINDOW_PER_THREAD;
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.changed, NULL);
+
+  std::vector<search_worker_t> workers(numThreads);
+  std::vector<pthread_t> threads(numThreads);
+  unsigned started = 0;
+  for (; started < numThreads; started++) {
+    workers[started] = (search_worker_t){&job, started};
+    if (pthread_create(&threads[started], NULL, workerMain, &workers[started]) != 0) {
+      MPLOG_WARNING("only started %u of %u search threads", started, numThreads);
+      break;
+    }
+  }
+  ssize_t matches = -1;
+  if (started == 0) {
+    error = "unable to start searching";
+  } else {
+    matches = writeMatches(&job, fd);
+    if (matches < 0) {
+      error = "unable to send results";
+    }
+  }
+  for (unsigned i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&job.changed);
+  pthread_mutex_destroy(&job.lock);
+  for (auto it = job.regexes.begin(); it != job.regexes.end(); ++it) {
+    regfree(&*it);
+  }
+  for (auto it = job.files.begin(); it != job.files.end(); ++it) {
+    if (it->size > 0) {
+      munmap(const_cast<char *>(it->data), it->size);
+    }
+  }
+  return matches;
+}
+
+void *g18::LogSearch::workerMain(void *arg)
+{
+  const search_worker_t *worker = static_cast<search_worker_t *>(arg);
+  search_job_t *job = worker->job;
+  while (!job->aborted.load()) {
+    const size_t t = job->nextTask.fetch_add(1);
+    if (t >= job->tasks.size()) {
+      break;
+    }
+    // Don't get too far ahead of the writer, or we'd hold every match in memory
+    pthread_mutex_lock(&job->lock);
+    while (t >= job->written + job->window && !job->aborted.load()) {
+      pthread_cond_wait(&job->changed, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+    if (job->aborted.load()) {
+      break;
+    }
+    searchChunk(job, worker->index, t);
+    pthread_mutex_lock(&job->lock);
+    job->results[t].done = true;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+  }
+  return NULL;
+}
+
+void g18::LogSearch::searchChunk(search_job_t *job, const unsigned worker, const size_t t)
+{
+  const search_query_t &query = *job->query;
+  const search_task_t &task = job->tasks[t];
+  const mapped_file_t &file = job->files[task.file];
+  const literal_t &lit = job->literal;
+  const char *data = file.data;
+  chunk_result_t &result = job->results[t];
+  result.matches = 0;
+
+  // Whether [line, line + len) matches any pattern. Lines are never
+  // NUL-terminated, so the regex is told where they end.
+  const size_t numPatterns = query.patterns.size();
+  auto lineMatches = [&](const char *line, const size_t len) -> bool {
+    for (size_t p = 0; p < numPatterns; p++) {
+      if (query.fixed) {
+        if (findLiteral(line, len, job->fixed[p]) != NULL) {
+          return true;
+        }
+        continue;
+      }
+      regmatch_t range;
+      range.rm_so = 0;
+      range.rm_eo = len;
+      if (regexec(&job->regexes[worker * numPatterns + p], line, 1, &range,
+                  REG_STARTEND) == 0) {
+        return true;
+      }
+    }
+    return false;
+  };
+  auto addLine = [&](const char *line, const char *lineEnd) {
+    result.matches++;
+    if (query.countOnly) {
+      return;
+    }
+    const std::string &prefix = job->prefixes[task.file];
+    result.iov.push_back((struct iovec){const_cast<char *>(prefix.data()), prefix.size()});
+    if (lineEnd < data + file.size) {
+      // Take the newline with it
+      result.iov.push_back((struct iovec){const_cast<char *>(line),
+                                          static_cast<size_t>(lineEnd - line) + 1});
+    } else {
+      result.iov.push_back((struct iovec){const_cast<char *>(line),
+                                          static_cast<size_t>(lineEnd - line)});
+      result.iov.push_back((struct iovec){const_cast<char *>(&newline), 1});
+    }
+  };
+
+  const char *pos = data + task.start, *end = data + task.end;
+  if (!query.invert && !lit.text.empty()) {
+    // Jump from one occurrence of the literal to the next, and only look at
+    // the lines they're on
+    const char *hit;
+    while (pos < end && (hit = findLiteral(pos, end - pos, lit)) != NULL) {
+      const char *line = static_cast<const char *>(memrchr(pos, '\n', hit - pos));
+      line = (line == NULL) ? pos : line + 1;
+      const char *lineEnd = static_cast<const char *>(memchr(hit, '\n', end - hit));
+      lineEnd = (lineEnd == NULL) ? end : lineEnd;
+      if (lineMatches(line, lineEnd - line)) {
+        addLine(line, lineEnd);
+      }
+      pos = lineEnd + 1;
+    }
+    return;
+  }
+  // Every line has to be looked at
+  while (pos < end) {
+    const char *lineEnd = static_cast<const char *>(memchr(pos, '\n', end - pos));
+    lineEnd = (lineEnd == NULL) ? end : lineEnd;
+    const size_t len = lineEnd - pos;
+    const bool matched = (lit.text.empty() || findLiteral(pos, len, lit) != NULL) &&
+                         lineMatches(pos, len);
+    if (matched != query.invert) {
+      addLine(pos, lineEnd);
+    }
+    pos = lineEnd + 1;
+  }
+}
+
+ssize_t g18::LogSearch::writeMatches(search_job_t *job, const int fd)
+{
+  size_t total = 0, fileMatches = 0;
+  std::vector<struct iovec> batch;
+  batch.reserve(maxIovecs);
+  for (size_t t = 0; t < job->tasks.size(); t++) {
+    pthread_mutex_lock(&job->lock);
+    while (!job->results[t].done) {
+      pthread_cond_wait(&job->changed, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    chunk_result_t &result = job->results[t];
+    total += result.matches;
+    fileMatches += result.matches;
+    int status = 0;
+    for (size_t i = 0; i < result.iov.size() && status == 0; i += maxIovecs) {
+      const int count = static_cast<int>(std::min(result.iov.size() - i,
+                                                  static_cast<size_t>(maxIovecs)));
+      status = writeAll(fd, &result.iov[i], count);
+    }
+    if (status == 0 && job->query->countOnly && job->tasks[t].lastOfFile) {
+      char count[32];
+      const int len = snprintf(count, sizeof(count), "%zu\n", fileMatches);
+      const std::string &prefix = job->prefixes[job->tasks[t].file];
+      struct iovec iov[2] = {
+        {const_cast<char *>(prefix.data()), prefix.size()},
+        {count, static_cast<size_t>(len)}
+      };
+      status = writeAll(fd, iov, 2);
+    }
+    if (job->tasks[t].lastOfFile) {
+      fileMatches = 0;
+    }
+    // Let the memory go, and let the workers move on
+    std::vector<struct iovec>().swap(result.iov);
+    pthread_mutex_lock(&job->lock);
+    job->written = t + 1;
+    if (status != 0) {
+      job->aborted = true;
+    }
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+    if (status != 0) {
+      return -1;
+    }
+  }
+  return total;
+}
+
+int g18::LogSearch::writeAll(const int fd, struct iovec *iov, int count)
+{
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    // Skip whatever made it out
+    while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return 0;
+}
+
+int g18::LogSearch::mapFile(const std::string &name, mapped_file_t &file) const
+{
+  const int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    MPLOG_WARNING("not searching %s: %s", name.c_str(), strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    MPLOG_WARNING("not searching %s: %s", name.c_str(), strerror(errno));
+    close(fd);
+    return -1;
+  }
+  file.name = &name;
+  file.size = st.st_size;
+  file.data = NULL;
+  file.chunkStarts.clear();
+  file.chunkStarts.push_back(0);
+  if (file.size > 0) {
+    void *data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      MPLOG_WARNING("not searching %s: %s", name.c_str(), strerror(errno));
+      close(fd);
+      return -1;
+    }
+    madvise(data, file.size, MADV_SEQUENTIAL);
+    file.data = static_cast<const char *>(data);
+    // Each chunk starts just after a newline, so no line is split
+    for (size_t target = chunkSize; target < file.size; target += chunkSize) {
+      if (target <= file.chunkStarts.back()) {
+        continue;
+      }
+      const char *nl = static_cast<const char *>(
+        memchr(file.data + target, '\n', file.size - target));
+      if (nl == NULL || static_cast<size_t>(nl + 1 - file.data) >= file.size) {
+        break;
+      }
+      file.chunkStarts.push_back(nl + 1 - file.data);
+    }
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/// The grep options the log query server understands.
+typedef struct {
+  /// A line matches if it matches any of these, as with several -e.
+  std::vector<std::string> patterns;
+  /// -i
+  bool ignoreCase;
+  /// -E: extended rather than basic regular expressions.
+  bool extended;
+  /// -F: the pattern is a plain string.
+  bool fixed;
+  /// -v: print the lines that don't match.
+  bool invert;
+  /// -c: print how many lines matched in each file instead.
+  bool countOnly;
+} search_query_t;
+
+namespace g18 {
+  /// Searches log files the way `grep -H` would, without spawning it. Each
+  /// file is mapped into memory and split at line boundaries into chunks
+  /// that worker threads search in parallel. Before any regular expression
+  /// is run, a SIMD scan skips to the lines containing a literal string the
+  /// pattern requires, so most lines are never handed to regexec(). Matches
+  /// are written out in file order with writev(), straight from the mapping.
+  class LogSearch {
+    public:
+      /// Bytes of a file each worker searches at a time.
+      static const size_t defaultChunkSize = 4 << 20;
+
+      /// Most iovecs we pass to a single writev().
+      static const int maxIovecs = 1024;
+
+      /// Search these files with numThreads workers.
+      LogSearch(const std::vector<std::string> &files, const unsigned numThreads,
+                const size_t chunkSize = defaultChunkSize);
+
+      /// Parse a grep command line, as sent by a client, into a query. Words
+      /// may be quoted the way a shell would, and options may come before or
+      /// after the pattern, up to a "--". Returns 0 on success; on failure
+      /// error says why.
+      static int parseCommand(const std::string &command, search_query_t &query,
+                              std::string &error);
+
+      /// Write every matching line to fd, as "file:line", and return how many
+      /// there were, or -1 if the pattern is invalid or fd can't be written.
+      /// Files that can't be opened are skipped. Safe to call from several
+      /// threads at once.
+      ssize_t search(const search_query_t &query, const int fd, std::string &error) const;
+
+      /// The longest string every line matching the patterns must contain,
+      /// or "" if there's no such string we can be sure of, as when there's
+      /// more than one pattern.
+      static std::string requiredLiteral(const search_query_t &query);
+
+    private:
+      const std::vector<std::string> files;
+      const unsigned numThreads;
+      const size_t chunkSize;
+
+      /// A file mapped into memory, and split into chunks.
+      typedef struct {
+        const std::string *name;
+        const char *data;
+        size_t size;
+        std::vector<size_t> chunkStarts;
+      } mapped_file_t;
+
+      /// What the workers share while searching one file.
+      struct search_job;
+      typedef struct search_job search_job_t;
+
+      typedef struct {
+        search_job_t *job;
+        unsigned index;
+      } search_worker_t;
+
+      static void *workerMain(void *arg);
+
+      /// Search one chunk, collecting the iovecs for its matching lines.
+      static void searchChunk(search_job_t *job, const unsigned worker, const size_t chunk);
+
+      /// Write out every chunk's matches, in order, as they become ready.
+      /// Returns how many lines matched, or -1 if fd can't be written.
+      static ssize_t writeMatches(search_job_t *job, const int fd);
+
+      /// Write iovecs, retrying on partial writes. Returns 0 on success.
+      static int writeAll(const int fd, struct iovec *iov, int count);
+
+      /// Map a file and pick its chunk boundaries. Returns 0 on success.
+      int mapFile(const std::string &name, mapped_file_t &file) const;
+
+      LogSearch(const LogSearch &) = delete;
+      LogSearch & operator=(const LogSearch &) = delete;
+  };
+}
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+#include <unistd.h>
+#include "Logger.hpp"
+
+/// Bytes the background thread formats before each write().
+#define LOG_BATCH_SIZE 65536
+
+/// Longest line we'll write: the prefix plus the longest message.
+#define LOG_MAX_LINE 512
+
+/// Prefixes for each level, to keep the old "Debug: ..." style of our logs.
+static const char *levelPrefixes[] = {"Debug: ", "", "Warning: ", "Error: "};
+
+const size_t g18::Logger::maxMessageLength;
+const unsigned g18::Logger::ringCapacity;
+const unsigned g18::Logger::maxThreads;
+const unsigned g18::Logger::flushIntervalMs;
+
+/// Each thread's ring; released when the thread exits.
+static pthread_key_t ringKey;
+
+g18::Logger & g18::Logger::instance()
+{
+  static Logger *logger = new Logger();
+  return *logger;
+}
+
+g18::Logger::Logger()
+: numRings(0), outputFd(STDOUT_FILENO), writtenCount(0),
+unregisteredDropCount(0), stopping(false)
+{
+  pthread_mutex_init(&registerLock, NULL);
+  pthread_key_create(&ringKey, releaseRing);
+  if (pthread_create(&writerThread, NULL, writerMain, this) != 0) {
+    fprintf(stderr, "MPLOG ERROR: Unable to start the log writer\n");
+    exit(1);
+  }
+  atexit(stopAtExit);
+}
+
+void g18::Logger::log(const int level, const char *file, const char *function,
+                      const int line, const char *fmt, ...)
+{
+  ring_t *ring = localRing();
+  if (ring == NULL) {
+    unregisteredDropCount.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  if (tail - ring->head.load(std::memory_order_acquire) >= ringCapacity) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  log_record_t &record = ring->records[tail % ringCapacity];
+  record.file = file;
+  record.function = function;
+  record.line = line;
+  record.level = level;
+  va_list argp;
+  va_start(argp, fmt);
+  const int len = vsnprintf(record.message, sizeof(record.message), fmt, argp);
+  va_end(argp);
+  record.length = (len < 0) ? 0 : std::min(static_cast<size_t>(len), maxMessageLength);
+  ring->tail.store(tail + 1, std::memory_order_release);
+}
+
+void g18::Logger::setOutput(const int fd)
+{
+  outputFd.store(fd);
+}
+
+void g18::Logger::flush()
+{
+  if (stopping.load()) {
+    return;
+  }
+  // Wait for the background thread to catch up with where every ring is now
+  const unsigned n = numRings.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < n; i++) {
+    const uint64_t tail = rings[i]->tail.load(std::memory_order_acquire);
+    while (rings[i]->head.load(std::memory_order_acquire) < tail) {
+      const struct timespec wait = {0, flushIntervalMs * 1000000L};
+      nanosleep(&wait, NULL);
+    }
+  }
+}
+
+uint64_t g18::Logger::getWrittenCount() const
+{
+  return writtenCount.load();
+}
+
+uint64_t g18::Logger::getDroppedCount() const
+{
+  uint64_t dropped = unregisteredDropCount.load();
+  const unsigned n = numRings.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < n; i++) {
+    dropped += rings[i]->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+g18::Logger::ring_t * g18::Logger::localRing()
+{
+  ring_t *ring = static_cast<ring_t *>(pthread_getspecific(ringKey));
+  if (ring != NULL) {
+    return ring;
+  }
+  pthread_mutex_lock(&registerLock);
+  // Reuse the ring of a thread that has exited, once it's been written out
+  const unsigned n = numRings.load(std::memory_order_relaxed);
+  for (unsigned i = 0; i < n && ring == NULL; i++) {
+    if (!rings[i]->inUse.load() &&
+        rings[i]->head.load() == rings[i]->tail.load()) {
+      ring = rings[i];
+    }
+  }
+  if (ring == NULL && n < maxThreads) {
+    ring = new ring_t();
+    rings[n] = ring;
+    numRings.store(n + 1, std::memory_order_release);
+  }
+  if (ring != NULL) {
+    ring->inUse.store(true);
+    pthread_setspecific(ringKey, ring);
+  }
+  pthread_mutex_unlock(&registerLock);
+  return ring;
+}
+
+size_t g18::Logger::drain()
+{
+  static char batch[LOG_BATCH_SIZE];
+  size_t used = 0;
+  size_t total = 0;
+  const int fd = outputFd.load();
+  const unsigned n = numRings.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < n; i++) {
+    ring_t *ring = rings[i];
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    for (uint64_t r = head; r != tail; r++) {
+      if (used + LOG_MAX_LINE > sizeof(batch)) {
+        writeAll(fd, batch, used);
+        used = 0;
+      }
+      const log_record_t &record = ring->records[r % ringCapacity];
+      const char *prefix = record.level < sizeof(levelPrefixes) / sizeof(levelPrefixes[0])
+                         ? levelPrefixes[record.level] : "";
+      const int len = snprintf(batch + used, LOG_MAX_LINE, "%s:%s:%u: %s%.*s\n",
+                               record.file, record.function, record.line, prefix,
+                               static_cast<int>(record.length), record.message);
+      used += std::min(static_cast<size_t>(std::max(len, 0)),
+                       static_cast<size_t>(LOG_MAX_LINE - 1));
+    }
+    // Only now may the producer reuse those records
+    ring->head.store(tail, std::memory_order_release);
+    total += tail - head;
+  }
+  writeAll(fd, batch, used);
+  writtenCount.fetch_add(total, std::memory_order_relaxed);
+  return total;
+}
+
+void g18::Logger::writeAll(const int fd, const char *buf, size_t len)
+{
+  while (len > 0) {
+    const ssize_t written = write(fd, buf, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return; // Nowhere to report it
+    }
+    buf += written;
+    len -= written;
+  }
+}
+
+void *g18::Logger::writerMain(void *context)
+{
+  Logger *logger = static_cast<Logger *>(context);
+  while (!logger->stopping.load()) {
+    if (logger->drain() == 0) {
+      const struct timespec wait = {0, flushIntervalMs * 1000000L};
+      nanosleep(&wait, NULL);
+    }
+  }
+  return NULL;
+}
+
+void g18::Logger::releaseRing(void *ring)
+{
+  static_cast<ring_t *>(ring)->inUse.store(false);
+}
+
+void g18::Logger::stopAtExit()
+{
+  // Take over from the background thread and write out what's left
+  Logger &logger = instance();
+  logger.stopping.store(true);
+  pthread_join(logger.writerThread, NULL);
+  logger.drain();
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <pthread.h>
+#include <stdint.h>
+
+/////////////////////////////////////////
+// Log levels
+//
+// Anything below MPLOG_LEVEL is compiled out: its arguments are still type
+// checked, but it generates no code. Set it with `make MPLOG_LEVEL=n`.
+/////////////////////////////////////////
+
+#define MPLOG_LEVEL_DEBUG 0
+#define MPLOG_LEVEL_INFO 1
+#define MPLOG_LEVEL_WARNING 2
+#define MPLOG_LEVEL_ERROR 3
+
+#ifndef MPLOG_LEVEL
+#define MPLOG_LEVEL MPLOG_LEVEL_DEBUG
+#endif
+
+#define _MPLOG(level, fmt, ...) do { \
+  if ((level) >= MPLOG_LEVEL) { \
+    g18::Logger::instance().log((level), __FILE__, __FUNCTION__, __LINE__, \
+                                fmt , ## __VA_ARGS__); \
+  } \
+} while (0)
+#define MPLOG_DEBUG(fmt, ...) _MPLOG(MPLOG_LEVEL_DEBUG, fmt , ## __VA_ARGS__)
+#define MPLOG_INFO(fmt, ...) _MPLOG(MPLOG_LEVEL_INFO, fmt , ## __VA_ARGS__)
+#define MPLOG_WARNING(fmt, ...) _MPLOG(MPLOG_LEVEL_WARNING, fmt , ## __VA_ARGS__)
+#define MPLOG_ERROR(fmt, ...) _MPLOG(MPLOG_LEVEL_ERROR, fmt , ## __VA_ARGS__)
+#define MPLOG(fmt, ...) MPLOG_INFO(fmt , ## __VA_ARGS__)
+
+namespace g18 {
+  /// An asynchronous logger. Each thread formats its message into a
+  /// fixed-size record in its own lock-free ring, and a background thread
+  /// adds the prefix and writes out everything waiting in one go. When a
+  /// thread's ring is full its records are dropped rather than making it
+  /// wait. Everything still queued is written out when the process exits.
+  class Logger {
+    public:
+      /// Longest message kept; anything longer is truncated.
+      static const size_t maxMessageLength = 215;
+
+      /// Records each thread can have waiting.
+      static const unsigned ringCapacity = 1024;
+
+      /// Threads that can log. Any more and their records are dropped.
+      static const unsigned maxThreads = 64;
+
+      /// How long the background thread sleeps when there's nothing to write.
+      static const unsigned flushIntervalMs = 1;
+
+      /// The logger. Starts the background thread the first time.
+      static Logger & instance();
+
+      /// Queue a message. Never blocks.
+      void log(const int level, const char *file, const char *function,
+               const int line, const char *fmt, ...)
+        __attribute__((format(printf, 6, 7)));
+
+      /// Write logs to this file descriptor from now on. Defaults to stdout.
+      void setOutput(const int fd);
+
+      /// Wait until everything queued so far has been written.
+      void flush();
+
+      /// Records written out so far.
+      uint64_t getWrittenCount() const;
+
+      /// Records dropped because a ring was full.
+      uint64_t getDroppedCount() const;
+
+    private:
+      typedef struct {
+        const char *file;
+        const char *function;
+        uint32_t line;
+        uint8_t level;
+        uint16_t length;
+        char message[maxMessageLength + 1];
+      } log_record_t;
+
+      /// A single-producer, single-consumer ring. The head and tail are
+      /// kept on separate cache lines so the two sides don't contend.
+      typedef struct {
+        log_record_t records[ringCapacity];
+        std::atomic<uint64_t> head;
+        char pad1[64 - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint64_t> tail;
+        char pad2[64 - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint64_t> dropped;
+        /// Whether a live thread owns this ring.
+        std::atomic<bool> inUse;
+      } ring_t;
+
+      ring_t *rings[maxThreads];
+      std::atomic<unsigned> numRings;
+      pthread_mutex_t registerLock;
+
+      std::atomic<int> outputFd;
+      std::atomic<uint64_t> writtenCount;
+      std::atomic<uint64_t> unregisteredDropCount;
+      std::atomic<bool> stopping;
+      pthread_t writerThread;
+
+      Logger();
+
+      Logger(const Logger &) = delete;
+      Logger & operator=(const Logger &) = delete;
+
+      /// This thread's ring, registering one if need be. NULL if we're out.
+      ring_t * localRing();
+
+      /// Write out everything waiting. Returns how many records there were.
+      /// Only the background thread, or whoever has stopped it, may call this.
+      size_t drain();
+
+      static void writeAll(const int fd, const char *buf, size_t len);
+
+      static void *writerMain(void *context);
+      static void releaseRing(void *ring);
+      static void stopAtExit();
+  };
+}
@@ -1,190 +1,262 @@
+#include <algorithm>
+#include <cinttypes>
 #include <cstring>
 #include "MembershipList.hpp"
 #include "utils.hpp"
 
+g18::MembershipList::MembershipList()
+: published(std::make_shared<const MembershipSnapshot>()), updateDepth(0),
+dirty(false)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&writeLock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+g18::MembershipList::~MembershipList()
+{
+  pthread_mutex_destroy(&writeLock);
+}
+
+std::shared_ptr<const g18::MembershipSnapshot> g18::MembershipList::snapshot() const
+{
+  return std::atomic_load(&published);
+}
+
+void g18::MembershipList::beginUpdate()
+{
+  pthread_mutex_lock(&writeLock);
+  updateDepth++;
+}
+
+void g18::MembershipList::endUpdate()
+{
+  if (--updateDepth == 0 && dirty) {
+    // Readers holding the old snapshot keep it alive until they're done
+    std::atomic_store(&published,
+                      std::make_shared<const MembershipSnapshot>(current));
+    dirty = false;
+  }
+  pthread_mutex_unlock(&writeLock);
+}
+
 int g18::MembershipList::nodeDidJoin(const node_id_t &node)
 {
-  // Check if we already have this node
-  const auto existingIt = lookUp(node.ip);
-  if (existingIt != members.end()) {
-    const membership_entry_t &existing = *existingIt;
-    // Make sure our existing copy is the same as the new one
-    if (existing.id.timestamp > node.timestamp) {
-      MPLOG("ERROR: Attempting to add node %u with timestamp %u when we have a newer version with timestamp %u",
-            node.ip, node.timestamp, existing.id.timestamp);
-      return -1;
-    } else if (existing.id.timestamp < node.timestamp) {
-      if (existing.state == NODE_STATE_ONLINE) {
-        MPLOG("ERROR: Attempting to add node %u with timestamp %u but an older version is still online with timestamp %u",
-              node.ip, node.timestamp, existing.id.timestamp);
-        return -1;
+  beginUpdate();
+  const int ret = joinNodeImpl(node);
+  dirty = dirty || ret > 0;
+  endUpdate();
+  return ret;
+}
+
+int g18::MembershipList::nodeDidLeave(const node_id_t &node, const lamp_time_t now)
+{
+  MPLOG_DEBUG("Node %d leaving", node.ip);
+  beginUpdate();
+  const int ret = killNodeImpl(node, NODE_STATE_DEPARTED, now);
+  dirty = dirty || ret == 0;
+  endUpdate();
+  return ret;
+}
+
+int g18::MembershipList::nodeDidDie(const node_id_t &node, const lamp_time_t now)
+{
+  MPLOG_DEBUG("Node %d dying", node.ip);
+  beginUpdate();
+  const int ret = killNodeImpl(node, NODE_STATE_DIED, now);
+  dirty = dirty || ret == 0;
+  endUpdate();
+  return ret;
+}
+
+size_t g18::MembershipList::collectTombstones(const uint64_t nowMs,
+                                              const lamp_time_t now,
+                                              const tombstone_policy_t &policy)
+{
+  beginUpdate();
+  std::vector<membership_entry_t> &members = current.members;
+  // Find out when the tombstones that are too young to expire went away, in
+  // case there are more of them than the cap allows
+  std::vector<uint64_t> unexpired;
+  for (auto it = members.begin(); it != members.end(); ++it) {
+    if (it->state != NODE_STATE_ONLINE && !isExpired(*it, nowMs, now, policy)) {
+      unexpired.push_back(it->goneAtMs);
+    }
+  }
+  // Over the cap, everything older than the cutoff goes, along with just
+  // enough of those that went away exactly at the cutoff
+  uint64_t cutoffMs = 0;
+  size_t cutoffTies = 0;
+  if (unexpired.size() > policy.maxTombstones) {
+    const size_t excess = unexpired.size() - policy.maxTombstones;
+    std::nth_element(unexpired.begin(), unexpired.begin() + excess - 1,
+                     unexpired.end());
+    cutoffMs = unexpired[excess - 1];
+    cutoffTies = excess;
+    for (size_t i = 0; i < excess - 1; i++) {
+      if (unexpired[i] < cutoffMs) {
+        cutoffTies--;
       }
-      // Continue on to add the node
-    } else { // Timestamps match
-      if (existing.state != NODE_STATE_ONLINE) {
-        MPLOG("ERROR: Attempting to add node %u which already exists in state %s",
-              node.ip, strNodeState(existing.state));
-        return -1;
+    }
+  }
+
+  // Compact in place, keeping ring order
+  size_t kept = 0;
+  for (size_t i = 0; i < members.size(); i++) {
+    const membership_entry_t &entry = members[i];
+    bool collect = false;
+    if (entry.state != NODE_STATE_ONLINE) {
+      if (isExpired(entry, nowMs, now, policy) || entry.goneAtMs < cutoffMs) {
+        collect = true;
+      } else if (cutoffTies > 0 && entry.goneAtMs == cutoffMs) {
+        collect = true;
+        cutoffTies--;
       }
-      // They match, nothing left to do here
-      return 0;
+    }
+    if (!collect) {
+      members[kept++] = entry;
     }
   }
-  // This node does not yet exist, so we add it
-  MPLOG("Debug: Node %d joining", node.ip);
-  members.push_back((membership_entry_t){
-    .id = node,
-    .state = NODE_STATE_ONLINE
-  });
-  return 1;
+  const size_t collected = members.size() - kept;
+  if (collected > 0) {
+    members.resize(kept);
+    if (members.capacity() > 2 * members.size()) {
+      members.shrink_to_fit();
+    }
+    current.reindex();
+    dirty = true;
+  }
+  endUpdate();
+  return collected;
 }
 
-int g18::MembershipList::nodeDidLeave(const node_id_t &node)
+bool g18::MembershipList::hasSuccessor(const node_id_t &node) const
 {
-  MPLOG("Debug: Node %d leaving", node.ip);
-  return killNodeImpl(node, NODE_STATE_DEPARTED);
+  return snapshot()->hasSuccessor(node);
 }
 
-int g18::MembershipList::nodeDidDie(const node_id_t &node)
+bool g18::MembershipList::hasPredecessor(const node_id_t &node) const
 {
-  MPLOG("Debug: Node %d dying", node.ip);
-  return killNodeImpl(node, NODE_STATE_DIED);
+  return snapshot()->hasPredecessor(node);
 }
 
-bool g18::MembershipList::hasSuccessor(const node_id_t &node)
+node_id_t g18::MembershipList::successorOf(const node_id_t &node) const
 {
-  return successorOfImpl(node) != members.end();
+  return snapshot()->successorOf(node);
 }
 
-bool g18::MembershipList::hasPredecessor(const node_id_t &node)
+node_id_t g18::MembershipList::predecessorOf(const node_id_t &node) const
 {
-  return predecessorOfImpl(node) != members.end();
+  return snapshot()->predecessorOf(node);
 }
 
-node_id_t g18::MembershipList::successorOf(const node_id_t &node)
+size_t g18::MembershipList::size() const
 {
-  std::list<membership_entry_t>::iterator it = successorOfImpl(node);
-  if (it == members.end()) {
-    // Not found
-    node_id_t nid;
-    memset(&nid, 0, sizeof(nid));
-    return nid;
-  }
-  return it->id;
+  return snapshot()->size();
 }
 
-node_id_t g18::MembershipList::predecessorOf(const node_id_t &node)
+size_t g18::MembershipList::liveCount() const
 {
-  std::list<membership_entry_t>::iterator it = predecessorOfImpl(node);
-  if (it == members.end()) {
-    // Not found
-    node_id_t nid;
-    memset(&nid, 0, sizeof(nid));
-    return nid;
-  }
-  return it->id;
+  return snapshot()->liveCount();
 }
 
-std::list<membership_entry_t>::iterator g18::MembershipList::successorOfImpl(const node_id_t &node)
+size_t g18::MembershipList::tombstoneCount() const
 {
-  auto queryNodeIt = lookUp(node), it = queryNodeIt;
-  // Walk the list
-  if (it != members.end()) {
-    // Skip over dead nodes
-    while (++it != members.end()) {
-      if (it->state == NODE_STATE_ONLINE) {
-        return it;
-      }
-    }
-    // Wrap around to the beginning if necessary
-    it = members.begin();
-    if (it != queryNodeIt) {
-      do {
-        if (it->state == NODE_STATE_ONLINE) {
-          return it;
-        }
-      } while (++it != queryNodeIt);
-    }
-  }
-  // Not found
-  return members.end();
+  return snapshot()->tombstoneCount();
 }
 
-std::list<membership_entry_t>::iterator g18::MembershipList::predecessorOfImpl(const node_id_t &node)
+size_t g18::MembershipList::memoryUsage() const
 {
-  auto queryNodeIt = lookUp(node), it = queryNodeIt;
-  if (it != members.end()) {
-    // Skip over dead nodes
-    if (it-- != members.begin()) {
-      do {
-        if (it->state == NODE_STATE_ONLINE) {
-          return it;
-        }
-      } while (it-- != members.begin());
-    }
-    // Wrap around to the end if necessary
-    it = members.end();
-    while (--it != queryNodeIt) {
-      if (it->state == NODE_STATE_ONLINE) {
-        return it;
+  return snapshot()->memoryUsage();
+}
+
+int g18::MembershipList::joinNodeImpl(const node_id_t &node)
+{
+  // Check if we already have this node
+  const size_t existingIdx = current.lookUp(node.ip);
+  if (existingIdx != MembershipSnapshot::notFound) {
+    const membership_entry_t &existing = current.members[existingIdx];
+    // Make sure our existing copy is the same as the new one
+    if (existing.id.timestamp > node.timestamp) {
+      MPLOG_ERROR("Attempting to add node %u with timestamp %" PRIu64 " when we have a newer version with timestamp %" PRIu64,
+            node.ip, node.timestamp, existing.id.timestamp);
+      return -1;
+    } else if (existing.id.timestamp < node.timestamp) {
+      if (existing.state == NODE_STATE_ONLINE) {
+        MPLOG_ERROR("Attempting to add node %u with timestamp %" PRIu64 " but an older version is still online with timestamp %" PRIu64,
+              node.ip, node.timestamp, existing.id.timestamp);
+        return -1;
       }
+      // Continue on to add the node
+    } else { // Timestamps match
+      if (existing.state != NODE_STATE_ONLINE) {
+        MPLOG_ERROR("Attempting to add node %u which already exists in state %s",
+              node.ip, strNodeState(existing.state));
+        return -1;
+      }
+      // They match, nothing left to do here
+      return 0;
     }
   }
-  // Not found
-  return members.end();
+  // This node does not yet exist, so we add it
+  MPLOG_DEBUG("Node %d joining", node.ip);
+  current.members.push_back((membership_entry_t){
+    .id = node,
+    .state = NODE_STATE_ONLINE,
+    .goneAtMs = 0,
+    .goneAtTime = 0
+  });
+  // The new entry is at the end, so it sorts last in both indices. Any older
+  // entry for this IP stays where it is, but can no longer be looked up.
+  current.indexByIP[node.ip] = current.members.size() - 1;
+  current.live.push_back(current.members.size() - 1);
+  current.toggleDigest(node);
+  return 1;
 }
 
 int g18::MembershipList::killNodeImpl(const node_id_t &node,
-                                      const node_state_e desiredState)
+                                      const node_state_e desiredState,
+                                      const lamp_time_t now)
 {
   // Check if we already have this node
-  const auto existingIt = lookUp(node.ip);
-  if (existingIt != members.end()) {
-    const membership_entry_t &existing = *existingIt;
+  const size_t existingIdx = current.lookUp(node.ip);
+  if (existingIdx != MembershipSnapshot::notFound) {
+    membership_entry_t &existing = current.members[existingIdx];
     // Make sure our existing copy is the same as the new one
     if (existing.id.timestamp != node.timestamp) {
-      MPLOG("ERROR: Node %u with timestamp %u reported gone, but we only have that node with timestamp %u",
+      MPLOG_ERROR("Node %u with timestamp %" PRIu64 " reported gone, but we only have that node with timestamp %" PRIu64,
             node.ip, node.timestamp, existing.id.timestamp);
       return -1;
     }
     if (existing.state != NODE_STATE_ONLINE) {
-      MPLOG("ERROR: Attempting to remove node %u which already exists in state %s",
+      MPLOG_ERROR("Attempting to remove node %u which already exists in state %s",
             node.ip, strNodeState(existing.state));
       return -1;
     }
     // They match. Mark it as gone.
-    membership_entry_t newEntry = existing;
-    newEntry.state = desiredState;
-    *existingIt = newEntry;
+    existing.state = desiredState;
+    existing.goneAtMs = monotonic_time_ns() / 1000000;
+    existing.goneAtTime = now;
+    current.live.erase(std::lower_bound(current.live.begin(),
+                                        current.live.end(), existingIdx));
+    current.toggleDigest(existing.id);
     return 0;
   } else {
     // This node does not yet exist, so it has no business dying
-    MPLOG("ERROR: Node %u doesn't exist, but it has been reported dead",
+    MPLOG_ERROR("Node %u doesn't exist, but it has been reported dead",
           node.ip);
     return -1;
   }
 }
 
-std::list<membership_entry_t>::iterator g18::MembershipList::lookUp(const persistent_node_id_t ip)
+bool g18::MembershipList::isExpired(const membership_entry_t &entry,
+                                    const uint64_t nowMs, const lamp_time_t now,
+                                    const tombstone_policy_t &policy)
 {
-  auto it = members.begin();
-  for (; it != members.end(); ++it) {
-    if (it->id.ip == ip) {
-      return it;
-    }
-  }
-  return it;
-}
-
-std::list<membership_entry_t>::iterator g18::MembershipList::lookUp(const node_id_t &node)
-{
-  auto it = members.begin();
-  for (; it != members.end(); ++it) {
-    if (isEqual(it->id, node)) {
-      return it;
-    }
-  }
-  return it;
+  return nowMs - entry.goneAtMs >= policy.maxAgeMs ||
+         now - entry.goneAtTime >= policy.maxAgeTicks;
 }
 
 const char * g18::MembershipList::strNodeState(const node_state_e state) const
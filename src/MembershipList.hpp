@@ -1,47 +1,92 @@
 #pragma once
-#include <list>
+#include <cstddef>
+#include <memory>
+#include <pthread.h>
+#include "MembershipSnapshot.hpp"
 #include "net_types.hpp"
 
-typedef struct __attribute__((packed)) {
-  node_id_t id;
-  node_state_e state;
-} membership_entry_t;
+/// When the entries of departed and dead nodes (tombstones) may be forgotten.
+/// Until then, a late message about the node can't bring it back to life.
+typedef struct {
+  /// A tombstone this many milliseconds old may be collected...
+  uint64_t maxAgeMs;
+  /// ...as may one this many Lamport ticks old.
+  lamp_time_t maxAgeTicks;
+  /// Never keep more than this many tombstones; the oldest go first.
+  size_t maxTombstones;
+} tombstone_policy_t;
 
 namespace g18 {
+  /// The membership list. Writers are serialized by a lock and publish a new
+  /// immutable snapshot after every change (or batch of changes); readers
+  /// take the latest snapshot without locking and may keep it as long as
+  /// they like.
   class MembershipList {
     public:
+      MembershipList();
+      ~MembershipList();
+
+      /// The current state of the list. Take one snapshot and ask it
+      /// everything, rather than calling the methods below one after another,
+      /// to get answers that are consistent with each other.
+      std::shared_ptr<const MembershipSnapshot> snapshot() const;
+
+      /// Hold off publishing until the matching endUpdate(), so a batch of
+      /// changes appears to readers all at once. Calls may nest. Snapshots
+      /// taken in between, even by the writer, don't see the batch.
+      void beginUpdate();
+      void endUpdate();
+
       /// Call this with each node that may possibly be joining. This method is
       /// idempotent. Returns -1 on error, 0 on no change, 1 if the node was added.
       int nodeDidJoin(const node_id_t &node);
 
-      /// Call this with each node that may possibly have left. This method is idempotent.
-      int nodeDidLeave(const node_id_t &node);
+      /// Call this with each node that may possibly have left, along with the
+      /// current Lamport time. This method is idempotent.
+      int nodeDidLeave(const node_id_t &node, const lamp_time_t now);
 
-      /// Call this with each node that may possibly have died. This method is idempotent.
-      int nodeDidDie(const node_id_t &node);
+      /// Call this with each node that may possibly have died, along with the
+      /// current Lamport time. This method is idempotent.
+      int nodeDidDie(const node_id_t &node, const lamp_time_t now);
 
-      /// Check if the node after this one exists and is alive.
-      bool hasSuccessor(const node_id_t &node);
+      /// Forget the tombstones the policy allows us to, compacting what's
+      /// left. Ring order is unaffected. Returns how many were collected.
+      size_t collectTombstones(const uint64_t nowMs, const lamp_time_t now,
+                               const tombstone_policy_t &policy);
 
-      /// Check if the node before this one exists and is alive.
-      bool hasPredecessor(const node_id_t &node);
+      /// Shorthands for asking the current snapshot.
+      bool hasSuccessor(const node_id_t &node) const;
+      bool hasPredecessor(const node_id_t &node) const;
+      node_id_t successorOf(const node_id_t &node) const;
+      node_id_t predecessorOf(const node_id_t &node) const;
+      size_t size() const;
+      size_t liveCount() const;
+      size_t tombstoneCount() const;
+      size_t memoryUsage() const;
 
-      /// Get the node after this one.
-      node_id_t successorOf(const node_id_t &node);
+    private:
+      /// The writers' working copy. Only touched with writeLock held.
+      MembershipSnapshot current;
 
-      /// Get the node before this one.
-      node_id_t predecessorOf(const node_id_t &node);
+      /// What readers see. Only accessed with std::atomic_load/store.
+      std::shared_ptr<const MembershipSnapshot> published;
 
-    private:
-      std::list<membership_entry_t> members;
+      /// Serializes writers. Recursive so that updates can nest.
+      pthread_mutex_t writeLock;
+      unsigned updateDepth;
+      bool dirty;
+
+      MembershipList(const MembershipList &) = delete;
+      MembershipList & operator=(const MembershipList &) = delete;
 
+      int joinNodeImpl(const node_id_t &node);
       int killNodeImpl(const node_id_t &node,
-                       const node_state_e desiredState);
+                       const node_state_e desiredState, const lamp_time_t now);
 
-      std::list<membership_entry_t>::iterator lookUp(const node_id_t &node);
-      std::list<membership_entry_t>::iterator lookUp(const persistent_node_id_t ip);
-      std::list<membership_entry_t>::iterator successorOfImpl(const node_id_t &node);
-      std::list<membership_entry_t>::iterator predecessorOfImpl(const node_id_t &node);
+      /// Whether the policy lets us forget this tombstone yet.
+      static bool isExpired(const membership_entry_t &entry,
+                            const uint64_t nowMs, const lamp_time_t now,
+                            const tombstone_policy_t &policy);
 
       /// Return a string representation of a node state.
       const char * strNodeState(const node_state_e state) const;
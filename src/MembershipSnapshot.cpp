@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "MembershipSnapshot.hpp"
+
+const size_t g18::MembershipSnapshot::notFound;
+const size_t g18::MembershipSnapshot::digestBuckets;
+
+/// The splitmix64 finalizer, so that nearby IPs and timestamps hash far apart.
+static uint64_t mix64(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+g18::MembershipSnapshot::MembershipSnapshot()
+: overallDigest(0)
+{
+  memset(bucketDigests, 0, sizeof(bucketDigests));
+}
+
+bool g18::MembershipSnapshot::hasSuccessor(const node_id_t &node) const
+{
+  return successorOfImpl(node) != notFound;
+}
+
+bool g18::MembershipSnapshot::hasPredecessor(const node_id_t &node) const
+{
+  return predecessorOfImpl(node) != notFound;
+}
+
+node_id_t g18::MembershipSnapshot::successorOf(const node_id_t &node) const
+{
+  const size_t idx = successorOfImpl(node);
+  if (idx == notFound) {
+    // Not found
+    node_id_t nid;
+    memset(&nid, 0, sizeof(nid));
+    return nid;
+  }
+  return members[idx].id;
+}
+
+node_id_t g18::MembershipSnapshot::predecessorOf(const node_id_t &node) const
+{
+  const size_t idx = predecessorOfImpl(node);
+  if (idx == notFound) {
+    // Not found
+    node_id_t nid;
+    memset(&nid, 0, sizeof(nid));
+    return nid;
+  }
+  return members[idx].id;
+}
+
+std::vector<node_id_t> g18::MembershipSnapshot::successorsOf(const node_id_t &node,
+                                                            const size_t k) const
+{
+  std::vector<node_id_t> nodes;
+  const size_t queryIdx = lookUp(node);
+  if (queryIdx == notFound || live.empty()) {
+    return nodes;
+  }
+  // Walk forwards from the first online node after this one, wrapping
+  // around, until we've seen every online node once
+  size_t pos = std::upper_bound(live.begin(), live.end(), queryIdx) - live.begin();
+  for (size_t step = 0; step < live.size() && nodes.size() < k; step++, pos++) {
+    const size_t idx = live[pos % live.size()];
+    if (idx != queryIdx) {
+      nodes.push_back(members[idx].id);
+    }
+  }
+  return nodes;
+}
+
+std::vector<node_id_t> g18::MembershipSnapshot::predecessorsOf(const node_id_t &node,
+                                                              const size_t k) const
+{
+  std::vector<node_id_t> nodes;
+  const size_t queryIdx = lookUp(node);
+  if (queryIdx == notFound || live.empty()) {
+    return nodes;
+  }
+  // Walk backwards from the last online node before this one
+  const size_t first = std::lower_bound(live.begin(), live.end(), queryIdx) - live.begin();
+  size_t pos = first + live.size() - 1;
+  for (size_t step = 0; step < live.size() && nodes.size() < k; step++, pos--) {
+    const size_t idx = live[pos % live.size()];
+    if (idx != queryIdx) {
+      nodes.push_back(members[idx].id);
+    }
+  }
+  return nodes;
+}
+
+node_id_t g18::MembershipSnapshot::liveMember(const size_t i) const
+{
+  return members[live[i]].id;
+}
+
+void g18::MembershipSnapshot::sampleLive(const size_t count,
+                                         const std::vector<node_id_t> &exclude,
+                                         unsigned *seed,
+                                         std::vector<node_id_t> &out) const
+{
+  out.clear();
+  // Floyd's algorithm: a uniformly random set of enough distinct members
+  // that there are still count once the excluded ones are left out
+  const size_t picks = std::min(live.size(), count + exclude.size());
+  std::vector<size_t> chosen;
+  for (size_t j = live.size() - picks; j < live.size(); j++) {
+    const size_t t = rand_r(seed) % (j + 1);
+    const bool taken = std::find(chosen.begin(), chosen.end(), t) != chosen.end();
+    chosen.push_back(taken ? j : t);
+  }
+  for (auto it = chosen.begin(); it != chosen.end(); ++it) {
+    const node_id_t &node = members[live[*it]].id;
+    bool excluded = false;
+    for (auto ex = exclude.begin(); ex != exclude.end(); ++ex) {
+      excluded = excluded || isEqual(node, *ex);
+    }
+    if (!excluded) {
+      out.push_back(node);
+    }
+  }
+  // The set is uniform but its order isn't, so drop extras at random
+  while (out.size() > count) {
+    out[rand_r(seed) % out.size()] = out.back();
+    out.pop_back();
+  }
+}
+
+bool g18::MembershipSnapshot::isOnline(const node_id_t &node) const
+{
+  const size_t idx = lookUp(node);
+  return idx != notFound && members[idx].state == NODE_STATE_ONLINE;
+}
+
+bool g18::MembershipSnapshot::latestEntryFor(const persistent_node_id_t ip,
+                                             membership_entry_t &out) const
+{
+  const size_t idx = lookUp(ip);
+  if (idx == notFound) {
+    return false;
+  }
+  out = members[idx];
+  return true;
+}
+
+const std::vector<membership_entry_t> & g18::MembershipSnapshot::entries() const
+{
+  return members;
+}
+
+membership_digest_t g18::MembershipSnapshot::digest() const
+{
+  return overallDigest;
+}
+
+membership_digest_t g18::MembershipSnapshot::bucketDigest(const size_t bucket) const
+{
+  return bucketDigests[bucket];
+}
+
+void g18::MembershipSnapshot::entriesInBuckets(const uint64_t mask,
+                                               std::vector<membership_entry_t> &out) const
+{
+  out.clear();
+  for (auto it = indexByIP.begin(); it != indexByIP.end(); ++it) {
+    if ((mask >> bucketOf(it->first)) & 1) {
+      out.push_back(members[it->second]);
+    }
+  }
+  // Nearby IPs encode in fewer bytes
+  std::sort(out.begin(), out.end(),
+            [](const membership_entry_t &a, const membership_entry_t &b) {
+    return a.id.ip < b.id.ip;
+  });
+}
+
+size_t g18::MembershipSnapshot::bucketOf(const persistent_node_id_t ip)
+{
+  return mix64(ip) % digestBuckets;
+}
+
+membership_digest_t g18::MembershipSnapshot::entryHash(const node_id_t &node)
+{
+  const uint64_t hash = mix64(mix64(node.ip) ^ node.timestamp);
+  return static_cast<membership_digest_t>(hash ^ (hash >> 32));
+}
+
+size_t g18::MembershipSnapshot::size() const
+{
+  return members.size();
+}
+
+size_t g18::MembershipSnapshot::liveCount() const
+{
+  return live.size();
+}
+
+size_t g18::MembershipSnapshot::tombstoneCount() const
+{
+  return members.size() - live.size();
+}
+
+size_t g18::MembershipSnapshot::memoryUsage() const
+{
+  // Each hash node holds the pair and a next pointer
+  return members.capacity() * sizeof(membership_entry_t) +
+         live.capacity() * sizeof(size_t) +
+         indexByIP.bucket_count() * sizeof(void *) +
+         indexByIP.size() * (sizeof(std::pair<persistent_node_id_t, size_t>) +
+                             sizeof(void *));
+}
+
+size_t g18::MembershipSnapshot::lookUp(const persistent_node_id_t ip) const
+{
+  auto it = indexByIP.find(ip);
+  return it == indexByIP.end() ? notFound : it->second;
+}
+
+size_t g18::MembershipSnapshot::lookUp(const node_id_t &node) const
+{
+  // Only the most recent entry for an IP can be found
+  const size_t idx = lookUp(node.ip);
+  if (idx == notFound || !isEqual(members[idx].id, node)) {
+    return notFound;
+  }
+  return idx;
+}
+
+size_t g18::MembershipSnapshot::successorOfImpl(const node_id_t &node) const
+{
+  const size_t queryIdx = lookUp(node);
+  if (queryIdx == notFound || live.empty()) {
+    return notFound;
+  }
+  // The first online node after this one, wrapping around to the beginning
+  auto it = std::upper_bound(live.begin(), live.end(), queryIdx);
+  if (it == live.end()) {
+    it = live.begin();
+  }
+  // We might have wrapped all the way back around to ourself
+  return *it == queryIdx ? notFound : *it;
+}
+
+size_t g18::MembershipSnapshot::predecessorOfImpl(const node_id_t &node) const
+{
+  const size_t queryIdx = lookUp(node);
+  if (queryIdx == notFound || live.empty()) {
+    return notFound;
+  }
+  // The last online node before this one, wrapping around to the end
+  auto it = std::lower_bound(live.begin(), live.end(), queryIdx);
+  if (it == live.begin()) {
+    it = live.end();
+  }
+  --it;
+  // We might have wrapped all the way back around to ourself
+  return *it == queryIdx ? notFound : *it;
+}
+
+void g18::MembershipSnapshot::toggleDigest(const node_id_t &node)
+{
+  const membership_digest_t hash = entryHash(node);
+  bucketDigests[bucketOf(node.ip)] ^= hash;
+  overallDigest ^= hash;
+}
+
+void g18::MembershipSnapshot::reindex()
+{
+  indexByIP.clear();
+  live.clear();
+  memset(bucketDigests, 0, sizeof(bucketDigests));
+  overallDigest = 0;
+  for (size_t i = 0; i < members.size(); i++) {
+    // Later entries are newer incarnations, so they win
+    indexByIP[members[i].id.ip] = i;
+    if (members[i].state == NODE_STATE_ONLINE) {
+      live.push_back(i);
+      toggleDigest(members[i].id);
+    }
+  }
+  if (live.capacity() > 2 * live.size()) {
+    live.shrink_to_fit();
+  }
+}
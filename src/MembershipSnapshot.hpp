@@ -0,0 +1,137 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "net_types.hpp"
+
+typedef struct __attribute__((packed)) {
+  node_id_t id;
+  node_state_e state;
+  /// When the node departed or died, in monotonic milliseconds and Lamport
+  /// time. Only meaningful for tombstones.
+  uint64_t goneAtMs;
+  lamp_time_t goneAtTime;
+} membership_entry_t;
+
+/// A hash of the online entries in a membership list, or some of them. Two
+/// lists with the same online nodes have the same digest, whatever order
+/// they heard about them in.
+typedef uint32_t membership_digest_t;
+
+namespace g18 {
+  class MembershipList;
+
+  /// The membership list as it stood at one instant. Once published by a
+  /// MembershipList a snapshot never changes, so any number of threads may
+  /// read it without locking.
+  class MembershipSnapshot {
+    public:
+      /// Entries are split into this many buckets by IP, each with its own
+      /// digest, so that two lists that differ can find out where.
+      static const size_t digestBuckets = 64;
+
+      MembershipSnapshot();
+
+      /// Check if the node after this one exists and is alive.
+      bool hasSuccessor(const node_id_t &node) const;
+
+      /// Check if the node before this one exists and is alive.
+      bool hasPredecessor(const node_id_t &node) const;
+
+      /// Get the node after this one, or all zeroes if there isn't one.
+      node_id_t successorOf(const node_id_t &node) const;
+
+      /// Get the node before this one, or all zeroes if there isn't one.
+      node_id_t predecessorOf(const node_id_t &node) const;
+
+      /// Get up to k distinct online nodes after this one, nearest first.
+      /// Never includes the node itself.
+      std::vector<node_id_t> successorsOf(const node_id_t &node, const size_t k) const;
+
+      /// Get up to k distinct online nodes before this one, nearest first.
+      /// Never includes the node itself.
+      std::vector<node_id_t> predecessorsOf(const node_id_t &node, const size_t k) const;
+
+      /// Get the i-th online node in ring order, for picking members at
+      /// random. i must be less than liveCount().
+      node_id_t liveMember(const size_t i) const;
+
+      /// Pick up to count distinct online nodes uniformly at random, leaving
+      /// out any in exclude, in O(count + exclude.size()). seed is for
+      /// rand_r().
+      void sampleLive(const size_t count, const std::vector<node_id_t> &exclude,
+                      unsigned *seed, std::vector<node_id_t> &out) const;
+
+      /// Whether this exact node is in the list and online.
+      bool isOnline(const node_id_t &node) const;
+
+      /// Get the most recent entry for this IP. Returns false if there isn't
+      /// one.
+      bool latestEntryFor(const persistent_node_id_t ip,
+                          membership_entry_t &out) const;
+
+      /// Every entry, online or not, in ring order.
+      const std::vector<membership_entry_t> & entries() const;
+
+      /// The XOR of every online entry's hash. Kept up to date as the list
+      /// changes, so it costs nothing to ask for.
+      membership_digest_t digest() const;
+
+      /// The XOR of the hashes of the online entries in one bucket.
+      membership_digest_t bucketDigest(const size_t bucket) const;
+
+      /// Get the most recent entry for every IP in the buckets set in mask,
+      /// online or not, in order of IP.
+      void entriesInBuckets(const uint64_t mask,
+                            std::vector<membership_entry_t> &out) const;
+
+      /// Which bucket this IP's entries are in.
+      static size_t bucketOf(const persistent_node_id_t ip);
+
+      /// What an online entry for this node contributes to the digests.
+      static membership_digest_t entryHash(const node_id_t &node);
+
+      /// Number of entries, online or not.
+      size_t size() const;
+
+      /// Number of online entries.
+      size_t liveCount() const;
+
+      /// Number of departed and dead entries.
+      size_t tombstoneCount() const;
+
+      /// Approximate heap usage of the entries and their indices, in bytes.
+      size_t memoryUsage() const;
+
+    private:
+      friend class MembershipList;
+
+      /// Every entry in ring order. New nodes always join at the end.
+      std::vector<membership_entry_t> members;
+
+      /// Index into members of the most recent entry for each IP.
+      std::unordered_map<persistent_node_id_t, size_t> indexByIP;
+
+      /// Indices into members of the online entries, in ascending order, so
+      /// ring navigation never has to step over dead entries.
+      std::vector<size_t> live;
+
+      /// Indexed by bucketOf(). The overall digest is all of these XORed.
+      membership_digest_t bucketDigests[digestBuckets];
+      membership_digest_t overallDigest;
+
+      static const size_t notFound = static_cast<size_t>(-1);
+
+      /// These all return an index into members, or notFound.
+      size_t lookUp(const node_id_t &node) const;
+      size_t lookUp(const persistent_node_id_t ip) const;
+      size_t successorOfImpl(const node_id_t &node) const;
+      size_t predecessorOfImpl(const node_id_t &node) const;
+
+      /// Add or remove an online entry's hash from the digests.
+      void toggleDigest(const node_id_t &node);
+
+      /// Rebuild indexByIP, live and the digests from members.
+      void reindex();
+  };
+}
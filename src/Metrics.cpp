@@ -0,0 +1,161 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Metrics.hpp"
+#include "utils.hpp"
+
+#define METRICS_NAME_ENTRY(id, name, description) name,
+
+static const char *counterNames[METRIC_COUNTER_COUNT] = {
+  METRICS_COUNTERS(METRICS_NAME_ENTRY)
+};
+
+static const char *histogramNames[METRIC_HISTOGRAM_COUNT] = {
+  METRICS_HISTOGRAMS(METRICS_NAME_ENTRY)
+};
+
+/// The calling thread's shard, plus one; zero until it's been assigned.
+static __thread unsigned localShardIndex;
+
+const unsigned g18::Metrics::numShards;
+
+g18::Metrics & g18::Metrics::instance()
+{
+  // Plain new can't honour the shards' alignment before C++17. Never
+  // destroyed, so it's safe to count from atexit handlers.
+  static char storage[sizeof(Metrics)] __attribute__((aligned(64)));
+  static Metrics *metrics = new (storage) Metrics();
+  return *metrics;
+}
+
+g18::Metrics::Metrics()
+: nextShard(0)
+{
+  for (unsigned s = 0; s < numShards; s++) {
+    for (unsigned c = 0; c < METRIC_COUNTER_COUNT; c++) {
+      shards[s].counters[c].store(0, std::memory_order_relaxed);
+    }
+  }
+  pthread_mutex_init(&gaugesLock, NULL);
+}
+
+void g18::Metrics::increment(const metric_counter_e counter, const uint64_t n)
+{
+  localShard().counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t g18::Metrics::value(const metric_counter_e counter) const
+{
+  uint64_t total = 0;
+  for (unsigned s = 0; s < numShards; s++) {
+    total += shards[s].counters[counter].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void g18::Metrics::record(const metric_histogram_e histogram, const uint64_t value)
+{
+  histograms[histogram].record(value);
+}
+
+const g18::Histogram & g18::Metrics::histogram(const metric_histogram_e histogram) const
+{
+  return histograms[histogram];
+}
+
+void g18::Metrics::addGauge(const char *name, gauge_t gauge, const void *context)
+{
+  const gauge_entry_t entry = {name, gauge, context};
+  pthread_mutex_lock(&gaugesLock);
+  gauges.push_back(entry);
+  pthread_mutex_unlock(&gaugesLock);
+}
+
+std::string g18::Metrics::report() const
+{
+  std::string out;
+  char line[512];
+  for (unsigned c = 0; c < METRIC_COUNTER_COUNT; c++) {
+    snprintf(line, sizeof(line), "%s %llu\n", counterNames[c],
+             (unsigned long long)value(static_cast<metric_counter_e>(c)));
+    out += line;
+  }
+  pthread_mutex_lock(&gaugesLock);
+  for (auto it = gauges.begin(); it != gauges.end(); ++it) {
+    snprintf(line, sizeof(line), "%s %llu\n", it->name,
+             (unsigned long long)it->gauge(it->context));
+    out += line;
+  }
+  pthread_mutex_unlock(&gaugesLock);
+  for (unsigned h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+    if (histograms[h].count() > 0) {
+      snprintf(line, sizeof(line), "%s %s\n", histogramNames[h],
+               histograms[h].summary().c_str());
+      out += line;
+    }
+  }
+  return out;
+}
+
+int g18::Metrics::openEndpoint(const char *path)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    MPLOG_ERROR("stats socket path %s is too long", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    MPLOG_ERROR("opening stats socket: %s", strerror(errno));
+    return -1;
+  }
+  // A previous run may have left its socket behind
+  unlink(path);
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 8) != 0) {
+    MPLOG_ERROR("listening on stats socket %s: %s", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  MPLOG("Serving stats on %s", path);
+  return fd;
+}
+
+void g18::Metrics::serveEndpoint(const int listenfd) const
+{
+  int connfd;
+  while ((connfd = accept4(listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    // A report fits easily in the socket buffer, so a client that isn't
+    // reading just gets a truncated one rather than holding up the loop
+    const std::string out = report();
+    if (send(connfd, out.data(), out.size(), MSG_NOSIGNAL) < 0) {
+      MPLOG_WARNING("sending stats: %s", strerror(errno));
+    }
+    close(connfd);
+  }
+}
+
+const char * g18::Metrics::counterName(const metric_counter_e counter)
+{
+  return counterNames[counter];
+}
+
+const char * g18::Metrics::histogramName(const metric_histogram_e histogram)
+{
+  return histogramNames[histogram];
+}
+
+g18::Metrics::shard_t & g18::Metrics::localShard()
+{
+  if (localShardIndex == 0) {
+    localShardIndex = nextShard.fetch_add(1, std::memory_order_relaxed) % numShards + 1;
+  }
+  return shards[localShardIndex - 1];
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+#include "Histogram.hpp"
+
+/////////////////////////////////////////
+// Metric definitions
+//
+// X(id, name, description). Each id becomes METRIC_<id>; the name is what
+// the stats endpoint reports.
+/////////////////////////////////////////
+
+#define METRICS_COUNTERS(X) \
+  X(HEARTBEATS_SENT, "heartbeats_sent", "Heartbeats sent to our successor") \
+  X(HEARTBEAT_SEND_ERRORS, "heartbeat_send_errors", "Heartbeats we couldn't send") \
+  X(HEARTBEATS_RECEIVED, "heartbeats_received", "Heartbeats received") \
+  X(HEARTBEATS_MALFORMED, "heartbeats_malformed", "Heartbeats dropped as malformed") \
+  X(MISSED_HEARTBEATS, "missed_heartbeats", "Heartbeat deadlines that passed") \
+  X(NODES_DECLARED_DEAD, "nodes_declared_dead", "Predecessors we declared dead") \
+  X(FAILURE_REPORTS_DEFERRED, "failure_reports_deferred", "Timeouts left to a closer monitor") \
+  X(PROBES_STARTED, "probes_started", "Suspects we began probing") \
+  X(PROBES_REFUTED, "probes_refuted", "Suspects that answered, or heartbeat, in time") \
+  X(PROBES_FAILED, "probes_failed", "Suspects that didn't") \
+  X(PROBE_MESSAGES_SENT, "probe_messages_sent", "Pings and acks sent for others' probes") \
+  X(BP_MESSAGES_RECEIVED, "bp_messages_received", "BP messages received") \
+  X(BP_MESSAGES_MALFORMED, "bp_messages_malformed", "BP messages dropped as malformed") \
+  X(BP_MESSAGES_SENT, "bp_messages_sent", "BP messages sent to our predecessor") \
+  X(BP_DATAGRAMS_SENT, "bp_datagrams_sent", "Datagrams those BP messages took") \
+  X(BP_SEND_ERRORS, "bp_send_errors", "BP messages we couldn't send") \
+  X(GOSSIP_ROUNDS, "gossip_rounds", "Rounds of gossip sent") \
+  X(GOSSIP_DATAGRAMS_SENT, "gossip_datagrams_sent", "Datagrams those rounds took, over all recipients") \
+  X(GOSSIP_SEND_ERRORS, "gossip_send_errors", "Rounds of gossip we couldn't send") \
+  X(PIGGYBACKED_CHANGES_SENT, "piggybacked_changes_sent", "Changes carried on our heartbeats") \
+  X(PIGGYBACKED_CHANGES_RECEIVED, "piggybacked_changes_received", "Changes that came with heartbeats") \
+  X(PIGGYBACKED_CHANGES_PRUNED, "piggybacked_changes_pruned", "Changes dropped before their last retransmission") \
+  X(JOIN_REQUESTS_SENT, "join_requests_sent", "Requests we sent seeds to let us join") \
+  X(JOIN_REQUESTS_ADMITTED, "join_requests_admitted", "Join requests we admitted") \
+  X(JOIN_BATCHES, "join_batches", "Batches of join requests we admitted together") \
+  X(SNAPSHOTS_SENT, "snapshots_sent", "Membership lists sent to nodes we admitted") \
+  X(SNAPSHOTS_APPLIED, "snapshots_applied", "Membership lists we joined from") \
+  X(DIGEST_MISMATCHES, "digest_mismatches", "Heartbeats whose membership digest differed from ours") \
+  X(SYNC_REQUESTS_SENT, "sync_requests_sent", "Neighbors we asked to sync after their digest stayed different") \
+  X(SYNC_DATAGRAMS_SENT, "sync_datagrams_sent", "Datagrams of entries sent to sync with a neighbor") \
+  X(SYNC_REPAIRS, "sync_repairs", "Changes we'd missed and learned from a sync") \
+  X(CLOCK_SKEW_REJECTED, "clock_skew_rejected", "Remote times ignored for being too far ahead of our clock") \
+  X(CHANGELISTS_ENCODED, "changelists_encoded", "Changelists encoded") \
+  X(CHANGELISTS_DECODED, "changelists_decoded", "Changelists decoded") \
+  X(CHANGELIST_DECODE_ERRORS, "changelist_decode_errors", "Changelists that failed to decode")
+
+#define METRICS_HISTOGRAMS(X) \
+  X(HEARTBEAT_SEND_NS, "heartbeat_send_ns", "Time to send a heartbeat") \
+  X(MISSED_HEARTBEAT_NS, "missed_heartbeat_ns", "Time to handle a missed heartbeat") \
+  X(HEARTBEAT_TIMEOUT_MS, "heartbeat_timeout_ms", "Deadline given each neighbor's next heartbeat") \
+  X(PROBE_RTT_NS, "probe_rtt_ns", "Time from starting a probe to its first ack") \
+  X(JOIN_LATENCY_MS, "join_latency_ms", "Time from our first join request to joining") \
+  X(JOIN_BATCH_SIZE, "join_batch_size", "Join requests admitted in each batch") \
+  X(BP_HANDLER_NS, "bp_handler_ns", "Time to apply a received BP message") \
+  X(BP_MESSAGE_BYTES, "bp_message_bytes", "Size of received BP datagrams") \
+  X(BP_CHANGES, "bp_changes", "Changes in each received BP datagram") \
+  X(DELTA_LOCK_HOLD_NS, "delta_lock_hold_ns", "How long deltaLock is held") \
+  X(ENCODE_NS, "encode_ns", "Time to encode a changelist") \
+  X(DECODE_NS, "decode_ns", "Time to decode a changelist")
+
+#define METRICS_ENUM_ENTRY(id, name, description) METRIC_##id,
+
+typedef enum {
+  METRICS_COUNTERS(METRICS_ENUM_ENTRY)
+  METRIC_COUNTER_COUNT
+} metric_counter_e;
+
+typedef enum {
+  METRICS_HISTOGRAMS(METRICS_ENUM_ENTRY)
+  METRIC_HISTOGRAM_COUNT
+} metric_histogram_e;
+
+namespace g18 {
+  /// The process's counters and histograms. Counters are split into shards,
+  /// each on its own cache lines, and every thread bumps only its own, so
+  /// counting is a single uncontended relaxed add. Reading sums the shards.
+  /// Histograms are the lock-free Histogram. Values owned elsewhere can be
+  /// added as gauges, which are read whenever the metrics are reported.
+  class Metrics {
+    public:
+      /// Threads are spread over this many counter shards.
+      static const unsigned numShards = 16;
+
+      /// Reads a value owned by someone else.
+      typedef uint64_t (*gauge_t)(const void *context);
+
+      static Metrics & instance();
+
+      void increment(const metric_counter_e counter, const uint64_t n = 1);
+      uint64_t value(const metric_counter_e counter) const;
+
+      void record(const metric_histogram_e histogram, const uint64_t value);
+      const Histogram & histogram(const metric_histogram_e histogram) const;
+
+      /// Report gauge(context) under name from now on.
+      void addGauge(const char *name, gauge_t gauge, const void *context);
+
+      /// Everything, one "name value" line per counter and gauge, then one
+      /// "name n=.. min=.. .." line per histogram that has samples.
+      std::string report() const;
+
+      /// Open a Unix socket at path that report() can be served from. Any
+      /// stale socket there is replaced. Returns the listening fd, or -1.
+      static int openEndpoint(const char *path);
+
+      /// Accept every waiting connection on an endpoint, write it the
+      /// report, and close it. Never blocks.
+      void serveEndpoint(const int listenfd) const;
+
+      static const char * counterName(const metric_counter_e counter);
+      static const char * histogramName(const metric_histogram_e histogram);
+
+    private:
+      typedef struct {
+        std::atomic<uint64_t> counters[METRIC_COUNTER_COUNT];
+      } __attribute__((aligned(64))) shard_t;
+
+      typedef struct {
+        const char *name;
+        gauge_t gauge;
+        const void *context;
+      } gauge_entry_t;
+
+      shard_t shards[numShards];
+      Histogram histograms[METRIC_HISTOGRAM_COUNT];
+
+      std::atomic<unsigned> nextShard;
+
+      std::vector<gauge_entry_t> gauges;
+      mutable pthread_mutex_t gaugesLock;
+
+      Metrics();
+
+      /// The calling thread's shard.
+      shard_t & localShard();
+
+      Metrics(const Metrics &) = delete;
+      Metrics & operator=(const Metrics &) = delete;
+  };
+}
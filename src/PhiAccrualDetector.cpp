@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include "PhiAccrualDetector.hpp"
+
+// The normal distribution's tail, as the logistic approximation
+// 1 - F(y) = 1 / (1 + exp(y * (a + b * y * y))), so that phi has a closed
+// form and so does its inverse.
+#define PHI_LOGISTIC_A 1.5976
+#define PHI_LOGISTIC_B 0.070566
+
+// Intervals are capped at about a minute, which keeps a full window's sum of
+// squares well inside 64 bits
+#define PHI_MAX_INTERVAL_US (static_cast<uint64_t>(1) << 26)
+
+const unsigned g18::PhiAccrualDetector::windowSize;
+const unsigned g18::PhiAccrualDetector::minSamples;
+
+g18::PhiAccrualDetector::PhiAccrualDetector(const double threshold,
+                                            const unsigned minStdDevMs,
+                                            const unsigned acceptablePauseMs)
+: threshold(threshold), minStdDevMs(minStdDevMs), acceptablePauseMs(acceptablePauseMs)
+{
+}
+
+void g18::PhiAccrualDetector::heartbeat(const node_id_t &node, const uint64_t nowNs)
+{
+  auto it = histories.find(node.ip);
+  if (it == histories.end() || !isEqual(it->second.node, node)) {
+    history_t &fresh = histories[node.ip];
+    fresh.node = node;
+    fresh.lastArrivalNs = nowNs;
+    fresh.next = fresh.count = 0;
+    fresh.sumUs = fresh.sumSquaresUs = 0;
+    return;
+  }
+  history_t &history = it->second;
+  const uint64_t elapsedUs = nowNs > history.lastArrivalNs ?
+    (nowNs - history.lastArrivalNs) / 1000 : 0;
+  const uint32_t intervalUs =
+    static_cast<uint32_t>(std::min(elapsedUs, PHI_MAX_INTERVAL_US));
+  history.lastArrivalNs = nowNs;
+  if (history.count == windowSize) {
+    const uint64_t oldest = history.intervalsUs[history.next];
+    history.sumUs -= oldest;
+    history.sumSquaresUs -= oldest * oldest;
+  } else {
+    history.count++;
+  }
+  history.intervalsUs[history.next] = intervalUs;
+  history.next = (history.next + 1) % windowSize;
+  history.sumUs += intervalUs;
+  history.sumSquaresUs += static_cast<uint64_t>(intervalUs) * intervalUs;
+}
+
+double g18::PhiAccrualDetector::phi(const node_id_t &node, const uint64_t nowNs) const
+{
+  const history_t *history = usableHistory(node);
+  if (history == NULL) {
+    return 0;
+  }
+  double meanMs, stdDevMs;
+  statistics(*history, meanMs, stdDevMs);
+  const double elapsedMs = nowNs > history->lastArrivalNs ?
+    (nowNs - history->lastArrivalNs) / 1e6 : 0;
+  return phiFor(elapsedMs, meanMs, stdDevMs);
+}
+
+bool g18::PhiAccrualDetector::timeUntilSuspicionMs(const node_id_t &node,
+                                                   const uint64_t nowNs,
+                                                   uint64_t &ms) const
+{
+  const history_t *history = usableHistory(node);
+  if (history == NULL) {
+    return false;
+  }
+  double meanMs, stdDevMs;
+  statistics(*history, meanMs, stdDevMs);
+  const double suspectAtNs = history->lastArrivalNs +
+    elapsedForPhi(threshold, meanMs, stdDevMs) * 1e6;
+  ms = suspectAtNs > nowNs ?
+    static_cast<uint64_t>(std::ceil((suspectAtNs - nowNs) / 1e6)) : 0;
+  return true;
+}
+
+void g18::PhiAccrualDetector::forget(const persistent_node_id_t ip)
+{
+  histories.erase(ip);
+}
+
+size_t g18::PhiAccrualDetector::size() const
+{
+  return histories.size();
+}
+
+double g18::PhiAccrualDetector::phiFor(const double elapsedMs, const double meanMs,
+                                       const double stdDevMs)
+{
+  // phi = log10(1 + exp(x)), which is just x * log10(e) once exp(x) would
+  // overflow, or swamp the 1
+  const double y = (elapsedMs - meanMs) / stdDevMs;
+  const double x = y * (PHI_LOGISTIC_A + PHI_LOGISTIC_B * y * y);
+  return x > 30 ? x / M_LN10 : std::log10(1 + std::exp(x));
+}
+
+double g18::PhiAccrualDetector::elapsedForPhi(const double threshold,
+                                              const double meanMs,
+                                              const double stdDevMs)
+{
+  if (threshold <= 0) {
+    return 0;
+  }
+  // Undo the log10 to get x, then solve the cubic b * y^3 + a * y = x, which
+  // has exactly one real root since a and b are positive
+  const double x = threshold > 13 ?
+    threshold * M_LN10 : std::log(std::expm1(threshold * M_LN10));
+  const double p = PHI_LOGISTIC_A / PHI_LOGISTIC_B, q = x / PHI_LOGISTIC_B;
+  const double d = std::sqrt(q * q / 4 + p * p * p / 27);
+  const double y = std::cbrt(q / 2 + d) + std::cbrt(q / 2 - d);
+  return std::max(meanMs + y * stdDevMs, 0.0);
+}
+
+const g18::PhiAccrualDetector::history_t *
+g18::PhiAccrualDetector::usableHistory(const node_id_t &node) const
+{
+  auto it = histories.find(node.ip);
+  if (it == histories.end() || !isEqual(it->second.node, node) ||
+      it->second.count < minSamples) {
+    return NULL;
+  }
+  return &it->second;
+}
+
+void g18::PhiAccrualDetector::statistics(const history_t &history, double &meanMs,
+                                         double &stdDevMs) const
+{
+  const double n = history.count;
+  const double meanUs = history.sumUs / n;
+  const double variance = std::max(history.sumSquaresUs / n - meanUs * meanUs, 0.0);
+  meanMs = meanUs / 1000 + acceptablePauseMs;
+  stdDevMs = std::max(std::sqrt(variance) / 1000, minStdDevMs);
+}
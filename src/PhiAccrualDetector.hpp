@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <stdint.h>
+#include "net_types.hpp"
+
+namespace g18 {
+  /// The phi accrual failure detector of Hayashibara et al. For each node it
+  /// keeps a sliding window of heartbeat inter-arrival times and, rather than
+  /// a yes-or-no timeout, gives a suspicion level phi that grows the longer
+  /// the next heartbeat is overdue: phi = -log10(P(a heartbeat comes later
+  /// than this)), modelling arrivals as normally distributed. A node is
+  /// suspected once phi passes a threshold, so a steady link is watched
+  /// closely and a jittery one given more slack. Updating a window is O(1).
+  /// Not thread-safe.
+  class PhiAccrualDetector {
+    public:
+      /// Inter-arrival times kept per node.
+      static const unsigned windowSize = 100;
+
+      /// Intervals needed before we trust the window over a fixed timeout.
+      static const unsigned minSamples = 3;
+
+      /// threshold is the phi at which a node is suspected. The standard
+      /// deviation is taken to be at least minStdDevMs, so that a perfectly
+      /// regular link doesn't make the smallest delay look like a failure, and
+      /// heartbeats are only expected acceptablePauseMs after the mean, which
+      /// lets a link lose one now and then.
+      PhiAccrualDetector(const double threshold, const unsigned minStdDevMs,
+                         const unsigned acceptablePauseMs = 0);
+
+      /// Record a heartbeat from node at nowNs. A heartbeat from a new
+      /// incarnation starts its window over.
+      void heartbeat(const node_id_t &node, const uint64_t nowNs);
+
+      /// How suspect node is at nowNs, or 0 if we don't have minSamples
+      /// intervals for it yet.
+      double phi(const node_id_t &node, const uint64_t nowNs) const;
+
+      /// Find how long after nowNs node's phi reaches the threshold, which is
+      /// 0 if it already has. Returns false if we don't have minSamples
+      /// intervals for it yet.
+      bool timeUntilSuspicionMs(const node_id_t &node, const uint64_t nowNs,
+                                uint64_t &ms) const;
+
+      /// Drop everything we know about this IP.
+      void forget(const persistent_node_id_t ip);
+
+      /// Number of nodes with a window.
+      size_t size() const;
+
+      /// phi for a heartbeat elapsedMs overdue, given the window's mean and
+      /// standard deviation.
+      static double phiFor(const double elapsedMs, const double meanMs,
+                           const double stdDevMs);
+
+      /// The inverse of phiFor(): how long after the last heartbeat phi reaches
+      /// the threshold.
+      static double elapsedForPhi(const double threshold, const double meanMs,
+                                  const double stdDevMs);
+
+    private:
+      typedef struct {
+        node_id_t node;
+        uint64_t lastArrivalNs;
+        /// A ring of the last count intervals, in microseconds, the oldest at
+        /// next once it's full. Integer sums don't drift as samples come and go.
+        uint32_t intervalsUs[windowSize];
+        unsigned next;
+        unsigned count;
+        uint64_t sumUs;
+        uint64_t sumSquaresUs;
+      } history_t;
+
+      const double threshold;
+      const double minStdDevMs;
+      const double acceptablePauseMs;
+
+      std::unordered_map<persistent_node_id_t, history_t> histories;
+
+      /// Find node's window, if it has enough samples to go by.
+      const history_t * usableHistory(const node_id_t &node) const;
+      void statistics(const history_t &history, double &meanMs, double &stdDevMs) const;
+
+      PhiAccrualDetector(const PhiAccrualDetector &) = delete;
+      PhiAccrualDetector & operator=(const PhiAccrualDetector &) = delete;
+  };
+}
@@ -0,0 +1,129 @@
+#include "TimerWheel.hpp"
+
+g18::TimerWheel::TimerWheel(const unsigned tickMs, const unsigned numSlots,
+                            expiry_handler_t handler, void *context)
+: tickMs(tickMs), handler(handler), context(context), slots(numSlots),
+currentTick(0), originMs(0), hasOrigin(false)
+{
+  for (auto it = slots.begin(); it != slots.end(); ++it) {
+    it->prev = it->next = &*it;
+  }
+}
+
+g18::TimerWheel::~TimerWheel()
+{
+  for (auto it = index.begin(); it != index.end(); ++it) {
+    delete it->second;
+  }
+}
+
+void g18::TimerWheel::schedule(const node_id_t &node, const uint64_t timeoutMs,
+                               const uint64_t nowMs)
+{
+  setOriginIfNeeded(nowMs);
+  // Round up so we never fire early
+  uint64_t deadlineTick = tickFor(nowMs + timeoutMs + tickMs - 1);
+  if (deadlineTick <= currentTick) {
+    deadlineTick = currentTick + 1;
+  }
+  timer_entry_t *entry;
+  auto it = index.find(node.ip);
+  if (it != index.end()) {
+    entry = it->second;
+    unlink(entry);
+  } else {
+    entry = new timer_entry_t;
+    index[node.ip] = entry;
+  }
+  entry->node = node;
+  entry->deadlineTick = deadlineTick;
+  link(entry);
+}
+
+void g18::TimerWheel::cancel(const persistent_node_id_t ip)
+{
+  auto it = index.find(ip);
+  if (it == index.end()) {
+    return;
+  }
+  unlink(it->second);
+  delete it->second;
+  index.erase(it);
+}
+
+bool g18::TimerWheel::isScheduled(const node_id_t &node) const
+{
+  auto it = index.find(node.ip);
+  return it != index.end() && isEqual(it->second->node, node);
+}
+
+size_t g18::TimerWheel::size() const
+{
+  return index.size();
+}
+
+void g18::TimerWheel::advance(const uint64_t nowMs)
+{
+  setOriginIfNeeded(nowMs);
+  const uint64_t targetTick = tickFor(nowMs);
+  std::vector<node_id_t> expired;
+  while (currentTick < targetTick) {
+    currentTick++;
+    timer_entry_t *head = &slots[currentTick % slots.size()];
+    for (timer_entry_t *entry = head->next; entry != head; ) {
+      timer_entry_t *next = entry->next;
+      if (entry->deadlineTick <= currentTick) {
+        expired.push_back(entry->node);
+        unlink(entry);
+        index.erase(entry->node.ip);
+        delete entry;
+      }
+      entry = next;
+    }
+    // Wake up no more than once per turn when the wheel is empty
+    if (index.empty()) {
+      currentTick = targetTick;
+    }
+  }
+  // Fire after we're done walking, since handlers may reschedule
+  for (auto it = expired.begin(); it != expired.end(); ++it) {
+    handler(*it, context);
+  }
+}
+
+unsigned g18::TimerWheel::getTickMs() const
+{
+  return tickMs;
+}
+
+void g18::TimerWheel::setOriginIfNeeded(const uint64_t nowMs)
+{
+  if (!hasOrigin) {
+    originMs = nowMs;
+    hasOrigin = true;
+  }
+}
+
+uint64_t g18::TimerWheel::tickFor(const uint64_t ms) const
+{
+  if (ms < originMs) {
+    return 0;
+  }
+  return (ms - originMs) / tickMs;
+}
+
+void g18::TimerWheel::unlink(timer_entry_t *entry)
+{
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+  entry->prev = entry->next = entry;
+}
+
+void g18::TimerWheel::link(timer_entry_t *entry)
+{
+  timer_entry_t *head = &slots[entry->deadlineTick % slots.size()];
+  entry->next = head->next;
+  entry->prev = head;
+  head->next->prev = entry;
+  head->next = entry;
+}
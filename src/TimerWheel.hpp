@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "net_types.hpp"
+
+namespace g18 {
+  /// A hashed timer wheel holding at most one deadline per node. Scheduling,
+  /// re-arming and cancelling are O(1); advancing costs O(1) per elapsed tick
+  /// plus O(1) per timer that shares a slot with an expiring one.
+  class TimerWheel {
+    public:
+      /// Called once for each node whose deadline has passed. The timer has
+      /// already been removed, so the handler may schedule it again.
+      typedef void (*expiry_handler_t)(const node_id_t &node, void *context);
+
+      /// tickMs is the resolution of every deadline; numSlots * tickMs is one
+      /// full turn of the wheel. Deadlines further out than that just take
+      /// more than one turn to come due.
+      TimerWheel(const unsigned tickMs, const unsigned numSlots,
+                 expiry_handler_t handler, void *context);
+      ~TimerWheel();
+
+      /// Arm a deadline timeoutMs from nowMs, replacing any deadline this
+      /// node's IP already has.
+      void schedule(const node_id_t &node, const uint64_t timeoutMs,
+                    const uint64_t nowMs);
+
+      /// Drop this IP's deadline, if it has one.
+      void cancel(const persistent_node_id_t ip);
+
+      /// Whether this exact node currently has a deadline.
+      bool isScheduled(const node_id_t &node) const;
+
+      /// Number of pending deadlines.
+      size_t size() const;
+
+      /// Fire every deadline that has passed as of nowMs.
+      void advance(const uint64_t nowMs);
+
+      unsigned getTickMs() const;
+
+    private:
+      typedef struct timer_entry {
+        node_id_t node;
+        uint64_t deadlineTick;
+        struct timer_entry *prev, *next;
+      } timer_entry_t;
+
+      const unsigned tickMs;
+      expiry_handler_t handler;
+      void *context;
+
+      /// Each slot is a circular list headed by a sentinel.
+      std::vector<timer_entry_t> slots;
+      std::unordered_map<persistent_node_id_t, timer_entry_t *> index;
+
+      /// The last tick we've fully processed, and the time it corresponds to.
+      uint64_t currentTick;
+      uint64_t originMs;
+      bool hasOrigin;
+
+      void setOriginIfNeeded(const uint64_t nowMs);
+      uint64_t tickFor(const uint64_t ms) const;
+      static void unlink(timer_entry_t *entry);
+      void link(timer_entry_t *entry);
+
+      TimerWheel(const TimerWheel &) = delete;
+      TimerWheel & operator=(const TimerWheel &) = delete;
+  };
+}
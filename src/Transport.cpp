@@ -0,0 +1,212 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "Transport.hpp"
+#include "socket.hpp"
+#include "utils.hpp"
+
+g18::Transport::Transport()
+: cacheLock(PTHREAD_MUTEX_INITIALIZER), sockfdV4(-1), sockfdV6(-1),
+resolutionCount(0), sendCount(0), sendErrorCount(0)
+{
+}
+
+g18::Transport::~Transport()
+{
+  if (sockfdV4 >= 0) {
+    close(sockfdV4);
+  }
+  if (sockfdV6 >= 0) {
+    close(sockfdV6);
+  }
+}
+
+int g18::Transport::sendTo(const persistent_node_id_t peer, const char *portId,
+                           const std::string &packet)
+{
+  peer_address_t dest;
+  if (lookUp(peer, portId, dest) != 0) {
+    sendErrorCount++;
+    return -1;
+  }
+  int sockfd = socketFor(dest.addr.ss_family);
+  if (sockfd < 0) {
+    sendErrorCount++;
+    return -1;
+  }
+  ssize_t sent = sendto(sockfd, packet.data(), packet.length(), 0,
+                        (struct sockaddr *)&dest.addr, dest.addrLen);
+  if (sent <= 0) {
+    MPLOG_ERROR("sending to node %u: %s", peer, strerror(errno));
+    sendErrorCount++;
+    return -1;
+  }
+  sendCount++;
+  return static_cast<int>(sent);
+}
+
+int g18::Transport::sendBatch(const std::vector<persistent_node_id_t> &peers,
+                              const char *portId,
+                              const std::vector<std::string> &packets)
+{
+  // Resolve everyone up front; skip anyone we can't reach
+  std::vector<peer_address_t> dests;
+  dests.reserve(peers.size());
+  for (auto it = peers.begin(); it != peers.end(); ++it) {
+    peer_address_t dest;
+    if (lookUp(*it, portId, dest) != 0) {
+      sendErrorCount += packets.size();
+      continue;
+    }
+    dests.push_back(dest);
+  }
+
+  std::vector<struct iovec> iovecs(packets.size());
+  for (size_t i = 0; i < packets.size(); i++) {
+    iovecs[i].iov_base = const_cast<char *>(packets[i].data());
+    iovecs[i].iov_len = packets[i].length();
+  }
+
+  // One sendmmsg() per address family
+  int totalSent = 0;
+  const int families[] = {AF_INET, AF_INET6};
+  for (size_t f = 0; f < sizeof(families) / sizeof(families[0]); f++) {
+    std::vector<struct mmsghdr> msgs;
+    for (auto dest = dests.begin(); dest != dests.end(); ++dest) {
+      if (dest->addr.ss_family != families[f]) {
+        continue;
+      }
+      for (size_t i = 0; i < packets.size(); i++) {
+        struct mmsghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_hdr.msg_name = &dest->addr;
+        msg.msg_hdr.msg_namelen = dest->addrLen;
+        msg.msg_hdr.msg_iov = &iovecs[i];
+        msg.msg_hdr.msg_iovlen = 1;
+        msgs.push_back(msg);
+      }
+    }
+    if (msgs.empty()) {
+      continue;
+    }
+    int sockfd = socketFor(families[f]);
+    if (sockfd < 0) {
+      sendErrorCount += msgs.size();
+      continue;
+    }
+    // sendmmsg() may stop early; pick up where it left off, skipping any
+    // datagram it refuses outright
+    size_t offset = 0;
+    while (offset < msgs.size()) {
+      int sent = sendmmsg(sockfd, &msgs[offset], msgs.size() - offset, 0);
+      if (sent <= 0) {
+        MPLOG_ERROR("in sendmmsg: %s", strerror(errno));
+        sendErrorCount++;
+        offset++;
+        continue;
+      }
+      offset += sent;
+      totalSent += sent;
+    }
+  }
+  sendCount += totalSent;
+  return totalSent > 0 ? totalSent : -1;
+}
+
+void g18::Transport::invalidate(const persistent_node_id_t peer)
+{
+  pthread_mutex_lock(&cacheLock);
+  for (auto it = addressCache.begin(); it != addressCache.end(); ) {
+    if ((it->first >> 16) == peer) {
+      it = addressCache.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  pthread_mutex_unlock(&cacheLock);
+}
+
+void g18::Transport::invalidateAll()
+{
+  pthread_mutex_lock(&cacheLock);
+  addressCache.clear();
+  pthread_mutex_unlock(&cacheLock);
+}
+
+uint64_t g18::Transport::getResolutionCount() const
+{
+  return resolutionCount.load();
+}
+
+uint64_t g18::Transport::getSendCount() const
+{
+  return sendCount.load();
+}
+
+uint64_t g18::Transport::getSendErrorCount() const
+{
+  return sendErrorCount.load();
+}
+
+int g18::Transport::lookUp(const persistent_node_id_t peer, const char *portId,
+                           peer_address_t &out)
+{
+  const uint64_t key = (static_cast<uint64_t>(peer) << 16) | atoi(portId);
+  pthread_mutex_lock(&cacheLock);
+  auto it = addressCache.find(key);
+  if (it != addressCache.end()) {
+    out = it->second;
+    pthread_mutex_unlock(&cacheLock);
+    return 0;
+  }
+  pthread_mutex_unlock(&cacheLock);
+
+  // Cache miss; resolve without holding the lock
+  struct addrinfo hints;
+  struct addrinfo *servinfo;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC; // don't care IPv4/v6
+  hints.ai_socktype = SOCK_DGRAM; // UDP
+
+  char *hostname = generateServerHostname(peer);
+  int status = getaddrinfo(hostname, portId, &hints, &servinfo);
+  resolutionCount++;
+  if (status != 0) {
+    MPLOG_ERROR("looking up %s: %s", hostname, gai_strerror(status));
+    free(hostname);
+    return -1;
+  }
+  free(hostname);
+  if (servinfo == NULL || servinfo->ai_addrlen > sizeof(out.addr)) {
+    freeaddrinfo(servinfo);
+    return -1;
+  }
+  memset(&out, 0, sizeof(out));
+  memcpy(&out.addr, servinfo->ai_addr, servinfo->ai_addrlen);
+  out.addrLen = servinfo->ai_addrlen;
+  freeaddrinfo(servinfo);
+
+  pthread_mutex_lock(&cacheLock);
+  addressCache[key] = out;
+  pthread_mutex_unlock(&cacheLock);
+  return 0;
+}
+
+int g18::Transport::socketFor(const int family)
+{
+  int *sockfd = (family == AF_INET6) ? &sockfdV6 : &sockfdV4;
+  pthread_mutex_lock(&cacheLock);
+  if (*sockfd < 0) {
+    *sockfd = socket(family, SOCK_DGRAM, 0);
+    if (*sockfd < 0) {
+      MPLOG_ERROR("opening socket: %s", strerror(errno));
+    }
+  }
+  int ret = *sockfd;
+  pthread_mutex_unlock(&cacheLock);
+  return ret;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "net_types.hpp"
+
+namespace g18 {
+  /// Sends datagrams to peers over a single shared UDP socket per address
+  /// family. Each (peer, port) pair is resolved once and its address is cached
+  /// until the peer is invalidated, so steady-state sends cost one syscall.
+  class Transport {
+    public:
+      Transport();
+      ~Transport();
+
+      /// Send a datagram to the given peer on the given port. Returns the
+      /// number of bytes sent, or -1 on error.
+      int sendTo(const persistent_node_id_t peer, const char *portId,
+                 const std::string &packet);
+
+      /// Send every packet to every peer on the given port with as few
+      /// sendmmsg() calls as possible. Returns the number of datagrams sent,
+      /// or -1 if none could be.
+      int sendBatch(const std::vector<persistent_node_id_t> &peers,
+                    const char *portId, const std::vector<std::string> &packets);
+
+      /// Forget the cached addresses for this peer. Call this whenever the
+      /// peer's membership changes so that it is resolved afresh next time.
+      void invalidate(const persistent_node_id_t peer);
+
+      /// Forget every cached address.
+      void invalidateAll();
+
+      /// Number of hostname resolutions performed so far.
+      uint64_t getResolutionCount() const;
+
+      /// Number of datagrams successfully handed to the kernel so far.
+      uint64_t getSendCount() const;
+
+      /// Number of sends that failed, either in resolution or in sendto().
+      uint64_t getSendErrorCount() const;
+
+    private:
+      typedef struct {
+        struct sockaddr_storage addr;
+        socklen_t addrLen;
+      } peer_address_t;
+
+      /// Cached addresses keyed by (peer << 16 | port).
+      std::unordered_map<uint64_t, peer_address_t> addressCache;
+      mutable pthread_mutex_t cacheLock;
+
+      /// Shared unconnected sockets, opened lazily.
+      int sockfdV4;
+      int sockfdV6;
+
+      std::atomic<uint64_t> resolutionCount;
+      std::atomic<uint64_t> sendCount;
+      std::atomic<uint64_t> sendErrorCount;
+
+      Transport(const Transport &) = delete;
+      Transport & operator=(const Transport &) = delete;
+
+      /// Look up the address for this peer, resolving it on a cache miss.
+      /// Returns 0 on success, -1 on error.
+      int lookUp(const persistent_node_id_t peer, const char *portId,
+                 peer_address_t &out);
+
+      /// Get the shared socket for the given address family, opening it if
+      /// necessary. Returns -1 on error.
+      int socketFor(const int family);
+  };
+}
@@ -0,0 +1,548 @@
+#include <cstring>
+#include "Metrics.hpp"
+#include "codec.hpp"
+#include "utils.hpp"
+
+#define WIRE_HEADER_SIZE 3
+#define WIRE_CHECKSUM_SIZE 4
+#define NODE_RECORD_SIZE (sizeof(persistent_node_id_t) + sizeof(lamp_time_t))
+#define MAX_VARINT_SIZE 10
+#define PROBE_SIZE (WIRE_HEADER_SIZE + 3 * sizeof(uint32_t) + NODE_RECORD_SIZE + \
+                    WIRE_CHECKSUM_SIZE)
+
+static size_t varintSize(uint64_t value)
+{
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static unsigned char * putVarint(unsigned char *p, uint64_t value)
+{
+  while (value >= 0x80) {
+    *p++ = static_cast<unsigned char>(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = static_cast<unsigned char>(value);
+  return p;
+}
+
+/// Returns NULL if the varint runs past end.
+static const unsigned char * getVarint(const unsigned char *p,
+                                       const unsigned char *end,
+                                       uint64_t &value)
+{
+  value = 0;
+  for (unsigned shift = 0; p < end && shift < 7 * MAX_VARINT_SIZE; shift += 7) {
+    const unsigned char byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+static unsigned char * putUint(unsigned char *p, uint64_t value, const size_t width)
+{
+  for (size_t i = 0; i < width; i++) {
+    *p++ = static_cast<unsigned char>(value);
+    value >>= 8;
+  }
+  return p;
+}
+
+static uint64_t getUint(const unsigned char *p, const size_t width)
+{
+  uint64_t value = 0;
+  for (size_t i = width; i > 0; i--) {
+    value = (value << 8) | p[i - 1];
+  }
+  return value;
+}
+
+static uint32_t fnv1a(const unsigned char *p, const size_t len)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static unsigned char * putNodes(unsigned char *p, const std::list<node_id_t> &nodes)
+{
+  for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+    p = putUint(p, it->ip, sizeof(it->ip));
+    p = putUint(p, it->timestamp, sizeof(it->timestamp));
+  }
+  return p;
+}
+
+static const unsigned char * getNodes(const unsigned char *p, const uint64_t count,
+                                      std::list<node_id_t> &nodes)
+{
+  for (uint64_t i = 0; i < count; i++) {
+    node_id_t node;
+    node.ip = static_cast<persistent_node_id_t>(getUint(p, sizeof(node.ip)));
+    p += sizeof(node.ip);
+    node.timestamp = static_cast<lamp_time_t>(getUint(p, sizeof(node.timestamp)));
+    p += sizeof(node.timestamp);
+    nodes.push_back(node);
+  }
+  return p;
+}
+
+void g18::encodeChangelist(const changelist_t &msg, std::string &out)
+{
+  const uint64_t startNs = monotonic_time_ns();
+  const size_t numJoined = msg.joined.size();
+  const size_t numLeft = msg.left.size();
+  const size_t numFailed = msg.failed.size();
+  const size_t size = WIRE_HEADER_SIZE + sizeof(lamp_time_t) +
+    varintSize(numJoined) + varintSize(numLeft) + varintSize(numFailed) +
+    (numJoined + numLeft + numFailed) * NODE_RECORD_SIZE + WIRE_CHECKSUM_SIZE;
+  out.resize(size);
+
+  unsigned char *start = reinterpret_cast<unsigned char *>(&out[0]), *p = start;
+  *p++ = WIRE_MAGIC;
+  *p++ = WIRE_VERSION;
+  *p++ = WIRE_MSG_CHANGELIST;
+  p = putUint(p, msg.timestamp, sizeof(msg.timestamp));
+  p = putVarint(p, numJoined);
+  p = putVarint(p, numLeft);
+  p = putVarint(p, numFailed);
+  p = putNodes(p, msg.joined);
+  p = putNodes(p, msg.left);
+  p = putNodes(p, msg.failed);
+  putUint(p, fnv1a(start, p - start), WIRE_CHECKSUM_SIZE);
+
+  Metrics &metrics = Metrics::instance();
+  metrics.increment(METRIC_CHANGELISTS_ENCODED);
+  metrics.record(METRIC_ENCODE_NS, monotonic_time_ns() - startNs);
+}
+
+void g18::encodeChangelistDatagrams(const changelist_t &msg,
+                                    const size_t maxDatagramSize,
+                                    std::vector<std::string> &out)
+{
+  // Leave room for the header, timestamp, three worst-case counts and checksum
+  const size_t overhead = WIRE_HEADER_SIZE + sizeof(lamp_time_t) +
+    3 * varintSize(maxDatagramSize) + WIRE_CHECKSUM_SIZE;
+  size_t perDatagram = 1;
+  if (maxDatagramSize > overhead + NODE_RECORD_SIZE) {
+    perDatagram = (maxDatagramSize - overhead) / NODE_RECORD_SIZE;
+  }
+
+  out.clear();
+  changelist_t chunk;
+  chunk.timestamp = msg.timestamp;
+  size_t inChunk = 0;
+  const std::list<node_id_t> *src[3] = {&msg.joined, &msg.left, &msg.failed};
+  std::list<node_id_t> *dst[3] = {&chunk.joined, &chunk.left, &chunk.failed};
+  for (int l = 0; l < 3; l++) {
+    for (auto it = src[l]->begin(); it != src[l]->end(); ++it) {
+      dst[l]->push_back(*it);
+      if (++inChunk == perDatagram) {
+        out.push_back(std::string());
+        encodeChangelist(chunk, out.back());
+        chunk.joined.clear();
+        chunk.left.clear();
+        chunk.failed.clear();
+        inChunk = 0;
+      }
+    }
+  }
+  if (inChunk > 0 || out.empty()) {
+    out.push_back(std::string());
+    encodeChangelist(chunk, out.back());
+  }
+}
+
+/// decodeChangelist() without the metrics.
+static int decodeChangelistUncounted(const char *buf, const size_t len,
+                                     changelist_t &out)
+{
+  if (!g18::isWireMessage(buf, len, WIRE_MSG_CHANGELIST) ||
+      len < WIRE_HEADER_SIZE + sizeof(lamp_time_t) + WIRE_CHECKSUM_SIZE) {
+    return -1;
+  }
+  const unsigned char *start = reinterpret_cast<const unsigned char *>(buf);
+  const unsigned char *end = start + len - WIRE_CHECKSUM_SIZE;
+  if (fnv1a(start, end - start) != getUint(end, WIRE_CHECKSUM_SIZE)) {
+    return -1;
+  }
+
+  const unsigned char *p = start + WIRE_HEADER_SIZE;
+  out.timestamp = static_cast<lamp_time_t>(getUint(p, sizeof(lamp_time_t)));
+  p += sizeof(lamp_time_t);
+  uint64_t numJoined, numLeft, numFailed;
+  if ((p = getVarint(p, end, numJoined)) == NULL ||
+      (p = getVarint(p, end, numLeft)) == NULL ||
+      (p = getVarint(p, end, numFailed)) == NULL) {
+    return -1;
+  }
+  // Make sure the records exactly fill the rest of the message
+  const uint64_t maxRecords = (end - p) / NODE_RECORD_SIZE;
+  if ((end - p) % NODE_RECORD_SIZE != 0 || numJoined > maxRecords ||
+      numLeft > maxRecords || numFailed > maxRecords ||
+      numJoined + numLeft + numFailed != maxRecords) {
+    return -1;
+  }
+  out.joined.clear();
+  out.left.clear();
+  out.failed.clear();
+  p = getNodes(p, numJoined, out.joined);
+  p = getNodes(p, numLeft, out.left);
+  getNodes(p, numFailed, out.failed);
+  return 0;
+}
+
+int g18::decodeChangelist(const char *buf, const size_t len, changelist_t &out)
+{
+  const uint64_t startNs = monotonic_time_ns();
+  const int status = decodeChangelistUncounted(buf, len, out);
+  Metrics &metrics = Metrics::instance();
+  if (status != 0) {
+    metrics.increment(METRIC_CHANGELIST_DECODE_ERRORS);
+    return status;
+  }
+  metrics.increment(METRIC_CHANGELISTS_DECODED);
+  metrics.record(METRIC_DECODE_NS, monotonic_time_ns() - startNs);
+  return 0;
+}
+
+static uint64_t zigzag(const int64_t value)
+{
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(const uint64_t value)
+{
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/// The two varints of a snapshot entry, relative to prev.
+static void snapshotEntryFields(const membership_entry_t &entry, const node_id_t &prev,
+                                uint64_t &ipField, uint64_t &timestampField)
+{
+  const int64_t ipDelta = static_cast<int64_t>(entry.id.ip) - static_cast<int64_t>(prev.ip);
+  ipField = zigzag(ipDelta) << 2 | entry.state;
+  timestampField = zigzag(static_cast<int64_t>(entry.id.timestamp - prev.timestamp));
+}
+
+static size_t snapshotEntrySize(const membership_entry_t &entry, const node_id_t &prev)
+{
+  uint64_t ipField, timestampField;
+  snapshotEntryFields(entry, prev, ipField, timestampField);
+  return varintSize(ipField) + varintSize(timestampField);
+}
+
+/// How many bytes putEntries() needs for entries [begin, end).
+static size_t entriesSize(const std::vector<membership_entry_t> &entries,
+                          const size_t begin, const size_t end)
+{
+  const node_id_t zero = {0, 0};
+  size_t size = varintSize(end - begin);
+  for (size_t i = begin; i < end; i++) {
+    size += snapshotEntrySize(entries[i], i == begin ? zero : entries[i - 1].id);
+  }
+  return size;
+}
+
+/// Write the count of entries [begin, end), then each relative to the last.
+static unsigned char * putEntries(unsigned char *p,
+                                  const std::vector<membership_entry_t> &entries,
+                                  const size_t begin, const size_t end)
+{
+  const node_id_t zero = {0, 0};
+  p = putVarint(p, end - begin);
+  for (size_t i = begin; i < end; i++) {
+    uint64_t ipField, timestampField;
+    snapshotEntryFields(entries[i], i == begin ? zero : entries[i - 1].id,
+                        ipField, timestampField);
+    p = putVarint(p, ipField);
+    p = putVarint(p, timestampField);
+  }
+  return p;
+}
+
+/// Read what putEntries() wrote. Returns NULL if it's malformed or runs past
+/// end.
+static const unsigned char * getEntries(const unsigned char *p,
+                                        const unsigned char *end,
+                                        std::vector<membership_entry_t> &out)
+{
+  uint64_t numEntries;
+  if ((p = getVarint(p, end, numEntries)) == NULL ||
+      numEntries > static_cast<uint64_t>(end - p) / 2) {
+    return NULL;
+  }
+  out.resize(numEntries);
+  node_id_t prev = {0, 0};
+  for (uint64_t i = 0; i < numEntries; i++) {
+    uint64_t ipField, timestampField;
+    if ((p = getVarint(p, end, ipField)) == NULL ||
+        (p = getVarint(p, end, timestampField)) == NULL ||
+        (ipField & 3) > NODE_STATE_DIED) {
+      return NULL;
+    }
+    membership_entry_t &entry = out[i];
+    entry.id.ip = static_cast<persistent_node_id_t>(prev.ip + unzigzag(ipField >> 2));
+    entry.id.timestamp = prev.timestamp + static_cast<lamp_time_t>(unzigzag(timestampField));
+    entry.state = static_cast<node_state_e>(ipField & 3);
+    entry.goneAtMs = 0;
+    entry.goneAtTime = 0;
+    prev = entry.id;
+  }
+  return p;
+}
+
+/// Split entries into runs that each take at most budget bytes, after the
+/// count, returning where each starts followed by entries.size(). Every run
+/// starts its deltas over, so it can be decoded on its own. There's always
+/// at least one run.
+static void splitEntries(const std::vector<membership_entry_t> &entries,
+                         const size_t budget, std::vector<size_t> &starts)
+{
+  const node_id_t zero = {0, 0};
+  starts.assign(1, 0);
+  size_t used = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    size_t size = snapshotEntrySize(entries[i], i == starts.back() ? zero : entries[i - 1].id);
+    if (i > starts.back() && used + size > budget) {
+      starts.push_back(i);
+      used = 0;
+      size = snapshotEntrySize(entries[i], zero);
+    }
+    used += size;
+  }
+  starts.push_back(entries.size());
+}
+
+/// Check a message's type and checksum, and find its body. Returns false if
+/// it isn't a well-formed message of this type with at least minBody bytes.
+static bool openMessage(const char *buf, const size_t len, const wire_msg_type_e type,
+                        const size_t minBody, const unsigned char *&body,
+                        const unsigned char *&end)
+{
+  if (!g18::isWireMessage(buf, len, type) ||
+      len < WIRE_HEADER_SIZE + minBody + WIRE_CHECKSUM_SIZE) {
+    return false;
+  }
+  const unsigned char *start = reinterpret_cast<const unsigned char *>(buf);
+  end = start + len - WIRE_CHECKSUM_SIZE;
+  body = start + WIRE_HEADER_SIZE;
+  return fnv1a(start, end - start) == getUint(end, WIRE_CHECKSUM_SIZE);
+}
+
+static unsigned char * putHeader(unsigned char *p, const wire_msg_type_e type)
+{
+  *p++ = WIRE_MAGIC;
+  *p++ = WIRE_VERSION;
+  *p++ = type;
+  return p;
+}
+
+static void encodeSnapshotChunk(const std::vector<membership_entry_t> &entries,
+                                const size_t begin, const size_t end,
+                                const lamp_time_t version,
+                                const persistent_node_id_t origin, const size_t index,
+                                const size_t count, std::string &out)
+{
+  out.resize(WIRE_HEADER_SIZE + sizeof(lamp_time_t) + sizeof(origin) + varintSize(index) +
+             varintSize(count) + entriesSize(entries, begin, end) + WIRE_CHECKSUM_SIZE);
+  unsigned char *start = reinterpret_cast<unsigned char *>(&out[0]), *p = start;
+  p = putHeader(p, WIRE_MSG_SNAPSHOT);
+  p = putUint(p, version, sizeof(version));
+  p = putUint(p, origin, sizeof(origin));
+  p = putVarint(p, index);
+  p = putVarint(p, count);
+  p = putEntries(p, entries, begin, end);
+  putUint(p, fnv1a(start, p - start), WIRE_CHECKSUM_SIZE);
+}
+
+void g18::encodeSnapshotDatagrams(const std::vector<membership_entry_t> &entries,
+                                  const lamp_time_t version,
+                                  const persistent_node_id_t origin,
+                                  const size_t maxDatagramSize,
+                                  std::vector<std::string> &out)
+{
+  // Leave room for the header, version, origin, three worst-case counts and
+  // checksum
+  const size_t overhead = WIRE_HEADER_SIZE + sizeof(lamp_time_t) + sizeof(origin) +
+    3 * varintSize(maxDatagramSize) + WIRE_CHECKSUM_SIZE;
+  const size_t budget = maxDatagramSize > overhead + 2 * MAX_VARINT_SIZE ?
+    maxDatagramSize - overhead : 2 * MAX_VARINT_SIZE;
+
+  // Every datagram says how many there are, so split them up first
+  std::vector<size_t> starts;
+  splitEntries(entries, budget, starts);
+  const size_t count = starts.size() - 1;
+  out.resize(count);
+  for (size_t c = 0; c < count; c++) {
+    encodeSnapshotChunk(entries, starts[c], starts[c + 1], version, origin, c, count, out[c]);
+  }
+}
+
+int g18::decodeSnapshot(const char *buf, const size_t len, snapshot_chunk_t &out)
+{
+  const unsigned char *p, *end;
+  if (!openMessage(buf, len, WIRE_MSG_SNAPSHOT, sizeof(lamp_time_t) + sizeof(out.origin),
+                   p, end)) {
+    return -1;
+  }
+  out.version = static_cast<lamp_time_t>(getUint(p, sizeof(lamp_time_t)));
+  p += sizeof(lamp_time_t);
+  out.origin = static_cast<persistent_node_id_t>(getUint(p, sizeof(out.origin)));
+  p += sizeof(out.origin);
+  uint64_t index, count;
+  // The count sizes the joiner's reassembly, so it mustn't be just anything
+  if ((p = getVarint(p, end, index)) == NULL ||
+      (p = getVarint(p, end, count)) == NULL ||
+      index >= count || count > WIRE_MAX_SNAPSHOT_DATAGRAMS ||
+      (p = getEntries(p, end, out.entries)) == NULL) {
+    return -1;
+  }
+  out.index = static_cast<uint32_t>(index);
+  out.count = static_cast<uint32_t>(count);
+  return p == end ? 0 : -1;
+}
+
+void g18::encodeSyncRequest(const sync_request_t &req, std::string &out)
+{
+  const size_t numBuckets = req.buckets.size();
+  out.resize(WIRE_HEADER_SIZE + sizeof(req.origin) + varintSize(numBuckets) +
+             numBuckets * sizeof(membership_digest_t) + WIRE_CHECKSUM_SIZE);
+  unsigned char *start = reinterpret_cast<unsigned char *>(&out[0]), *p = start;
+  p = putHeader(p, WIRE_MSG_SYNC_REQUEST);
+  p = putUint(p, req.origin, sizeof(req.origin));
+  p = putVarint(p, numBuckets);
+  for (size_t i = 0; i < numBuckets; i++) {
+    p = putUint(p, req.buckets[i], sizeof(membership_digest_t));
+  }
+  putUint(p, fnv1a(start, p - start), WIRE_CHECKSUM_SIZE);
+}
+
+int g18::decodeSyncRequest(const char *buf, const size_t len, sync_request_t &out)
+{
+  const unsigned char *p, *end;
+  if (!openMessage(buf, len, WIRE_MSG_SYNC_REQUEST, sizeof(out.origin), p, end)) {
+    return -1;
+  }
+  out.origin = static_cast<persistent_node_id_t>(getUint(p, sizeof(out.origin)));
+  p += sizeof(out.origin);
+  uint64_t numBuckets;
+  if ((p = getVarint(p, end, numBuckets)) == NULL ||
+      numBuckets * sizeof(membership_digest_t) != static_cast<uint64_t>(end - p)) {
+    return -1;
+  }
+  out.buckets.resize(numBuckets);
+  for (uint64_t i = 0; i < numBuckets; i++) {
+    out.buckets[i] = static_cast<membership_digest_t>(getUint(p, sizeof(membership_digest_t)));
+    p += sizeof(membership_digest_t);
+  }
+  return 0;
+}
+
+void g18::encodeSyncEntriesDatagrams(const sync_entries_t &msg,
+                                     const size_t maxDatagramSize,
+                                     std::vector<std::string> &out)
+{
+  const size_t fixed = WIRE_HEADER_SIZE + sizeof(msg.origin) + sizeof(msg.buckets) + 1;
+  const size_t overhead = fixed + varintSize(maxDatagramSize) + WIRE_CHECKSUM_SIZE;
+  const size_t budget = maxDatagramSize > overhead + 2 * MAX_VARINT_SIZE ?
+    maxDatagramSize - overhead : 2 * MAX_VARINT_SIZE;
+
+  std::vector<size_t> starts;
+  splitEntries(msg.entries, budget, starts);
+  out.resize(starts.size() - 1);
+  for (size_t c = 0; c < out.size(); c++) {
+    out[c].resize(fixed + entriesSize(msg.entries, starts[c], starts[c + 1]) +
+                  WIRE_CHECKSUM_SIZE);
+    unsigned char *start = reinterpret_cast<unsigned char *>(&out[c][0]), *p = start;
+    p = putHeader(p, WIRE_MSG_SYNC_ENTRIES);
+    p = putUint(p, msg.origin, sizeof(msg.origin));
+    p = putUint(p, msg.buckets, sizeof(msg.buckets));
+    // Only one datagram asks for a reply, so that we get just the one
+    *p++ = msg.wantsReply && c == 0;
+    p = putEntries(p, msg.entries, starts[c], starts[c + 1]);
+    putUint(p, fnv1a(start, p - start), WIRE_CHECKSUM_SIZE);
+  }
+}
+
+int g18::decodeSyncEntries(const char *buf, const size_t len, sync_entries_t &out)
+{
+  const unsigned char *p, *end;
+  if (!openMessage(buf, len, WIRE_MSG_SYNC_ENTRIES,
+                   sizeof(out.origin) + sizeof(out.buckets) + 1, p, end)) {
+    return -1;
+  }
+  out.origin = static_cast<persistent_node_id_t>(getUint(p, sizeof(out.origin)));
+  p += sizeof(out.origin);
+  out.buckets = getUint(p, sizeof(out.buckets));
+  p += sizeof(out.buckets);
+  if (*p > 1) {
+    return -1;
+  }
+  out.wantsReply = *p++ == 1;
+  if ((p = getEntries(p, end, out.entries)) == NULL) {
+    return -1;
+  }
+  return p == end ? 0 : -1;
+}
+
+void g18::encodeProbe(const probe_t &probe, std::string &out)
+{
+  out.resize(PROBE_SIZE);
+  unsigned char *start = reinterpret_cast<unsigned char *>(&out[0]), *p = start;
+  *p++ = WIRE_MAGIC;
+  *p++ = WIRE_VERSION;
+  *p++ = probe.type;
+  p = putUint(p, probe.seq, sizeof(probe.seq));
+  p = putUint(p, probe.origin, sizeof(probe.origin));
+  p = putUint(p, probe.relay, sizeof(probe.relay));
+  p = putUint(p, probe.target.ip, sizeof(probe.target.ip));
+  p = putUint(p, probe.target.timestamp, sizeof(probe.target.timestamp));
+  putUint(p, fnv1a(start, p - start), WIRE_CHECKSUM_SIZE);
+}
+
+int g18::decodeProbe(const char *buf, const size_t len, probe_t &out)
+{
+  if (len != PROBE_SIZE ||
+      !(isWireMessage(buf, len, WIRE_MSG_PING) ||
+        isWireMessage(buf, len, WIRE_MSG_PING_REQ) ||
+        isWireMessage(buf, len, WIRE_MSG_ACK))) {
+    return -1;
+  }
+  const unsigned char *start = reinterpret_cast<const unsigned char *>(buf);
+  const unsigned char *end = start + len - WIRE_CHECKSUM_SIZE;
+  if (fnv1a(start, end - start) != getUint(end, WIRE_CHECKSUM_SIZE)) {
+    return -1;
+  }
+  const unsigned char *p = start + WIRE_HEADER_SIZE;
+  out.type = static_cast<wire_msg_type_e>(start[2]);
+  out.seq = static_cast<uint32_t>(getUint(p, sizeof(out.seq)));
+  p += sizeof(out.seq);
+  out.origin = static_cast<persistent_node_id_t>(getUint(p, sizeof(out.origin)));
+  p += sizeof(out.origin);
+  out.relay = static_cast<persistent_node_id_t>(getUint(p, sizeof(out.relay)));
+  p += sizeof(out.relay);
+  out.target.ip = static_cast<persistent_node_id_t>(getUint(p, sizeof(out.target.ip)));
+  p += sizeof(out.target.ip);
+  out.target.timestamp = static_cast<lamp_time_t>(getUint(p, sizeof(out.target.timestamp)));
+  return 0;
+}
+
+bool g18::isWireMessage(const char *buf, const size_t len,
+                        const wire_msg_type_e type)
+{
+  return len >= WIRE_HEADER_SIZE + WIRE_CHECKSUM_SIZE &&
+    static_cast<unsigned char>(buf[0]) == WIRE_MAGIC &&
+    static_cast<unsigned char>(buf[1]) == WIRE_VERSION &&
+    static_cast<unsigned char>(buf[2]) == type;
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "MembershipSnapshot.hpp"
+#include "net_types.hpp"
+
+/////////////////////////////////////////
+// Binary wire format
+//
+// Every message starts with a three byte header:
+//   magic (0xB7) | version | message type
+// and ends with a four byte FNV-1a checksum of everything before it.
+// Integers are little-endian. Counts are LEB128 varints.
+//
+// A changelist message's body is:
+//   timestamp (uint64) | #joined | #left | #failed
+// followed by that many fixed-width node records, joined first, then left,
+// then failed:
+//   ip (uint32) | timestamp (uint64)
+//
+// A snapshot message carries a whole membership list, for a node that's
+// just joined, split into as many datagrams as it takes:
+//   version (uint64) | origin ip (uint32) | datagram index | #datagrams |
+//   #entries
+// followed by that many entries in ring order, each as two varints relative
+// to the entry before it in the same datagram (or to zeroes, for the first):
+//   zigzag(ip delta) << 2 | state, zigzag(timestamp delta)
+// Entries mostly join in order, so most take four or five bytes rather than
+// a node record's twelve.
+//
+// Nodes compare digests of their lists on every heartbeat. When a neighbor's
+// stays different, a sync request asks it which buckets differ:
+//   origin ip (uint32) | #buckets | bucket digest (uint32) ...
+// and it answers with sync entries messages, as many datagrams as it takes:
+//   origin ip (uint32) | bucket mask (uint64) | wants reply (uint8) | #entries
+// followed by the latest entry for every IP in those buckets, encoded as in
+// a snapshot. The first datagram of an answer to a sync request wants a
+// reply, which is the same for the asker's entries in the same buckets.
+//
+// Probe messages (ping, ping request and ack) all have the same body:
+//   seq (uint32) | origin ip (uint32) | relay ip (uint32) | target record
+// The origin is the node that suspects the target. The relay, if not zero,
+// pings the target on the origin's behalf and passes the ack back.
+//
+// Version 2 widened timestamps from 16 to 64 bits for the hybrid clock.
+/////////////////////////////////////////
+
+#define WIRE_MAGIC 0xB7
+#define WIRE_VERSION 2
+
+/// The largest group, and the most tombstones, we'll take a snapshot of.
+#define WIRE_MAX_SNAPSHOT_MEMBERS 65536
+#define WIRE_MAX_SNAPSHOT_TOMBSTONES 4096
+/// Snapshots are sent in datagrams of at least this many bytes, which hold
+/// at least WIRE_MIN_SNAPSHOT_ENTRIES entries even at 15 bytes apiece. No
+/// snapshot we'd take has more than WIRE_MAX_SNAPSHOT_DATAGRAMS of them.
+#define WIRE_MIN_SNAPSHOT_DATAGRAM_SIZE 1400
+#define WIRE_MIN_SNAPSHOT_ENTRIES 90
+#define WIRE_MAX_SNAPSHOT_DATAGRAMS \
+  ((WIRE_MAX_SNAPSHOT_MEMBERS + WIRE_MAX_SNAPSHOT_TOMBSTONES + \
+    WIRE_MIN_SNAPSHOT_ENTRIES - 1) / WIRE_MIN_SNAPSHOT_ENTRIES)
+
+typedef enum {
+  WIRE_MSG_CHANGELIST = 1,
+  WIRE_MSG_PING = 2,
+  WIRE_MSG_PING_REQ = 3,
+  WIRE_MSG_ACK = 4,
+  WIRE_MSG_SNAPSHOT = 5,
+  WIRE_MSG_SYNC_REQUEST = 6,
+  WIRE_MSG_SYNC_ENTRIES = 7
+} wire_msg_type_e;
+
+/// A ping, ping request or ack.
+typedef struct {
+  wire_msg_type_e type;
+  uint32_t seq;
+  persistent_node_id_t origin;
+  /// Zero for a direct probe.
+  persistent_node_id_t relay;
+  node_id_t target;
+} probe_t;
+
+/// One datagram's worth of a membership snapshot.
+typedef struct {
+  /// The sender's Lamport time when it took the snapshot. A joining node may
+  /// be sent more than one; only the newest counts.
+  lamp_time_t version;
+  /// The node that sent it.
+  persistent_node_id_t origin;
+  uint32_t index;
+  uint32_t count;
+  /// In ring order. Only the IDs and states are sent.
+  std::vector<membership_entry_t> entries;
+} snapshot_chunk_t;
+
+/// A node's bucket digests, sent to a neighbor whose digest differs.
+typedef struct {
+  persistent_node_id_t origin;
+  /// Indexed by MembershipSnapshot::bucketOf().
+  std::vector<membership_digest_t> buckets;
+} sync_request_t;
+
+/// One datagram's worth of a node's entries in the buckets that differ.
+typedef struct {
+  persistent_node_id_t origin;
+  /// Bit i is set for each bucket i sent.
+  uint64_t buckets;
+  /// Whether the origin wants our entries in the same buckets back.
+  bool wantsReply;
+  /// Only the IDs and states are sent.
+  std::vector<membership_entry_t> entries;
+} sync_entries_t;
+
+namespace g18 {
+  /// Encode a changelist, replacing the contents of out.
+  void encodeChangelist(const changelist_t &msg, std::string &out);
+
+  /// Encode a changelist as one or more datagrams of at most maxDatagramSize
+  /// bytes each, replacing the contents of out. Every datagram is a complete
+  /// changelist with the same timestamp. Always produces at least one.
+  void encodeChangelistDatagrams(const changelist_t &msg,
+                                 const size_t maxDatagramSize,
+                                 std::vector<std::string> &out);
+
+  /// Decode a changelist. Returns 0 on success, or -1 if the buffer is
+  /// truncated, corrupt, or from an incompatible version.
+  int decodeChangelist(const char *buf, const size_t len, changelist_t &out);
+
+  /// Encode every entry of a membership list, in ring order, as one or more
+  /// datagrams of at most maxDatagramSize bytes each, replacing the contents
+  /// of out. Always produces at least one.
+  void encodeSnapshotDatagrams(const std::vector<membership_entry_t> &entries,
+                               const lamp_time_t version,
+                               const persistent_node_id_t origin,
+                               const size_t maxDatagramSize,
+                               std::vector<std::string> &out);
+
+  /// Decode one datagram of a snapshot. Returns 0 on success, or -1 if the
+  /// buffer isn't a well-formed snapshot message or claims to be one of more
+  /// than WIRE_MAX_SNAPSHOT_DATAGRAMS.
+  int decodeSnapshot(const char *buf, const size_t len, snapshot_chunk_t &out);
+
+  /// Encode a sync request, replacing the contents of out.
+  void encodeSyncRequest(const sync_request_t &req, std::string &out);
+
+  /// Decode a sync request. Returns 0 on success, or -1 if the buffer isn't
+  /// a well-formed sync request.
+  int decodeSyncRequest(const char *buf, const size_t len, sync_request_t &out);
+
+  /// Encode sync entries as one or more datagrams of at most maxDatagramSize
+  /// bytes each, replacing the contents of out. Only the first wants a
+  /// reply, if msg does. Always produces at least one.
+  void encodeSyncEntriesDatagrams(const sync_entries_t &msg,
+                                  const size_t maxDatagramSize,
+                                  std::vector<std::string> &out);
+
+  /// Decode one datagram of sync entries. Returns 0 on success, or -1 if the
+  /// buffer isn't a well-formed sync entries message.
+  int decodeSyncEntries(const char *buf, const size_t len, sync_entries_t &out);
+
+  /// Encode a probe message, replacing the contents of out.
+  void encodeProbe(const probe_t &probe, std::string &out);
+
+  /// Decode a probe message. Returns 0 on success, or -1 if the buffer isn't
+  /// a well-formed probe message.
+  int decodeProbe(const char *buf, const size_t len, probe_t &out);
+
+  /// Whether this buffer looks like one of our binary messages of this type.
+  bool isWireMessage(const char *buf, const size_t len,
+                     const wire_msg_type_e type);
+}
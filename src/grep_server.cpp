@@ -0,0 +1,186 @@
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "LogSearch.hpp"
+#include "net_types.hpp"
+#include "utils.hpp"
+
+using g18::LogSearch;
+
+/// The longest command we'll wait for.
+#define MAX_COMMAND_SIZE 4096
+
+typedef struct {
+  const LogSearch *search;
+  int connfd;
+} connection_t;
+
+static void printUsage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-t threads] [-p port] [log_file ...]\n", prog);
+}
+
+/// Open a TCP socket listening on port. Exits on failure.
+static int openListenSocket(const char *port)
+{
+  struct addrinfo hints;
+  struct addrinfo *servinfo;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  const int status = getaddrinfo(NULL, port, &hints, &servinfo);
+  if (status != 0) {
+    MPLOG_ERROR("getaddrinfo: %s", gai_strerror(status));
+    exit(1);
+  }
+  int sockfd = -1;
+  for (struct addrinfo *ai = servinfo; ai != NULL; ai = ai->ai_next) {
+    sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sockfd < 0) {
+      continue;
+    }
+    const int yes = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (bind(sockfd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(sockfd, 16) == 0) {
+      break;
+    }
+    close(sockfd);
+    sockfd = -1;
+  }
+  freeaddrinfo(servinfo);
+  if (sockfd < 0) {
+    MPLOG_ERROR("listening on port %s: %s", port, strerror(errno));
+    exit(1);
+  }
+  MPLOG("Waiting for connection on port %s", port);
+  return sockfd;
+}
+
+/// Read the client's command, which ends with a null byte. Returns 0 on success.
+static int receiveCommand(const int connfd, std::string &command)
+{
+  char buf[1024];
+  while (command.size() < MAX_COMMAND_SIZE) {
+    const ssize_t len = recv(connfd, buf, sizeof(buf), 0);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    } else if (len <= 0) {
+      // Netcat closes its end without sending the null byte
+      return command.empty() ? -1 : 0;
+    }
+    const char *nul = static_cast<const char *>(memchr(buf, '\0', len));
+    command.append(buf, nul == NULL ? len : nul - buf);
+    if (nul != NULL) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void *handleConnection(void *arg)
+{
+  connection_t *conn = static_cast<connection_t *>(arg);
+  const int connfd = conn->connfd;
+  std::string command;
+  if (receiveCommand(connfd, command) != 0) {
+    MPLOG_WARNING("dropping connection that never sent a command");
+  } else {
+    MPLOG("Received command: %s", command.c_str());
+    shutdown(connfd, SHUT_RD);
+    search_query_t query;
+    std::string error;
+    const uint64_t start = monotonic_time_ns();
+    ssize_t matches = -1;
+    if (LogSearch::parseCommand(command, query, error) == 0) {
+      matches = conn->search->search(query, connfd, error);
+    }
+    if (matches < 0) {
+      // Report it the way grep would have
+      const std::string msg = "grep: " + error + "\n";
+      MPLOG_WARNING("%s", error.c_str());
+      if (send(connfd, msg.data(), msg.size(), MSG_NOSIGNAL) < 0) {
+        MPLOG_WARNING("client closed the connection");
+      }
+    } else {
+      MPLOG("Sent %zd matching lines in %" PRIu64 " ms", matches,
+            (monotonic_time_ns() - start) / 1000000);
+    }
+    // A null byte tells the client we're done
+    const char nul = '\0';
+    if (send(connfd, &nul, sizeof(nul), MSG_NOSIGNAL) < 0) {
+      MPLOG_WARNING("client closed the connection");
+    }
+  }
+  shutdown(connfd, SHUT_RDWR);
+  close(connfd);
+  delete conn;
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *port = GREP_PORT_STR;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:p:")) != -1) {
+    switch (opt) {
+    case 't':
+      numThreads = atol(optarg);
+      break;
+    case 'p':
+      port = optarg;
+      break;
+    default:
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (numThreads <= 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  // Search the files we're given, or our own vmN.log
+  std::vector<std::string> files(argv + optind, argv + argc);
+  if (files.empty()) {
+    char name[32];
+    snprintf(name, sizeof(name), "vm%d.log", get_server_number());
+    files.push_back(name);
+  }
+  const LogSearch search(files, numThreads);
+
+  // Results are written with writev(), which can't be told not to raise it
+  signal(SIGPIPE, SIG_IGN);
+  const int listenfd = openListenSocket(port);
+  while (true) {
+    const int connfd = accept(listenfd, NULL, NULL);
+    if (connfd < 0) {
+      if (errno != EINTR) {
+        MPLOG_ERROR("in accept: %s", strerror(errno));
+      }
+      continue;
+    }
+    connection_t *conn = new connection_t();
+    conn->search = &search;
+    conn->connfd = connfd;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, handleConnection, conn) != 0) {
+      MPLOG_ERROR("starting a connection thread: %s", strerror(errno));
+      close(connfd);
+      delete conn;
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
@@ -0,0 +1,126 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include "EventJournal.hpp"
+#include "HybridClock.hpp"
+
+using g18::EventJournal;
+using g18::HybridClock;
+
+static void printUsage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-d journal_dir] [-n node] [-s from_unix_ms] [-e to_unix_ms]\n"
+                  "       [-l last_seconds] [-t type[,type...]] [-c]\n"
+                  "Types: joined, left, died, heartbeat, missed-heartbeat, changes\n", prog);
+}
+
+/// Parse a comma separated list of event names into a type mask.
+static int parseTypes(char *list, uint32_t &mask)
+{
+  mask = 0;
+  for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+    if (strcmp(name, "changes") == 0) {
+      mask |= (1U << JOURNAL_EVENT_JOINED) | (1U << JOURNAL_EVENT_LEFT) |
+              (1U << JOURNAL_EVENT_DIED);
+      continue;
+    }
+    unsigned type = 0;
+    while (type < JOURNAL_EVENT_COUNT && strcmp(name, EventJournal::eventName(type)) != 0) {
+      type++;
+    }
+    if (type == JOURNAL_EVENT_COUNT) {
+      fprintf(stderr, "Unknown event type %s\n", name);
+      return -1;
+    }
+    mask |= 1U << type;
+  }
+  return 0;
+}
+
+static void printRecord(const journal_record_t &record)
+{
+  const time_t seconds = record.wallNs / 1000000000ULL;
+  struct tm wall;
+  char date[32];
+  localtime_r(&seconds, &wall);
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &wall);
+  printf("%s.%06" PRIu64 " %" PRIu64 ".%05" PRIu64 " %-16s %02u:%" PRIu64 "\n",
+         date, (record.wallNs / 1000) % 1000000,
+         HybridClock::physicalPart(record.time), HybridClock::logicalPart(record.time),
+         EventJournal::eventName(record.type), record.node.ip, record.node.timestamp);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *dir = "journal";
+  bool countOnly = false;
+  uint64_t fromMs = 0, toMs = UINT64_MAX >> HybridClock::logicalBits;
+  journal_query_t query = {
+    .anyNode = true,
+    .ip = 0,
+    .from = 0,
+    .to = UINT64_MAX,
+    .typeMask = ~0U
+  };
+  int opt;
+  while ((opt = getopt(argc, argv, "d:n:s:e:l:t:c")) != -1) {
+    switch (opt) {
+    case 'd':
+      dir = optarg;
+      break;
+    case 'n':
+      query.anyNode = false;
+      query.ip = static_cast<persistent_node_id_t>(strtoul(optarg, NULL, 10));
+      break;
+    case 's':
+      fromMs = strtoull(optarg, NULL, 10);
+      break;
+    case 'e':
+      toMs = strtoull(optarg, NULL, 10);
+      break;
+    case 'l': {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      const uint64_t nowMs = static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+      const uint64_t lastMs = strtoull(optarg, NULL, 10) * 1000;
+      fromMs = lastMs < nowMs ? nowMs - lastMs : 0;
+      break;
+    }
+    case 't':
+      if (parseTypes(optarg, query.typeMask) != 0) {
+        return 1;
+      }
+      break;
+    case 'c':
+      countOnly = true;
+      break;
+    default:
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc || fromMs > toMs) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  // Lamport times are wall-clock milliseconds with a logical counter below
+  query.from = fromMs << HybridClock::logicalBits;
+  query.to = (toMs << HybridClock::logicalBits) | ((1ULL << HybridClock::logicalBits) - 1);
+
+  std::vector<journal_record_t> results;
+  journal_query_stats_t stats;
+  if (EventJournal::query(dir, query, results, &stats) != 0) {
+    return 1;
+  }
+  if (!countOnly) {
+    for (auto it = results.begin(); it != results.end(); ++it) {
+      printRecord(*it);
+    }
+  }
+  fprintf(stderr, "%zu records; searched %zu of %zu segments, examining %zu records\n",
+          results.size(), stats.segmentsSearched, stats.segments, stats.recordsExamined);
+  return 0;
+}
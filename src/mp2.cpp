@@ -1,6 +1,7 @@
 #include <cerrno>
 #include <cstring>
 #include <pthread.h>
+#include <unistd.h>
 #include "Daemon.hpp"
 #include "utils.hpp"
 
@@ -35,11 +36,37 @@ static void startREPL(Daemon &daemon)
       daemon.leaveGroup();
       break;
 
+    // Heartbeat jitter
+    case 'j': {
+      const g18::HeartbeatScheduler &hb = daemon.getHeartbeatScheduler();
+      printf("Heartbeat period %u ms; intervals (us): %s\n", hb.getPeriodMs(),
+             hb.getIntervalHistogram().summary().c_str());
+      printf("%llu late, %llu skipped\n", (unsigned long long)hb.getLateCount(),
+             (unsigned long long)hb.getSkippedCount());
+      break;
+    }
+
+    // Membership list size
+    case 'm': {
+      const g18::MembershipList &list = daemon.getMembershipList();
+      printf("%zu live, %zu tombstones, %zu bytes\n", list.liveCount(),
+             list.tombstoneCount(), list.memoryUsage());
+      break;
+    }
+
+    // Metrics
+    case 's':
+      printf("%s", g18::Metrics::instance().report().c_str());
+      break;
+
     case 'h':
     default:
       // Print help message
       printf("h\tDisplay this help message\n");
       printf("l\tLeave the group peacefully after giving notice\n");
+      printf("j\tShow how regularly we've been sending heartbeats\n");
+      printf("m\tShow the size of our membership list\n");
+      printf("s\tShow our metrics\n");
       printf("k\tKill ourself without notice\n");
       printf("q\tSynonym for k\n");
       break;
@@ -47,12 +74,102 @@ static void startREPL(Daemon &daemon)
   } while (true);
 }
 
-int main(int argc, const char *argv[])
+static void printUsage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-p heartbeat_period_ms] [-k monitors] [-D ring|gossip|piggyback] [-i probe_helpers] [-P phi_threshold] [-w join_window_ms] [-S seed,seed,...] [-r rt_priority] [-c cpu] [-J journal_dir] [-s stats_socket] [id]\n", prog);
+}
+
+/// Parse a comma-separated list of node IDs. Returns 0 on success, -1 if
+/// it's malformed or empty.
+static int parseSeeds(const char *str, std::vector<persistent_node_id_t> &out)
+{
+  out.clear();
+  char *end;
+  while (isdigit(*str)) {
+    out.push_back(strtoul(str, &end, 10));
+    if (*end == '\0') {
+      return 0;
+    }
+    if (*end != ',') {
+      break;
+    }
+    str = end + 1;
+  }
+  return -1;
+}
+
+int main(int argc, char *argv[])
 {
+  // Parse our options
+  daemon_config_t config = Daemon::defaultConfig();
+  std::vector<persistent_node_id_t> seeds;
+  int opt;
+  while ((opt = getopt(argc, argv, "p:k:D:i:P:w:S:r:c:J:s:")) != -1) {
+    switch (opt) {
+    case 'p':
+      config.heartbeatPeriodMs = atoi(optarg);
+      break;
+    case 'k':
+      config.monitoringDegree = atoi(optarg);
+      break;
+    case 'D':
+      if (strcmp(optarg, "ring") == 0) {
+        config.dissemination = DISSEMINATION_RING;
+      } else if (strcmp(optarg, "gossip") == 0) {
+        config.dissemination = DISSEMINATION_GOSSIP;
+      } else if (strcmp(optarg, "piggyback") == 0) {
+        config.dissemination = DISSEMINATION_PIGGYBACK;
+      } else {
+        printUsage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'i':
+      config.probeHelpers = atoi(optarg);
+      break;
+    case 'P':
+      config.phiThreshold = atof(optarg);
+      break;
+    case 'w':
+      config.joinWindowMs = atoi(optarg);
+      break;
+    case 'S':
+      if (parseSeeds(optarg, seeds) != 0) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      config.seeds = seeds.data();
+      config.numSeeds = seeds.size();
+      break;
+    case 'r':
+      config.heartbeatPriority = atoi(optarg);
+      break;
+    case 'c':
+      config.heartbeatCpu = atoi(optarg);
+      break;
+    case 'J':
+      // An empty directory turns the journal off
+      config.journalDir = (*optarg == '\0') ? NULL : optarg;
+      break;
+    case 's':
+      config.statsSocket = (*optarg == '\0') ? NULL : optarg;
+      break;
+    default:
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (config.heartbeatPeriodMs == 0 || config.monitoringDegree == 0 ||
+      config.monitoringDegree > Daemon::maxMonitoringDegree ||
+      config.phiThreshold < 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
   // Get our ID number
   persistent_node_id_t ourID = 0;
-  if (argc > 1) {
-    const char *id_num_str = argv[1], *c = id_num_str;
+  if (optind < argc) {
+    const char *id_num_str = argv[optind], *c = id_num_str;
     while (isdigit(*c)) {
       c++;
     }
@@ -65,7 +182,7 @@ int main(int argc, const char *argv[])
     ourID = static_cast<persistent_node_id_t>(get_server_number());
   }
 
-  Daemon daemon = Daemon(ourID);
+  Daemon daemon(ourID, config);
   // Start the REPL
   startREPL(daemon);
 }
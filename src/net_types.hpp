@@ -2,8 +2,9 @@
 #include <list>
 #include <stdint.h>
 
-/// Lamport time
-typedef uint16_t lamp_time_t;
+/// Lamport time, as kept by a HybridClock: wall-clock milliseconds in the
+/// upper 48 bits and a logical counter in the lower 16.
+typedef uint64_t lamp_time_t;
 
 typedef uint32_t persistent_node_id_t; // The node's IP address
 
@@ -24,6 +25,7 @@ typedef enum {
 
 #define FORWARD_PROP_PORT_STR "31337"
 #define BACK_PROP_PORT_STR "31338"
+#define GREP_PORT_STR "31339"
 
 // A listing of all changes that we have not yet seem come full circle around the ring. For local use only; not in network format.
 typedef struct {
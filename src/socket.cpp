@@ -21,15 +21,13 @@
 #include "utils.hpp"
 
 
-#define MAX_SIZE 512
-#define TEST "5678"
 
 
 char * generateServerHostname(persistent_node_id_t id)
 {
   char * hostName = NULL;
   asprintf(&hostName, "fa17-cs425-g18-%02d.cs.illinois.edu", id);
-  // MPLOG("Debug: Generated hostname %s for id %d", hostName, id);
+  // MPLOG_DEBUG("Generated hostname %s for id %d", hostName, id);
   return hostName;
 }
 
@@ -50,21 +48,21 @@ int openReadSocket(char *portId)
 
   status = getaddrinfo(NULL, portId, &hints, &servinfo);
   if (status != 0) {
-   MPLOG("getaddrinfo error: %s", gai_strerror(status));
+   MPLOG_ERROR("getaddrinfo: %s", gai_strerror(status));
     exit(1);
   }
 
   for(ai_results = servinfo; ai_results != NULL; ai_results = ai_results->ai_next){   // loops through to get a correct output
-     sockfd = socket(servinfo->ai_family, servinfo->ai_socktype, servinfo->ai_protocol);
+     sockfd = socket(servinfo->ai_family, servinfo->ai_socktype | SOCK_NONBLOCK, servinfo->ai_protocol);
     if (sockfd == -1) {
-     MPLOG("Error opening socket: %s", strerror(errno));
+     MPLOG_ERROR("opening socket: %s", strerror(errno));
       continue;
     }
     break;  // if no error, break from the loop
   }
 
   if (bind(sockfd, servinfo->ai_addr, servinfo->ai_addrlen) == -1) {
-   MPLOG("Error on bind: %s", strerror(errno));
+   MPLOG_ERROR("on bind: %s", strerror(errno));
     exit(1);
   }
 
@@ -77,45 +75,26 @@ int openReadSocket(char *portId)
 
 
 
-std::string receiveData(int sockfd)
+ssize_t receiveDatagram(int sockfd, char *buf, size_t bufLen)
 {
-  int received;
-  std::string retPacket = "";
-  char buf[MAX_SIZE];
-  struct timeval tv;
-  tv.tv_sec = 1;
-  tv.tv_usec = 0;
-  struct sockaddr_storage their_addr;
-  socklen_t addr_len = sizeof(their_addr);
-  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO,&tv,sizeof(tv)) < 0)
-  {
-    perror("Error");
-  }
-  received = recvfrom(sockfd, buf, MAX_SIZE-1, 0, (struct sockaddr *)&their_addr, &addr_len);
-  if(received < 0)
-  {
-    return retPacket;
-  }
-  else
-  {
-    int i = 0;
-
-    while(1)
-    {
-      retPacket += buf[i];
-      i++;
-      if(buf[i] == 'T' && buf[i+1] == 'T' && buf[i+2] == 'T')
-        break;
+  while (true) {
+    // MSG_TRUNC makes recv report the datagram's real length
+    ssize_t received = recv(sockfd, buf, bufLen, MSG_TRUNC);
+    if (received < 0) {
+      return -1;
     }
-    return retPacket;
+    if (static_cast<size_t>(received) > bufLen) {
+      MPLOG_WARNING("Dropping %zd byte datagram that doesn't fit in our %zu byte buffer",
+            received, bufLen);
+      continue;
+    }
+    return received;
   }
 }
 
 
-int Write(const char *hostname, char *portId, std::string &thePacket)
+int Write(const char *hostname, char *portId, const std::string &thePacket)
 {
-
-  thePacket += "TTT";
   int status;
   struct addrinfo hints;
   struct addrinfo *ai_results, *servinfo;
@@ -126,7 +105,7 @@ int Write(const char *hostname, char *portId, std::string &thePacket)
 
   status = getaddrinfo(hostname, portId, &hints, &ai_results);  // sets up the struct in order to make connections
   if (status != 0) {
-    MPLOG("getaddrinfo error: %s", gai_strerror(status));
+    MPLOG_ERROR("getaddrinfo: %s", gai_strerror(status));
     exit(1);
   }
 
@@ -137,24 +116,25 @@ int Write(const char *hostname, char *portId, std::string &thePacket)
   for(ai_results = servinfo; ai_results != NULL; ai_results = ai_results->ai_next){   // loops through to get a correct output
      sockfd = socket(servinfo->ai_family, servinfo->ai_socktype, servinfo->ai_protocol);
     if (sockfd == -1) {
-     MPLOG("Error opening socket: %s", strerror(errno));
+     MPLOG_ERROR("opening socket: %s", strerror(errno));
       continue;
     }
     break;  // if no error, break from the loop
   }
 
   if(ai_results == NULL){
-    MPLOG("NO available socket: %s", strerror(errno));  // if we could not find any possible solutions, program exits
+    MPLOG_ERROR("NO available socket: %s", strerror(errno));  // if we could not find any possible solutions, program exits
     pthread_exit(0);
   }
 
 
-  const char * packet = thePacket.c_str();
-  size_t pacLength = strlen(packet);
+  const char * packet = thePacket.data();
+  size_t pacLength = thePacket.length();
   int sent;
   sent = sendto(sockfd, packet, pacLength, 0, ai_results->ai_addr, ai_results->ai_addrlen);
 
-  freeaddrinfo(ai_results); // free the memory
+  freeaddrinfo(servinfo); // free the memory
+  close(sockfd);
 
   if(sent <= 0)
   {
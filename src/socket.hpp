@@ -1,14 +1,24 @@
 #pragma once
+#include <string>
+#include <sys/types.h>
 #include "net_types.hpp"
 
+/// The largest payload a UDP datagram can carry. Each datagram we send is
+/// exactly one message, so this is also our largest message.
+#define MAX_DATAGRAM_SIZE 65507
+
 /// Generate the hostname of a machine from its persistent identifier.
 char * generateServerHostname(persistent_node_id_t id);
 
-/// Open a socket for receiving and return it as a file descriptor.
+/// Open a non-blocking socket for receiving and return it as a file descriptor.
 int openReadSocket(char *portId);
 
-/// Receive data with a timeout.
-std::string receiveData(int sockfd);
+/// Receive one datagram into buf without blocking or allocating. Returns its
+/// length, or -1 if nothing is waiting. Datagrams longer than bufLen are
+/// dropped.
+ssize_t receiveDatagram(int sockfd, char *buf, size_t bufLen);
 
-/// Returns 0 on success.
-int Write(const char *hostname, char *portId, std::string &thePacket);
+/// Send a single packet, resolving the hostname each time. Prefer
+/// g18::Transport for anything sent repeatedly. Returns the number of bytes
+/// sent, or -1 on error.
+int Write(const char *hostname, char *portId, const std::string &thePacket);
@@ -1,18 +1,11 @@
 
 #pragma once
 
-#include <cstdarg>
-
-#define _MPLOG(fmt, ...) do { \
-  grep_log("%s:%s:%d: " fmt "\n", \
-      __FILE__, __FUNCTION__, __LINE__ , ## __VA_ARGS__); \
-} while (0)
-#define MPLOG(fmt, ...) _MPLOG(fmt , ## __VA_ARGS__)
-
-#define MPLOG_LOG_FILE "mplog.log"
-
-void grep_log(const char *fmt, ...);
+#include <stdint.h>
+#include "Logger.hpp"
 
 /// Parse our server number from our hostname.
 int get_server_number(void);
 
+/// Nanoseconds on CLOCK_MONOTONIC.
+uint64_t monotonic_time_ns(void);
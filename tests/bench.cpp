@@ -0,0 +1,2882 @@
+// Microbenchmarks for the daemon's hot paths. Build with `make bench` in
+// src/ and run `./bench [name...]` to run some or all of them.
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "AntiEntropy.hpp"
+#include "ChangeSet.hpp"
+#include "Daemon.hpp"
+#include "EventJournal.hpp"
+#include "GossipDisseminator.hpp"
+#include "Histogram.hpp"
+#include "HybridClock.hpp"
+#include "IndirectProber.hpp"
+#include "JoinAdmissionQueue.hpp"
+#include "JoinBackoff.hpp"
+#include "LogSearch.hpp"
+#include "Logger.hpp"
+#include "MembershipList.hpp"
+#include "Metrics.hpp"
+#include "PhiAccrualDetector.hpp"
+#include "codec.hpp"
+#include "net_types.hpp"
+#include "utils.hpp"
+
+/////////////////////////////////////////
+// Helpers
+/////////////////////////////////////////
+
+/// Keep the optimizer from discarding a result.
+static volatile size_t sink;
+
+static double elapsedNsPer(const uint64_t startNs, const uint64_t iterations)
+{
+  return static_cast<double>(monotonic_time_ns() - startNs) / iterations;
+}
+
+/////////////////////////////////////////
+// Changelist codec
+/////////////////////////////////////////
+
+// The original text codec, from test.cpp, as a baseline. It only works for
+// single-digit IDs and 10.
+static std::string legacyEncode(changelist_t theChanges)
+{
+  std::stringstream theStream;
+  theStream << theChanges.timestamp;
+  std::list<node_id_t> *lists[3] = {
+    &theChanges.joined, &theChanges.left, &theChanges.failed
+  };
+  const char delims[3] = {'j', 'l', 'f'};
+  for (int l = 0; l < 3; l++) {
+    theStream << delims[l];
+    while (!lists[l]->empty()) {
+      node_id_t val = lists[l]->front();
+      if (val.ip == 10) {
+        theStream << 10;
+      } else {
+        theStream << 0;
+        theStream << val.ip;
+      }
+      theStream << val.timestamp;
+      theStream << "m";
+      lists[l]->pop_front();
+    }
+  }
+  return theStream.str();
+}
+
+static changelist_t legacyDecode(const std::string &CLPacket)
+{
+  changelist_t ret;
+  std::list<node_id_t> *lists[3] = {&ret.joined, &ret.left, &ret.failed};
+  const char ends[3] = {'l', 'f', '\0'};
+  size_t j = CLPacket.find('j');
+  ret.timestamp = atoi(CLPacket.substr(0, j).c_str());
+  j++;
+  for (int l = 0; l < 3; l++) {
+    while (j < CLPacket.size() && CLPacket[j] != ends[l]) {
+      std::string temp;
+      int k = 0;
+      for (; CLPacket[j] != 'm'; j++) {
+        temp += CLPacket[j];
+        if (++k == 2) {
+          temp += " ";
+        }
+      }
+      std::istringstream iss(temp);
+      int val, val2;
+      iss >> val;
+      iss >> val2;
+      node_id_t hold;
+      hold.ip = val;
+      hold.timestamp = val2;
+      lists[l]->push_back(hold);
+      j++;
+    }
+    j++;
+  }
+  return ret;
+}
+
+static changelist_t makeChangelist(const size_t numEntries)
+{
+  changelist_t msg;
+  msg.timestamp = 4242;
+  for (size_t i = 0; i < numEntries; i++) {
+    node_id_t node;
+    node.ip = 1 + i % 9;
+    node.timestamp = 10000 + i;
+    switch (i % 3) {
+    case 0: msg.joined.push_back(node); break;
+    case 1: msg.left.push_back(node); break;
+    default: msg.failed.push_back(node); break;
+    }
+  }
+  return msg;
+}
+
+static bool sameNodes(const std::list<node_id_t> &a, const std::list<node_id_t> &b)
+{
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (auto ait = a.begin(), bit = b.begin(); ait != a.end(); ++ait, ++bit) {
+    if (!g18::isEqual(*ait, *bit)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int benchCodec()
+{
+  const size_t sizes[] = {1, 10, 100, 1000};
+  printf("%-8s %12s %12s %12s %12s %12s %12s\n", "entries", "text bytes",
+         "text enc ns", "text dec ns", "bin bytes", "bin enc ns", "bin dec ns");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const changelist_t msg = makeChangelist(sizes[s]);
+    const uint64_t iterations = 200000 / sizes[s] + 100;
+
+    // Round trip through the binary codec first
+    std::string packet;
+    g18::encodeChangelist(msg, packet);
+    changelist_t decoded;
+    if (g18::decodeChangelist(packet.data(), packet.length(), decoded) != 0 ||
+        decoded.timestamp != msg.timestamp || !sameNodes(decoded.joined, msg.joined) ||
+        !sameNodes(decoded.left, msg.left) || !sameNodes(decoded.failed, msg.failed)) {
+      printf("FAIL: binary round trip of %zu entries\n", sizes[s]);
+      return 1;
+    }
+    // Corrupting any byte must be caught
+    packet[packet.length() / 2] ^= 0x40;
+    if (g18::decodeChangelist(packet.data(), packet.length(), decoded) == 0) {
+      printf("FAIL: corrupted packet of %zu entries decoded\n", sizes[s]);
+      return 1;
+    }
+
+    // Splitting into datagrams must keep every entry and respect the limit
+    std::vector<std::string> datagrams;
+    g18::encodeChangelistDatagrams(msg, 1400, datagrams);
+    size_t numSplit = 0;
+    for (auto it = datagrams.begin(); it != datagrams.end(); ++it) {
+      if (it->length() > 1400 ||
+          g18::decodeChangelist(it->data(), it->length(), decoded) != 0) {
+        printf("FAIL: bad datagram splitting %zu entries\n", sizes[s]);
+        return 1;
+      }
+      numSplit += decoded.joined.size() + decoded.left.size() + decoded.failed.size();
+    }
+    if (numSplit != sizes[s]) {
+      printf("FAIL: splitting %zu entries kept %zu\n", sizes[s], numSplit);
+      return 1;
+    }
+
+    uint64_t start = monotonic_time_ns();
+    std::string text;
+    for (uint64_t i = 0; i < iterations; i++) {
+      text = legacyEncode(msg);
+    }
+    const double textEnc = elapsedNsPer(start, iterations);
+    start = monotonic_time_ns();
+    for (uint64_t i = 0; i < iterations; i++) {
+      sink = legacyDecode(text).joined.size();
+    }
+    const double textDec = elapsedNsPer(start, iterations);
+
+    start = monotonic_time_ns();
+    for (uint64_t i = 0; i < iterations; i++) {
+      g18::encodeChangelist(msg, packet);
+    }
+    const double binEnc = elapsedNsPer(start, iterations);
+    start = monotonic_time_ns();
+    for (uint64_t i = 0; i < iterations; i++) {
+      g18::decodeChangelist(packet.data(), packet.length(), decoded);
+      sink = decoded.joined.size();
+    }
+    const double binDec = elapsedNsPer(start, iterations);
+
+    printf("%-8zu %12zu %12.0f %12.0f %12zu %12.0f %12.0f\n", sizes[s],
+           text.length(), textEnc, textDec, packet.length(), binEnc, binDec);
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Membership list
+/////////////////////////////////////////
+
+// The original list-walking ring navigation, as a baseline
+typedef struct {
+  node_id_t id;
+  bool online;
+} legacy_entry_t;
+
+static const legacy_entry_t *legacySuccessorOf(const std::list<legacy_entry_t> &members,
+                                               const node_id_t &node)
+{
+  auto queryIt = members.begin();
+  while (queryIt != members.end() && !g18::isEqual(queryIt->id, node)) {
+    ++queryIt;
+  }
+  if (queryIt == members.end()) {
+    return NULL;
+  }
+  auto it = queryIt;
+  for (;;) {
+    if (++it == members.end()) {
+      it = members.begin();
+    }
+    if (it == queryIt) {
+      return NULL;
+    }
+    if (it->online) {
+      return &*it;
+    }
+  }
+}
+
+static int benchMembership()
+{
+  const size_t sizes[] = {1000, 2000, 5000, 10000};
+  printf("%-8s %8s %14s %14s %12s %12s %12s\n", "members", "live",
+         "legacy ns/op", "indexed ns/op", "bytes", "gc bytes", "gc ns/op");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    g18::MembershipList list;
+    std::list<legacy_entry_t> legacy;
+    std::vector<node_id_t> ids;
+    for (size_t i = 0; i < n; i++) {
+      node_id_t id = {static_cast<persistent_node_id_t>(i + 1),
+                      static_cast<lamp_time_t>(i % 1000)};
+      list.nodeDidJoin(id);
+      legacy.push_back((legacy_entry_t){id, true});
+      ids.push_back(id);
+    }
+    // Kill three quarters of the ring in runs, leaving plenty of tombstones
+    // for the navigation to step over
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+      if (i % 8 < 6) {
+        list.nodeDidDie(ids[i], 1);
+        auto it = legacy.begin();
+        std::advance(it, i);
+        it->online = false;
+      }
+    }
+
+    // Check both agree before timing anything
+    for (size_t i = 0; i < n; i++) {
+      const legacy_entry_t *expected = legacySuccessorOf(legacy, ids[i]);
+      const node_id_t actual = list.successorOf(ids[i]);
+      if (expected == NULL ? actual.ip != 0 : !g18::isEqual(expected->id, actual)) {
+        printf("FAIL: successor of %u differs\n", ids[i].ip);
+        return 1;
+      }
+    }
+
+    const size_t legacyIterations = 2000;
+    uint64_t start = monotonic_time_ns();
+    for (size_t i = 0; i < legacyIterations; i++) {
+      const legacy_entry_t *e = legacySuccessorOf(legacy, ids[rand() % n]);
+      sink = e == NULL ? 0 : e->id.ip;
+    }
+    const double legacyNs = elapsedNsPer(start, legacyIterations);
+
+    const size_t iterations = 1000000;
+    start = monotonic_time_ns();
+    for (size_t i = 0; i < iterations; i++) {
+      const node_id_t &id = ids[rand() % n];
+      sink = list.successorOf(id).ip + list.predecessorOf(id).ip;
+    }
+    // Two lookups per iteration
+    const double indexedNs = elapsedNsPer(start, iterations) / 2;
+
+    // Collect all but a sixteenth of the tombstones through the cap, then
+    // make sure the ring still looks the same to the survivors
+    const size_t bytes = list.memoryUsage();
+    const tombstone_policy_t policy = {
+      .maxAgeMs = UINT64_MAX,
+      .maxAgeTicks = UINT64_MAX,
+      .maxTombstones = n / 16
+    };
+    start = monotonic_time_ns();
+    list.collectTombstones(monotonic_time_ns() / 1000000, 2, policy);
+    const double gcNs = elapsedNsPer(start, n);
+    if (list.tombstoneCount() != n / 16) {
+      printf("FAIL: kept %zu tombstones, not %zu\n", list.tombstoneCount(), n / 16);
+      return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (i % 8 < 6) {
+        continue;
+      }
+      const legacy_entry_t *expected = legacySuccessorOf(legacy, ids[i]);
+      const node_id_t actual = list.successorOf(ids[i]);
+      if (expected == NULL ? actual.ip != 0 : !g18::isEqual(expected->id, actual)) {
+        printf("FAIL: successor of %u differs after collection\n", ids[i].ip);
+        return 1;
+      }
+    }
+
+    printf("%-8zu %8zu %14.0f %14.0f %12zu %12zu %12.1f\n", n, list.liveCount(),
+           legacyNs, indexedNs, bytes, list.memoryUsage(), gcNs);
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Membership snapshots under contention
+/////////////////////////////////////////
+
+typedef struct {
+  g18::MembershipList *list;
+  persistent_node_id_t numIPs;
+  const std::atomic<bool> *stop;
+  g18::Histogram *latencyNs;
+  uint64_t reads;
+  uint64_t inconsistent;
+  unsigned seed;
+} snapshot_reader_t;
+
+static void *snapshotReader(void *arg)
+{
+  snapshot_reader_t *r = static_cast<snapshot_reader_t *>(arg);
+  while (!*r->stop) {
+    const uint64_t start = monotonic_time_ns();
+    std::shared_ptr<const g18::MembershipSnapshot> view = r->list->snapshot();
+    membership_entry_t entry;
+    const persistent_node_id_t ip = rand_r(&r->seed) % r->numIPs + 1;
+    if (view->latestEntryFor(ip, entry)) {
+      const node_id_t next = view->successorOf(entry.id);
+      // Within one snapshot the ring has to be consistent
+      if (entry.state == NODE_STATE_ONLINE && next.ip != 0 &&
+          !g18::isEqual(view->predecessorOf(next), entry.id)) {
+        r->inconsistent++;
+      }
+    }
+    r->latencyNs->record(monotonic_time_ns() - start);
+    r->reads++;
+  }
+  return NULL;
+}
+
+static int benchSnapshots()
+{
+  const persistent_node_id_t numIPs = 1000;
+  const unsigned readerCounts[] = {1, 4, 16};
+  const uint64_t durationMs = 500;
+  printf("%-8s %12s %12s %10s %10s %10s\n", "readers", "reads/s", "writes/s",
+         "p50 ns", "p99 ns", "max ns");
+  for (size_t c = 0; c < sizeof(readerCounts) / sizeof(readerCounts[0]); c++) {
+    g18::MembershipList list;
+    std::vector<node_id_t> ids;
+    for (persistent_node_id_t ip = 1; ip <= numIPs; ip++) {
+      node_id_t id = {ip, 0};
+      list.nodeDidJoin(id);
+      ids.push_back(id);
+    }
+
+    std::atomic<bool> stop(false);
+    g18::Histogram latencyNs;
+    std::vector<snapshot_reader_t> readers(readerCounts[c]);
+    std::vector<pthread_t> threads(readerCounts[c]);
+    for (unsigned i = 0; i < readerCounts[c]; i++) {
+      readers[i] = (snapshot_reader_t){&list, numIPs, &stop, &latencyNs, 0, 0, i + 1};
+      pthread_create(&threads[i], NULL, snapshotReader, &readers[i]);
+    }
+
+    // Churn the ring from this thread: kill a node and bring it straight back
+    // as its next incarnation, collecting tombstones as we go
+    const tombstone_policy_t policy = {UINT64_MAX, UINT64_MAX, 64};
+    unsigned seed = 42;
+    uint64_t writes = 0;
+    const uint64_t start = monotonic_time_ns();
+    while (monotonic_time_ns() - start < durationMs * 1000000) {
+      node_id_t &id = ids[rand_r(&seed) % numIPs];
+      list.beginUpdate();
+      list.nodeDidDie(id, 1);
+      id.timestamp++;
+      list.nodeDidJoin(id);
+      list.collectTombstones(0, 1, policy);
+      list.endUpdate();
+      writes++;
+      usleep(100);
+    }
+    stop = true;
+    uint64_t reads = 0, inconsistent = 0;
+    for (unsigned i = 0; i < readerCounts[c]; i++) {
+      pthread_join(threads[i], NULL);
+      reads += readers[i].reads;
+      inconsistent += readers[i].inconsistent;
+    }
+    if (inconsistent != 0) {
+      printf("FAIL: %llu reads saw an inconsistent ring\n",
+             (unsigned long long)inconsistent);
+      return 1;
+    }
+    const double seconds = durationMs / 1000.0;
+    printf("%-8u %12.0f %12.0f %10llu %10llu %10llu\n", readerCounts[c],
+           reads / seconds, writes / seconds,
+           (unsigned long long)latencyNs.percentile(0.5),
+           (unsigned long long)latencyNs.percentile(0.99),
+           (unsigned long long)latencyNs.max());
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Delta reconciliation
+/////////////////////////////////////////
+
+// The original nested-loop reconciliation, as a baseline
+static void legacyRemoveSent(std::list<node_id_t> &msgList,
+                             std::list<node_id_t> &deltaList)
+{
+  for (auto deltaIter = deltaList.begin(); deltaIter != deltaList.end(); ) {
+    bool erased = false;
+    for (auto msgIter = msgList.begin(); msgIter != msgList.end(); ++msgIter) {
+      if (g18::isEqual(*deltaIter, *msgIter)) {
+        deltaIter = deltaList.erase(deltaIter);
+        msgList.erase(msgIter);
+        erased = true;
+        break;
+      }
+    }
+    if (!erased) {
+      ++deltaIter;
+    }
+  }
+}
+
+static void legacyAugment(std::list<node_id_t> &msgList,
+                          const std::list<node_id_t> &deltaList)
+{
+  for (auto deltaIter = deltaList.begin(); deltaIter != deltaList.end(); ++deltaIter) {
+    bool found = false;
+    for (auto msgIter = msgList.begin(); msgIter != msgList.end(); ++msgIter) {
+      if (g18::isEqual(*deltaIter, *msgIter)) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      msgList.push_back(*deltaIter);
+    }
+  }
+}
+
+static void legacyReconcile(changelist_t &msg, changelist_t &delta)
+{
+  legacyRemoveSent(msg.joined, delta.joined);
+  legacyRemoveSent(msg.left, delta.left);
+  legacyRemoveSent(msg.failed, delta.failed);
+  legacyAugment(msg.joined, delta.joined);
+  legacyAugment(msg.left, delta.left);
+  legacyAugment(msg.failed, delta.failed);
+}
+
+/// n changes starting at the given offset, so two calls can overlap.
+static changelist_t makeChanges(const size_t offset, const size_t n)
+{
+  changelist_t msg;
+  msg.timestamp = 1;
+  for (size_t i = offset; i < offset + n; i++) {
+    node_id_t node = {static_cast<persistent_node_id_t>(i / 3 + 1),
+                      static_cast<lamp_time_t>(i)};
+    switch (i % 3) {
+    case 0: msg.joined.push_back(node); break;
+    case 1: msg.left.push_back(node); break;
+    default: msg.failed.push_back(node); break;
+    }
+  }
+  return msg;
+}
+
+static int benchChangeSet()
+{
+  // Random inserts and erases over a small key space, so probe runs collide
+  // and wrap, checked against a std::set
+  g18::ChangeSet set;
+  std::set<std::pair<uint32_t, int> > reference;
+  unsigned seed = 7;
+  for (int i = 0; i < 200000; i++) {
+    const change_t change = {
+      {static_cast<persistent_node_id_t>(rand_r(&seed) % 64), 0},
+      static_cast<node_state_e>(rand_r(&seed) % 3)
+    };
+    const std::pair<uint32_t, int> key(change.id.ip, change.state);
+    const bool present = reference.count(key) != 0;
+    bool ok;
+    if (rand_r(&seed) % 2) {
+      ok = set.insert(change) == !present;
+      reference.insert(key);
+    } else {
+      ok = set.erase(change) == present;
+      reference.erase(key);
+    }
+    if (!ok || set.size() != reference.size()) {
+      printf("FAIL: change set disagrees with std::set after %d operations\n", i);
+      return 1;
+    }
+  }
+
+  const size_t sizes[] = {100, 1000, 2000, 5000, 10000};
+  printf("%-8s %14s %14s %10s\n", "entries", "legacy ns/op", "set ns/op", "speedup");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    // The incoming message and our delta share half their entries
+    const changelist_t msg = makeChanges(0, n);
+    const changelist_t delta = makeChanges(n / 2, n);
+
+    // Check both agree before timing anything
+    changelist_t legacyMsg = msg, legacyDelta = delta;
+    legacyReconcile(legacyMsg, legacyDelta);
+    g18::ChangeSet expected;
+    expected.insert(legacyMsg);
+    g18::ChangeSet incoming, deltaSet;
+    incoming.insert(msg);
+    deltaSet.insert(delta);
+    const size_t common = incoming.cancelCommon(deltaSet);
+    incoming.merge(deltaSet);
+    const size_t expectedSize = expected.size();
+    expected.subtract(incoming);
+    if (common != n / 2 || incoming.size() != expectedSize || !expected.empty()) {
+      printf("FAIL: reconciliation of %zu entries differs\n", n);
+      return 1;
+    }
+
+    // Both include building their inputs from a decoded changelist
+    const uint64_t legacyIterations = 20000000 / (n * n) + 1;
+    uint64_t start = monotonic_time_ns();
+    for (uint64_t i = 0; i < legacyIterations; i++) {
+      changelist_t m = msg, d = delta;
+      legacyReconcile(m, d);
+      sink = m.joined.size();
+    }
+    const double legacyNs = elapsedNsPer(start, legacyIterations);
+
+    const uint64_t iterations = 2000000 / n + 1;
+    start = monotonic_time_ns();
+    for (uint64_t i = 0; i < iterations; i++) {
+      g18::ChangeSet in, d;
+      in.insert(msg);
+      d.insert(delta);
+      in.cancelCommon(d);
+      in.merge(d);
+      sink = in.size();
+    }
+    const double setNs = elapsedNsPer(start, iterations);
+
+    printf("%-8zu %14.0f %14.0f %9.1fx\n", n, legacyNs, setNs, legacyNs / setNs);
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Hybrid logical clock
+/////////////////////////////////////////
+
+typedef struct {
+  g18::HybridClock *clock;
+  std::vector<lamp_time_t> values;
+} clock_ticker_t;
+
+static void *clockTicker(void *arg)
+{
+  clock_ticker_t *t = static_cast<clock_ticker_t *>(arg);
+  for (size_t i = 0; i < t->values.size(); i++) {
+    // Mix local events with receives from a node slightly ahead of us
+    t->values[i] = (i % 4 == 0) ? t->clock->update(t->clock->now() + 3)
+                                : t->clock->tick();
+  }
+  return NULL;
+}
+
+static int benchClock()
+{
+  const unsigned threadCounts[] = {1, 2, 4, 8};
+  const size_t ticksPerThread = 200000;
+  printf("%-8s %12s %14s\n", "threads", "ns/tick", "max logical");
+  for (size_t c = 0; c < sizeof(threadCounts) / sizeof(threadCounts[0]); c++) {
+    g18::HybridClock clock;
+    std::vector<clock_ticker_t> tickers(threadCounts[c]);
+    std::vector<pthread_t> threads(threadCounts[c]);
+    const uint64_t start = monotonic_time_ns();
+    for (unsigned i = 0; i < threadCounts[c]; i++) {
+      tickers[i].clock = &clock;
+      tickers[i].values.resize(ticksPerThread);
+      pthread_create(&threads[i], NULL, clockTicker, &tickers[i]);
+    }
+    for (unsigned i = 0; i < threadCounts[c]; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    const double ns = elapsedNsPer(start, ticksPerThread * threadCounts[c]);
+
+    // Every value handed out must be unique, and increase within a thread
+    std::vector<lamp_time_t> all;
+    uint64_t maxLogical = 0;
+    for (unsigned i = 0; i < threadCounts[c]; i++) {
+      const std::vector<lamp_time_t> &v = tickers[i].values;
+      for (size_t j = 0; j < v.size(); j++) {
+        if (j > 0 && v[j] <= v[j - 1]) {
+          printf("FAIL: clock went backwards in thread %u\n", i);
+          return 1;
+        }
+        maxLogical = MAX(maxLogical, g18::HybridClock::logicalPart(v[j]));
+      }
+      all.insert(all.end(), v.begin(), v.end());
+    }
+    std::sort(all.begin(), all.end());
+    if (std::adjacent_find(all.begin(), all.end()) != all.end()) {
+      printf("FAIL: clock handed out the same value twice\n");
+      return 1;
+    }
+    printf("%-8u %12.1f %14llu\n", threadCounts[c], ns,
+           (unsigned long long)maxLogical);
+  }
+
+  // A remote a little ahead is followed; one too far ahead, however far,
+  // neither moves the clock nor sends it backwards
+  g18::HybridClock clock(1000);
+  const lamp_time_t ms = static_cast<lamp_time_t>(1) << g18::HybridClock::logicalBits;
+  const lamp_time_t near = clock.now() + 500 * ms;
+  const lamp_time_t followed = clock.update(near);
+  const lamp_time_t ignored = clock.update(near + 5000 * ms);
+  const lamp_time_t wrapped = clock.update(UINT64_MAX);
+  if (followed <= near || ignored <= followed || ignored >= near + 5000 * ms ||
+      wrapped <= ignored || wrapped >= near + 5000 * ms) {
+    printf("FAIL: clock followed a remote too far ahead, or went backwards\n");
+    return 1;
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Logger
+/////////////////////////////////////////
+
+// The old grep_log, as a baseline: it opened and closed the log file on
+// every call, and wrote straight to stdout.
+static void legacyLog(FILE *out, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+static void legacyLog(FILE *out, const char *fmt, ...)
+{
+  FILE *log_file = fopen("/dev/null", "a");
+  if (log_file == NULL) {
+    return;
+  }
+  va_list argp;
+  va_start(argp, fmt);
+  vfprintf(out, fmt, argp);
+  va_end(argp);
+  fclose(log_file);
+}
+
+typedef struct {
+  size_t calls;
+  /// Calls between flushes, or 0 to log flat out.
+  size_t burst;
+  uint64_t loggingNs;
+} log_writer_t;
+
+static void *logWriter(void *arg)
+{
+  log_writer_t *w = static_cast<log_writer_t *>(arg);
+  const size_t burst = w->burst ? w->burst : w->calls;
+  w->loggingNs = 0;
+  for (size_t done = 0; done < w->calls; done += burst) {
+    const uint64_t start = monotonic_time_ns();
+    for (size_t i = done; i < done + burst && i < w->calls; i++) {
+      MPLOG("Node %u timed out; marking as dead (%zu)", 7u, i);
+    }
+    w->loggingNs += monotonic_time_ns() - start;
+    if (w->burst) {
+      g18::Logger::instance().flush();
+    }
+  }
+  return NULL;
+}
+
+/// Run the writers, and return the average ns per call and the fraction dropped.
+static void runLogWriters(const unsigned numThreads, const size_t calls,
+                          const size_t burst, double &ns, double &dropRate)
+{
+  g18::Logger &logger = g18::Logger::instance();
+  logger.flush();
+  const uint64_t droppedBefore = logger.getDroppedCount();
+  const uint64_t writtenBefore = logger.getWrittenCount();
+  std::vector<log_writer_t> writers(numThreads);
+  std::vector<pthread_t> threads(numThreads);
+  for (unsigned i = 0; i < numThreads; i++) {
+    writers[i].calls = calls;
+    writers[i].burst = burst;
+    pthread_create(&threads[i], NULL, logWriter, &writers[i]);
+  }
+  uint64_t totalNs = 0;
+  for (unsigned i = 0; i < numThreads; i++) {
+    pthread_join(threads[i], NULL);
+    totalNs += writers[i].loggingNs;
+  }
+  logger.flush();
+  const uint64_t dropped = logger.getDroppedCount() - droppedBefore;
+  const uint64_t written = logger.getWrittenCount() - writtenBefore;
+  ns = static_cast<double>(totalNs) / (calls * numThreads);
+  dropRate = static_cast<double>(dropped) / (dropped + written);
+}
+
+static int benchLogger()
+{
+  const int devNull = open("/dev/null", O_WRONLY);
+  FILE *devNullFile = fdopen(dup(devNull), "w");
+  if (devNull < 0 || devNullFile == NULL) {
+    printf("FAIL: unable to open /dev/null\n");
+    return 1;
+  }
+  g18::Logger &logger = g18::Logger::instance();
+  logger.setOutput(devNull);
+
+  const size_t legacyCalls = 20000;
+  uint64_t start = monotonic_time_ns();
+  for (size_t i = 0; i < legacyCalls; i++) {
+    legacyLog(devNullFile, "%s:%s:%d: Node %u timed out; marking as dead (%zu)\n",
+              __FILE__, __FUNCTION__, __LINE__, 7u, i);
+  }
+  const double legacyNs = elapsedNsPer(start, legacyCalls);
+
+  // Below the compiled-in level, so this must cost nothing
+  const size_t debugCalls = 10000000;
+  start = monotonic_time_ns();
+  for (size_t i = 0; i < debugCalls; i++) {
+    MPLOG_DEBUG("Node %u missed a heartbeat (%zu)", 7u, i);
+  }
+  const double debugNs = elapsedNsPer(start, debugCalls);
+  printf("%-28s %10.1f ns/call\n", "grep_log (fopen per call)", legacyNs);
+  printf("%-28s %10.1f ns/call\n", "MPLOG_DEBUG (compiled out)", debugNs);
+
+  // Keep the bursts within a ring so nothing is dropped, then log flat out
+  const unsigned threadCounts[] = {1, 4, 8};
+  const size_t calls = 200000;
+  printf("%-8s %14s %14s %14s\n", "threads", "paced ns/call", "flood ns/call",
+         "flood dropped");
+  for (size_t c = 0; c < sizeof(threadCounts) / sizeof(threadCounts[0]); c++) {
+    double pacedNs, pacedDropRate, floodNs, floodDropRate;
+    runLogWriters(threadCounts[c], calls, g18::Logger::ringCapacity / 2,
+                  pacedNs, pacedDropRate);
+    if (pacedDropRate != 0) {
+      printf("FAIL: dropped %.2f%% of paced records\n", pacedDropRate * 100);
+      return 1;
+    }
+    runLogWriters(threadCounts[c], calls, 0, floodNs, floodDropRate);
+    printf("%-8u %14.1f %14.1f %13.1f%%\n", threadCounts[c], pacedNs, floodNs,
+           floodDropRate * 100);
+  }
+
+  logger.setOutput(STDOUT_FILENO);
+  fclose(devNullFile);
+  close(devNull);
+  return 0;
+}
+
+/////////////////////////////////////////
+// Event journal
+/////////////////////////////////////////
+
+static void removeDirectory(const char *dir)
+{
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      unlinkat(dirfd(d), entry->d_name, 0);
+    }
+  }
+  closedir(d);
+  rmdir(dir);
+}
+
+static int benchJournal()
+{
+  char dir[] = "/tmp/journal-bench-XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    printf("FAIL: unable to create a journal directory\n");
+    return 1;
+  }
+  // Ten nodes heartbeating, with the odd membership change, plus one node
+  // that only shows up for a while in the middle
+  const size_t numRecords = 16 * g18::EventJournal::recordsPerSegment;
+  const persistent_node_id_t rareNode = 42;
+  const size_t rareFrom = numRecords / 2, rareTo = rareFrom + 1000;
+  const lamp_time_t base = static_cast<lamp_time_t>(1500000000000ULL) << 16;
+  g18::EventJournal journal;
+  if (journal.open(dir) != 0) {
+    printf("FAIL: unable to open the journal\n");
+    removeDirectory(dir);
+    return 1;
+  }
+  uint64_t start = monotonic_time_ns();
+  for (size_t i = 0; i < numRecords; i++) {
+    const bool rare = i >= rareFrom && i < rareTo && i % 10 == 0;
+    const node_id_t node = {rare ? rareNode : static_cast<persistent_node_id_t>(1 + i % 10),
+                            base};
+    const journal_event_e type = (i % 1000 == 992) ? JOURNAL_EVENT_DIED
+                                                   : JOURNAL_EVENT_HEARTBEAT;
+    journal.append(type, node, base + (i << 8));
+  }
+  const double appendNs = elapsedNsPer(start, numRecords);
+
+  // Everything the rare node did, over the whole journal
+  journal_query_t query = {
+    .anyNode = false,
+    .ip = rareNode,
+    .from = 0,
+    .to = UINT64_MAX,
+    .typeMask = ~0U
+  };
+  std::vector<journal_record_t> results;
+  journal_query_stats_t stats;
+  const unsigned queries = 20;
+  start = monotonic_time_ns();
+  for (unsigned q = 0; q < queries; q++) {
+    results.clear();
+    g18::EventJournal::query(dir, query, results, &stats);
+  }
+  const double nodeNs = elapsedNsPer(start, queries);
+  if (results.size() != (rareTo - rareFrom) / 10 || stats.segmentsSearched != 1) {
+    printf("FAIL: node query found %zu records in %zu segments\n", results.size(),
+           stats.segmentsSearched);
+    removeDirectory(dir);
+    return 1;
+  }
+  const journal_query_stats_t nodeStats = stats;
+
+  // Deaths of one busy node in a 100 ms window
+  query.ip = 3;
+  query.from = base + (static_cast<lamp_time_t>(numRecords / 3) << 8);
+  query.to = query.from + (static_cast<lamp_time_t>(100) << 16);
+  query.typeMask = 1U << JOURNAL_EVENT_DIED;
+  start = monotonic_time_ns();
+  for (unsigned q = 0; q < queries; q++) {
+    results.clear();
+    g18::EventJournal::query(dir, query, results, &stats);
+  }
+  const double windowNs = elapsedNsPer(start, queries);
+  const size_t windowResults = results.size();
+
+  // The same question, answered by reading every record
+  query.anyNode = true;
+  query.from = 0;
+  query.to = UINT64_MAX;
+  query.typeMask = ~0U;
+  const lamp_time_t windowFrom = base + (static_cast<lamp_time_t>(numRecords / 3) << 8);
+  const lamp_time_t windowTo = windowFrom + (static_cast<lamp_time_t>(100) << 16);
+  start = monotonic_time_ns();
+  size_t scanResults = 0;
+  journal_query_stats_t scanStats;
+  for (unsigned q = 0; q < queries; q++) {
+    results.clear();
+    g18::EventJournal::query(dir, query, results, &scanStats);
+    scanResults = 0;
+    for (auto it = results.begin(); it != results.end(); ++it) {
+      scanResults += it->node.ip == 3 && it->type == JOURNAL_EVENT_DIED &&
+                     it->time >= windowFrom && it->time <= windowTo;
+    }
+  }
+  const double scanNs = elapsedNsPer(start, queries);
+  removeDirectory(dir);
+  if (scanResults != windowResults || windowResults == 0) {
+    printf("FAIL: window query found %zu records, but a full scan found %zu\n",
+           windowResults, scanResults);
+    return 1;
+  }
+
+  printf("%zu records in %zu segments, %.1f ns/append\n", numRecords,
+         scanStats.segments, appendNs);
+  printf("%-22s %12s %10s %12s\n", "query", "us/query", "segments", "examined");
+  printf("%-22s %12.1f %10zu %12zu\n", "rare node, all time", nodeNs / 1000,
+         nodeStats.segmentsSearched, nodeStats.recordsExamined);
+  printf("%-22s %12.1f %10zu %12zu\n", "node 3 deaths, 100 ms", windowNs / 1000,
+         stats.segmentsSearched, stats.recordsExamined);
+  printf("%-22s %12.1f %10zu %12zu\n", "full scan", scanNs / 1000,
+         scanStats.segmentsSearched, scanStats.recordsExamined);
+  return 0;
+}
+
+/////////////////////////////////////////
+// Log search
+/////////////////////////////////////////
+
+/// Write a log that looks like ours, of about size bytes.
+static int writeSampleLog(const char *path, const size_t size)
+{
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    return -1;
+  }
+  size_t written = 0;
+  for (unsigned i = 0; written < size; i++) {
+    int len;
+    switch (i % 8) {
+    case 0:
+      len = fprintf(f, "Daemon.cpp:onHeartbeatReadable:%u: Got heartbeat: %u:%u\n",
+                    580 + i % 3, 1 + i % 10, i);
+      break;
+    case 1:
+      len = fprintf(f, "Daemon.cpp:handleMissedHeartbeat:91: Node %u timed out; marking as dead\n",
+                    1 + (i / 8) % 10);
+      break;
+    case 2:
+      len = fprintf(f, "Transport.cpp:sendTo:44: Error: sending to node %u: Connection refused\n",
+                    i % 10);
+      break;
+    case 3:
+      len = fprintf(f, "HeartbeatScheduler.cpp:onTimer:91: Warning: heartbeat is %u us late\n",
+                    i % 5000);
+      break;
+    default:
+      len = fprintf(f, "MembershipList.cpp:nodeDidJoin:204: Debug: Node %u joining at %u\n",
+                    i % 1000, i);
+      break;
+    }
+    written += len;
+  }
+  // Leave the last line without a newline, as a log cut off mid-write would
+  fprintf(f, "Daemon.cpp:main:1: Node 4 timed out");
+  return fclose(f);
+}
+
+static bool readFile(const char *path, std::string &contents)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+  char buf[65536];
+  size_t len;
+  contents.clear();
+  while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+    contents.append(buf, len);
+  }
+  fclose(f);
+  return true;
+}
+
+static int benchLogSearch()
+{
+  const char *logPath = "/tmp/logsearch-bench.log";
+  const char *grepOut = "/tmp/logsearch-bench.grep";
+  const char *ourOut = "/tmp/logsearch-bench.out";
+  if (writeSampleLog(logPath, 64 << 20) != 0) {
+    printf("FAIL: unable to write a sample log\n");
+    return 1;
+  }
+  const char *commands[] = {
+    "-F 'Connection refused'",
+    "-E 'Node [0-9]+ timed out'",
+    "-i 'warning: heartbeat is 4[0-9]* us'",
+    "-c -v heartbeat",
+    "'^[A-Z][a-z]*\\.cpp:main'",
+    "'[[:digit:]] us late'",
+    "'[[:digit:]]x'",
+    "-E 'node [[=7=][.8.]]: Conn'",
+    "'[]a]b'",
+    "-e 'timed out' -e 'Connection refused'",
+    "-F -i -e 'US LATE' -e 'joining at 7'",
+    "'Warning: heartbeat' -c",
+    "-c -- -v",
+  };
+  const unsigned threadCounts[] = {1, 2, 4};
+  const std::vector<std::string> files(1, logPath);
+  printf("%-38s %10s %10s", "command", "matches", "grep ms");
+  for (size_t c = 0; c < sizeof(threadCounts) / sizeof(threadCounts[0]); c++) {
+    printf(" %8u thr", threadCounts[c]);
+  }
+  printf("\n");
+  int failed = 0;
+  for (size_t q = 0; q < sizeof(commands) / sizeof(commands[0]) && !failed; q++) {
+    // What grep itself says, and how long it takes including the spawn
+    const std::string shell = std::string("grep -H ") + commands[q] + " " + logPath +
+                              " > " + grepOut;
+    uint64_t start = monotonic_time_ns();
+    if (system(shell.c_str()) == -1) {
+      printf("FAIL: unable to run grep\n");
+      failed = 1;
+      break;
+    }
+    const double grepMs = (monotonic_time_ns() - start) / 1e6;
+    std::string expected, actual;
+    readFile(grepOut, expected);
+
+    search_query_t query;
+    std::string error;
+    if (g18::LogSearch::parseCommand(commands[q], query, error) != 0) {
+      printf("FAIL: unable to parse %s: %s\n", commands[q], error.c_str());
+      failed = 1;
+      break;
+    }
+    printf("%-38s", commands[q]);
+    for (size_t c = 0; c < sizeof(threadCounts) / sizeof(threadCounts[0]); c++) {
+      const g18::LogSearch search(files, threadCounts[c]);
+      const int fd = open(ourOut, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      start = monotonic_time_ns();
+      const ssize_t matches = search.search(query, fd, error);
+      const double ms = (monotonic_time_ns() - start) / 1e6;
+      close(fd);
+      readFile(ourOut, actual);
+      if (matches < 0 || actual != expected) {
+        printf("\nFAIL: output differs from grep's with %u threads (%zu vs %zu bytes)\n",
+               threadCounts[c], actual.size(), expected.size());
+        failed = 1;
+        break;
+      }
+      if (c == 0) {
+        printf(" %10zd %10.1f", matches, grepMs);
+      }
+      printf(" %9.1f ms", ms);
+    }
+    printf("\n");
+  }
+  unlink(logPath);
+  unlink(grepOut);
+  unlink(ourOut);
+  return failed;
+}
+
+/////////////////////////////////////////
+// Metrics
+/////////////////////////////////////////
+
+/// A single counter every thread shares, as a baseline for the shards.
+static std::atomic<uint64_t> sharedCounter;
+
+typedef struct {
+  size_t calls;
+  bool sharded;
+  uint64_t ns;
+} counter_writer_t;
+
+static void *counterWriter(void *arg)
+{
+  counter_writer_t *w = static_cast<counter_writer_t *>(arg);
+  g18::Metrics &metrics = g18::Metrics::instance();
+  const uint64_t start = monotonic_time_ns();
+  if (w->sharded) {
+    for (size_t i = 0; i < w->calls; i++) {
+      metrics.increment(METRIC_HEARTBEATS_RECEIVED);
+    }
+  } else {
+    for (size_t i = 0; i < w->calls; i++) {
+      sharedCounter.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  w->ns = monotonic_time_ns() - start;
+  return NULL;
+}
+
+/// Returns the average ns per increment.
+static double runCounterWriters(const unsigned numThreads, const size_t calls,
+                                const bool sharded)
+{
+  std::vector<counter_writer_t> writers(numThreads);
+  std::vector<pthread_t> threads(numThreads);
+  for (unsigned i = 0; i < numThreads; i++) {
+    writers[i].calls = calls;
+    writers[i].sharded = sharded;
+    pthread_create(&threads[i], NULL, counterWriter, &writers[i]);
+  }
+  uint64_t totalNs = 0;
+  for (unsigned i = 0; i < numThreads; i++) {
+    pthread_join(threads[i], NULL);
+    totalNs += writers[i].ns;
+  }
+  return static_cast<double>(totalNs) / (calls * numThreads);
+}
+
+static int benchMetrics()
+{
+  g18::Metrics &metrics = g18::Metrics::instance();
+  const unsigned threadCounts[] = {1, 4, 8};
+  const size_t calls = 2000000;
+  printf("%-8s %14s %14s\n", "threads", "shared ns/inc", "sharded ns/inc");
+  for (size_t c = 0; c < sizeof(threadCounts) / sizeof(threadCounts[0]); c++) {
+    const unsigned n = threadCounts[c];
+    const uint64_t before = metrics.value(METRIC_HEARTBEATS_RECEIVED);
+    const double sharedNs = runCounterWriters(n, calls, false);
+    const double shardedNs = runCounterWriters(n, calls, true);
+    const uint64_t counted = metrics.value(METRIC_HEARTBEATS_RECEIVED) - before;
+    if (counted != n * calls) {
+      printf("FAIL: counted %llu increments, expected %llu\n",
+             (unsigned long long)counted, (unsigned long long)(n * calls));
+      return 1;
+    }
+    printf("%-8u %14.1f %14.1f\n", n, sharedNs, shardedNs);
+  }
+
+  const size_t records = 10000000;
+  uint64_t start = monotonic_time_ns();
+  for (size_t i = 0; i < records; i++) {
+    metrics.record(METRIC_BP_HANDLER_NS, i & 0xFFFFF);
+  }
+  printf("%-28s %10.1f ns/record\n", "histogram record", elapsedNsPer(start, records));
+
+  const size_t reports = 1000;
+  start = monotonic_time_ns();
+  for (size_t i = 0; i < reports; i++) {
+    sink += metrics.report().size();
+  }
+  printf("%-28s %10.1f us/report\n", "report", elapsedNsPer(start, reports) / 1000);
+  return 0;
+}
+
+/////////////////////////////////////////
+// k-monitoring
+/////////////////////////////////////////
+
+// A ring of simulated nodes, each with its own view of the membership and
+// the Daemon's rules for heartbeating and monitoring: a node monitors its k
+// predecessors, a newly monitored node gets a full timeout, and
+// Daemon::closerReporter() decides who reports a failure. With probing, a
+// monitor probes a predecessor for Daemon::probeTimeoutMs before reporting
+// it. Failure reports reach each node after one hop per node they pass on
+// the way round the ring.
+
+#define SIM_NODES 32
+#define SIM_PERIOD_MS 250
+#define SIM_TIMEOUT_MS 1000
+#define SIM_TICK_MS 50
+#define SIM_HOP_MS 2
+#define SIM_NEVER UINT64_MAX
+
+typedef struct {
+  g18::MembershipList view;
+  bool alive;
+  /// Deadline for each monitored predecessor, by IP; SIM_NEVER for nodes
+  /// that are still heartbeating.
+  std::vector<uint64_t> deadline;
+  std::vector<bool> monitoring;
+  /// When our probe of each predecessor gives up, by IP; SIM_NEVER for
+  /// nodes we aren't probing.
+  std::vector<uint64_t> probeUntil;
+} sim_node_t;
+
+typedef struct {
+  uint64_t atMs;
+  unsigned to;
+  node_id_t dead;
+} sim_report_t;
+
+static node_id_t simID(const unsigned ip)
+{
+  return (node_id_t){static_cast<persistent_node_id_t>(ip), 1};
+}
+
+/// Start monitoring j's current k predecessors, as refreshMonitoredNeighbors() does.
+static void simRefresh(std::vector<sim_node_t> &nodes, const unsigned j,
+                       const unsigned k, const uint64_t nowMs)
+{
+  sim_node_t &n = nodes[j];
+  const std::vector<node_id_t> preds =
+    n.view.snapshot()->predecessorsOf(simID(j), k);
+  std::vector<bool> expected(SIM_NODES, false);
+  for (size_t i = 0; i < preds.size(); i++) {
+    const unsigned p = preds[i].ip;
+    expected[p] = true;
+    if (!n.monitoring[p]) {
+      n.monitoring[p] = true;
+      n.deadline[p] = nodes[p].alive ? SIM_NEVER : nowMs + SIM_TIMEOUT_MS;
+    }
+  }
+  for (unsigned p = 0; p < SIM_NODES; p++) {
+    if (!expected[p]) {
+      n.monitoring[p] = false;
+    }
+  }
+}
+
+/// Crash nodes [first, first + failed) and return how long until all of them
+/// have been declared dead, or SIM_NEVER. Adds to *reports the failure
+/// reports sent.
+static uint64_t simulateFailure(const unsigned k, const unsigned first,
+                                const unsigned failed, const bool dedup,
+                                const bool probing, unsigned *seed, size_t *reports)
+{
+  // IP 0 is never used, so that ip == index
+  std::vector<sim_node_t> nodes(SIM_NODES);
+  for (unsigned j = 1; j < SIM_NODES; j++) {
+    for (unsigned i = 1; i < SIM_NODES; i++) {
+      nodes[j].view.nodeDidJoin(simID(i));
+    }
+    nodes[j].alive = !(j >= first && j < first + failed);
+    nodes[j].deadline.assign(SIM_NODES, SIM_NEVER);
+    nodes[j].monitoring.assign(SIM_NODES, false);
+    nodes[j].probeUntil.assign(SIM_NODES, SIM_NEVER);
+  }
+  // Every node has been heartbeating its k successors until now, and the
+  // crashed ones sent their last heartbeats sometime in the last period
+  for (unsigned j = 1; j < SIM_NODES; j++) {
+    simRefresh(nodes, j, k, 0);
+  }
+  for (unsigned p = first; p < first + failed; p++) {
+    const uint64_t lastHeartbeatMs = SIM_PERIOD_MS - 1 - rand_r(seed) % SIM_PERIOD_MS;
+    for (unsigned j = 1; j < SIM_NODES; j++) {
+      if (nodes[j].monitoring[p]) {
+        // Shifted a period so nothing goes negative
+        nodes[j].deadline[p] = lastHeartbeatMs + SIM_TIMEOUT_MS;
+      }
+    }
+  }
+
+  std::vector<uint64_t> declaredAt(SIM_NODES, SIM_NEVER);
+  std::vector<sim_report_t> inFlight;
+  unsigned undeclared = failed;
+  const uint64_t crashMs = SIM_PERIOD_MS;
+  uint64_t nowMs;
+  auto declareDead = [&](const unsigned j, const unsigned p) {
+    nodes[j].view.nodeDidDie(simID(p), 1);
+    (*reports)++;
+    if (declaredAt[p] == SIM_NEVER) {
+      declaredAt[p] = nowMs;
+      undeclared--;
+    }
+    // The report goes backwards round the ring
+    for (unsigned hops = 1; hops < SIM_NODES - 1; hops++) {
+      const unsigned to = (j + SIM_NODES - 1 - hops - 1) % (SIM_NODES - 1) + 1;
+      if (nodes[to].alive) {
+        inFlight.push_back((sim_report_t){nowMs + hops * SIM_HOP_MS, to, simID(p)});
+      }
+    }
+    simRefresh(nodes, j, k, nowMs);
+  };
+  for (nowMs = crashMs; nowMs < crashMs + 30000 && undeclared > 0; nowMs += SIM_TICK_MS) {
+    // Deliver the reports that have arrived
+    for (size_t r = 0; r < inFlight.size(); ) {
+      if (inFlight[r].atMs <= nowMs) {
+        g18::MembershipList &view = nodes[inFlight[r].to].view;
+        if (view.snapshot()->isOnline(inFlight[r].dead)) {
+          view.nodeDidDie(inFlight[r].dead, 1);
+          simRefresh(nodes, inFlight[r].to, k, nowMs);
+        }
+        inFlight[r] = inFlight.back();
+        inFlight.pop_back();
+      } else {
+        r++;
+      }
+    }
+    for (unsigned j = 1; j < SIM_NODES; j++) {
+      sim_node_t &n = nodes[j];
+      if (!n.alive) {
+        continue;
+      }
+      // Everything due this tick expires together, as in the TimerWheel
+      std::vector<bool> expired(SIM_NODES, false);
+      for (unsigned p = 1; p < SIM_NODES; p++) {
+        expired[p] = n.monitoring[p] && n.deadline[p] <= nowMs;
+      }
+      for (unsigned p = 1; p < SIM_NODES; p++) {
+        if (n.probeUntil[p] <= nowMs) {
+          // Nobody else could reach it either, unless a report beat us to it
+          n.probeUntil[p] = SIM_NEVER;
+          if (n.view.snapshot()->isOnline(simID(p))) {
+            declareDead(j, p);
+          }
+          continue;
+        }
+        if (!expired[p] || !n.monitoring[p]) {
+          continue;
+        }
+        const std::vector<node_id_t> preds =
+          n.view.snapshot()->predecessorsOf(simID(j), k);
+        std::vector<monitored_state_e> closer;
+        for (size_t c = 0; dedup && c < preds.size() && preds[c].ip != p; c++) {
+          const unsigned q = preds[c].ip;
+          closer.push_back(n.probeUntil[q] != SIM_NEVER ? MONITORED_PROBING :
+                           expired[q] ? MONITORED_SILENT : MONITORED_HEARTBEATING);
+        }
+        if (g18::Daemon::closerReporter(closer) >= 0) {
+          n.deadline[p] = nowMs + SIM_TICK_MS;
+          continue;
+        }
+        if (probing) {
+          n.deadline[p] = SIM_NEVER;
+          n.probeUntil[p] = nowMs + g18::Daemon::probeTimeoutMs;
+          continue;
+        }
+        declareDead(j, p);
+      }
+    }
+  }
+  if (undeclared > 0) {
+    return SIM_NEVER;
+  }
+  uint64_t lastMs = 0;
+  for (unsigned p = first; p < first + failed; p++) {
+    lastMs = std::max(lastMs, declaredAt[p]);
+  }
+  return lastMs - crashMs;
+}
+
+static int benchMonitoring()
+{
+  // Check the k-neighbor walks against repeated single steps
+  g18::MembershipList list;
+  for (unsigned i = 1; i <= 40; i++) {
+    list.nodeDidJoin(simID(i));
+  }
+  for (unsigned i = 1; i <= 40; i += 3) {
+    list.nodeDidDie(simID(i), 1);
+  }
+  std::shared_ptr<const g18::MembershipSnapshot> snap = list.snapshot();
+  for (unsigned i = 1; i <= 40; i++) {
+    const std::vector<node_id_t> succs = snap->successorsOf(simID(i), 5);
+    const std::vector<node_id_t> preds = snap->predecessorsOf(simID(i), 5);
+    node_id_t s = simID(i), p = simID(i);
+    for (size_t j = 0; j < 5; j++) {
+      s = snap->successorOf(s);
+      p = snap->predecessorOf(p);
+      if (j >= succs.size() || !g18::isEqual(succs[j], s) ||
+          j >= preds.size() || !g18::isEqual(preds[j], p)) {
+        printf("FAIL: neighbors of %u differ at distance %zu\n", i, j + 1);
+        return 1;
+      }
+    }
+  }
+
+  const unsigned trials = 50;
+  printf("Time until every one of f adjacent crashed nodes is declared dead (ms),\n"
+         "and failure reports sent per crashed node with and without dedup, when\n"
+         "monitors report straight away and when they probe first\n");
+  printf("%-3s %-7s %8s %8s %8s %8s %12s %12s\n", "k", "probing", "f=1", "f=2", "f=3", "f=4",
+         "reports", "no dedup");
+  unsigned seed = 42;
+  for (unsigned k = 1; k <= 4; k++) {
+    for (int probing = 0; probing <= 1; probing++) {
+      printf("%-3u %-7s", k, probing ? "yes" : "no");
+      size_t reports = 0, undedupedReports = 0, crashed = 0;
+      for (unsigned f = 1; f <= 4; f++) {
+        uint64_t totalMs = 0;
+        for (unsigned t = 0; t < trials; t++) {
+          const unsigned first = 1 + rand_r(&seed) % (SIM_NODES - 1 - f);
+          unsigned undedupedSeed = seed;
+          const uint64_t ms = simulateFailure(k, first, f, true, probing, &seed, &reports);
+          simulateFailure(k, first, f, false, probing, &undedupedSeed, &undedupedReports);
+          if (ms == SIM_NEVER) {
+            printf("\nFAIL: %u adjacent failures never detected with k = %u\n", f, k);
+            return 1;
+          }
+          totalMs += ms;
+          crashed += f;
+        }
+        printf(" %8.0f", static_cast<double>(totalMs) / trials);
+      }
+      printf(" %12.2f %12.2f\n", static_cast<double>(reports) / crashed,
+             static_cast<double>(undedupedReports) / crashed);
+    }
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Dissemination
+/////////////////////////////////////////
+
+// How long one change takes to reach every member when it's passed back
+// around the ring versus gossiped, with each simulated member running its
+// own GossipDisseminator. Every datagram takes 0.2-0.6 ms to arrive, plus
+// SLOW_NODE_MS at one member in the "slow" runs.
+
+#define PROTOCOL_PERIOD_MS 250
+#define SLOW_NODE_MS 100.0
+
+typedef struct {
+  double atMs;
+  unsigned node;
+  /// A gossip round is due, rather than a datagram arriving.
+  bool tick;
+} sim_event_t;
+
+struct sim_event_later {
+  bool operator()(const sim_event_t &a, const sim_event_t &b) const
+  {
+    return a.atMs > b.atMs;
+  }
+};
+
+static double simLatencyMs(unsigned *seed)
+{
+  return 0.2 + (rand_r(seed) % 400) / 1000.0;
+}
+
+static double simulateRing(const unsigned n, const unsigned slow, unsigned *seed)
+{
+  // Each member passes the change straight on to its predecessor
+  double nowMs = 0;
+  for (unsigned hop = 1; hop < n; hop++) {
+    const unsigned to = n - hop + 1;
+    nowMs += simLatencyMs(seed) + (to == slow ? SLOW_NODE_MS : 0);
+  }
+  return nowMs;
+}
+
+/// Returns how long until everyone knew, or -1 if not everyone ever did, and
+/// adds how long until 99% knew to *mostMs. Adds the datagrams sent to
+/// *datagrams.
+static double simulateGossip(const g18::MembershipSnapshot &members, const unsigned n,
+                             const unsigned slow, unsigned *seed, double *mostMs,
+                             size_t *datagrams)
+{
+  std::vector<std::unique_ptr<g18::GossipDisseminator> > nodes(n + 1);
+  std::vector<double> phaseMs(n + 1);
+  for (unsigned j = 1; j <= n; j++) {
+    nodes[j].reset(new g18::GossipDisseminator(g18::GossipDisseminator::defaultFanout,
+                                               rand_r(seed)));
+    phaseMs[j] = rand_r(seed) % PROTOCOL_PERIOD_MS;
+  }
+  std::vector<bool> knows(n + 1, false), ticking(n + 1, false);
+  std::priority_queue<sim_event_t, std::vector<sim_event_t>, sim_event_later> events;
+  const node_id_t change = {static_cast<persistent_node_id_t>(n + 1), 1};
+  unsigned informed = 0;
+  double convergedMs = -1;
+  events.push((sim_event_t){0, 1, false});
+  while (!events.empty()) {
+    const sim_event_t ev = events.top();
+    events.pop();
+    g18::GossipDisseminator &d = *nodes[ev.node];
+    if (!ev.tick) {
+      if (knows[ev.node]) {
+        continue;
+      }
+      knows[ev.node] = true;
+      if (++informed == (n * 99 + 99) / 100) {
+        *mostMs += ev.atMs;
+      }
+      if (informed == n) {
+        convergedMs = ev.atMs;
+      }
+      d.enqueue(change, NODE_STATE_ONLINE);
+    }
+    // A round on every tick, and straight away for news, as the Daemon does
+    std::vector<persistent_node_id_t> targets;
+    changelist_t msg;
+    d.chooseTargets(members, members.liveMember(ev.node - 1), targets);
+    d.nextRound(n, msg);
+    *datagrams += targets.size();
+    for (auto it = targets.begin(); it != targets.end(); ++it) {
+      events.push((sim_event_t){ev.atMs + simLatencyMs(seed) +
+                                (*it == slow ? SLOW_NODE_MS : 0), *it, false});
+    }
+    if (ev.tick) {
+      ticking[ev.node] = false;
+    }
+    if (!d.empty() && !ticking[ev.node]) {
+      // Next protocol period
+      const double periods = ceil((ev.atMs - phaseMs[ev.node]) / PROTOCOL_PERIOD_MS + 1e-9);
+      events.push((sim_event_t){phaseMs[ev.node] + periods * PROTOCOL_PERIOD_MS,
+                                ev.node, true});
+      ticking[ev.node] = true;
+    }
+  }
+  return convergedMs;
+}
+
+static int benchDissemination()
+{
+  const unsigned sizes[] = {50, 100, 200, 500, 1000};
+  const unsigned trials = 5;
+  printf("Time for one change to reach every member (ms)\n");
+  printf("%-6s %10s %10s %10s %12s %12s %8s %15s\n", "nodes", "ring", "ring slow",
+         "gossip 99%", "gossip 100%", "gossip slow", "rounds", "datagrams/node");
+  unsigned seed = 42;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const unsigned n = sizes[s];
+    g18::MembershipList list;
+    for (unsigned i = 1; i <= n; i++) {
+      list.nodeDidJoin((node_id_t){static_cast<persistent_node_id_t>(i), 1});
+    }
+    std::shared_ptr<const g18::MembershipSnapshot> members = list.snapshot();
+    // The slow member is halfway round the ring from where the change starts
+    const unsigned slow = n / 2;
+    double ringMs = 0, ringSlowMs = 0, gossipMs = 0, gossipSlowMs = 0;
+    double mostMs = 0, slowMostMs = 0;
+    size_t datagrams = 0, slowDatagrams = 0;
+    for (unsigned t = 0; t < trials; t++) {
+      ringMs += simulateRing(n, 0, &seed);
+      ringSlowMs += simulateRing(n, slow, &seed);
+      const double ms = simulateGossip(*members, n, 0, &seed, &mostMs, &datagrams);
+      const double slowMs = simulateGossip(*members, n, slow, &seed, &slowMostMs,
+                                           &slowDatagrams);
+      if (ms < 0 || slowMs < 0) {
+        printf("FAIL: gossip never reached all %u members\n", n);
+        return 1;
+      }
+      gossipMs += ms;
+      gossipSlowMs += slowMs;
+    }
+    printf("%-6u %10.1f %10.1f %10.1f %12.1f %12.1f %8u %15.1f\n", n, ringMs / trials,
+           ringSlowMs / trials, mostMs / trials, gossipMs / trials, gossipSlowMs / trials,
+           g18::GossipDisseminator::retransmitLimit(n),
+           static_cast<double>(datagrams) / trials / n);
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Indirect probing
+/////////////////////////////////////////
+
+// A monitor suspects a healthy node after its heartbeats go missing on a
+// lossy network. Every probe message really is encoded, decoded and
+// answered by the member it's addressed to, and each is lost independently.
+// Without probing, every suspicion is a false positive.
+
+#define PROBE_LOSS_TIMEOUT_HEARTBEATS 4
+
+typedef struct {
+  probe_t probe;
+  persistent_node_id_t to;
+  double atMs;
+} probe_in_flight_t;
+
+/// Deliver a probe unless it's lost, returning whether it arrived.
+static bool simDeliver(const probe_t &probe, const double lossRate, unsigned *seed,
+                       probe_t &received)
+{
+  std::string packet;
+  g18::encodeProbe(probe, packet);
+  if (rand_r(seed) < lossRate * RAND_MAX) {
+    return false;
+  }
+  return g18::decodeProbe(packet.data(), packet.size(), received) == 0;
+}
+
+/// Run one probe of a live target. Returns whether any ack made it back,
+/// with the round trip of the first one.
+static bool simulateProbe(g18::IndirectProber &prober, const g18::MembershipSnapshot &members,
+                          const node_id_t &self, const node_id_t &target,
+                          const double lossRate, unsigned *seed, double &rttMs)
+{
+  std::vector<probe_t> probes;
+  std::vector<persistent_node_id_t> recipients;
+  prober.begin(target, self, members, 0, probes, recipients);
+  std::vector<probe_in_flight_t> inFlight;
+  for (size_t i = 0; i < probes.size(); i++) {
+    inFlight.push_back((probe_in_flight_t){probes[i], recipients[i], 0});
+  }
+  double firstAckMs = -1;
+  while (!inFlight.empty()) {
+    const probe_in_flight_t msg = inFlight.back();
+    inFlight.pop_back();
+    probe_t in;
+    if (!simDeliver(msg.probe, lossRate, seed, in)) {
+      continue;
+    }
+    const double atMs = msg.atMs + simLatencyMs(seed);
+    if (msg.to == self.ip && in.type == WIRE_MSG_ACK && in.origin == self.ip) {
+      firstAckMs = firstAckMs < 0 ? atMs : std::min(firstAckMs, atMs);
+      continue;
+    }
+    // Everyone in members is alive, and answers as the Daemon would
+    node_id_t recipient = target;
+    membership_entry_t entry;
+    if (msg.to != target.ip && members.latestEntryFor(msg.to, entry)) {
+      recipient = entry.id;
+    }
+    probe_t reply;
+    persistent_node_id_t to;
+    if (g18::IndirectProber::respond(in, recipient, reply, to) == 0) {
+      inFlight.push_back((probe_in_flight_t){reply, to, atMs});
+    }
+  }
+  if (firstAckMs < 0) {
+    prober.end(target);
+    return false;
+  }
+  uint64_t rttNs;
+  probe_t ack = {WIRE_MSG_ACK, 0, self.ip, 0, target};
+  ack.seq = probes[0].seq;
+  if (prober.acknowledge(ack, static_cast<uint64_t>(firstAckMs * 1e6), rttNs) != 0) {
+    return false;
+  }
+  rttMs = rttNs / 1e6;
+  return true;
+}
+
+static int benchProbing()
+{
+  g18::MembershipList list;
+  const unsigned n = 100;
+  for (unsigned i = 1; i <= n; i++) {
+    list.nodeDidJoin((node_id_t){static_cast<persistent_node_id_t>(i), 1});
+  }
+  std::shared_ptr<const g18::MembershipSnapshot> members = list.snapshot();
+  const node_id_t self = {1, 1}, target = {2, 1};
+
+  // A dead target must never be cleared
+  g18::IndirectProber prober(g18::IndirectProber::defaultHelpers, 7);
+  std::vector<probe_t> probes;
+  std::vector<persistent_node_id_t> recipients;
+  prober.begin(target, self, *members, 0, probes, recipients);
+  probe_t reply;
+  persistent_node_id_t to;
+  const node_id_t reborn = {2, 99};
+  if (probes.size() != g18::IndirectProber::defaultHelpers + 1 ||
+      g18::IndirectProber::respond(probes[0], reborn, reply, to) == 0) {
+    printf("FAIL: an old incarnation's ping was answered\n");
+    return 1;
+  }
+  prober.end(target);
+
+  const double lossRates[] = {0.01, 0.05, 0.10, 0.20};
+  const unsigned trials = 200000;
+  unsigned seed = 42;
+  printf("False positives for a healthy node, per heartbeat timeout, when %d\n"
+         "heartbeats in a row must be lost to raise a suspicion\n",
+         PROBE_LOSS_TIMEOUT_HEARTBEATS);
+  printf("%-6s %14s %14s %14s %10s %10s\n", "loss", "no probing", "direct only",
+         "3 helpers", "median rtt", "p99 rtt");
+  for (size_t l = 0; l < sizeof(lossRates) / sizeof(lossRates[0]); l++) {
+    const double loss = lossRates[l];
+    const double suspicionRate = pow(loss, PROBE_LOSS_TIMEOUT_HEARTBEATS);
+    size_t failed[2] = {0, 0};
+    g18::Histogram rtt;
+    for (unsigned helpers = 0, h = 0; h < 2; h++, helpers = g18::IndirectProber::defaultHelpers) {
+      g18::IndirectProber p(helpers, 11);
+      for (unsigned t = 0; t < trials; t++) {
+        double rttMs;
+        if (!simulateProbe(p, *members, self, target, loss, &seed, rttMs)) {
+          failed[h]++;
+        } else if (helpers > 0) {
+          rtt.record(static_cast<uint64_t>(rttMs * 1000));
+        }
+      }
+    }
+    printf("%5.0f%% %14.2e %14.2e %14.2e %8.2fms %8.2fms\n", loss * 100, suspicionRate,
+           suspicionRate * failed[0] / trials, suspicionRate * failed[1] / trials,
+           rtt.percentile(0.5) / 1000.0, rtt.percentile(0.99) / 1000.0);
+  }
+
+  // What a probe costs the monitor, from suspicion to the first ack
+  const size_t probesRun = 200000;
+  g18::IndirectProber p(g18::IndirectProber::defaultHelpers, 13);
+  const uint64_t start = monotonic_time_ns();
+  for (size_t i = 0; i < probesRun; i++) {
+    double rttMs;
+    sink += simulateProbe(p, *members, self, target, 0, &seed, rttMs);
+  }
+  printf("%-28s %10.1f ns/probe\n", "probe (4 paths, 10 messages)",
+         elapsedNsPer(start, probesRun));
+  return 0;
+}
+
+/////////////////////////////////////////
+// Phi accrual detection
+/////////////////////////////////////////
+
+// One neighbor heartbeats every period over a link that adds 1 ms plus
+// exponentially distributed jitter, and loses some heartbeats. After each
+// heartbeat the monitor sets a deadline, as the Daemon does: a fixed timeout,
+// or wherever phi will cross the threshold. A deadline that passes before
+// the next heartbeat arrives is a false suspicion. Had the neighbor crashed
+// right after sending that heartbeat, the deadline is when we'd notice.
+
+#define PHI_SIM_PERIOD_MS 250
+#define PHI_SIM_MIN_STDDEV_MS 25
+#define PHI_SIM_HEARTBEATS 400000
+/// The Daemon's timeout, which phi falls back on until it has a few samples
+#define PHI_SIM_FIXED_TIMEOUT_MS 1000
+
+typedef struct {
+  const char *name;
+  double jitterMs;
+  double loss;
+} phi_sim_link_t;
+
+typedef struct {
+  /// 0 for a fixed timeout of pauseMs
+  double threshold;
+  /// Slack past the mean interval, for phi
+  unsigned pauseMs;
+} phi_sim_detector_t;
+
+static void simulatePhiLink(const phi_sim_detector_t &detector, const phi_sim_link_t &link,
+                            unsigned *seed, double &falsePerHeartbeat, double &detectMs)
+{
+  g18::PhiAccrualDetector phi(detector.threshold, PHI_SIM_MIN_STDDEV_MS, detector.pauseMs);
+  const node_id_t node = {2, 1};
+  size_t falseSuspicions = 0, deadlines = 0;
+  double totalDetectMs = 0, deadlineMs = -1, lastArrivalMs = 0;
+  for (unsigned i = 0; i < PHI_SIM_HEARTBEATS; i++) {
+    const double sentMs = static_cast<double>(i) * PHI_SIM_PERIOD_MS;
+    if (rand_r(seed) < link.loss * RAND_MAX) {
+      continue;
+    }
+    const double u = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+    const double arrivalMs = std::max(sentMs + 1 - link.jitterMs * log(u), lastArrivalMs);
+    lastArrivalMs = arrivalMs;
+    if (deadlineMs >= 0 && arrivalMs > deadlineMs) {
+      falseSuspicions++;
+    }
+    const uint64_t nowNs = static_cast<uint64_t>(arrivalMs * 1e6);
+    phi.heartbeat(node, nowNs);
+    uint64_t timeoutMs = PHI_SIM_FIXED_TIMEOUT_MS;
+    if (detector.threshold > 0) {
+      phi.timeUntilSuspicionMs(node, nowNs, timeoutMs);
+    } else if (detector.pauseMs > 0) {
+      timeoutMs = detector.pauseMs;
+    }
+    deadlineMs = arrivalMs + timeoutMs;
+    totalDetectMs += deadlineMs - sentMs;
+    deadlines++;
+  }
+  falsePerHeartbeat = static_cast<double>(falseSuspicions) / PHI_SIM_HEARTBEATS;
+  detectMs = totalDetectMs / deadlines;
+}
+
+static int benchPhiAccrual()
+{
+  // The closed-form inverse must agree with phi itself
+  const double thresholds[] = {0.5, 1, 3, 8, 12, 16};
+  for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+    const double elapsedMs = g18::PhiAccrualDetector::elapsedForPhi(thresholds[t], 250, 25);
+    const double phi = g18::PhiAccrualDetector::phiFor(elapsedMs, 250, 25);
+    if (fabs(phi - thresholds[t]) > 1e-6 * thresholds[t]) {
+      printf("FAIL: phi %g inverts to %.3f ms, which has phi %g\n", thresholds[t],
+             elapsedMs, phi);
+      return 1;
+    }
+  }
+
+  const phi_sim_link_t links[] = {
+    {"lan", 2, 0},
+    {"wan", 20, 0.001},
+    {"lossy", 50, 0.02},
+  };
+  const phi_sim_detector_t detectors[] = {
+    {0, 1000},
+    {0, 500},
+    {3, 0},
+    {8, 0},
+    {16, 0},
+    {3, PHI_SIM_PERIOD_MS},
+    {8, PHI_SIM_PERIOD_MS},
+    {16, PHI_SIM_PERIOD_MS},
+  };
+  const size_t numLinks = sizeof(links) / sizeof(links[0]);
+  unsigned seed = 17;
+  printf("Heartbeats every %d ms; false suspicions per heartbeat / mean ms from\n"
+         "a crash to its detection\n", PHI_SIM_PERIOD_MS);
+  printf("%-16s", "detector");
+  for (size_t l = 0; l < numLinks; l++) {
+    char name[32];
+    snprintf(name, sizeof(name), "%s, %g%% loss", links[l].name, links[l].loss * 100);
+    printf(" %21s", name);
+  }
+  printf("\n");
+  for (size_t d = 0; d < sizeof(detectors) / sizeof(detectors[0]); d++) {
+    char name[32];
+    if (detectors[d].threshold > 0) {
+      snprintf(name, sizeof(name), "phi %g +%u ms", detectors[d].threshold,
+               detectors[d].pauseMs);
+    } else {
+      snprintf(name, sizeof(name), "fixed %u ms", detectors[d].pauseMs);
+    }
+    printf("%-16s", name);
+    for (size_t l = 0; l < numLinks; l++) {
+      double falsePerHeartbeat, detectMs;
+      simulatePhiLink(detectors[d], links[l], &seed, falsePerHeartbeat, detectMs);
+      printf(" %10.2e / %6.0f ms", falsePerHeartbeat, detectMs);
+    }
+    printf("\n");
+  }
+
+  // Updating a window and finding the next deadline, over many neighbors
+  const unsigned peers = 1024;
+  const size_t heartbeats = 2000000;
+  g18::PhiAccrualDetector phi(8, PHI_SIM_MIN_STDDEV_MS);
+  uint64_t nowNs = 0;
+  const uint64_t start = monotonic_time_ns();
+  for (size_t i = 0; i < heartbeats; i++) {
+    const node_id_t node = {static_cast<persistent_node_id_t>(i % peers + 1), 1};
+    nowNs += 250000000 / peers + rand_r(&seed) % 1000;
+    phi.heartbeat(node, nowNs);
+    uint64_t ms;
+    sink += phi.timeUntilSuspicionMs(node, nowNs, ms) ? ms : 0;
+  }
+  printf("%-28s %10.1f ns/heartbeat\n", "heartbeat + next deadline",
+         elapsedNsPer(start, heartbeats));
+  return 0;
+}
+
+/////////////////////////////////////////
+// Piggybacking
+/////////////////////////////////////////
+
+// Steady membership churn in a ring of n members that each heartbeat their
+// successor every period. In the two-channel design every change also goes
+// once round the ring in a BP datagram of its own. In piggyback mode it only
+// ever rides on heartbeats, a bounded slice at a time, as the Daemon sends
+// them. Packets and bytes count what goes on the wire, including 28 bytes of
+// IPv4 and UDP header per datagram.
+
+#define PIGGYBACK_SIM_PERIOD_MS 250
+#define PIGGYBACK_SIM_SECONDS 60
+#define PIGGYBACK_SIM_MAX_CHANGES 16
+#define PIGGYBACK_SIM_MAX_BACKLOG (4 * PIGGYBACK_SIM_MAX_CHANGES)
+#define PIGGYBACK_SIM_HEADER_BYTES 28
+
+typedef struct {
+  double packetsPerNode;
+  double bytesPerNode;
+  /// Mean time for a change to reach everyone, over the changes that did
+  double spreadMs;
+  /// Changes that didn't reach everyone
+  double missedFraction;
+} piggyback_sim_result_t;
+
+/// A heartbeat as the Daemon sends it: our ID, then any piggybacked changes.
+static std::string simHeartbeat(const unsigned node, const changelist_t *changes)
+{
+  char id[48];
+  snprintf(id, sizeof(id), "%u:%llu", node, 0x18B9A1C2D3E40000ULL);
+  std::string hb = id;
+  if (changes != NULL) {
+    std::string slice;
+    g18::encodeChangelist(*changes, slice);
+    hb += slice;
+  }
+  return hb;
+}
+
+static piggyback_sim_result_t simulateTwoChannel(const unsigned n, const double churnPerSec,
+                                                 unsigned *seed)
+{
+  const double heartbeats = static_cast<double>(n) * PIGGYBACK_SIM_SECONDS * 1000 /
+    PIGGYBACK_SIM_PERIOD_MS;
+  const size_t changes = static_cast<size_t>(churnPerSec * PIGGYBACK_SIM_SECONDS);
+  double packets = heartbeats, bytes = 0, spreadMs = 0;
+  for (unsigned i = 1; i <= n; i++) {
+    bytes += (simHeartbeat(i, NULL).size() + PIGGYBACK_SIM_HEADER_BYTES) * heartbeats / n;
+  }
+  for (size_t c = 0; c < changes; c++) {
+    changelist_t msg;
+    msg.timestamp = 0x18B9A1C2D3E40000ULL;
+    msg.failed.push_back((node_id_t){static_cast<persistent_node_id_t>(n + 1 + c), 1});
+    std::string packet;
+    g18::encodeChangelist(msg, packet);
+    // Round the ring and back to where it started
+    packets += n;
+    bytes += static_cast<double>(n) * (packet.size() + PIGGYBACK_SIM_HEADER_BYTES);
+    spreadMs += simulateRing(n, 0, seed);
+  }
+  const piggyback_sim_result_t result = {
+    packets / n / PIGGYBACK_SIM_SECONDS,
+    bytes / n / PIGGYBACK_SIM_SECONDS,
+    changes > 0 ? spreadMs / changes : 0,
+    0
+  };
+  return result;
+}
+
+static piggyback_sim_result_t simulatePiggyback(const unsigned n, const double churnPerSec,
+                                                unsigned *seed)
+{
+  std::vector<std::unique_ptr<g18::GossipDisseminator> > nodes(n + 1);
+  std::priority_queue<sim_event_t, std::vector<sim_event_t>, sim_event_later> events;
+  for (unsigned j = 1; j <= n; j++) {
+    nodes[j].reset(new g18::GossipDisseminator(0, rand_r(seed)));
+    events.push((sim_event_t){static_cast<double>(rand_r(seed) % PIGGYBACK_SIM_PERIOD_MS),
+                              j, true});
+  }
+  // Changes start at random members at a steady rate
+  const size_t numChanges = static_cast<size_t>(churnPerSec * PIGGYBACK_SIM_SECONDS);
+  for (size_t c = 0; c < numChanges; c++) {
+    events.push((sim_event_t){c * 1000 / churnPerSec,
+                              static_cast<unsigned>(1 + rand_r(seed) % n), false});
+  }
+  // Which changes each member has heard of, and when each reached everyone
+  std::vector<std::vector<bool> > knows(n + 1, std::vector<bool>(numChanges, false));
+  std::vector<unsigned> informed(numChanges, 0);
+  std::vector<double> startedMs(numChanges, 0);
+  size_t nextChange = 0, converged = 0;
+  double packets = 0, bytes = 0, spreadMs = 0;
+  const double endMs = PIGGYBACK_SIM_SECONDS * 1000.0;
+  while (!events.empty() && events.top().atMs < endMs) {
+    const sim_event_t ev = events.top();
+    events.pop();
+    if (!ev.tick) {
+      const size_t c = nextChange++;
+      knows[ev.node][c] = true;
+      informed[c] = 1;
+      startedMs[c] = ev.atMs;
+      nodes[ev.node]->enqueue((node_id_t){static_cast<persistent_node_id_t>(n + 1 + c), 1},
+                              NODE_STATE_DIED);
+      continue;
+    }
+    g18::GossipDisseminator &d = *nodes[ev.node];
+    changelist_t slice;
+    slice.timestamp = 0x18B9A1C2D3E40000ULL;
+    d.prune(PIGGYBACK_SIM_MAX_BACKLOG);
+    const size_t count = d.empty() ? 0 : d.nextRound(n, slice, PIGGYBACK_SIM_MAX_CHANGES);
+    const std::string hb = simHeartbeat(ev.node, count > 0 ? &slice : NULL);
+    packets++;
+    bytes += hb.size() + PIGGYBACK_SIM_HEADER_BYTES;
+    const unsigned to = ev.node % n + 1;
+    for (auto it = slice.failed.begin(); it != slice.failed.end(); ++it) {
+      const size_t c = it->ip - n - 1;
+      if (knows[to][c]) {
+        continue;
+      }
+      knows[to][c] = true;
+      nodes[to]->enqueue(*it, NODE_STATE_DIED);
+      if (++informed[c] == n) {
+        spreadMs += ev.atMs + simLatencyMs(seed) - startedMs[c];
+        converged++;
+      }
+    }
+    events.push((sim_event_t){ev.atMs + PIGGYBACK_SIM_PERIOD_MS, ev.node, true});
+  }
+  // Changes from the last few seconds haven't had time to get round
+  size_t settled = 0, missed = 0;
+  for (size_t c = 0; c < nextChange; c++) {
+    if (startedMs[c] < endMs / 2) {
+      settled++;
+      missed += informed[c] < n;
+    }
+  }
+  const piggyback_sim_result_t result = {
+    packets / n / PIGGYBACK_SIM_SECONDS,
+    bytes / n / PIGGYBACK_SIM_SECONDS,
+    converged > 0 ? spreadMs / converged : 0,
+    settled > 0 ? static_cast<double>(missed) / settled : 0
+  };
+  return result;
+}
+
+static int benchPiggyback()
+{
+  // Changes not yet sent go first, and pruning never drops them
+  g18::GossipDisseminator queue(0);
+  for (unsigned i = 1; i <= 20; i++) {
+    queue.enqueue((node_id_t){i, 1}, NODE_STATE_ONLINE);
+  }
+  changelist_t first, second;
+  queue.nextRound(32, first, PIGGYBACK_SIM_MAX_CHANGES);
+  queue.nextRound(32, second, PIGGYBACK_SIM_MAX_CHANGES);
+  const size_t pruned = queue.prune(4);
+  const std::vector<node_id_t> resent(second.joined.begin(), second.joined.end());
+  if (first.joined.size() != 16 || first.joined.back().ip != 16 ||
+      resent.size() != 16 || resent[11].ip != 12 || resent[12].ip != 17 ||
+      pruned != 16 || queue.size() != 4) {
+    printf("FAIL: piggyback slices out of order\n");
+    return 1;
+  }
+
+  const unsigned sizes[] = {32, 128};
+  const double churns[] = {0.1, 1, 10, 50};
+  unsigned seed = 23;
+  printf("Per member, heartbeating every %d ms with membership changes at a steady\n"
+         "rate across the group\n", PIGGYBACK_SIM_PERIOD_MS);
+  printf("%-6s %9s | %8s %10s %9s | %8s %10s %9s %7s\n", "nodes", "changes/s",
+         "pkts/s", "bytes/s", "spread", "pkts/s", "bytes/s", "spread", "missed");
+  printf("%-16s | %-29s | %s\n", "", "two channels", "piggybacked");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t c = 0; c < sizeof(churns) / sizeof(churns[0]); c++) {
+      const piggyback_sim_result_t two = simulateTwoChannel(sizes[s], churns[c], &seed);
+      const piggyback_sim_result_t piggy = simulatePiggyback(sizes[s], churns[c], &seed);
+      printf("%-6u %9g | %8.2f %10.1f %7.0fms | %8.2f %10.1f %7.0fms %6.2f%%\n",
+             sizes[s], churns[c], two.packetsPerNode, two.bytesPerNode, two.spreadMs,
+             piggy.packetsPerNode, piggy.bytesPerNode, piggy.spreadMs,
+             piggy.missedFraction * 100);
+    }
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Snapshot transfer
+/////////////////////////////////////////
+
+// A joining node is sent the recruiter's whole membership list. Check that
+// replaying it, as the Daemon does, rebuilds the same ring, and compare what
+// it costs with every member announcing itself around the ring.
+
+/// A list of n members, with every tenth one dead and every twentieth of
+/// those back again.
+static void buildChurnedList(g18::MembershipList &list, const unsigned n)
+{
+  for (unsigned i = 1; i <= n; i++) {
+    const lamp_time_t joinedMs = 1700000000000ULL + i * 1500;
+    list.nodeDidJoin((node_id_t){i, joinedMs << 16});
+  }
+  for (unsigned i = 10; i <= n; i += 10) {
+    membership_entry_t entry;
+    list.snapshot()->latestEntryFor(i, entry);
+    list.nodeDidDie(entry.id, entry.id.timestamp + 1);
+    if (i % 200 == 0) {
+      list.nodeDidJoin((node_id_t){i, entry.id.timestamp + (1000000ULL << 16)});
+    }
+  }
+}
+
+static void replaySnapshot(const std::vector<snapshot_chunk_t> &chunks, g18::MembershipList &list)
+{
+  list.beginUpdate();
+  for (auto c = chunks.begin(); c != chunks.end(); ++c) {
+    for (auto it = c->entries.begin(); it != c->entries.end(); ++it) {
+      list.nodeDidJoin(it->id);
+      if (it->state == NODE_STATE_DEPARTED) {
+        list.nodeDidLeave(it->id, 1);
+      } else if (it->state == NODE_STATE_DIED) {
+        list.nodeDidDie(it->id, 1);
+      }
+    }
+  }
+  list.endUpdate();
+}
+
+static int benchSnapshotTransfer()
+{
+  const unsigned sizes[] = {10, 100, 1000, 5000};
+  const size_t maxDatagram = 1400;
+  unsigned seed = 31;
+  printf("Cost of one join, announced by everyone versus sent as a snapshot\n");
+  printf("%-6s %16s %14s | %10s %10s %11s %10s %10s\n", "nodes", "announced recs",
+         "bytes", "datagrams", "bytes", "bytes/entry", "encode", "decode");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const unsigned n = sizes[s];
+    g18::MembershipList list;
+    buildChurnedList(list, n);
+    std::shared_ptr<const g18::MembershipSnapshot> members = list.snapshot();
+
+    std::vector<std::string> msg;
+    const unsigned reps = 20000 / n + 1;
+    uint64_t start = monotonic_time_ns();
+    for (unsigned r = 0; r < reps; r++) {
+      g18::encodeSnapshotDatagrams(members->entries(), 42, 7, maxDatagram, msg);
+    }
+    const double encodeUs = (monotonic_time_ns() - start) / 1000.0 / reps;
+
+    // Datagrams can arrive in any order
+    std::vector<std::string> shuffled(msg);
+    for (size_t i = shuffled.size(); i > 1; i--) {
+      std::swap(shuffled[i - 1], shuffled[rand_r(&seed) % i]);
+    }
+    std::vector<snapshot_chunk_t> chunks;
+    start = monotonic_time_ns();
+    for (unsigned r = 0; r < reps; r++) {
+      chunks.assign(shuffled.size(), snapshot_chunk_t());
+      for (auto it = shuffled.begin(); it != shuffled.end(); ++it) {
+        snapshot_chunk_t chunk;
+        if (g18::decodeSnapshot(it->data(), it->size(), chunk) != 0 || chunk.version != 42 ||
+            chunk.origin != 7 || chunk.count != msg.size() || it->size() > maxDatagram) {
+          printf("FAIL: snapshot datagram didn't decode\n");
+          return 1;
+        }
+        chunks[chunk.index] = chunk;
+      }
+    }
+    const double decodeUs = (monotonic_time_ns() - start) / 1000.0 / reps;
+
+    g18::MembershipList rebuilt;
+    replaySnapshot(chunks, rebuilt);
+    std::shared_ptr<const g18::MembershipSnapshot> copy = rebuilt.snapshot();
+    bool same = copy->size() == members->size() && copy->liveCount() == members->liveCount();
+    for (size_t i = 0; same && i < members->size(); i++) {
+      const membership_entry_t &a = members->entries()[i], &b = copy->entries()[i];
+      same = g18::isEqual(a.id, b.id) && a.state == b.state;
+    }
+    for (size_t i = 0; same && i < members->liveCount(); i++) {
+      const node_id_t node = members->liveMember(i);
+      same = g18::isEqual(copy->successorOf(node), members->successorOf(node)) &&
+             g18::isEqual(copy->predecessorOf(node), members->predecessorOf(node));
+    }
+    if (!same) {
+      printf("FAIL: a replayed snapshot of %u nodes has a different ring\n", n);
+      return 1;
+    }
+
+    size_t bytes = 0;
+    for (auto it = msg.begin(); it != msg.end(); ++it) {
+      bytes += it->size();
+    }
+    // Every live member's announcement goes once round the ring, a
+    // 12-byte record per hop
+    const double live = static_cast<double>(members->liveCount());
+    const double records = live * live;
+    printf("%-6u %16.0f %14.0f | %10zu %10zu %11.2f %8.1fus %8.1fus\n", n, records,
+           records * 12, msg.size(), bytes, static_cast<double>(bytes) / members->size(),
+           encodeUs, decodeUs);
+  }
+
+  // The largest list we take, at its least compressible, still fits in the
+  // datagrams a joiner accepts; a snapshot claiming any more is refused
+  std::vector<membership_entry_t> widest;
+  for (unsigned i = 0; i < WIRE_MAX_SNAPSHOT_MEMBERS + WIRE_MAX_SNAPSHOT_TOMBSTONES; i++) {
+    const node_id_t id = {(i % 2) ? 0xFFFFFFFFU - i : i, (i % 2) ? (1ULL << 62) + i : i};
+    widest.push_back((membership_entry_t){id, NODE_STATE_ONLINE, 0, 0});
+  }
+  std::vector<std::string> msg;
+  g18::encodeSnapshotDatagrams(widest, 1, 1, maxDatagram, msg);
+  snapshot_chunk_t chunk;
+  if (msg.size() > WIRE_MAX_SNAPSHOT_DATAGRAMS ||
+      g18::decodeSnapshot(msg.back().data(), msg.back().size(), chunk) != 0) {
+    printf("FAIL: the largest snapshot took %zu datagrams, over the %u a joiner accepts\n",
+           msg.size(), WIRE_MAX_SNAPSHOT_DATAGRAMS);
+    return 1;
+  }
+  g18::encodeSnapshotDatagrams(widest, 1, 1, 64, msg);
+  if (g18::decodeSnapshot(msg[0].data(), msg[0].size(), chunk) == 0) {
+    printf("FAIL: accepted a snapshot of %zu datagrams\n", msg.size());
+    return 1;
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Anti-entropy
+/////////////////////////////////////////
+
+// Two lists drift apart when one misses changes for good. Check that the
+// digests tell them apart, and that one sync request and its answers bring
+// them back together, at a fraction of the cost of a whole snapshot.
+
+/// Apply changes as the Daemon does, departures and deaths first.
+static void applyChanges(g18::MembershipList &list, const changelist_t &changes)
+{
+  list.beginUpdate();
+  for (auto it = changes.left.begin(); it != changes.left.end(); ++it) {
+    list.nodeDidLeave(*it, 1);
+  }
+  for (auto it = changes.failed.begin(); it != changes.failed.end(); ++it) {
+    list.nodeDidDie(*it, 1);
+  }
+  for (auto it = changes.joined.begin(); it != changes.joined.end(); ++it) {
+    list.nodeDidJoin(*it);
+  }
+  list.endUpdate();
+}
+
+/// Send entries as sync datagrams and apply what they repair at the other
+/// end. Returns the bytes sent.
+static size_t simSyncEntries(const g18::MembershipList &from, g18::MembershipList &to,
+                             const uint64_t mask, const bool wantsReply,
+                             bool &replyWanted, size_t &repaired)
+{
+  sync_entries_t msg;
+  msg.origin = 1;
+  msg.buckets = mask;
+  msg.wantsReply = wantsReply;
+  from.snapshot()->entriesInBuckets(mask, msg.entries);
+  std::vector<std::string> datagrams;
+  g18::encodeSyncEntriesDatagrams(msg, 1400, datagrams);
+  size_t bytes = 0;
+  replyWanted = false;
+  changelist_t repairs;
+  for (auto it = datagrams.begin(); it != datagrams.end(); ++it) {
+    sync_entries_t in;
+    if (g18::decodeSyncEntries(it->data(), it->size(), in) != 0 || in.buckets != mask) {
+      return 0;
+    }
+    g18::AntiEntropy::reconcile(*to.snapshot(), in.entries, repairs);
+    replyWanted = replyWanted || in.wantsReply;
+    bytes += it->size();
+  }
+  repaired += repairs.joined.size() + repairs.left.size() + repairs.failed.size();
+  applyChanges(to, repairs);
+  return bytes;
+}
+
+static bool sameLiveMembers(const g18::MembershipSnapshot &a, const g18::MembershipSnapshot &b)
+{
+  if (a.liveCount() != b.liveCount()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.liveCount(); i++) {
+    if (!b.isOnline(a.liveMember(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int benchAntiEntropy()
+{
+  const unsigned sizes[] = {100, 1000, 5000};
+  const unsigned missedCounts[] = {1, 8, 64};
+  unsigned seed = 47;
+  printf("Repairing a list that missed changes, versus resending a snapshot\n");
+  printf("%-6s %7s %8s %9s %9s %9s %9s | %10s\n", "nodes", "missed", "buckets",
+         "request", "entries", "reply", "repaired", "snapshot");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const unsigned n = sizes[s];
+    for (size_t m = 0; m < sizeof(missedCounts) / sizeof(missedCounts[0]); m++) {
+      const unsigned missed = missedCounts[m];
+      // a is up to date; b started out the same, but heard of nothing since
+      g18::MembershipList a, b;
+      buildChurnedList(a, n);
+      std::vector<snapshot_chunk_t> chunks(1);
+      chunks[0].entries = a.snapshot()->entries();
+      replaySnapshot(chunks, b);
+      if (a.snapshot()->digest() != b.snapshot()->digest()) {
+        printf("FAIL: identical lists have different digests\n");
+        return 1;
+      }
+      // Half of what b missed are deaths, the rest joins
+      for (unsigned i = 0; i < missed; i++) {
+        if (i % 2 == 0) {
+          std::shared_ptr<const g18::MembershipSnapshot> members = a.snapshot();
+          a.nodeDidDie(members->liveMember(rand_r(&seed) % members->liveCount()), 2);
+        } else {
+          a.nodeDidJoin((node_id_t){n + 1 + i, 1ULL << 60});
+        }
+      }
+      // ...and a missed one of b's
+      b.nodeDidLeave(b.snapshot()->liveMember(0), 2);
+      if (a.snapshot()->digest() == b.snapshot()->digest()) {
+        printf("FAIL: lists that differ have the same digest\n");
+        return 1;
+      }
+
+      // b's heartbeat gives it away, so a sends its bucket digests
+      sync_request_t req;
+      req.origin = 1;
+      for (size_t i = 0; i < g18::MembershipSnapshot::digestBuckets; i++) {
+        req.buckets.push_back(a.snapshot()->bucketDigest(i));
+      }
+      std::string packet;
+      g18::encodeSyncRequest(req, packet);
+      sync_request_t received;
+      if (g18::decodeSyncRequest(packet.data(), packet.size(), received) != 0) {
+        printf("FAIL: sync request didn't decode\n");
+        return 1;
+      }
+      const uint64_t mask = g18::AntiEntropy::differingBuckets(*b.snapshot(), received.buckets);
+      bool replyWanted, unused;
+      size_t repaired = 0;
+      const size_t entryBytes = simSyncEntries(b, a, mask, true, replyWanted, repaired);
+      const size_t replyBytes = replyWanted ?
+        simSyncEntries(a, b, mask, false, unused, repaired) : 0;
+      if (entryBytes == 0 || !replyWanted ||
+          a.snapshot()->digest() != b.snapshot()->digest() ||
+          !sameLiveMembers(*a.snapshot(), *b.snapshot())) {
+        printf("FAIL: one sync didn't repair %u missed changes among %u nodes\n",
+               missed, n);
+        return 1;
+      }
+      std::vector<std::string> snapshot;
+      g18::encodeSnapshotDatagrams(a.snapshot()->entries(), 1, 1, 1400, snapshot);
+      size_t snapshotBytes = 0;
+      for (auto it = snapshot.begin(); it != snapshot.end(); ++it) {
+        snapshotBytes += it->size();
+      }
+      unsigned buckets = 0;
+      for (uint64_t bits = mask; bits != 0; bits &= bits - 1) {
+        buckets++;
+      }
+      printf("%-6u %7u %8u %9zu %9zu %9zu %9zu | %10zu\n", n, missed, buckets,
+             packet.size(), entryBytes, replyBytes, repaired, snapshotBytes);
+    }
+  }
+
+  // The steady-state cost: a digest on every heartbeat, kept up to date as
+  // the list changes
+  g18::MembershipList list;
+  buildChurnedList(list, 1000);
+  std::stringstream digestStr;
+  digestStr << ":" << list.snapshot()->digest();
+  const size_t reps = 20000;
+  // One batch, so that publishing snapshots doesn't swamp the change itself
+  uint64_t start = monotonic_time_ns();
+  list.beginUpdate();
+  for (size_t i = 0; i < reps; i++) {
+    const node_id_t node = {static_cast<persistent_node_id_t>(2000 + i), 1ULL << 60};
+    list.nodeDidJoin(node);
+    list.nodeDidDie(node, 2);
+  }
+  list.endUpdate();
+  const double changeNs = elapsedNsPer(start, 2 * reps);
+  start = monotonic_time_ns();
+  for (size_t i = 0; i < reps; i++) {
+    sink = list.snapshot()->digest();
+  }
+  const double digestNs = elapsedNsPer(start, reps);
+  printf("heartbeat overhead: %zu bytes; list change with digest update: %.0f ns;"
+         " reading the digest: %.0f ns\n", digestStr.str().size(), changeNs, digestNs);
+
+  // Only a digest that stays different for the grace period prompts a sync
+  g18::AntiEntropy tracker(2000);
+  const bool early = tracker.observe(5, 1, 2, 1000) || tracker.observe(5, 1, 2, 2500);
+  const bool due = tracker.observe(5, 1, 2, 3000);
+  const bool again = tracker.observe(5, 1, 2, 3500);
+  const bool agreed = tracker.observe(5, 2, 2, 4000) || tracker.size() != 0;
+  if (early || !due || again || agreed) {
+    printf("FAIL: sync requested at the wrong time\n");
+    return 1;
+  }
+  // Neighbors that churn away are forgotten, not kept for good
+  for (unsigned peer = 100; peer < 1100; peer++) {
+    tracker.observe(peer, 1, 2, 5000);
+    tracker.forget(peer);
+  }
+  if (tracker.size() != 0) {
+    printf("FAIL: anti-entropy kept %zu departed neighbors\n", tracker.size());
+    return 1;
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Mass joins
+/////////////////////////////////////////
+
+// A deploy starts J nodes whose join requests reach the recruiter spread
+// over JOIN_SIM_SPREAD_MS. Every admission costs the recruiter a membership
+// update, a snapshot for each new node and one BP round, which every member
+// applies in one update and passes on. Those costs are measured from the
+// real code, plus JOIN_SIM_DATAGRAM_US per datagram sent or received. Like
+// delta, a round carries every join the recruiter hasn't yet seen come back
+// around the ring. Throughput is the joins over the time until every member
+// knows of every one.
+
+#define JOIN_SIM_SPREAD_MS 1000.0
+#define JOIN_SIM_DATAGRAM_US 5.0
+
+typedef struct {
+  /// Publishing a snapshot after an update, per entry in the list.
+  double publishNsPerEntry;
+  /// Encoding or decoding and applying one record of a BP message.
+  double recordNs;
+  /// Encoding a snapshot for a new node, per entry.
+  double snapshotNsPerEntry;
+  double snapshotBytesPerEntry;
+  /// How many records fit in one BP datagram.
+  size_t recordsPerDatagram;
+} join_sim_costs_t;
+
+typedef struct {
+  double joinsPerSec;
+  double meanLatencyMs;
+  unsigned rounds;
+  size_t datagrams;
+} join_sim_result_t;
+
+static join_sim_costs_t measureJoinCosts()
+{
+  join_sim_costs_t costs;
+  g18::MembershipList list;
+  buildChurnedList(list, 1000);
+  const unsigned reps = 200;
+  uint64_t start = monotonic_time_ns();
+  for (unsigned i = 0; i < reps; i++) {
+    list.nodeDidJoin((node_id_t){2000 + i, 1ULL << 60});
+  }
+  costs.publishNsPerEntry = elapsedNsPer(start, reps) / list.size();
+
+  changelist_t changes;
+  changes.timestamp = 1;
+  for (unsigned i = 0; i < reps; i++) {
+    changes.joined.push_back((node_id_t){2000 + i, 1ULL << 60});
+  }
+  std::string packet;
+  start = monotonic_time_ns();
+  for (unsigned r = 0; r < 100; r++) {
+    g18::encodeChangelist(changes, packet);
+    changelist_t decoded;
+    g18::decodeChangelist(packet.data(), packet.size(), decoded);
+    // Already known, so this is just the lookups
+    list.beginUpdate();
+    for (auto it = decoded.joined.begin(); it != decoded.joined.end(); ++it) {
+      list.nodeDidJoin(*it);
+    }
+    list.endUpdate();
+  }
+  costs.recordNs = elapsedNsPer(start, 100 * reps);
+
+  std::vector<std::string> msg;
+  start = monotonic_time_ns();
+  for (unsigned r = 0; r < 100; r++) {
+    g18::encodeSnapshotDatagrams(list.snapshot()->entries(), 1, 1, 1400, msg);
+  }
+  costs.snapshotNsPerEntry = elapsedNsPer(start, 100) / list.size();
+  size_t bytes = 0;
+  for (auto it = msg.begin(); it != msg.end(); ++it) {
+    bytes += it->size();
+  }
+  costs.snapshotBytesPerEntry = static_cast<double>(bytes) / list.size();
+
+  g18::encodeChangelistDatagrams(changes, 1400, msg);
+  changelist_t first;
+  g18::decodeChangelist(msg[0].data(), msg[0].size(), first);
+  costs.recordsPerDatagram = first.joined.size();
+  return costs;
+}
+
+static size_t datagramsFor(const double items, const double perDatagram)
+{
+  return static_cast<size_t>(std::ceil(std::max(items, 1.0) / perDatagram));
+}
+
+static join_sim_result_t simulateMassJoin(const unsigned n, const unsigned joins,
+                                          const unsigned windowMs,
+                                          const join_sim_costs_t &costs, unsigned *seed)
+{
+  std::vector<double> arrivals(joins);
+  for (unsigned i = 0; i < joins; i++) {
+    arrivals[i] = (rand_r(seed) % 1000000) / 1000000.0 * JOIN_SIM_SPREAD_MS;
+  }
+  std::sort(arrivals.begin(), arrivals.end());
+
+  g18::JoinAdmissionQueue queue(windowMs);
+  std::vector<double> waitingSinceMs;
+  std::vector<double> hopFreeMs(n - 1, 0);
+  // Rounds still on their way back to the recruiter: when they get there,
+  // and how many joins had been admitted when they left
+  std::queue<std::pair<double, size_t> > inFlight;
+  double recruiterFreeMs = 0, allKnowMs = 0, latencySumMs = 0;
+  size_t admitted = 0, confirmed = 0;
+  join_sim_result_t result = {0, 0, 0, 0};
+
+  auto admit = [&](const double atMs) {
+    std::vector<node_id_t> batch;
+    const size_t k = queue.take(batch);
+    if (k == 0) {
+      return;
+    }
+    double t = std::max(atMs, recruiterFreeMs);
+    while (!inFlight.empty() && inFlight.front().first <= t) {
+      confirmed = inFlight.front().second;
+      inFlight.pop();
+    }
+    admitted += k;
+    const double listSize = n + admitted;
+    const double records = static_cast<double>(admitted - confirmed);
+    const size_t datagrams = datagramsFor(records, costs.recordsPerDatagram);
+    const size_t snapshotDatagrams =
+      datagramsFor(listSize * costs.snapshotBytesPerEntry, 1400);
+    const double applyUs = (listSize * costs.publishNsPerEntry +
+                            records * costs.recordNs) / 1000.0;
+    const double snapshotUs = listSize * costs.snapshotNsPerEntry / 1000.0 +
+      snapshotDatagrams * JOIN_SIM_DATAGRAM_US;
+    t += (applyUs + k * snapshotUs + datagrams * JOIN_SIM_DATAGRAM_US) / 1000.0;
+    recruiterFreeMs = t;
+    // Each member receives the round, applies it and passes it on
+    for (unsigned hop = 0; hop < n - 1; hop++) {
+      const double startMs = std::max(t + simLatencyMs(seed), hopFreeMs[hop]);
+      t = startMs + (applyUs + 2 * datagrams * JOIN_SIM_DATAGRAM_US) / 1000.0;
+      hopFreeMs[hop] = t;
+    }
+    allKnowMs = std::max(allKnowMs, t);
+    inFlight.push(std::make_pair(t + simLatencyMs(seed), admitted));
+    for (size_t i = 0; i < k; i++) {
+      latencySumMs += t - waitingSinceMs[i];
+    }
+    waitingSinceMs.clear();
+    result.rounds++;
+    result.datagrams += datagrams * n + k * snapshotDatagrams;
+  };
+
+  double dueMs = 0;
+  for (unsigned i = 0; i < joins; i++) {
+    if (queue.size() > 0 && dueMs <= arrivals[i]) {
+      admit(dueMs);
+    }
+    waitingSinceMs.push_back(arrivals[i]);
+    if (queue.add((node_id_t){n + 1 + i, 1})) {
+      dueMs = arrivals[i] + windowMs;
+    }
+    if (windowMs == 0 || queue.isFull()) {
+      admit(arrivals[i]);
+    }
+  }
+  admit(dueMs);
+  result.joinsPerSec = joins / (allKnowMs / 1000.0);
+  result.meanLatencyMs = latencySumMs / joins;
+  return result;
+}
+
+static int benchJoinAdmission()
+{
+  // Retries while a request waits are only queued once
+  g18::JoinAdmissionQueue q(100);
+  std::vector<node_id_t> batch;
+  if (!q.add((node_id_t){7, 1}) || q.add((node_id_t){8, 1}) || q.add((node_id_t){7, 2}) ||
+      q.size() != 2 || q.take(batch) != 2 || !g18::isEqual(batch[0], (node_id_t){7, 1}) ||
+      batch[1].ip != 8 || q.size() != 0 || !q.add((node_id_t){7, 1})) {
+    printf("FAIL: join queue didn't batch requests as expected\n");
+    return 1;
+  }
+
+  const join_sim_costs_t costs = measureJoinCosts();
+  printf("measured: publish %.1f ns/entry, BP record %.0f ns, snapshot %.1f ns/entry,"
+         " %zu records/datagram; %.0f us per datagram assumed\n",
+         costs.publishNsPerEntry, costs.recordNs, costs.snapshotNsPerEntry,
+         costs.recordsPerDatagram, JOIN_SIM_DATAGRAM_US);
+  const unsigned sizes[] = {100, 1000};
+  const unsigned joinCounts[] = {200, 1000, 5000};
+  const unsigned windows[] = {0, 10, 50, 100, 250};
+  unsigned seed = 53;
+  printf("%.0f ms of join requests, each admitted alone (window 0) or in batches\n",
+         JOIN_SIM_SPREAD_MS);
+  printf("%-6s %6s %7s | %8s %10s %12s %12s\n", "nodes", "joins", "window",
+         "rounds", "joins/s", "latency ms", "datagrams");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t j = 0; j < sizeof(joinCounts) / sizeof(joinCounts[0]); j++) {
+      join_sim_result_t unbatched = {0, 0, 0, 0};
+      for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        const join_sim_result_t r =
+          simulateMassJoin(sizes[s], joinCounts[j], windows[w], costs, &seed);
+        printf("%-6u %6u %5ums | %8u %10.0f %12.1f %12zu\n", sizes[s], joinCounts[j],
+               windows[w], r.rounds, r.joinsPerSec, r.meanLatencyMs, r.datagrams);
+        if (windows[w] == 0) {
+          unbatched = r;
+          continue;
+        }
+        // Below saturation, joins are admitted as fast as they come either
+        // way; above it, batching is what keeps up
+        if (r.datagrams >= unbatched.datagrams ||
+            (joinCounts[j] >= 5000 && r.joinsPerSec <= unbatched.joinsPerSec)) {
+          printf("FAIL: batching %u joins didn't pay off\n", joinCounts[j]);
+          return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Joining through seeds
+/////////////////////////////////////////
+
+// J nodes start over JOIN_SIM_SPREAD_MS and ask to join. Before, each sent
+// one request to the recruiter and waited for it however long that took;
+// now each asks the seeds in turn, as JoinBackoff paces it, until one lets
+// it in. Seeds serve requests one at a time, each costing what an admission
+// in a group of SEED_SIM_NODES does, from the measured join costs. Node 1 is
+// healthy, down, or overloaded with other work so that each admission takes
+// SEED_SIM_OVERLOADED_MS. Requests and snapshots are lost at
+// SEED_SIM_LOSS_PCT. A node that hasn't joined after SEED_SIM_HORIZON_MS
+// never does.
+
+#define SEED_SIM_SEEDS 5
+#define SEED_SIM_NODES 100
+#define SEED_SIM_LOSS_PCT 2
+#define SEED_SIM_OVERLOADED_MS 20.0
+#define SEED_SIM_HORIZON_MS 60000.0
+#define SEED_SIM_RESTARTS 10000
+
+typedef enum {
+  SEED_SIM_HEALTHY,
+  SEED_SIM_DOWN,
+  SEED_SIM_OVERLOADED
+} seed_sim_scenario_e;
+
+typedef struct {
+  double joinedPct;
+  double medianMs;
+  double p99Ms;
+  /// The rate the first 99% of the nodes that joined did, so that a straggler
+  /// or two whose requests were lost don't set it.
+  double joinsPerSec;
+  /// Admissions per node that joined, counting those that came too late.
+  double admissionsPerJoin;
+} seed_sim_result_t;
+
+static seed_sim_result_t simulateSeedJoin(const unsigned joins, const bool useSeeds,
+                                          const seed_sim_scenario_e scenario,
+                                          const double admitMs, unsigned *seed)
+{
+  std::vector<persistent_node_id_t> seeds;
+  const unsigned numSeeds = useSeeds ? SEED_SIM_SEEDS : 1;
+  for (unsigned s = 1; s <= numSeeds; s++) {
+    seeds.push_back(s);
+  }
+  std::vector<double> seedFreeMs(numSeeds + 1, 0);
+  std::vector<double> joinedMs(joins, -1), startedMs(joins);
+  std::vector<std::unique_ptr<g18::JoinBackoff> > backoffs(joins);
+  // (when, joiner): a request due to be sent, in time order so that seeds
+  // serve them first come, first served
+  typedef std::pair<double, unsigned> event_t;
+  std::priority_queue<event_t, std::vector<event_t>, std::greater<event_t> > sends;
+  for (unsigned i = 0; i < joins; i++) {
+    startedMs[i] = (rand_r(seed) % 1000000) / 1000000.0 * JOIN_SIM_SPREAD_MS;
+    backoffs[i].reset(new g18::JoinBackoff(seeds, rand_r(seed)));
+    sends.push(event_t(startedMs[i], i));
+  }
+  size_t admissions = 0;
+  while (!sends.empty()) {
+    const double t = sends.top().first;
+    const unsigned i = sends.top().second;
+    sends.pop();
+    if (t > SEED_SIM_HORIZON_MS || (joinedMs[i] >= 0 && joinedMs[i] <= t)) {
+      continue;
+    }
+    uint64_t waitMs;
+    const persistent_node_id_t to = backoffs[i]->next(waitMs);
+    if (useSeeds) {
+      sends.push(event_t(t + waitMs, i));
+    }
+    if ((to == 1 && scenario == SEED_SIM_DOWN) ||
+        static_cast<unsigned>(rand_r(seed) % 100) < SEED_SIM_LOSS_PCT) {
+      continue;
+    }
+    const double cost = (to == 1 && scenario == SEED_SIM_OVERLOADED) ?
+      SEED_SIM_OVERLOADED_MS : admitMs;
+    const double doneMs = std::max(t + simLatencyMs(seed), seedFreeMs[to]) + cost;
+    seedFreeMs[to] = doneMs;
+    admissions++;
+    if (static_cast<unsigned>(rand_r(seed) % 100) < SEED_SIM_LOSS_PCT) {
+      continue;
+    }
+    const double answeredMs = doneMs + simLatencyMs(seed);
+    if (answeredMs <= SEED_SIM_HORIZON_MS && (joinedMs[i] < 0 || answeredMs < joinedMs[i])) {
+      joinedMs[i] = answeredMs;
+    }
+  }
+
+  std::vector<double> latencies, joinTimes;
+  for (unsigned i = 0; i < joins; i++) {
+    if (joinedMs[i] >= 0) {
+      latencies.push_back(joinedMs[i] - startedMs[i]);
+      joinTimes.push_back(joinedMs[i]);
+    }
+  }
+  seed_sim_result_t result = {0, 0, 0, 0, 0};
+  if (latencies.empty()) {
+    return result;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  std::sort(joinTimes.begin(), joinTimes.end());
+  result.joinedPct = 100.0 * latencies.size() / joins;
+  result.medianMs = latencies[latencies.size() / 2];
+  result.p99Ms = latencies[latencies.size() * 99 / 100];
+  const size_t most = (joinTimes.size() * 99 + 99) / 100;
+  result.joinsPerSec = most / (joinTimes[most - 1] / 1000.0);
+  result.admissionsPerJoin = static_cast<double>(admissions) / latencies.size();
+  return result;
+}
+
+// The first seed restarts while the group carries on without it, with
+// seedUp[s] saying which of the other seeds are still up. It asks them in
+// turn as Daemon::onJoinRetryTimer() does, until one lets it back in or it
+// founds a group of its own. Sets founded accordingly and returns how long it
+// took. With foundAfterFirst it founds after its first unanswered request,
+// as it used to.
+static double simulateFounderRestart(const std::vector<bool> &seedUp, const bool foundAfterFirst,
+                                     const double admitMs, bool &founded, unsigned *seed)
+{
+  std::vector<persistent_node_id_t> others;
+  for (unsigned s = 2; s <= SEED_SIM_SEEDS; s++) {
+    others.push_back(s);
+  }
+  g18::JoinBackoff backoff(others, rand_r(seed));
+  double t = 0;
+  while (true) {
+    uint64_t waitMs;
+    const persistent_node_id_t to = backoff.next(waitMs);
+    if (seedUp[to] && static_cast<unsigned>(rand_r(seed) % 100) >= SEED_SIM_LOSS_PCT &&
+        static_cast<unsigned>(rand_r(seed) % 100) >= SEED_SIM_LOSS_PCT) {
+      const double answeredMs = simLatencyMs(seed) + admitMs + simLatencyMs(seed);
+      if (answeredMs < waitMs) {
+        founded = false;
+        return t + answeredMs;
+      }
+    }
+    t += waitMs;
+    if (foundAfterFirst || backoff.hasAskedEverySeed()) {
+      founded = true;
+      return t;
+    }
+  }
+}
+
+static int benchSeedJoin()
+{
+  // Waits double from the base up to the cap, and jitter keeps each within
+  // the upper half of its ceiling
+  unsigned seed = 59;
+  for (unsigned attempt = 0; attempt < 12; attempt++) {
+    const uint64_t ceilingMs = std::min(static_cast<uint64_t>(500) << attempt,
+                                        static_cast<uint64_t>(8000));
+    for (unsigned r = 0; r < 1000; r++) {
+      const uint64_t ms = g18::JoinBackoff::delayMs(attempt, 500, 8000, &seed);
+      if (ms < ceilingMs / 2 || ms > ceilingMs) {
+        printf("FAIL: attempt %u waited %" PRIu64 " ms, outside [%" PRIu64 ", %" PRIu64 "]\n",
+               attempt, ms, ceilingMs / 2, ceilingMs);
+        return 1;
+      }
+    }
+  }
+  // Every seed is asked once before any is asked again
+  std::vector<persistent_node_id_t> seeds;
+  for (unsigned s = 1; s <= SEED_SIM_SEEDS; s++) {
+    seeds.push_back(s);
+  }
+  g18::JoinBackoff backoff(seeds, 7);
+  std::set<persistent_node_id_t> asked;
+  uint64_t waitMs;
+  for (unsigned i = 0; i < SEED_SIM_SEEDS; i++) {
+    asked.insert(backoff.next(waitMs));
+  }
+  if (asked.size() != SEED_SIM_SEEDS || backoff.getAttempts() != SEED_SIM_SEEDS) {
+    printf("FAIL: join requests didn't go round the seeds\n");
+    return 1;
+  }
+  // A full round without an answer takes every other seed being down, or
+  // every request to or answer from the live ones being lost
+  g18::JoinBackoff unanswered(seeds, 7);
+  for (unsigned i = 0; i < SEED_SIM_SEEDS; i++) {
+    if (unanswered.hasAskedEverySeed()) {
+      printf("FAIL: gave up on the seeds after %u of %u\n", i, SEED_SIM_SEEDS);
+      return 1;
+    }
+    unanswered.next(waitMs);
+  }
+  if (!unanswered.hasAskedEverySeed()) {
+    printf("FAIL: didn't notice every seed had been asked\n");
+    return 1;
+  }
+  // A node asks every seed to admit it as the same ID, so however many of
+  // them do, the group ends up with one incarnation of it
+  const node_id_t joiner = {42, 1000};
+  g18::MembershipList first, second;
+  if (first.nodeDidJoin(joiner) != 1 || first.nodeDidJoin(joiner) != 0 ||
+      second.nodeDidJoin(joiner) != 1 || first.snapshot()->digest() != second.snapshot()->digest()) {
+    printf("FAIL: two seeds admitting the same request disagreed\n");
+    return 1;
+  }
+
+  const join_sim_costs_t costs = measureJoinCosts();
+  const double admitMs = (SEED_SIM_NODES * (costs.publishNsPerEntry + costs.snapshotNsPerEntry) +
+                          costs.recordNs) / 1000000.0 +
+    datagramsFor(SEED_SIM_NODES * costs.snapshotBytesPerEntry, 1400) * JOIN_SIM_DATAGRAM_US / 1000.0;
+  // The first seed restarting must rejoin the group rather than split from
+  // it, even with another seed down; with them all down it must still found
+  printf("%-18s %-12s | %8s %12s\n", "first seed back", "founds after", "founded", "mean ms");
+  const char *downNames[] = {"with node 3 down", "with all down"};
+  for (int allDown = 0; allDown <= 1; allDown++) {
+    std::vector<bool> seedUp(SEED_SIM_SEEDS + 1, !allDown);
+    seedUp[3] = false;
+    for (int foundAfterFirst = 1; foundAfterFirst >= 0; foundAfterFirst--) {
+      unsigned foundings = 0;
+      double totalMs = 0;
+      for (unsigned r = 0; r < SEED_SIM_RESTARTS; r++) {
+        bool founded;
+        totalMs += simulateFounderRestart(seedUp, foundAfterFirst, admitMs, founded, &seed);
+        foundings += founded;
+      }
+      const double foundedPct = 100.0 * foundings / SEED_SIM_RESTARTS;
+      printf("%-18s %-12s | %7.2f%% %12.1f\n", downNames[allDown],
+             foundAfterFirst ? "1 request" : "full round", foundedPct,
+             totalMs / SEED_SIM_RESTARTS);
+      if (foundAfterFirst) {
+        continue;
+      }
+      if (allDown ? foundings != SEED_SIM_RESTARTS : foundedPct > 0.1) {
+        printf("FAIL: the first seed %s the group %s\n", allDown ? "didn't found" : "split",
+               downNames[allDown]);
+        return 1;
+      }
+    }
+  }
+
+  printf("%.0f ms of joins into %u nodes, %.3f ms per admission, %u%% loss; node 1 overloaded"
+         " takes %.0f ms per admission\n", JOIN_SIM_SPREAD_MS, SEED_SIM_NODES, admitMs,
+         SEED_SIM_LOSS_PCT, SEED_SIM_OVERLOADED_MS);
+  printf("%-6s %-10s %-9s | %8s %10s %10s %10s %11s\n", "joins", "node 1", "asking",
+         "joined", "median ms", "p99 ms", "joins/s", "admissions");
+  const unsigned joinCounts[] = {1000, 5000};
+  const seed_sim_scenario_e scenarios[] = {SEED_SIM_HEALTHY, SEED_SIM_DOWN, SEED_SIM_OVERLOADED};
+  const char *scenarioNames[] = {"healthy", "down", "overloaded"};
+  for (size_t j = 0; j < sizeof(joinCounts) / sizeof(joinCounts[0]); j++) {
+    double healthyPerSec = 0;
+    for (size_t c = 0; c < sizeof(scenarios) / sizeof(scenarios[0]); c++) {
+      for (int useSeeds = 0; useSeeds <= 1; useSeeds++) {
+        const seed_sim_result_t r =
+          simulateSeedJoin(joinCounts[j], useSeeds, scenarios[c], admitMs, &seed);
+        printf("%-6u %-10s %-9s | %7.1f%% %10.1f %10.1f %10.0f %11.2f\n", joinCounts[j],
+               scenarioNames[c], useSeeds ? "seeds" : "recruiter", r.joinedPct, r.medianMs,
+               r.p99Ms, r.joinsPerSec, r.admissionsPerJoin);
+        if (!useSeeds) {
+          continue;
+        }
+        if (scenarios[c] == SEED_SIM_HEALTHY) {
+          healthyPerSec = r.joinsPerSec;
+        }
+        // Losing node 1 costs its share of first requests a retry, no more
+        if (r.joinedPct < 100 || r.joinsPerSec < healthyPerSec / 2) {
+          printf("FAIL: joining through seeds didn't hold up with node 1 %s\n",
+                 scenarioNames[c]);
+          return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+// Driver
+/////////////////////////////////////////
+
+typedef struct {
+  const char *name;
+  int (*run)();
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+  {"codec", benchCodec},
+  {"membership", benchMembership},
+  {"snapshots", benchSnapshots},
+  {"changeset", benchChangeSet},
+  {"clock", benchClock},
+  {"log", benchLogger},
+  {"journal", benchJournal},
+  {"grep", benchLogSearch},
+  {"metrics", benchMetrics},
+  {"monitoring", benchMonitoring},
+  {"dissemination", benchDissemination},
+  {"probing", benchProbing},
+  {"phi", benchPhiAccrual},
+  {"piggyback", benchPiggyback},
+  {"snapshot", benchSnapshotTransfer},
+  {"antientropy", benchAntiEntropy},
+  {"joins", benchJoinAdmission},
+  {"seeds", benchSeedJoin},
+};
+
+int main(int argc, char *argv[])
+{
+  const size_t numBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  int failed = 0;
+  for (size_t i = 0; i < numBenchmarks; i++) {
+    bool selected = (argc == 1);
+    for (int a = 1; a < argc; a++) {
+      selected = selected || strcmp(argv[a], benchmarks[i].name) == 0;
+    }
+    if (selected) {
+      printf("== %s ==\n", benchmarks[i].name);
+      failed |= benchmarks[i].run();
+    }
+  }
+  return failed;
+}